@@ -1,19 +1,222 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <optional>
+#include <stdexcept>
 
 #include "edge_detection/canny.h"
+#include "pipeline/batch.h"
+#include "pipeline/graph.h"
+#include "pipeline/result_cache.h"
+#include "pipeline/server.h"
+#include "pipeline/streaming.h"
 #include "util/image.h"
 
-int main() {
+/**
+ * Streams a bitmap of any size through blur -> grayscale -> Sobel with bounded memory.
+ * Usage: main --stream <input.bmp> <output.bmp> [strip rows]
+ */
+static int runStreaming(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " --stream <input.bmp> <output.bmp> [strip rows]"
+                  << std::endl;
+        return 1;
+    }
+    CUDAVISION::StreamingOptions options;
+    if (argc > 4) {
+        options.stripRows = std::strtoul(argv[4], nullptr, 10);
+    }
+    try {
+        CUDAVISION::StreamingStatistics statistics =
+            CUDAVISION::streamEdgeDetection(argv[2], argv[3], options);
+        std::cout << statistics.width << "x" << statistics.height << " streamed with "
+                  << statistics.bufferBytes / 1024 << " KiB of line buffers" << std::endl;
+    } catch (const std::runtime_error& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Blur, grayscale and the three edge operators, run as one tiled sweep. The outputs are blur,
+ * grayscale, Roberts, Prewitt and Sobel.
+ */
+static CUDAVISION::Pipeline makePipeline() {
+    CUDAVISION::Pipeline pipeline;
+    auto blur = pipeline.gaussianSmooth(pipeline.input(), 5, 20.0);
+    auto gray = pipeline.grayscale(blur);
+    pipeline.output(blur);
+    pipeline.output(gray);
+    pipeline.output(pipeline.robertsOperator(gray));
+    pipeline.output(pipeline.prewittOperator(gray));
+    pipeline.output(pipeline.sobelOperator(gray));
+    return pipeline;
+}
+
+/**
+ * Runs the pipeline of main over every bitmap of a directory or manifest, with reading,
+ * computing and writing overlapped. With a cache directory, the pipeline results of inputs
+ * processed by an earlier batch are read from it instead of computed.
+ * Usage: main --batch <directory | manifest> <output directory> [queue depth] [cache directory]
+ */
+static int runBatch(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0]
+                  << " --batch <directory | manifest> <output directory> [queue depth]"
+                     " [cache directory]"
+                  << std::endl;
+        return 1;
+    }
+    CUDAVISION::BatchOptions options;
+    if (argc > 4) {
+        options.queueDepth = std::strtoul(argv[4], nullptr, 10);
+    }
+    CUDAVISION::Pipeline pipeline = makePipeline();
+    std::optional<CUDAVISION::ResultCache> cache;
+    if (argc > 5) {
+        try {
+            cache.emplace(CUDAVISION::ResultCacheOptions{argv[5]});
+        } catch (const std::exception& error) {
+            std::cerr << error.what() << std::endl;
+            return 1;
+        }
+        pipeline.setCache(&*cache);
+    }
+    auto process = [&](const Image& image) {
+        std::vector<Image> results = pipeline.run(image);
+        // Edge maps are binary, a 1 bpp bitmap is a 24th of the BGR one.
+        BitImage edges(image.getWidth(), image.getHeight());
+        CUDAVISION::canny(results[1].view(), edges, 50, 100);
+        std::vector<CUDAVISION::BatchOutput> outputs;
+        outputs.push_back({"blur", std::move(results[0])});
+        outputs.push_back({"roberts", std::move(results[2])});
+        outputs.push_back({"prewitt", std::move(results[3])});
+        outputs.push_back({"sobel", std::move(results[4])});
+        outputs.push_back({"canny", std::move(edges)});
+        return outputs;
+    };
+    CUDAVISION::BatchStatistics statistics;
+    try {
+        statistics = CUDAVISION::runBatch(CUDAVISION::collectBatchInputs(argv[2]), argv[3],
+                                          process, options);
+    } catch (const std::exception& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    for (const std::string& error : statistics.errors) {
+        std::cerr << "Failed: " << error << std::endl;
+    }
+    const double seconds = std::max(statistics.seconds, 1e-9);
+    std::cout << statistics.succeeded << " images processed, " << statistics.failed
+              << " failed in " << seconds << " s" << std::endl
+              << statistics.succeeded / seconds << " images/s, "
+              << statistics.megapixels / seconds << " MPix/s" << std::endl
+              << "latency p50 " << statistics.p50Milliseconds << " ms, p99 "
+              << statistics.p99Milliseconds << " ms" << std::endl;
+    if (cache) {
+        const CUDAVISION::ResultCacheStatistics cacheStatistics = cache->getStatistics();
+        std::cout << "cache: " << cacheStatistics.memoryHits << " memory hits, "
+                  << cacheStatistics.diskHits << " disk hits, " << cacheStatistics.misses
+                  << " misses, " << cacheStatistics.evictions << " evictions, "
+                  << cacheStatistics.hashSeconds * 1000.0 << " ms hashing" << std::endl;
+    }
+    return statistics.failed == 0 ? 0 : 2;
+}
+
+static std::atomic<bool> stopServer{false};
+
+/**
+ * Serves image requests on a Unix domain socket until SIGINT or SIGTERM, see pipeline/server.h
+ * for the protocol.
+ * Usage: main --serve <socket> [workers] [queue depth]
+ */
+static int runServe(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " --serve <socket> [workers] [queue depth]"
+                  << std::endl;
+        return 1;
+    }
+    CUDAVISION::ServerOptions options;
+    options.socketPath = argv[2];
+    if (argc > 3) {
+        options.workers = std::strtoul(argv[3], nullptr, 10);
+    }
+    if (argc > 4) {
+        options.queueDepth = std::strtoul(argv[4], nullptr, 10);
+    }
+    std::signal(SIGINT, [](int) { stopServer = true; });
+    std::signal(SIGTERM, [](int) { stopServer = true; });
+    CUDAVISION::ServerStatistics statistics;
+    try {
+        std::cout << "Listening on " << options.socketPath << std::endl;
+        statistics = CUDAVISION::runServer(options, stopServer);
+    } catch (const std::runtime_error& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    std::cout << statistics.succeeded << " requests served, " << statistics.failed
+              << " failed, " << statistics.rejected << " connections rejected" << std::endl
+              << "latency p50 " << statistics.p50Milliseconds << " ms, p99 "
+              << statistics.p99Milliseconds << " ms" << std::endl;
+    return 0;
+}
+
+/**
+ * Sends one request to a running server and prints its answer and the round trip time.
+ * Usage: main --client <socket> <input.bmp> <output.bmp> <operator> [<operator> ...]
+ */
+static int runClient(int argc, char** argv) {
+    if (argc < 6) {
+        std::cerr << "Usage: " << argv[0]
+                  << " --client <socket> <input.bmp> <output.bmp> <operator> [<operator> ...]"
+                  << std::endl;
+        return 1;
+    }
+    std::string request = argv[3];
+    for (int i = 4; i < argc; i++) {
+        request += std::string(" ") + argv[i];
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::string answer;
+    try {
+        answer = CUDAVISION::sendServerRequest(argv[2], request);
+    } catch (const std::runtime_error& error) {
+        std::cerr << error.what() << std::endl;
+        return 1;
+    }
+    const double milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+            .count();
+    std::cout << answer << " (round trip " << milliseconds << " ms)" << std::endl;
+    return answer.compare(0, 3, "ok ") == 0 ? 0 : 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::strcmp(argv[1], "--stream") == 0) {
+        return runStreaming(argc, argv);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--batch") == 0) {
+        return runBatch(argc, argv);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--serve") == 0) {
+        return runServe(argc, argv);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--client") == 0) {
+        return runClient(argc, argv);
+    }
     Image sampleImage = Image("images/sample3.bmp");
-    std::vector<double> kernel = CUDAVISION::getGaussianKernel(5, 20.0);
-    Image blur = CUDAVISION::gaussianSmooth(sampleImage, 5, 20.0);
-    blur.writeImageToFile("output/blur.bmp");
-    Image grayscale = blur.toGrayscale();
-    Image roberts = CUDAVISION::robertsOperator(grayscale);
-    roberts.writeImageToFile("output/roberts.bmp");
-    Image prewitt = CUDAVISION::prewittOperator(grayscale);
-    prewitt.writeImageToFile("output/prewitt.bmp");
-    Image sobel = CUDAVISION::sobelOperator(grayscale);
-    sobel.writeImageToFile("output/sobel.bmp");
+    std::vector<Image> results = makePipeline().run(sampleImage);
+    results[0].writeImageToFile("output/blur.bmp");
+    results[2].writeImageToFile("output/roberts.bmp");
+    results[3].writeImageToFile("output/prewitt.bmp");
+    results[4].writeImageToFile("output/sobel.bmp");
+    BitImage edges(sampleImage.getWidth(), sampleImage.getHeight());
+    CUDAVISION::canny(results[1].view(), edges, 50, 100);
+    edges.writeImageToFile("output/canny.bmp");
     return 0;
 }
@@ -0,0 +1,318 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "conformance.h"
+#include "operators.h"
+#include "synthetic.h"
+#include "util/backend.h"
+#include "util/cpu_features.h"
+#include "util/image.h"
+#include "util/thread_pool.h"
+
+/**
+ * Operator benchmark suite
+ *
+ * Times every operator on deterministic synthetic images from VGA to 8K, plus odd widths that
+ * exercise the scalar tails of the vector kernels. Every measurement runs warmup repetitions
+ * first and then reports the median and minimum time, the throughput in MPix/s and the bytes
+ * read and written per pixel. Results can be saved as a JSON baseline, and a later run can be
+ * compared against it: an operator whose median time grew by more than the threshold counts as
+ * a regression and makes the benchmark exit with status 1.
+ *
+ * --conformance runs the conformance test of cuda_vision_conformance (see conformance.h).
+ *
+ * Usage: cuda_vision_bench [--sizes vga,hd,...|all] [--filter substring] [--warmup n]
+ *                          [--repetitions n] [--threads n] [--backend name]
+ *                          [--save baseline.json] [--compare baseline.json]
+ *                          [--threshold percent]
+ *        cuda_vision_bench --conformance [--filter substring] [--seed n]
+ */
+
+struct Size {
+    std::string name;
+    unsigned int width;
+    unsigned int height;
+};
+
+static const std::vector<Size> SIZES = {
+    {"vga", 640, 480},       {"vga-odd", 641, 479}, {"hd", 1280, 720},  {"fhd", 1920, 1080},
+    {"fhd-odd", 1923, 1081}, {"4k", 3840, 2160},    {"8k", 7680, 4320},
+};
+
+struct Result {
+    std::string operatorName;
+    std::string sizeName;
+    unsigned int width = 0;
+    unsigned int height = 0;
+    double medianMilliseconds = 0.0;
+    double minMilliseconds = 0.0;
+    double megapixelsPerSecond = 0.0;
+    double bytesPerPixel = 0.0;
+};
+
+struct Options {
+    std::vector<Size> sizes = SIZES;
+    std::string filter;
+    int warmup = 1;
+    int repetitions = 5;
+    std::string savePath;
+    std::string comparePath;
+    double threshold = 10.0;
+    bool conformance = false;
+    unsigned int seed = 1;
+};
+
+static Result measure(const Operator& op, const Size& size, const Image& color, const Image& gray,
+                      const Options& options) {
+    const Image& input = op.inputChannels == 3 ? color : gray;
+    const PixelFormat outputFormat =
+        op.outputChannels == 3 ? PixelFormat::BGR8 : PixelFormat::Gray8;
+    Image output(size.width, size.height, outputFormat);
+    Image scratch(size.width, size.height, outputFormat);
+
+    std::vector<double> times;
+    for (int i = 0; i < options.warmup + options.repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        op.run(input.view(), output.mutableView(), scratch.mutableView());
+        auto stop = std::chrono::steady_clock::now();
+        if (i >= options.warmup) {
+            times.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+        }
+    }
+    std::sort(times.begin(), times.end());
+
+    Result result;
+    result.operatorName = op.name;
+    result.sizeName = size.name;
+    result.width = size.width;
+    result.height = size.height;
+    result.medianMilliseconds = times[times.size() / 2];
+    result.minMilliseconds = times.front();
+    result.megapixelsPerSecond =
+        static_cast<double>(size.width) * size.height / 1e3 / result.medianMilliseconds;
+    result.bytesPerPixel = op.inputChannels + op.outputChannels;
+    return result;
+}
+
+static void saveBaseline(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream file(path);
+    file << "{\n  \"isa\": \"" << CUDAVISION::toString(CUDAVISION::getInstructionSet())
+         << "\",\n  \"threads\": " << CUDAVISION::getThreadCount() << ",\n  \"results\": [\n";
+    for (std::size_t i = 0; i < results.size(); i++) {
+        const Result& result = results[i];
+        file << "    {\"operator\": \"" << result.operatorName << "\", \"size\": \""
+             << result.sizeName << "\", \"width\": " << result.width
+             << ", \"height\": " << result.height
+             << ", \"median_ms\": " << result.medianMilliseconds
+             << ", \"min_ms\": " << result.minMilliseconds
+             << ", \"mpix_per_s\": " << result.megapixelsPerSecond
+             << ", \"bytes_per_pixel\": " << result.bytesPerPixel << "}"
+             << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    file << "  ]\n}\n";
+    if (!file) {
+        std::cerr << "Could not write " << path << std::endl;
+    }
+}
+
+/**
+ * Value of "key" in a flat JSON object, as raw text without quotes.
+ */
+static std::string jsonField(const std::string& object, const std::string& key) {
+    std::size_t position = object.find("\"" + key + "\"");
+    if (position == std::string::npos) {
+        return {};
+    }
+    position = object.find(':', position);
+    if (position == std::string::npos) {
+        return {};
+    }
+    position = object.find_first_not_of(" \t\n\r", position + 1);
+    if (position == std::string::npos) {
+        return {};
+    }
+    if (object[position] == '"') {
+        std::size_t end = object.find('"', position + 1);
+        return object.substr(position + 1, end - position - 1);
+    }
+    std::size_t end = object.find_first_of(",} \t\n\r", position);
+    return object.substr(position, end - position);
+}
+
+/**
+ * Median times of a baseline written by saveBaseline, keyed by operator and size.
+ */
+static std::map<std::pair<std::string, std::string>, double> loadBaseline(
+    const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Could not read " << path << std::endl;
+        std::exit(2);
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    const std::string json = contents.str();
+
+    std::map<std::pair<std::string, std::string>, double> baseline;
+    std::size_t position = json.find("\"results\"");
+    while (position != std::string::npos) {
+        std::size_t begin = json.find('{', position);
+        if (begin == std::string::npos) {
+            break;
+        }
+        std::size_t end = json.find('}', begin);
+        if (end == std::string::npos) {
+            break;
+        }
+        const std::string object = json.substr(begin, end - begin + 1);
+        const std::string median = jsonField(object, "median_ms");
+        if (!median.empty()) {
+            baseline[{jsonField(object, "operator"), jsonField(object, "size")}] =
+                std::strtod(median.c_str(), nullptr);
+        }
+        position = end;
+    }
+    return baseline;
+}
+
+static std::vector<Size> parseSizes(const std::string& list) {
+    if (list == "all") {
+        return SIZES;
+    }
+    std::vector<Size> sizes;
+    std::stringstream stream(list);
+    std::string name;
+    while (std::getline(stream, name, ',')) {
+        auto size = std::find_if(SIZES.begin(), SIZES.end(),
+                                 [&](const Size& candidate) { return candidate.name == name; });
+        if (size == SIZES.end()) {
+            std::cerr << "Unknown size " << name << ", expected one of:";
+            for (const Size& candidate : SIZES) {
+                std::cerr << " " << candidate.name;
+            }
+            std::cerr << std::endl;
+            std::exit(2);
+        }
+        sizes.push_back(*size);
+    }
+    return sizes;
+}
+
+static Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        const char* argument = argv[i];
+        if (std::strcmp(argument, "--conformance") == 0) {
+            options.conformance = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << argument << std::endl;
+            std::exit(2);
+        }
+        const char* value = argv[++i];
+        if (std::strcmp(argument, "--sizes") == 0) {
+            options.sizes = parseSizes(value);
+        } else if (std::strcmp(argument, "--filter") == 0) {
+            options.filter = value;
+        } else if (std::strcmp(argument, "--warmup") == 0) {
+            options.warmup = std::max(std::atoi(value), 0);
+        } else if (std::strcmp(argument, "--repetitions") == 0) {
+            options.repetitions = std::max(std::atoi(value), 1);
+        } else if (std::strcmp(argument, "--threads") == 0) {
+            CUDAVISION::setThreadCount(std::strtoul(value, nullptr, 10));
+        } else if (std::strcmp(argument, "--backend") == 0) {
+            try {
+                CUDAVISION::setBackend(value);
+            } catch (const std::invalid_argument& error) {
+                std::cerr << error.what() << std::endl;
+                std::exit(2);
+            }
+        } else if (std::strcmp(argument, "--seed") == 0) {
+            options.seed = std::strtoul(value, nullptr, 10);
+        } else if (std::strcmp(argument, "--save") == 0) {
+            options.savePath = value;
+        } else if (std::strcmp(argument, "--compare") == 0) {
+            options.comparePath = value;
+        } else if (std::strcmp(argument, "--threshold") == 0) {
+            options.threshold = std::strtod(value, nullptr);
+        } else {
+            std::cerr << "Unknown option " << argument << std::endl;
+            std::exit(2);
+        }
+    }
+    return options;
+}
+
+int main(int argc, char** argv) {
+    const Options options = parseOptions(argc, argv);
+    if (options.conformance) {
+        return runConformance(options.filter, options.seed) == 0 ? 0 : 1;
+    }
+    std::map<std::pair<std::string, std::string>, double> baseline;
+    if (!options.comparePath.empty()) {
+        baseline = loadBaseline(options.comparePath);
+    }
+    const std::vector<Operator> operators = makeOperators();
+
+    std::cout << CUDAVISION::getBackendName() << " backend, "
+              << CUDAVISION::toString(CUDAVISION::getInstructionSet()) << ", "
+              << CUDAVISION::getThreadCount() << " threads, " << options.warmup << " warmup, "
+              << options.repetitions << " repetitions" << std::endl;
+    std::cout << std::left << std::setw(32) << "operator" << std::setw(10) << "size"
+              << std::right << std::setw(11) << "median ms" << std::setw(10) << "min ms"
+              << std::setw(10) << "MPix/s" << std::setw(8) << "B/px";
+    if (!baseline.empty()) {
+        std::cout << std::setw(10) << "change";
+    }
+    std::cout << std::endl;
+
+    std::vector<Result> results;
+    int regressions = 0;
+    for (const Size& size : options.sizes) {
+        const Image color = syntheticImage(size.width, size.height);
+        const Image gray = color.toGrayscale();
+        for (const Operator& op : operators) {
+            if (op.name.find(options.filter) == std::string::npos) {
+                continue;
+            }
+            Result result = measure(op, size, color, gray, options);
+            std::cout << std::left << std::setw(32) << result.operatorName << std::setw(10)
+                      << result.sizeName << std::right << std::fixed << std::setprecision(3)
+                      << std::setw(11) << result.medianMilliseconds << std::setw(10)
+                      << result.minMilliseconds << std::setprecision(1) << std::setw(10)
+                      << result.megapixelsPerSecond << std::setw(8) << result.bytesPerPixel;
+            auto reference = baseline.find({result.operatorName, result.sizeName});
+            if (reference != baseline.end() && reference->second > 0.0) {
+                const double change =
+                    100.0 * (result.medianMilliseconds / reference->second - 1.0);
+                const bool regressed = change > options.threshold;
+                regressions += regressed;
+                std::cout << std::showpos << std::setw(9) << change << "%" << std::noshowpos
+                          << (regressed ? "  REGRESSION" : "");
+            }
+            std::cout << std::endl;
+            results.push_back(result);
+        }
+    }
+
+    if (!options.savePath.empty()) {
+        saveBaseline(options.savePath, results);
+    }
+    if (!baseline.empty()) {
+        std::cout << regressions << " regressions above " << options.threshold << "%"
+                  << std::endl;
+    }
+    return regressions == 0 ? 0 : 1;
+}
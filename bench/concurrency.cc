@@ -0,0 +1,149 @@
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "edge_detection/canny.h"
+#include "pipeline/incremental.h"
+#include "util/image.h"
+#include "util/region.h"
+#include "util/thread_pool.h"
+
+/**
+ * Concurrent callers test, registered with ctest
+ *
+ * Several application threads call operators on the same global pool at once, each one a
+ * different operator with different parameters, and compare every result with the one computed
+ * before by a single caller. A pool that runs the chunks of one caller's loop on another caller's
+ * thread, or an operator that keeps per-thread state alive across its own parallel loops, shows
+ * up as a differing result.
+ *
+ * Exits with status 1 if any call returned a differing result.
+ *
+ * Usage: cuda_vision_concurrency [--iterations n] [--threads n]
+ */
+
+struct Scenario {
+    std::string name;
+    std::function<Image(const Image&)> run;
+};
+
+static Image copyOf(ImageView view) {
+    Image image(view.width, view.height, view.channels == 1 ? PixelFormat::Gray8
+                                                             : PixelFormat::BGR8);
+    for (unsigned int y = 0; y < view.height; y++) {
+        std::memcpy(image.mutableView().row(y), view.row(y), view.rowElements());
+    }
+    return image;
+}
+
+static std::vector<Scenario> makeScenarios() {
+    using namespace CUDAVISION;
+    // One rectangle runs the operator on the calling thread, six far apart form six groups
+    // spread over the pool, each of them running the operator from inside a chunk.
+    const std::vector<Rect> one = {{20, 30, 120, 90}};
+    std::vector<Rect> six;
+    for (unsigned int i = 0; i < 6; i++) {
+        six.push_back({(i % 3) * 70 + 5, (i / 3) * 80 + 10, 40, 40});
+    }
+    return {
+        {"gaussianSmooth 7 2.0",
+         [](const Image& image) { return gaussianSmooth(image, 7, 2.0); }},
+        {"gaussianSmooth 1 region 5 20.0",
+         [one](const Image& image) {
+             return gaussianSmooth(image, one, 5, 20.0, SmoothingMode::Fused);
+         }},
+        {"gaussianSmooth 6 regions 9 1.0",
+         [six](const Image& image) {
+             return gaussianSmooth(image, six, 9, 1.0, SmoothingMode::Fused);
+         }},
+        {"gaussianSmooth fused 3 0.8",
+         [](const Image& image) { return gaussianSmooth(image, 3, 0.8, SmoothingMode::Fused); }},
+        {"canny", [](const Image& image) { return canny(image.toGrayscale(), 40, 90); }},
+        // The first frame is one run computed on the calling thread, the second one changes
+        // a few tiles far apart, which are spread over the pool.
+        {"FrameProcessor two frames",
+         [](const Image& image) {
+             FrameProcessor processor({5, 2.0, 32});
+             processor.process(image.view());
+             Image next = image;
+             for (unsigned int y = 5; y < next.getHeight(); y += 70) {
+                 for (unsigned int x = 7; x < next.getWidth(); x += 80) {
+                     next.mutableView().row(y)[3 * x] ^= 0x80;
+                 }
+             }
+             return copyOf(processor.process(next.view()));
+         }},
+    };
+}
+
+static Image makeInput(unsigned int width, unsigned int height) {
+    std::mt19937 random(5);
+    Image image(width, height, PixelFormat::BGR8);
+    MutableImageView view = image.mutableView();
+    for (unsigned int y = 0; y < height; y++) {
+        unsigned char* row = view.row(y);
+        for (std::size_t i = 0; i < view.rowElements(); i++) {
+            row[i] = (i / 3 + y) % 64 < 32 ? random() % 64 : 192 + random() % 64;
+        }
+    }
+    return image;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 200;
+    unsigned int threads = 4;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << argv[i] << std::endl;
+            return 2;
+        }
+        if (std::strcmp(argv[i], "--iterations") == 0) {
+            iterations = std::max(std::atoi(argv[++i]), 1);
+        } else if (std::strcmp(argv[i], "--threads") == 0) {
+            threads = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            std::cerr << "Unknown option " << argv[i] << std::endl;
+            return 2;
+        }
+    }
+    // More threads than cores on purpose, the workers get preempted in the middle of chunks.
+    CUDAVISION::setThreadCount(threads);
+    // Small grains queue many chunks per loop, so the loops of the callers interleave.
+    CUDAVISION::setGrainSize(2);
+
+    const Image input = makeInput(211, 157);
+    const std::vector<Scenario> scenarios = makeScenarios();
+    std::vector<Image> expected;
+    for (const Scenario& scenario : scenarios) {
+        expected.push_back(scenario.run(input));
+    }
+
+    std::vector<std::atomic<int>> mismatches(scenarios.size());
+    std::vector<std::thread> callers;
+    for (std::size_t s = 0; s < scenarios.size(); s++) {
+        callers.emplace_back([&, s] {
+            for (int i = 0; i < iterations; i++) {
+                if (scenarios[s].run(input).getPixels() != expected[s].getPixels()) {
+                    mismatches[s]++;
+                }
+            }
+        });
+    }
+    for (std::thread& caller : callers) {
+        caller.join();
+    }
+
+    int failures = 0;
+    for (std::size_t s = 0; s < scenarios.size(); s++) {
+        failures += mismatches[s] > 0;
+        std::cout << scenarios[s].name << ": " << mismatches[s] << " of " << iterations
+                  << " results differ" << (mismatches[s] > 0 ? "  FAIL" : "") << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+#include "conformance.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "filter/recursive_gaussian.h"
+#include "operators.h"
+#include "util/backend.h"
+#include "util/image.h"
+#include "util/thread_pool.h"
+
+/**
+ * Conformance inputs: every size with random pixels, constant black and white and a 0/255
+ * checkerboard, which drive the kernels into saturation.
+ */
+static std::vector<Image> makeConformanceImages(unsigned int channels, unsigned int seed) {
+    static const std::vector<std::pair<unsigned int, unsigned int>> sizes = {
+        {1, 1},  {1, 9},  {9, 1},   {2, 3},   {17, 5},   {63, 7},
+        {64, 3}, {65, 33}, {130, 67}, {333, 71}, {641, 19},
+    };
+    std::mt19937 random(seed);
+    std::vector<Image> images;
+    for (const auto& [width, height] : sizes) {
+        for (int pattern = 0; pattern < 4; pattern++) {
+            Image image(width, height, channels == 1 ? PixelFormat::Gray8 : PixelFormat::BGR8);
+            MutableImageView view = image.mutableView();
+            for (unsigned int y = 0; y < height; y++) {
+                unsigned char* row = view.row(y);
+                for (std::size_t i = 0; i < view.rowElements(); i++) {
+                    const unsigned int x = i / channels;
+                    row[i] = pattern == 0   ? random()
+                             : pattern == 1 ? 0
+                             : pattern == 2 ? 255
+                                            : ((x + y) % 2) * 255;
+                }
+            }
+            images.push_back(std::move(image));
+        }
+    }
+    return images;
+}
+
+/**
+ * Accuracy input: a VGA frame of smooth gradients, hard-edged rectangles and mild noise, closer to
+ * a photograph than the conformance images are.
+ */
+static Image makeAccuracyImage(unsigned int seed) {
+    constexpr unsigned int width = 640, height = 480;
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> noise(-8, 8);
+    Image image(width, height, PixelFormat::BGR8);
+    MutableImageView view = image.mutableView();
+    for (unsigned int y = 0; y < height; y++) {
+        unsigned char* row = view.row(y);
+        for (unsigned int x = 0; x < width; x++) {
+            const bool inside = (x / 80 + y / 60) % 3 == 0;
+            for (unsigned int c = 0; c < 3; c++) {
+                const int value = inside ? 40 + 90 * c : (x * (c + 1) + y * (3 - c)) * 255 / 2560;
+                row[x * 3 + c] = std::clamp(value + noise(random), 0, 255);
+            }
+        }
+    }
+    return image;
+}
+
+/**
+ * Prints the deviation of the IIR Gaussian from the FIR one over the sigma range where
+ * GaussianMethod::Auto picks the IIR filter. Informational, nothing fails.
+ */
+static void reportGaussianAccuracy(unsigned int seed) {
+    const Image image = makeAccuracyImage(seed);
+    std::cout << "recursiveGaussian against FIR gaussianBlur, " << image.getWidth() << " x "
+              << image.getHeight() << " BGR" << std::endl;
+    std::cout << std::setw(8) << "sigma" << std::setw(10) << "max diff" << std::setw(11)
+              << "mean diff" << std::setw(12) << "PSNR (dB)" << std::endl;
+    for (double sigma : {8.0, 10.0, 12.0, 15.0, 20.0, 25.0, 30.0}) {
+        const CUDAVISION::GaussianAccuracy accuracy =
+            CUDAVISION::measureRecursiveGaussianAccuracy(image, sigma);
+        std::cout << std::fixed << std::setprecision(1) << std::setw(8) << sigma << std::setw(10)
+                  << accuracy.maxError << std::setprecision(3) << std::setw(11)
+                  << accuracy.meanError << std::setprecision(2) << std::setw(12) << accuracy.psnr
+                  << std::defaultfloat << std::endl;
+    }
+}
+
+int runConformance(const std::string& filter, unsigned int seed) {
+    std::vector<Operator> operators = makeOperators();
+    for (Operator& op : makeConformanceOperators()) {
+        operators.push_back(std::move(op));
+    }
+    std::erase_if(operators, [&](const Operator& op) {
+        return op.name.find(filter) == std::string::npos;
+    });
+    const std::vector<std::string> backends = CUDAVISION::getAvailableBackendNames();
+    const std::vector<Image> inputs[] = {makeConformanceImages(1, seed),
+                                         makeConformanceImages(3, seed)};
+    // Small grains split even the small images into bands, to cover the band borders.
+    CUDAVISION::setGrainSize(1);
+
+    struct Outcome {
+        int maxDifference = 0;
+        std::size_t failedImages = 0;
+    };
+    std::map<std::pair<std::string, std::string>, Outcome> outcomes;
+    for (std::size_t channels = 0; channels < 2; channels++) {
+        for (const Image& input : inputs[channels]) {
+            std::vector<Image> reference;
+            for (const std::string& backend : backends) {
+                CUDAVISION::setBackend(backend);
+                std::size_t index = 0;
+                for (const Operator& op : operators) {
+                    if (op.inputChannels != (channels == 0 ? 1u : 3u)) {
+                        continue;
+                    }
+                    const PixelFormat format =
+                        op.outputChannels == 3 ? PixelFormat::BGR8 : PixelFormat::Gray8;
+                    Image output(input.getWidth(), input.getHeight(), format);
+                    Image scratch(input.getWidth(), input.getHeight(), format);
+                    op.run(input.view(), output.mutableView(), scratch.mutableView());
+                    if (backend == backends.front()) {
+                        reference.push_back(std::move(output));
+                        continue;
+                    }
+                    const std::vector<unsigned char>& expected = reference[index++].getPixels();
+                    const std::vector<unsigned char>& actual = output.getPixels();
+                    int difference = 0;
+                    for (std::size_t i = 0; i < actual.size(); i++) {
+                        difference = std::max(difference, std::abs(actual[i] - expected[i]));
+                    }
+                    Outcome& outcome = outcomes[{op.name, backend}];
+                    outcome.maxDifference = std::max(outcome.maxDifference, difference);
+                    outcome.failedImages += difference > op.tolerance;
+                }
+            }
+        }
+    }
+    CUDAVISION::setGrainSize(0);
+
+    std::cout << "reference backend " << backends.front() << ", " << inputs[0].size()
+              << " images per channel count, seed " << seed << std::endl;
+    std::cout << std::left << std::setw(36) << "operator" << std::setw(10) << "backend"
+              << std::right << std::setw(10) << "max diff" << std::setw(11) << "tolerance"
+              << std::setw(10) << "failed" << std::endl;
+    int failures = 0;
+    for (const Operator& op : operators) {
+        for (std::size_t b = 1; b < backends.size(); b++) {
+            const Outcome& outcome = outcomes[{op.name, backends[b]}];
+            failures += outcome.failedImages > 0;
+            std::cout << std::left << std::setw(36) << op.name << std::setw(10) << backends[b]
+                      << std::right << std::setw(10) << outcome.maxDifference << std::setw(11)
+                      << op.tolerance << std::setw(10) << outcome.failedImages
+                      << (outcome.failedImages > 0 ? "  FAIL" : "") << std::endl;
+        }
+    }
+    std::cout << failures << " failing operator and backend combinations" << std::endl;
+
+    if (std::any_of(operators.begin(), operators.end(), [](const Operator& op) {
+            return op.name.starts_with("recursiveGaussian");
+        })) {
+        reportGaussianAccuracy(seed);
+    }
+    return failures;
+}
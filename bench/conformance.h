@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+
+/**
+ * Conformance test
+ *
+ * Runs the operators of makeOperators, plus the edge cases of makeConformanceOperators, on every
+ * available backend (see util/backend.h) over random and constant images from 1 x 1 pixels up,
+ * and compares each result with the one of the reference backend, the first one registered. A
+ * result differing by more than the stated tolerance of the operator counts as a failure.
+ *
+ * When the recursive Gaussian operators are part of the run, the maximum and mean difference and
+ * the PSNR of the IIR against the FIR Gaussian are printed as well, for sigma from 8 to 30.
+ */
+
+/**
+ * @brief Runs the conformance test and prints one line per operator and backend.
+ *
+ * @param filter Only operators whose name contains this substring are run.
+ * @param seed Seed of the random input images.
+ *
+ * @return The number of failing operator and backend combinations.
+ *
+ */
+int runConformance(const std::string& filter, unsigned int seed);
@@ -0,0 +1,35 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "conformance.h"
+
+/**
+ * Conformance test executable, registered with ctest (see conformance.h)
+ *
+ * Exits with status 1 if any operator on any backend differs from the reference backend by more
+ * than its tolerance.
+ *
+ * Usage: cuda_vision_conformance [--filter substring] [--seed n]
+ */
+
+int main(int argc, char** argv) {
+    std::string filter;
+    unsigned int seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << argv[i] << std::endl;
+            return 2;
+        }
+        if (std::strcmp(argv[i], "--filter") == 0) {
+            filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--seed") == 0) {
+            seed = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            std::cerr << "Unknown option " << argv[i] << std::endl;
+            return 2;
+        }
+    }
+    return runConformance(filter, seed) == 0 ? 0 : 1;
+}
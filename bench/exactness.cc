@@ -0,0 +1,585 @@
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "edge_detection/canny.h"
+#include "filter/median.h"
+#include "pipeline/graph.h"
+#include "pipeline/incremental.h"
+#include "pipeline/result_cache.h"
+#include "pipeline/streaming.h"
+#include "util/bit_image.h"
+#include "util/bitmap_io.h"
+#include "util/image.h"
+#include "util/region.h"
+#include "util/tiled_image.h"
+
+/**
+ * Exactness tests, registered with ctest
+ *
+ * The components that reorganize how an operator chain is computed, by tiles, strips, regions,
+ * changed tiles or cached results, promise results identical to the plain operators on the whole
+ * image. Every check compares the two bit for bit on images from 1 x 1 pixels up; the bitmap
+ * check round-trips every supported file layout and rejects malformed headers.
+ *
+ * Exits with status 1 if any comparison fails.
+ *
+ * Usage: cuda_vision_exactness [--check name] [--seed n]
+ */
+
+using namespace CUDAVISION;
+
+static const std::vector<std::pair<unsigned int, unsigned int>> SIZES = {
+    {1, 1}, {1, 9}, {9, 1}, {2, 3}, {17, 5}, {64, 33}, {300, 7}, {131, 97},
+};
+
+/**
+ * Random pixels in blocks of similar brightness, so that the blurs and edge maps are neither
+ * flat nor pure noise.
+ */
+static Image makeImage(unsigned int width, unsigned int height, PixelFormat format,
+                       std::mt19937& random) {
+    Image image(width, height, format);
+    MutableImageView view = image.mutableView();
+    for (unsigned int y = 0; y < height; y++) {
+        unsigned char* row = view.row(y);
+        for (std::size_t i = 0; i < view.rowElements(); i++) {
+            const unsigned int x = i / view.channels;
+            const bool bright = (x / 5 + y / 4) % 2 == 0;
+            row[i] = bright ? 160 + random() % 96 : random() % 96;
+        }
+    }
+    return image;
+}
+
+/**
+ * Compares two images, printing the first difference.
+ *
+ * @return 0 if they are identical, 1 otherwise.
+ */
+static int compare(const std::string& what, const Image& actual, const Image& expected) {
+    if (actual.getWidth() != expected.getWidth() || actual.getHeight() != expected.getHeight() ||
+        actual.getChannels() != expected.getChannels()) {
+        std::cout << "FAIL " << what << ": " << actual.getWidth() << " x " << actual.getHeight()
+                  << " x " << actual.getChannels() << ", expected " << expected.getWidth()
+                  << " x " << expected.getHeight() << " x " << expected.getChannels()
+                  << std::endl;
+        return 1;
+    }
+    const std::vector<unsigned char>& a = actual.getPixels();
+    const std::vector<unsigned char>& b = expected.getPixels();
+    const auto mismatch = std::mismatch(a.begin(), a.end(), b.begin());
+    if (mismatch.first == a.end()) {
+        return 0;
+    }
+    const std::size_t index = mismatch.first - a.begin();
+    const std::size_t rowElements = std::size_t{actual.getWidth()} * actual.getChannels();
+    std::cout << "FAIL " << what << " (" << actual.getWidth() << " x " << actual.getHeight()
+              << "): element " << index % rowElements << " of row " << index / rowElements
+              << " is " << int(*mismatch.first) << ", expected " << int(*mismatch.second)
+              << std::endl;
+    return 1;
+}
+
+static Image copyOf(ImageView view) {
+    Image image(view.width, view.height,
+                view.channels == 1 ? PixelFormat::Gray8 : PixelFormat::BGR8);
+    for (unsigned int y = 0; y < view.height; y++) {
+        std::memcpy(image.mutableView().row(y), view.row(y), view.rowElements());
+    }
+    return image;
+}
+
+/**
+ * The chain the pipelines below compute: blur, grayscale and the three edge operators.
+ */
+struct Chain {
+    Image blurred, gray, roberts, prewitt, sobel;
+};
+
+static Chain computeChain(const Image& image, int kernelSize, double sigma) {
+    Image blurred = gaussianSmooth(image, kernelSize, sigma, SmoothingMode::Fused);
+    Image gray = blurred.toGrayscale();
+    Image roberts = robertsOperator(gray);
+    Image prewitt = prewittOperator(gray);
+    Image sobel = sobelOperator(gray);
+    return {std::move(blurred), std::move(gray), std::move(roberts), std::move(prewitt),
+            std::move(sobel)};
+}
+
+/**
+ * A per-process scratch directory, removed when the check ends.
+ */
+class ScratchDirectory {
+   public:
+    explicit ScratchDirectory(const std::string& name)
+        : path(std::filesystem::temp_directory_path() /
+               ("cuda_vision_exactness_" + name + "_" + std::to_string(::getpid()))) {
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+    }
+    ~ScratchDirectory() { std::filesystem::remove_all(path); }
+
+    const std::filesystem::path path;
+};
+
+/**
+ * Pipeline::run against the eager operators, for every tile height. Without reordering every
+ * output is exact; with reordering as long as the color blur is an output itself, which keeps
+ * grayscale behind the blur.
+ */
+static int checkGraph(std::mt19937& random) {
+    int failures = 0;
+    for (const auto& [width, height] : SIZES) {
+        const Image image = makeImage(width, height, PixelFormat::BGR8, random);
+        const Chain expected = computeChain(image, 5, 2.0);
+        for (bool reordering : {false, true}) {
+            for (unsigned int tileRows : {1u, 2u, 7u, 64u, 1000u}) {
+                Pipeline pipeline;
+                pipeline.setReordering(reordering);
+                pipeline.setTileRows(tileRows);
+                const Pipeline::Node blurred = pipeline.gaussianSmooth(pipeline.input(), 5, 2.0);
+                const Pipeline::Node gray = pipeline.grayscale(blurred);
+                pipeline.output(blurred);
+                pipeline.output(gray);
+                pipeline.output(pipeline.robertsOperator(gray));
+                pipeline.output(pipeline.prewittOperator(gray));
+                pipeline.output(pipeline.sobelOperator(gray));
+                const std::vector<Image> results = pipeline.run(image);
+                const std::string what = "graph reordering " + std::to_string(reordering) +
+                                         " tile rows " + std::to_string(tileRows);
+                failures += compare(what + " blur", results[0], expected.blurred);
+                failures += compare(what + " gray", results[1], expected.gray);
+                failures += compare(what + " roberts", results[2], expected.roberts);
+                failures += compare(what + " prewitt", results[3], expected.prewitt);
+                failures += compare(what + " sobel", results[4], expected.sobel);
+            }
+            // Edges of the grayscale input, no blur involved.
+            Pipeline edges;
+            edges.setReordering(reordering);
+            edges.setTileRows(3);
+            edges.output(edges.sobelOperator(edges.grayscale(edges.input())));
+            failures += compare("graph gray sobel", edges.run(image)[0],
+                                sobelOperator(image.toGrayscale()));
+        }
+    }
+    return failures;
+}
+
+/**
+ * streamEdgeDetection against the in-memory chain, for 8, 24 and 32 bpp input files.
+ */
+static int checkStreaming(std::mt19937& random) {
+    ScratchDirectory directory("streaming");
+    const std::filesystem::path input = directory.path / "input.bmp";
+    const std::filesystem::path output = directory.path / "edges.bmp";
+    int failures = 0;
+    for (const auto& [width, height] : SIZES) {
+        for (unsigned int channels : {1u, 3u, 4u}) {
+            std::vector<unsigned char> pixels(std::size_t{width} * height * channels);
+            const Image block = makeImage(width * channels, height, PixelFormat::Gray8, random);
+            std::copy(block.getPixels().begin(), block.getPixels().end(), pixels.begin());
+            writeBitmap(input, ImageView{pixels.data(), width, height,
+                                         static_cast<std::ptrdiff_t>(width * channels),
+                                         channels});
+            const Image image = readBitmap(input);
+            const Image expected = computeChain(image, 7, 1.5).sobel;
+            for (unsigned int stripRows : {1u, 3u, 64u}) {
+                streamEdgeDetection(input, output, {7, 1.5, stripRows});
+                failures += compare("streaming " + std::to_string(8 * channels) + " bpp strip " +
+                                        std::to_string(stripRows),
+                                    readBitmap(output), expected);
+            }
+        }
+    }
+    return failures;
+}
+
+/**
+ * FrameProcessor over a sequence of frames against a complete computation of every frame:
+ * unchanged frames, a few changed pixels, changes at the borders, a completely new frame and a
+ * change of size.
+ */
+static int checkIncremental(std::mt19937& random) {
+    int failures = 0;
+    for (unsigned int tileSize : {1u, 8u, 64u}) {
+        FrameProcessor processor({5, 2.0, tileSize});
+        for (const auto& [width, height] : SIZES) {
+            Image frame = makeImage(width, height, PixelFormat::BGR8, random);
+            for (int step = 0; step < 6; step++) {
+                MutableImageView pixels = frame.mutableView();
+                if (step == 2) {
+                    pixels.row(0)[0] ^= 0x80;
+                    pixels.row(height - 1)[pixels.rowElements() - 1] ^= 0x80;
+                } else if (step == 3 || step == 4) {
+                    for (int k = 0; k < 3; k++) {
+                        pixels.row(random() % height)[random() % pixels.rowElements()] += 77;
+                    }
+                } else if (step == 5) {
+                    frame = makeImage(width, height, PixelFormat::BGR8, random);
+                }
+                const Image expected = computeChain(frame, 5, 2.0).sobel;
+                failures += compare("incremental tile " + std::to_string(tileSize) + " frame " +
+                                        std::to_string(step),
+                                    copyOf(processor.process(frame.view())), expected);
+            }
+        }
+    }
+    return failures;
+}
+
+/**
+ * TiledImage round trips and applyTiled against the operators on the linear image.
+ */
+static int checkTiled(std::mt19937& random) {
+    int failures = 0;
+    for (const auto& [width, height] : SIZES) {
+        const Image image = makeImage(width, height, PixelFormat::BGR8, random);
+        const Image blurred = gaussianSmooth(image, 5, 2.0, SmoothingMode::Fused);
+        const Image gray = image.toGrayscale();
+        const Image edges = sobelOperator(gray);
+        for (unsigned int tileSize : {1u, 4u, 16u, 256u}) {
+            const std::string what = "tiled tile size " + std::to_string(tileSize);
+            const TiledImage tiled(image.view(), tileSize);
+            failures += compare(what + " round trip", tiled.toImage(), image);
+
+            TiledImage smoothed(width, height, 3, tileSize);
+            applyTiled(tiled, smoothed, 6, 6, [](ImageView tile, MutableImageView target) {
+                gaussianSmoothFused(tile, target, 5, 2.0);
+            });
+            failures += compare(what + " blur", smoothed.toImage(), blurred);
+
+            const TiledImage tiledGray(gray.view(), tileSize);
+            TiledImage sobel(width, height, 1, tileSize);
+            applyTiled(tiledGray, sobel, 1, 1, [](ImageView tile, MutableImageView target) {
+                sobelOperator(tile, target);
+            });
+            failures += compare(what + " sobel", sobel.toImage(), edges);
+        }
+    }
+    return failures;
+}
+
+/**
+ * Keeps the pixels of an image inside a list of rectangles, zero elsewhere.
+ */
+static Image maskRegions(const Image& image, const std::vector<Rect>& regions) {
+    Image masked(image.getWidth(), image.getHeight(), image.getFormat());
+    for (const Rect& r : regions) {
+        const ImageView source = image.view().subView(r.x, r.y, r.width, r.height);
+        MutableImageView target = masked.mutableView().subView(r.x, r.y, r.width, r.height);
+        for (unsigned int y = 0; y < r.height; y++) {
+            std::memcpy(target.row(y), source.row(y), source.rowElements());
+        }
+    }
+    return masked;
+}
+
+/**
+ * The region overloads against the operators on the whole image, masked to the rectangles:
+ * single rectangles, overlapping ones merged into a group, far apart ones in groups of their
+ * own, and rectangles touching the image border.
+ */
+static int checkRegions(std::mt19937& random) {
+    int failures = 0;
+    for (const auto& [width, height] : SIZES) {
+        const Image image = makeImage(width, height, PixelFormat::BGR8, random);
+        const Image gray = image.toGrayscale();
+        std::vector<std::vector<Rect>> lists = {{{0, 0, width, height}}};
+        for (int list = 0; list < 4; list++) {
+            std::vector<Rect> regions;
+            for (int i = 0; i <= list; i++) {
+                const unsigned int x = random() % width;
+                const unsigned int y = random() % height;
+                const unsigned int w = 1 + random() % (width - x);
+                const unsigned int h = 1 + random() % (height - y);
+                regions.push_back({x, y, w, h});
+            }
+            lists.push_back(std::move(regions));
+        }
+        for (const std::vector<Rect>& regions : lists) {
+            const std::string what = "regions " + std::to_string(regions.size());
+            for (SmoothingMode mode : {SmoothingMode::Fused, SmoothingMode::Multipass}) {
+                failures += compare(what + " gaussianSmooth",
+                                    gaussianSmooth(image, regions, 7, 1.5, mode),
+                                    maskRegions(gaussianSmooth(image, 7, 1.5, mode), regions));
+            }
+            failures += compare(what + " toGrayscale", image.toGrayscale(regions),
+                                maskRegions(gray, regions));
+            failures += compare(what + " roberts", robertsOperator(gray, regions),
+                                maskRegions(robertsOperator(gray), regions));
+            failures += compare(what + " prewitt", prewittOperator(gray, regions),
+                                maskRegions(prewittOperator(gray), regions));
+            failures += compare(what + " sobel", sobelOperator(gray, regions),
+                                maskRegions(sobelOperator(gray), regions));
+        }
+    }
+    return failures;
+}
+
+/**
+ * Writes raw bytes to a file.
+ */
+static void writeFile(const std::filesystem::path& path, const std::vector<char>& bytes) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(bytes.data(), bytes.size());
+}
+
+static std::vector<char> readFile(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+static void put32(std::vector<char>& bytes, std::size_t offset, uint32_t value) {
+    std::memcpy(bytes.data() + offset, &value, sizeof(value));
+}
+
+/**
+ * Bitmap files: 8, 24 and 32 bpp round trips through writeBitmap and readBitmap, bottom-up and
+ * top-down, 1 bpp round trips through readBitImage, and malformed headers rejected by readBitmap
+ * and reported as an empty image by the Image constructor.
+ */
+static int checkBitmap(std::mt19937& random) {
+    ScratchDirectory directory("bitmap");
+    const std::filesystem::path path = directory.path / "image.bmp";
+    int failures = 0;
+    for (const auto& [width, height] : SIZES) {
+        for (PixelFormat format : {PixelFormat::Gray8, PixelFormat::BGR8}) {
+            const Image image = makeImage(width, height, format, random);
+            writeBitmap(path, image.view());
+            failures += compare("bitmap round trip", readBitmap(path), image);
+            failures += compare("bitmap Image(path)", Image(path), image);
+
+            // Top-down: negative height, the first row of the pixel array is the top row.
+            std::vector<char> bytes = readFile(path);
+            uint32_t offset;
+            std::memcpy(&offset, bytes.data() + 10, sizeof(offset));
+            const std::size_t rowSize = (bytes.size() - offset) / height;
+            std::vector<char> flipped(bytes.begin(), bytes.begin() + offset);
+            for (unsigned int y = height; y-- > 0;) {
+                flipped.insert(flipped.end(), bytes.begin() + offset + y * rowSize,
+                               bytes.begin() + offset + (y + 1) * rowSize);
+            }
+            put32(flipped, 22, static_cast<uint32_t>(-static_cast<int32_t>(height)));
+            writeFile(path, flipped);
+            failures += compare("bitmap top-down", readBitmap(path), image);
+        }
+
+        // 32 bpp files decode to BGR8, the fourth byte is dropped.
+        const Image color = makeImage(width, height, PixelFormat::BGR8, random);
+        std::vector<unsigned char> bgra(std::size_t{width} * height * 4, 0xAB);
+        for (std::size_t i = 0; i < std::size_t{width} * height; i++) {
+            std::memcpy(&bgra[4 * i], &color.getPixels()[3 * i], 3);
+        }
+        writeBitmap(path, ImageView{bgra.data(), width, height,
+                                    static_cast<std::ptrdiff_t>(width * 4), 4});
+        failures += compare("bitmap 32 bpp", readBitmap(path), color);
+
+        const BitImage mask = BitImage::fromThreshold(color.toGrayscale().view(), 127);
+        writeBitmap(path, mask);
+        if (!(readBitImage(path) == mask)) {
+            std::cout << "FAIL bitmap 1 bpp round trip (" << width << " x " << height << ")"
+                      << std::endl;
+            failures++;
+        }
+        failures += compare("bitmap 1 bpp as image", readBitmap(path), mask.toImage());
+    }
+
+    const Image image = makeImage(17, 5, PixelFormat::BGR8, random);
+    writeBitmap(path, image.view());
+    const std::vector<char> valid = readFile(path);
+    const Image gray = makeImage(17, 5, PixelFormat::Gray8, random);
+    writeBitmap(path, gray.view());
+    const std::vector<char> validGray = readFile(path);
+    std::vector<std::pair<std::string, std::vector<char>>> malformed;
+    auto corrupt = [&](const std::string& name, std::vector<char> bytes, std::size_t offset,
+                       uint32_t value) {
+        put32(bytes, offset, value);
+        malformed.emplace_back(name, std::move(bytes));
+    };
+    malformed.emplace_back("too small", std::vector<char>(valid.begin(), valid.begin() + 30));
+    malformed.emplace_back("truncated pixels",
+                           std::vector<char>(valid.begin(), valid.end() - 20));
+    corrupt("signature", valid, 0, 0x4D58);
+    corrupt("zero width", valid, 18, 0);
+    corrupt("negative width", valid, 18, static_cast<uint32_t>(-17));
+    corrupt("zero height", valid, 22, 0);
+    corrupt("minimum height", valid, 22, 0x80000000u);
+    corrupt("huge height", valid, 22, 0x7FFFFFFFu);
+    corrupt("16 bpp", valid, 28, 16);
+    corrupt("compression", valid, 30, 1);
+    corrupt("info header size", valid, 14, 12);
+    corrupt("pixel offset", valid, 10, static_cast<uint32_t>(valid.size() + 1));
+    corrupt("palette size", validGray, 46, 300);
+    corrupt("palette past pixels", validGray, 10, 54);
+    for (const auto& [name, bytes] : malformed) {
+        writeFile(path, bytes);
+        bool rejected = false;
+        try {
+            readBitmap(path);
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        // The constructor reports on std::cerr, keep the test output readable.
+        std::streambuf* errors = std::cerr.rdbuf(nullptr);
+        const Image empty(path);
+        std::cerr.rdbuf(errors);
+        if (!rejected || empty.getWidth() != 0 || empty.getHeight() != 0) {
+            std::cout << "FAIL bitmap malformed " << name << " accepted" << std::endl;
+            failures++;
+        }
+    }
+    return failures;
+}
+
+/**
+ * medianFilter against a plain sort of every window, replicating the border, on the sorting
+ * network radii and the histogram radii.
+ */
+static int checkMedian(std::mt19937& random) {
+    int failures = 0;
+    for (const auto& [width, height] : SIZES) {
+        for (PixelFormat format : {PixelFormat::Gray8, PixelFormat::BGR8}) {
+            const Image image = makeImage(width, height, format, random);
+            const ImageView input = image.view();
+            for (int radius : {0, 1, 2, 3, 7, 20}) {
+                Image expected(width, height, format);
+                MutableImageView output = expected.mutableView();
+                std::vector<unsigned char> window;
+                for (int y = 0; y < static_cast<int>(height); y++) {
+                    for (int x = 0; x < static_cast<int>(width); x++) {
+                        for (unsigned int c = 0; c < input.channels; c++) {
+                            window.clear();
+                            for (int dy = -radius; dy <= radius; dy++) {
+                                const int yy = std::clamp(y + dy, 0, int(height) - 1);
+                                for (int dx = -radius; dx <= radius; dx++) {
+                                    const int xx = std::clamp(x + dx, 0, int(width) - 1);
+                                    window.push_back(input.row(yy)[xx * input.channels + c]);
+                                }
+                            }
+                            std::nth_element(window.begin(), window.begin() + window.size() / 2,
+                                             window.end());
+                            output.row(y)[x * input.channels + c] = window[window.size() / 2];
+                        }
+                    }
+                }
+                failures += compare("median radius " + std::to_string(radius),
+                                    medianFilter(image, radius), expected);
+            }
+        }
+    }
+    return failures;
+}
+
+/**
+ * Pipeline runs answered by a ResultCache, from memory, from disk after reopening, and
+ * restarted from a cached intermediate, against runs without a cache.
+ */
+static int checkResultCache(std::mt19937& random) {
+    ScratchDirectory directory("cache");
+    int failures = 0;
+    for (const auto& [width, height] : SIZES) {
+        const Image image = makeImage(width, height, PixelFormat::BGR8, random);
+        Pipeline pipeline;
+        const Pipeline::Node blurred = pipeline.gaussianSmooth(pipeline.input(), 5, 2.0);
+        const Pipeline::Node gray = pipeline.grayscale(blurred);
+        pipeline.output(gray);
+        pipeline.output(pipeline.sobelOperator(gray));
+        pipeline.output(pipeline.robertsOperator(pipeline.grayscale(pipeline.input())));
+        pipeline.cacheIntermediate(blurred);
+        // Runs with a cache compute in the recorded order.
+        pipeline.setReordering(false);
+        const std::vector<Image> expected = pipeline.run(image);
+        pipeline.setReordering(true);
+
+        auto check = [&](const std::string& what) {
+            const std::vector<Image> results = pipeline.run(image);
+            for (std::size_t i = 0; i < expected.size(); i++) {
+                failures += compare("cache " + what + " output " + std::to_string(i),
+                                    results[i], expected[i]);
+            }
+        };
+        {
+            ResultCache cache({directory.path, std::size_t{1} << 30, std::size_t{1} << 30});
+            pipeline.setCache(&cache);
+            check("miss");
+            check("memory hit");
+        }
+        {
+            ResultCache cache({directory.path, std::size_t{1} << 30, std::size_t{1} << 30});
+            pipeline.setCache(&cache);
+            check("disk hit");
+            cache.clear();
+        }
+        {
+            // A second pipeline sharing the blur starts from the cached intermediate.
+            ResultCache cache({"", 0, std::size_t{1} << 30});
+            pipeline.setCache(&cache);
+            check("intermediate stored");
+            Pipeline other;
+            other.setReordering(false);
+            other.output(other.prewittOperator(
+                other.grayscale(other.gaussianSmooth(other.input(), 5, 2.0))));
+            const Image reference = other.run(image)[0];
+            other.setCache(&cache);
+            failures += compare("cache from intermediate", other.run(image)[0], reference);
+            failures += compare("cache from intermediate hit", other.run(image)[0], reference);
+        }
+        pipeline.setCache(nullptr);
+    }
+    return failures;
+}
+
+int main(int argc, char** argv) {
+    std::string selected;
+    unsigned int seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << argv[i] << std::endl;
+            return 2;
+        }
+        if (std::strcmp(argv[i], "--check") == 0) {
+            selected = argv[++i];
+        } else if (std::strcmp(argv[i], "--seed") == 0) {
+            seed = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            std::cerr << "Unknown option " << argv[i] << std::endl;
+            return 2;
+        }
+    }
+
+    const std::vector<std::pair<std::string, std::function<int(std::mt19937&)>>> checks = {
+        {"graph", checkGraph},   {"streaming", checkStreaming}, {"incremental", checkIncremental},
+        {"tiled", checkTiled},   {"regions", checkRegions},     {"bitmap", checkBitmap},
+        {"median", checkMedian}, {"cache", checkResultCache},
+    };
+    int failures = 0;
+    bool found = false;
+    for (const auto& [name, check] : checks) {
+        if (!selected.empty() && name != selected) {
+            continue;
+        }
+        found = true;
+        std::mt19937 random(seed);
+        const int failed = check(random);
+        std::cout << name << ": " << failed << " failing comparisons" << std::endl;
+        failures += failed;
+    }
+    if (!found) {
+        std::cerr << "Unknown check " << selected << std::endl;
+        return 2;
+    }
+    return failures == 0 ? 0 : 1;
+}
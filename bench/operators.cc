@@ -0,0 +1,340 @@
+#include "operators.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "edge_detection/canny.h"
+#include "filter/median.h"
+#include "filter/pyramid.h"
+#include "filter/recursive_gaussian.h"
+#include "filter/stencil.h"
+#include "pipeline/graph.h"
+#include "pipeline/incremental.h"
+#include "pipeline/result_cache.h"
+#include "pipeline/streaming.h"
+#include "util/bit_image.h"
+#include "util/bitmap_io.h"
+#include "util/histogram.h"
+#include "util/image.h"
+#include "util/tiled_image.h"
+
+/**
+ * Sixteen boxes of up to 128 x 128 pixels on a 4 x 4 grid, the kind of list a detector hands to
+ * the region overloads. Every other row is shifted right, its last box crossing the border.
+ */
+static std::vector<Rect> benchmarkRegions(unsigned int width, unsigned int height) {
+    const unsigned int boxWidth = std::min(128u, width / 4);
+    const unsigned int boxHeight = std::min(128u, height / 4);
+    std::vector<Rect> regions;
+    for (unsigned int i = 0; i < 16; i++) {
+        const unsigned int shift = (i / 4) % 2 == 0 ? 0 : width / 8;
+        regions.push_back({(i % 4) * width / 4 + width / 8 + shift - boxWidth / 2,
+                           (i / 4) * height / 4 + height / 16, boxWidth, boxHeight});
+    }
+    return regions;
+}
+
+/**
+ * Copies a view into an image of its own, for the components taking an Image.
+ */
+static Image copyOf(ImageView view) {
+    Image image(view.width, view.height,
+                view.channels == 1 ? PixelFormat::Gray8 : PixelFormat::BGR8);
+    MutableImageView target = image.mutableView();
+    for (unsigned int y = 0; y < view.height; y++) {
+        std::memcpy(target.row(y), view.row(y), view.rowElements());
+    }
+    return image;
+}
+
+/**
+ * Folds values of any count into the bytes of an output view, position by position, so that
+ * every differing value changes the output. Used by the components whose results do not have
+ * the size of their input: pyramid levels, histograms, thresholds.
+ */
+static void foldInto(MutableImageView output, const std::vector<unsigned char>& values) {
+    const std::size_t rowElements = output.rowElements();
+    const std::size_t total = rowElements * output.height;
+    for (unsigned int y = 0; y < output.height; y++) {
+        std::fill_n(output.row(y), rowElements, 0);
+    }
+    for (std::size_t i = 0; i < values.size(); i++) {
+        unsigned char& target = output.row((i % total) / rowElements)[i % rowElements];
+        target = static_cast<unsigned char>(target * 31 + values[i]);
+    }
+}
+
+/**
+ * Appends the bytes of 64-bit counters to the values folded by foldInto.
+ */
+static void appendCounts(std::vector<unsigned char>& values, const std::vector<uint64_t>& counts) {
+    for (uint64_t count : counts) {
+        for (int k = 0; k < 8; k++) {
+            values.push_back(static_cast<unsigned char>(count >> (8 * k)));
+        }
+    }
+}
+
+std::vector<Operator> makeOperators() {
+    const std::vector<double> kernel = CUDAVISION::getGaussianKernel(5, 20.0);
+    return {
+        {"horizontalConvolution", 3, 3,
+         [kernel](ImageView input, MutableImageView output, MutableImageView) {
+             CUDAVISION::horizontalConvolution(input, output, kernel);
+         }},
+        {"verticalConvolution", 3, 3,
+         [kernel](ImageView input, MutableImageView output, MutableImageView) {
+             CUDAVISION::verticalConvolution(input, output, kernel);
+         }},
+        {"gaussianSmooth", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView scratch) {
+             CUDAVISION::gaussianSmooth(input, output, scratch, 5, 20.0);
+         }},
+        {"gaussianSmoothFused", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             CUDAVISION::gaussianSmoothFused(input, output, 5, 20.0);
+         }},
+        {"gaussianSmoothFused 16 regions", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             CUDAVISION::gaussianSmooth(input, output,
+                                        benchmarkRegions(input.width, input.height), 5, 20.0);
+         }},
+        {"medianFilter 3x3", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             CUDAVISION::medianFilter(input, output, 1);
+         }},
+        {"medianFilter 5x5", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             CUDAVISION::medianFilter(input, output, 2);
+         }},
+        {"medianFilter radius 5", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             CUDAVISION::medianFilter(input, output, 5);
+         }},
+        {"medianFilter radius 15", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             CUDAVISION::medianFilter(input, output, 15);
+         }},
+        {"hashPixels", 3, 3,
+         [](ImageView input, MutableImageView, MutableImageView) {
+             CUDAVISION::hashPixels(input);
+         }},
+        {"toGrayscale", 3, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             Image::toGrayscale(input, output);
+         }},
+        {"robertsOperator", 1, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             CUDAVISION::robertsOperator(input, output);
+         }},
+        {"prewittOperator", 1, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             CUDAVISION::prewittOperator(input, output);
+         }},
+        {"sobelOperator", 1, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             CUDAVISION::sobelOperator(input, output);
+         }},
+        {"sobelOperator 16 regions", 1, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             CUDAVISION::sobelOperator(input, output,
+                                       benchmarkRegions(input.width, input.height));
+         }},
+        {"canny", 1, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             CUDAVISION::canny(input, output, 50, 100);
+         }},
+    };
+}
+
+std::vector<Operator> makeConformanceOperators() {
+    using namespace CUDAVISION;
+    const FixedPointKernel skewed = FixedPointKernel::fromKernel({0.1, 0.2, 0.7});
+    const FixedPointKernel sharpen = FixedPointKernel::fromKernel({-0.5, 2.0, -0.5});
+    const FixedPointKernel wide = FixedPointKernel::fromKernel(getGaussianKernel(31, 7.0));
+    return {
+        {"gaussianSmoothFused sigma 0.01", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             gaussianSmoothFused(input, output, 3, 0.01);
+         }},
+        {"gaussianSmoothFused 31 sigma 1000", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             gaussianSmoothFused(input, output, 31, 1000.0);
+         }},
+        {"separableConvolution skewed", 3, 3,
+         [skewed, wide](ImageView input, MutableImageView output, MutableImageView) {
+             separableConvolution(input, output, skewed, wide);
+         }},
+        {"separableConvolution sharpen", 1, 1,
+         [sharpen](ImageView input, MutableImageView output, MutableImageView) {
+             separableConvolution(input, output, sharpen, sharpen);
+         }},
+        {"sobelOperator color squared int32", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             // Folds every 32-bit magnitude into its output byte, so that any differing bit
+             // shows.
+             std::vector<int32_t> squared(input.rowElements() * input.height);
+             applyStencil<SobelStencil>(input,
+                                        {squared.data(), input.width, input.height,
+                                         std::ptrdiff_t(input.rowElements() * sizeof(int32_t)),
+                                         input.channels},
+                                        {BorderMode::Replicate, 0, Magnitude::Squared});
+             for (unsigned int y = 0; y < input.height; y++) {
+                 for (std::size_t i = 0; i < input.rowElements(); i++) {
+                     const uint32_t s = squared[y * input.rowElements() + i];
+                     output.row(y)[i] = static_cast<unsigned char>(s ^ s >> 8 ^ s >> 16 ^ s >> 24);
+                 }
+             }
+         }},
+        {"scharr reflect L1", 1, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             applyStencil<ScharrStencil>(input, output, {BorderMode::Reflect, 0, Magnitude::L1});
+         }},
+        {"laplacian constant", 1, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             applyStencil<LaplacianStencil>(input, output, {BorderMode::Constant, 200});
+         }},
+        {"laplacianOfGaussian replicate", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             applyStencil<LaplacianOfGaussianStencil>(input, output, {BorderMode::Replicate});
+         }},
+        {"medianFilter radius 127", 1, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             medianFilter(input, output, MEDIAN_MAX_RADIUS);
+         }},
+        {"recursiveGaussian sigma 0.5", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             recursiveGaussian(input, output, 0.5);
+         }},
+        {"recursiveGaussian sigma 40", 1, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             recursiveGaussian(input, output, 40.0);
+         }},
+        {"Pipeline blur", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             Pipeline pipeline;
+             pipeline.setTileRows(7);
+             pipeline.output(pipeline.gaussianSmooth(pipeline.input(), 5, 20.0));
+             foldInto(output, pipeline.run(copyOf(input))[0].getPixels());
+         }},
+        {"Pipeline gray edges", 3, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             Pipeline pipeline;
+             pipeline.setTileRows(7);
+             const Pipeline::Node gray =
+                 pipeline.grayscale(pipeline.gaussianSmooth(pipeline.input(), 7, 2.0));
+             pipeline.output(pipeline.robertsOperator(gray));
+             pipeline.output(pipeline.prewittOperator(gray));
+             pipeline.output(pipeline.sobelOperator(gray));
+             std::vector<unsigned char> values;
+             for (const Image& result : pipeline.run(copyOf(input))) {
+                 values.insert(values.end(), result.getPixels().begin(),
+                               result.getPixels().end());
+             }
+             foldInto(output, values);
+         }},
+        {"streamEdgeDetection", 3, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             // Per process, ctest may run several conformance tests at once.
+             const std::filesystem::path directory =
+                 std::filesystem::temp_directory_path() /
+                 ("cuda_vision_conformance_" + std::to_string(::getpid()));
+             std::filesystem::create_directories(directory);
+             writeBitmap(directory / "input.bmp", input);
+             streamEdgeDetection(directory / "input.bmp", directory / "edges.bmp", {5, 2.0, 3});
+             foldInto(output, readBitmap(directory / "edges.bmp").getPixels());
+             std::filesystem::remove_all(directory);
+         }},
+        {"FrameProcessor three frames", 3, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             // The second frame changes a pixel in every third tile, the third one nothing.
+             FrameProcessor processor({5, 2.0, 8});
+             processor.process(input);
+             Image next = copyOf(input);
+             MutableImageView pixels = next.mutableView();
+             for (unsigned int y = 0; y < pixels.height; y += 8) {
+                 for (unsigned int x = (y / 8) % 3 * 8; x < pixels.width; x += 24) {
+                     pixels.row(y)[3 * x + 1] ^= 0x40;
+                 }
+             }
+             processor.process(next.view());
+             const ImageView last = processor.process(next.view());
+             for (unsigned int y = 0; y < last.height; y++) {
+                 std::copy_n(last.row(y), last.rowElements(), output.row(y));
+             }
+         }},
+        {"GaussianPyramid levels", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             GaussianPyramid pyramid(copyOf(input));
+             std::vector<unsigned char> values;
+             for (unsigned int level = 1; level < pyramid.getLevelCount(); level++) {
+                 const ImageView pixels = pyramid.level(level);
+                 for (unsigned int y = 0; y < pixels.height; y++) {
+                     values.insert(values.end(), pixels.row(y),
+                                   pixels.row(y) + pixels.rowElements());
+                 }
+             }
+             foldInto(output, values);
+         }},
+        {"applyTiled gaussianSmoothFused", 3, 3,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             const TiledImage tiled(input, 16);
+             TiledImage result(input.width, input.height, input.channels, 16);
+             applyTiled(tiled, result, 6, 6, [](ImageView tile, MutableImageView target) {
+                 gaussianSmoothFused(tile, target, 5, 2.0);
+             });
+             foldInto(output, result.toImage().getPixels());
+         }},
+        {"BitImage threshold dilate erode", 1, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             const BitImage mask = BitImage::fromThreshold(input, 127);
+             const BitImage dilated = dilate(mask, 2);
+             const BitImage eroded = erode(mask, 3);
+             for (unsigned int y = 0; y < input.height; y++) {
+                 for (unsigned int x = 0; x < input.width; x++) {
+                     output.row(y)[x] = mask.get(x, y) | dilated.get(x, y) << 1 |
+                                        eroded.get(x, y) << 2;
+                 }
+             }
+         }},
+        {"canny otsu", 1, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             canny(input, output, AutoThreshold{});
+         }},
+        {"canny percentile", 1, 1,
+         [](ImageView input, MutableImageView output, MutableImageView) {
+             canny(input, output, AutoThreshold{ThresholdMethod::Percentile, 75.0, 0.4});
+         }},
+        {"histograms and thresholds", 1, 1,
+         [](ImageView input, MutableImageView output, MutableImageView scratch) {
+             // 16-bit values from -500 up, so that both clamped ends of the bins are hit.
+             std::vector<int16_t> wide(input.rowElements() * input.height);
+             for (unsigned int y = 0; y < input.height; y++) {
+                 for (std::size_t i = 0; i < input.rowElements(); i++) {
+                     wide[y * input.rowElements() + i] =
+                         static_cast<int16_t>(input.row(y)[i] * 7 - 500);
+                 }
+             }
+             const BasicImageView<const int16_t> wideView{
+                 wide.data(), input.width, input.height,
+                 std::ptrdiff_t(input.rowElements() * sizeof(int16_t)), input.channels};
+             Histogram magnitudes(256, 0);
+             sobelOperator(input, scratch, {}, &magnitudes);
+             const Histogram pixels = computeHistogram(input);
+             std::vector<unsigned char> values;
+             appendCounts(values, pixels);
+             appendCounts(values, computeHistogram(wideView, 1024));
+             appendCounts(values, magnitudes);
+             values.push_back(otsuThreshold(pixels));
+             values.push_back(percentileThreshold(pixels, 37.5));
+             values.push_back(otsuThreshold(magnitudes));
+             foldInto(output, values);
+         }},
+    };
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "util/image.h"
+
+/**
+ * Operators shared by the benchmark suite and the conformance test.
+ */
+
+/**
+ * An operator working on caller-provided views, so that the measurement does not include the
+ * allocation of the result.
+ */
+struct Operator {
+    std::string name;
+    unsigned int inputChannels;
+    unsigned int outputChannels;
+    std::function<void(ImageView input, MutableImageView output, MutableImageView scratch)> run;
+    /**
+     * Largest difference per channel to the reference backend accepted by the conformance test.
+     */
+    int tolerance = 0;
+};
+
+/**
+ * @brief The operators timed by cuda_vision_bench, from the separable convolutions to canny.
+ *
+ */
+std::vector<Operator> makeOperators();
+
+/**
+ * @brief Edge cases checked by the conformance test in addition to makeOperators: extreme
+ * sigma, skewed and negative kernels, every border mode and the largest median radius, plus the
+ * components built on the operators: Pipeline::run, streamEdgeDetection, FrameProcessor,
+ * GaussianPyramid, applyTiled, BitImage thresholding and morphology, canny with AutoThreshold and
+ * the histogram primitives. Results that do not have the size of the input are folded into the
+ * output bytes.
+ *
+ */
+std::vector<Operator> makeConformanceOperators();
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "edge_detection/canny.h"
+#include "filter/recursive_gaussian.h"
+#include "synthetic.h"
+#include "util/image.h"
+#include "util/thread_pool.h"
+
+/**
+ * Thread scaling benchmark
+ *
+ * Runs every operator with 1, 2, 4, ... up to N threads and reports the median time per frame,
+ * the speedup over one thread and whether the output is bit-identical to the single-threaded
+ * result.
+ *
+ * Usage: cuda_vision_scaling [image.bmp] [max threads] [iterations]
+ */
+
+struct Operator {
+    std::string name;
+    std::function<Image(const Image&)> run;
+};
+
+static double medianMilliseconds(const Operator& op, const Image& input, int iterations) {
+    std::vector<double> times;
+    for (int i = 0; i < iterations; i++) {
+        auto start = std::chrono::steady_clock::now();
+        Image output = op.run(input);
+        auto stop = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::milli>(stop - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+int main(int argc, char** argv) {
+    Image input = argc > 1 ? Image(argv[1]) : syntheticImage(1920, 1080);
+    unsigned int maxThreads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+    if (maxThreads == 0) {
+        maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    int iterations = argc > 3 ? std::atoi(argv[3]) : 10;
+    Image gray = input.toGrayscale();
+
+    std::vector<Operator> operators = {
+        {"grayscale", [](const Image& image) { return image.toGrayscale(); }},
+        {"gaussianSmooth",
+         [](const Image& image) { return CUDAVISION::gaussianSmooth(image, 5, 20.0); }},
+        {"gaussianSmooth fused",
+         [](const Image& image) {
+             return CUDAVISION::gaussianSmooth(image, 5, 20.0, CUDAVISION::SmoothingMode::Fused);
+         }},
+        {"gaussianBlur IIR",
+         [](const Image& image) {
+             return CUDAVISION::gaussianBlur(image, 10.0, CUDAVISION::GaussianMethod::IIR);
+         }},
+        {"roberts", [&](const Image&) { return CUDAVISION::robertsOperator(gray); }},
+        {"prewitt", [&](const Image&) { return CUDAVISION::prewittOperator(gray); }},
+        {"sobel", [&](const Image&) { return CUDAVISION::sobelOperator(gray); }},
+        {"canny", [&](const Image&) { return CUDAVISION::canny(gray, 50, 100); }},
+    };
+
+    std::cout << input.getWidth() << "x" << input.getHeight() << ", " << iterations
+              << " iterations, median ms per frame" << std::endl;
+    std::cout << std::left << std::setw(24) << "operator" << std::right << std::setw(8)
+              << "threads" << std::setw(10) << "ms" << std::setw(10) << "speedup"
+              << std::setw(12) << "identical" << std::endl;
+    bool allIdentical = true;
+    for (const Operator& op : operators) {
+        CUDAVISION::setThreadCount(1);
+        Image reference = op.run(input);
+        double baseline = 0.0;
+        for (unsigned int threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+            CUDAVISION::setThreadCount(threads);
+            bool identical = op.run(input).getPixels() == reference.getPixels();
+            allIdentical = allIdentical && identical;
+            double ms = medianMilliseconds(op, input, iterations);
+            if (threads == 1) {
+                baseline = ms;
+            }
+            std::cout << std::left << std::setw(24) << op.name << std::right << std::setw(8)
+                      << threads << std::setw(10) << std::fixed << std::setprecision(2) << ms
+                      << std::setw(9) << baseline / ms << "x" << std::setw(12)
+                      << (identical ? "yes" : "NO") << std::endl;
+            if (threads == maxThreads) {
+                break;
+            }
+        }
+    }
+    return allIdentical ? 0 : 1;
+}
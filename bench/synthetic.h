@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "util/image.h"
+
+/**
+ * @brief Creates a deterministic BGR8 test image: gradients, a checkerboard and pseudo-random
+ * noise, so that the operators see both flat areas and edges.
+ *
+ * @param width Width of the image.
+ * @param height Height of the image.
+ *
+ * @return Image The same pixels for the same size on every run and platform.
+ *
+ */
+inline Image syntheticImage(unsigned int width, unsigned int height) {
+    std::vector<unsigned char> pixels(std::size_t{width} * height * 3);
+    unsigned int state = 12345;
+    for (unsigned int y = 0; y < height; y++) {
+        for (unsigned int x = 0; x < width; x++) {
+            state = state * 1103515245 + 12345;
+            unsigned char noise = (state >> 16) & 31;
+            unsigned char* pixel = &pixels[(std::size_t{y} * width + x) * 3];
+            pixel[0] = static_cast<unsigned char>((x * 255) / width) ^ noise;
+            pixel[1] = static_cast<unsigned char>((y * 255) / height) + noise;
+            pixel[2] = ((x / 64 + y / 64) % 2) ? 200 : 40;
+        }
+    }
+    return Image(width, height, std::move(pixels));
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include "filter/separable_convolution.h"
+#include "filter/stencil.h"
+#include "util/bit_image.h"
+#include "util/histogram.h"
 #include "util/image.h"
 
 /**
@@ -11,6 +15,28 @@
  */
 
 namespace CUDAVISION {
+    /**
+     * @enum SmoothingMode
+     *
+     * @brief How gaussianSmooth applies its repeated 1D passes.
+     *
+     */
+    enum class SmoothingMode {
+        /**
+         * @brief Three vertical passes followed by three horizontal passes over the full image.
+         *
+         */
+        Multipass,
+        /**
+         * @brief One pass with the equivalent kernel of the three repeated passes, fused and
+         * cache-blocked (see separableConvolution). Matches Multipass up to rounding in the
+         * interior. Within 3 * (kernelSize / 2) pixels of the border the edge pixels are
+         * replicated once instead of once per pass, so results differ there.
+         *
+         */
+        Fused,
+    };
+
     /**
      * @brief Generates a 1d Gaussian Kernel
      *
@@ -26,6 +52,17 @@ namespace CUDAVISION {
      */
     std::vector<double> getGaussianKernel(int size, double sigma);
 
+    /**
+     * @brief Computes the kernel equivalent to applying a 1d kernel several times in a row.
+     *
+     * @param kernel The 1d kernel.
+     * @param passes Number of times the kernel is applied.
+     *
+     * @return The kernel convolved with itself 'passes' times, of size passes * (K - 1) + 1.
+     *
+     */
+    std::vector<double> getEquivalentKernel(const std::vector<double>& kernel, int passes);
+
     /**
      * @brief Applies a horizontal convolution to an image using a 1D Gaussian kernel.
      *
@@ -36,11 +73,24 @@ namespace CUDAVISION {
      *
      * @note This method applies horizontal convolution with a 1-dimensional Gaussian filter. The
      * convolution is applied to each color channel separately and afterwards the channels are
-     * recombined.
+     * recombined. The kernel is quantized to 16-bit fixed point and applied by the vectorized
+     * engine in filter/separable_convolution.h, results are within 1 of exact rounding down.
      *
      */
     Image horizontalConvolution(const Image& image, const std::vector<double>& kernel);
 
+    /**
+     * @brief Applies a horizontal convolution and writes the result into a caller-provided view.
+     *
+     * @param input The input pixels to be convolved.
+     * @param output View receiving the result. Must have the size and channel count of the input
+     * and must not overlap with it.
+     * @param kernel The 1D Gaussian kernel used for convolution.
+     *
+     */
+    void horizontalConvolution(ImageView input, MutableImageView output,
+                               const std::vector<double>& kernel);
+
     /**
      * @brief Applies a vertical convolution to an image using a 1D Gaussian kernel.
      *
@@ -51,11 +101,24 @@ namespace CUDAVISION {
      *
      * @note This method applies vertical convolution with a 1-dimensional Gaussian filter. The
      * convolution is applied to each color channel separately and afterwards the channels are
-     * recombined.
+     * recombined. The kernel is quantized to 16-bit fixed point and applied by the vectorized
+     * engine in filter/separable_convolution.h, results are within 1 of exact rounding down.
      *
      */
     Image verticalConvolution(const Image& image, const std::vector<double>& kernel);
 
+    /**
+     * @brief Applies a vertical convolution and writes the result into a caller-provided view.
+     *
+     * @param input The input pixels to be convolved.
+     * @param output View receiving the result. Must have the size and channel count of the input
+     * and must not overlap with it.
+     * @param kernel The 1D Gaussian kernel used for convolution.
+     *
+     */
+    void verticalConvolution(ImageView input, MutableImageView output,
+                             const std::vector<double>& kernel);
+
     /**
      * @brief Applies Gaussian smoothing to an image.
      *
@@ -69,16 +132,101 @@ namespace CUDAVISION {
      * 2D-Gaussian Matrix for the convolution, a 1-dimensional convolution on the vertical axis
      * followed by a 1-dimensional convolution on the horizontal axis is performed. This approach is
      * more efficient for larger kernels (O(K) instead of O(K^2)), and can be parallelized more
-     * easily.
+     * easily. Every pass is within 1 of exact rounding down, but the intermediates are 8-bit, so
+     * the differences of the six passes add up: whole calls are within 2 of the double-precision
+     * chain (about 0.1% of the values differ by 2).
      *
      */
     Image gaussianSmooth(const Image& image, int kernelSize, double sigma);
 
+    /**
+     * @brief Applies Gaussian smoothing to an image with the given smoothing mode.
+     *
+     * @param image The input image to be smoothed.
+     * @param kernelSize The size of the 1D Gaussian kernel.
+     * @param sigma The standard deviation of the Gaussian kernel.
+     * @param mode Multipass for the six separate passes, Fused for a single cache-blocked pass.
+     *
+     * @return Image, The resulting image after Gaussian smoothing.
+     *
+     */
+    Image gaussianSmooth(const Image& image, int kernelSize, double sigma, SmoothingMode mode);
+
+    /**
+     * @brief Applies Gaussian smoothing and writes the result into a caller-provided view.
+     *
+     * @param input The input pixels to be smoothed.
+     * @param output View receiving the result. Must have the size and channel count of the input.
+     * @param scratch Intermediate buffer of the same size, used to ping-pong between the passes.
+     * @param kernelSize The size of the 1D Gaussian kernel.
+     * @param sigma The standard deviation of the Gaussian kernel.
+     *
+     * @note None of the three views may overlap. No memory is allocated, the kernel of the last
+     * call is cached per thread.
+     *
+     */
+    void gaussianSmooth(ImageView input, MutableImageView output, MutableImageView scratch,
+                        int kernelSize, double sigma);
+
+    /**
+     * @brief Applies Gaussian smoothing in the Fused mode and writes the result into a
+     * caller-provided view.
+     *
+     * @param input The input pixels to be smoothed.
+     * @param output View receiving the result. Must have the size and channel count of the input
+     * and must not overlap with it.
+     * @param kernelSize The size of the 1D Gaussian kernel.
+     * @param sigma The standard deviation of the Gaussian kernel.
+     *
+     * @note The three vertical and three horizontal passes are folded into one equivalent kernel
+     * of size 3 * (kernelSize - 1) + 1, which is applied by separableConvolution. The input is
+     * read once and the output written once, no intermediate image is needed.
+     *
+     */
+    void gaussianSmoothFused(ImageView input, MutableImageView output, int kernelSize,
+                             double sigma);
+
+    /**
+     * @brief Applies Gaussian smoothing inside a list of rectangles.
+     *
+     * @param image The full input image to be smoothed.
+     * @param regions The rectangles, e.g. {box} for a single one.
+     * @param kernelSize The size of the 1D Gaussian kernel.
+     * @param sigma The standard deviation of the Gaussian kernel.
+     * @param mode Multipass for the six separate passes, Fused for a single cache-blocked pass.
+     *
+     * @return Image The smoothed pixels inside the rectangles, zero elsewhere.
+     *
+     */
+    Image gaussianSmooth(const Image& image, const std::vector<Rect>& regions, int kernelSize,
+                         double sigma, SmoothingMode mode = SmoothingMode::Fused);
+
+    /**
+     * @brief Applies Gaussian smoothing inside a list of rectangles and writes the result into a
+     * caller-provided view.
+     *
+     * @param input The full input pixels to be smoothed.
+     * @param output View of the size and channel count of the input, only the pixels inside the
+     * rectangles are written. Must not overlap with the input.
+     * @param regions The rectangles, e.g. {box} for a single one.
+     * @param kernelSize The size of the 1D Gaussian kernel.
+     * @param sigma The standard deviation of the Gaussian kernel.
+     * @param mode Multipass for the six separate passes, Fused for a single cache-blocked pass.
+     *
+     * @note The pixels within 3 * (kernelSize / 2) around the rectangles are read, so the result
+     * equals gaussianSmooth on the whole image inside the rectangles. See applyRegions().
+     *
+     */
+    void gaussianSmooth(ImageView input, MutableImageView output,
+                        const std::vector<Rect>& regions, int kernelSize, double sigma,
+                        SmoothingMode mode = SmoothingMode::Fused);
+
     /**
      * @brief Applies the Roberts cross edge detector to an image.
      *
      * @param image The input image to process.
-     * @return Image The resulting image showing edge magnitudes.
+     * @return Image The resulting image showing edge magnitudes, in the pixel format of the
+     * input. Gray8 images are processed as a single channel, BGR8 images per channel.
      *
      * @note This method convolves the image with two 2x2 Roberts Kernels:
      * Gx = [1  0]
@@ -88,11 +236,52 @@ namespace CUDAVISION {
      */
     Image robertsOperator(const Image& image);
 
+    /**
+     * @brief Same as robertsOperator(const Image&), writing into a caller-provided view.
+     *
+     * @param input The input pixels to process.
+     * @param output View receiving the edge magnitudes, including the zeroed border. Must have
+     * the size and channel count of the input and must not overlap with it.
+     * @param options Border mode and magnitude, see applyStencil. The defaults give the result
+     * of robertsOperator(const Image&).
+     * @param histogram If set, receives the 256-bin histogram of the output, counted in the
+     * same sweep, e.g. for otsuThreshold().
+     *
+     */
+    void robertsOperator(ImageView input, MutableImageView output,
+                         const StencilOptions& options = {}, Histogram* histogram = nullptr);
+
+    /**
+     * @brief Same as robertsOperator(const Image&) inside a list of rectangles.
+     *
+     * @param image The full input image.
+     * @param regions The rectangles, e.g. {box} for a single one.
+     *
+     * @return Image The edge magnitudes inside the rectangles, zero elsewhere. Inside they equal
+     * those of the whole image, see applyRegions().
+     *
+     */
+    Image robertsOperator(const Image& image, const std::vector<Rect>& regions);
+
+    /**
+     * @brief Same as robertsOperator(ImageView, MutableImageView) inside a list of rectangles.
+     *
+     * @param input The full input pixels.
+     * @param output View of the size and channel count of the input, only the pixels inside the
+     * rectangles are written. Must not overlap with the input.
+     * @param regions The rectangles, e.g. {box} for a single one.
+     * @param options Border mode and magnitude, see applyStencil.
+     *
+     */
+    void robertsOperator(ImageView input, MutableImageView output,
+                         const std::vector<Rect>& regions, const StencilOptions& options = {});
+
     /**
      * @brief Applies the Prewitt edge detector to an image.
      *
      * @param image The input image to process.
-     * @return Image The resulting image showing edge magnitudes.
+     * @return Image The resulting image showing edge magnitudes, in the pixel format of the
+     * input. Gray8 images are processed as a single channel, BGR8 images per channel.
      *
      * @note This method convolves the image with two 3x3 Prewitt Kernels:
      * Gx = [ 1   1   1]
@@ -104,11 +293,52 @@ namespace CUDAVISION {
      */
     Image prewittOperator(const Image& image);
 
+    /**
+     * @brief Same as prewittOperator(const Image&), writing into a caller-provided view.
+     *
+     * @param input The input pixels to process.
+     * @param output View receiving the edge magnitudes, including the zeroed border. Must have
+     * the size and channel count of the input and must not overlap with it.
+     * @param options Border mode and magnitude, see applyStencil. The defaults give the result
+     * of prewittOperator(const Image&).
+     * @param histogram If set, receives the 256-bin histogram of the output, counted in the
+     * same sweep, e.g. for otsuThreshold().
+     *
+     */
+    void prewittOperator(ImageView input, MutableImageView output,
+                         const StencilOptions& options = {}, Histogram* histogram = nullptr);
+
+    /**
+     * @brief Same as prewittOperator(const Image&) inside a list of rectangles.
+     *
+     * @param image The full input image.
+     * @param regions The rectangles, e.g. {box} for a single one.
+     *
+     * @return Image The edge magnitudes inside the rectangles, zero elsewhere. Inside they equal
+     * those of the whole image, see applyRegions().
+     *
+     */
+    Image prewittOperator(const Image& image, const std::vector<Rect>& regions);
+
+    /**
+     * @brief Same as prewittOperator(ImageView, MutableImageView) inside a list of rectangles.
+     *
+     * @param input The full input pixels.
+     * @param output View of the size and channel count of the input, only the pixels inside the
+     * rectangles are written. Must not overlap with the input.
+     * @param regions The rectangles, e.g. {box} for a single one.
+     * @param options Border mode and magnitude, see applyStencil.
+     *
+     */
+    void prewittOperator(ImageView input, MutableImageView output,
+                         const std::vector<Rect>& regions, const StencilOptions& options = {});
+
     /**
      * @brief Applies the Sobel edge detector to an image.
      *
      * @param image The input image to process.
-     * @return Image The resulting image showing edge magnitudes.
+     * @return Image The resulting image showing edge magnitudes, in the pixel format of the
+     * input. Gray8 images are processed as a single channel, BGR8 images per channel.
      *
      * @note This method convolves the image with two 3x3 Sobel Kernels:
      * Gx = [-1   0   1]
@@ -119,4 +349,178 @@ namespace CUDAVISION {
      *      [ 1   2   1]
      */
     Image sobelOperator(const Image& image);
+
+    /**
+     * @brief Same as sobelOperator(const Image&), writing into a caller-provided view.
+     *
+     * @param input The input pixels to process.
+     * @param output View receiving the edge magnitudes, including the zeroed border. Must have
+     * the size and channel count of the input and must not overlap with it.
+     * @param options Border mode and magnitude, see applyStencil. The defaults give the result
+     * of sobelOperator(const Image&).
+     * @param histogram If set, receives the 256-bin histogram of the output, counted in the
+     * same sweep, e.g. for otsuThreshold().
+     *
+     */
+    void sobelOperator(ImageView input, MutableImageView output,
+                       const StencilOptions& options = {}, Histogram* histogram = nullptr);
+
+    /**
+     * @brief Same as sobelOperator(const Image&) inside a list of rectangles.
+     *
+     * @param image The full input image.
+     * @param regions The rectangles, e.g. {box} for a single one.
+     *
+     * @return Image The edge magnitudes inside the rectangles, zero elsewhere. Inside they equal
+     * those of the whole image, see applyRegions().
+     *
+     */
+    Image sobelOperator(const Image& image, const std::vector<Rect>& regions);
+
+    /**
+     * @brief Same as sobelOperator(ImageView, MutableImageView) inside a list of rectangles.
+     *
+     * @param input The full input pixels.
+     * @param output View of the size and channel count of the input, only the pixels inside the
+     * rectangles are written. Must not overlap with the input.
+     * @param regions The rectangles, e.g. {box} for a single one.
+     * @param options Border mode and magnitude, see applyStencil.
+     *
+     */
+    void sobelOperator(ImageView input, MutableImageView output,
+                       const std::vector<Rect>& regions, const StencilOptions& options = {});
+
+    /**
+     * @brief Detects edges with the Canny edge detector.
+     *
+     * @param image The input image, BGR8 images are converted to grayscale first. Smoothing is
+     * not part of this function, apply gaussianSmooth beforehand as needed.
+     * @param lowThreshold Gradient magnitude above which a pixel may continue an edge.
+     * @param highThreshold Gradient magnitude above which a pixel starts an edge.
+     *
+     * @return Image Binary Gray8 edge map, 255 for edge pixels and 0 elsewhere.
+     *
+     * @note The gradient magnitude is the L1 norm |gx| + |gy| of the Sobel responses (range
+     * [0, 2040]). Stages 2 and 3 run fused in a single sweep over the image: each row's Sobel
+     * gx/gy, magnitude and direction (quantized to 0, 45, 90 and 135 degrees) are computed into
+     * rolling int16 row buffers, and non-maximum suppression of the previous row follows
+     * immediately. Hysteresis then grows the strong pixels into the weak ones with an explicit
+     * stack, so large edge maps cannot overflow the call stack.
+     *
+     */
+    Image canny(const Image& image, int lowThreshold, int highThreshold);
+
+    /**
+     * @brief Same as canny(const Image&, int, int), writing into a caller-provided view.
+     *
+     * @param input The Gray8 input pixels.
+     * @param output Gray8 view receiving the edge map. Must have the size of the input and must not
+     * overlap with it.
+     * @param lowThreshold Gradient magnitude above which a pixel may continue an edge.
+     * @param highThreshold Gradient magnitude above which a pixel starts an edge.
+     *
+     */
+    void canny(ImageView input, MutableImageView output, int lowThreshold, int highThreshold);
+
+    /**
+     * @brief Same as canny(ImageView, MutableImageView, int, int), producing a bit-packed edge
+     * map.
+     *
+     * @param input The Gray8 input pixels.
+     * @param output Receives the edge pixels, resized to the input if its size differs.
+     * @param lowThreshold Gradient magnitude above which a pixel may continue an edge.
+     * @param highThreshold Gradient magnitude above which a pixel starts an edge.
+     *
+     * @note The edge states of the hysteresis are packed into words directly, without the
+     * 0 / 255 map of the Gray8 overloads.
+     *
+     */
+    void canny(ImageView input, BitImage& output, int lowThreshold, int highThreshold);
+
+    /**
+     * @enum ThresholdMethod
+     *
+     * @brief How canny selects its high threshold from the gradient magnitudes.
+     *
+     */
+    enum class ThresholdMethod {
+        /**
+         * @brief Otsu's threshold of the magnitude histogram.
+         *
+         */
+        Otsu,
+        /**
+         * @brief The magnitude below which AutoThreshold::percentile percent of the pixels lie.
+         *
+         */
+        Percentile,
+    };
+
+    /**
+     * @struct AutoThreshold
+     *
+     * @brief Automatic selection of the Canny thresholds.
+     *
+     */
+    struct AutoThreshold {
+        /**
+         * @brief Selection of the high threshold.
+         *
+         */
+        ThresholdMethod method = ThresholdMethod::Otsu;
+        /**
+         * @brief Share of non-edge pixels in percent, for ThresholdMethod::Percentile.
+         *
+         */
+        double percentile = 90.0;
+        /**
+         * @brief The low threshold is lowRatio times the high threshold.
+         *
+         */
+        double lowRatio = 0.5;
+    };
+
+    /**
+     * @struct CannyThresholds
+     *
+     * @brief Thresholds selected by canny with AutoThreshold.
+     *
+     */
+    struct CannyThresholds {
+        int low = 0;
+        int high = 0;
+    };
+
+    /**
+     * @brief Detects edges with the Canny edge detector, selecting the thresholds from the
+     * gradient magnitudes of the image.
+     *
+     * @param image The input image (Gray8 or BGR8, converted to grayscale).
+     * @param selection How the thresholds are selected.
+     *
+     * @return Image Binary Gray8 edge map, 255 for edge pixels and 0 elsewhere.
+     *
+     */
+    Image canny(const Image& image, const AutoThreshold& selection);
+
+    /**
+     * @brief Same as canny(const Image&, const AutoThreshold&), writing into a caller-provided
+     * view.
+     *
+     * @param input The Gray8 input pixels.
+     * @param output Gray8 view receiving the edge map. Must have the size of the input and must
+     * not overlap with it.
+     * @param selection How the thresholds are selected.
+     *
+     * @return CannyThresholds The selected thresholds. The edge map equals canny(input, output,
+     * low, high) with them.
+     *
+     * @note The histogram of the magnitudes is counted in the gradient sweep, which also keeps
+     * the column and magnitude of every local maximum in a list per row band, 8 bytes per
+     * maximum. The thresholds are then applied to these lists, so neither the input nor a
+     * full-frame buffer is read a second time.
+     *
+     */
+    CannyThresholds canny(ImageView input, MutableImageView output,
+                          const AutoThreshold& selection);
 }  // namespace CUDAVISION
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "util/image.h"
+
+/**
+ * Median filtering
+ *
+ * The median of the (2r + 1) x (2r + 1) neighborhood removes salt-and-pepper noise without
+ * blurring edges, which makes it the prefilter of choice before the edge operators when the
+ * sensor noise is impulsive rather than Gaussian.
+ *
+ * Radii 1 and 2 select the median with the 19 and 99 compare-exchange sorting networks of
+ * Paeth and Devillard, applied to 16 or 32 pixels at once with byte min / max instructions.
+ * Larger radii use the sliding histograms of Perreault and Hebert ("Median filtering in constant
+ * time", 2007): every column keeps a histogram of its 2r + 1 pixels, updated with one pixel in
+ * and one pixel out per row, and the window histogram moves right by adding one column
+ * histogram and subtracting another. The histograms are split into 16 coarse and 256 fine bins;
+ * the coarse window histogram is updated for every pixel, a block of 16 fine bins only when the
+ * median falls into it. The cost per pixel does not depend on the radius.
+ */
+
+namespace CUDAVISION {
+    /**
+     * @brief Largest radius accepted by medianFilter, the window of 255 x 255 pixels still fits
+     * the 16-bit histogram bins.
+     *
+     */
+    constexpr int MEDIAN_MAX_RADIUS = 127;
+
+    /**
+     * @brief Replaces every pixel by the median of its neighborhood, each channel on its own.
+     *
+     * @param input The input pixels (Gray8 or BGR8).
+     * @param output View receiving the result, same size and channel count as the input. Must
+     * not overlap the input.
+     * @param radius Half the edge length of the square window, 1 for 3 x 3.
+     *
+     * @throws std::invalid_argument If radius is negative or exceeds MEDIAN_MAX_RADIUS.
+     *
+     * @note The image border is extended by replicating the edge pixels, as gaussianSmooth does.
+     * Rows are spread over the thread pool.
+     *
+     */
+    void medianFilter(ImageView input, MutableImageView output, int radius);
+
+    /**
+     * @brief Replaces every pixel of an image by the median of its neighborhood.
+     *
+     * @param image The input image (Gray8 or BGR8).
+     * @param radius Half the edge length of the square window, 1 for 3 x 3.
+     *
+     * @return Image The filtered image.
+     *
+     * @throws std::invalid_argument If radius is negative or exceeds MEDIAN_MAX_RADIUS.
+     *
+     */
+    Image medianFilter(const Image& image, int radius);
+}  // namespace CUDAVISION
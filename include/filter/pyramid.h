@@ -0,0 +1,106 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "filter/separable_convolution.h"
+#include "util/image.h"
+
+/**
+ * Gaussian pyramid
+ *
+ * Level 0 is the input image, every further level is the previous one blurred and decimated by
+ * two in both directions. Blur and decimation are one pass: only the even rows are filtered
+ * vertically and only the even columns of the result are kept, so level i + 1 costs about a
+ * quarter of level i and the whole pyramid about 1.33 blur passes over the input. Levels are
+ * built on first access and all of them share one allocation.
+ */
+
+namespace CUDAVISION {
+    /**
+     * @brief The 5-tap binomial kernel [1 4 6 4 1] / 16, the classic pyramid kernel.
+     *
+     */
+    std::vector<double> getBinomialKernel();
+
+    /**
+     * @class GaussianPyramid
+     *
+     * @brief Lazily built Gaussian pyramid of an image.
+     *
+     */
+    class GaussianPyramid {
+       public:
+        /**
+         * @brief Constructor, no level besides level 0 is computed yet.
+         *
+         * @param image The input image (Gray8 or BGR8), level 0.
+         * @param levelCount Number of levels including level 0. 0 or a larger count than
+         * possible gives all levels down to 1 x 1 pixels.
+         * @param kernel The 1D smoothing kernel applied before decimation.
+         *
+         */
+        explicit GaussianPyramid(Image image, unsigned int levelCount = 0,
+                                 const std::vector<double>& kernel = getBinomialKernel());
+
+        /**
+         * @brief Destructor, returns the level buffer to the pool.
+         *
+         */
+        ~GaussianPyramid();
+
+        GaussianPyramid(const GaussianPyramid&) = delete;
+        GaussianPyramid& operator=(const GaussianPyramid&) = delete;
+
+        /**
+         * @brief Get the number of levels including level 0.
+         *
+         */
+        unsigned int getLevelCount() const { return static_cast<unsigned int>(views.size()); }
+
+        /**
+         * @brief Get a level, computing it and the levels above it if needed.
+         *
+         * @param index Level index, 0 is the input image.
+         *
+         * @return A view valid for the lifetime of the pyramid.
+         *
+         * @note Thread-safe, levels are built once.
+         *
+         */
+        ImageView level(unsigned int index);
+
+        /**
+         * @brief Get a copy of a level as an image.
+         *
+         */
+        Image levelImage(unsigned int index);
+
+        /**
+         * @brief Runs an operator on every level, e.g. sobelOperator or canny.
+         *
+         * @param function Called with the level and a view of the same size receiving the result.
+         * @param format Pixel format of the results.
+         *
+         * @return One result per level, largest first.
+         *
+         * @note Missing levels are built first. The operators run level after level, each
+         * spreading its rows over the thread pool: level 0 carries three quarters of the work,
+         * so parallelizing within a level balances better than running levels side by side.
+         *
+         */
+        std::vector<Image> apply(const std::function<void(ImageView, MutableImageView)>& function,
+                                 PixelFormat format);
+
+       private:
+        void buildLevel(unsigned int index);
+
+        Image base;
+        FixedPointKernel kernel;
+        std::vector<unsigned char> storage;
+        std::vector<MutableImageView> views;
+        unsigned int builtLevels = 1;
+        std::mutex mutex;
+    };
+}  // namespace CUDAVISION
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vector>
+
+#include "util/image.h"
+
+/**
+ * Recursive (IIR) Gaussian filtering
+ *
+ * The Young - van Vliet recursive filter approximates a Gaussian with a causal and an anti-causal
+ * third order IIR filter per axis. Its cost per pixel does not depend on sigma, which makes it
+ * the method of choice for large sigma where an honest FIR kernel needs 6 sigma + 1 taps.
+ */
+
+namespace CUDAVISION {
+    /**
+     * @enum GaussianMethod
+     *
+     * @brief Implementation used by gaussianBlur.
+     *
+     */
+    enum class GaussianMethod {
+        /**
+         * @brief FIR below RECURSIVE_GAUSSIAN_SIGMA_THRESHOLD, IIR from there on.
+         *
+         */
+        Auto,
+        /**
+         * @brief Sampled Gaussian kernel with a radius of ceil(3 sigma), applied by the fused
+         * fixed-point separableConvolution. Cost grows linearly with sigma.
+         *
+         */
+        FIR,
+        /**
+         * @brief Young - van Vliet recursive filter. Constant cost per pixel, valid for
+         * sigma >= 0.5.
+         *
+         */
+        IIR,
+    };
+
+    /**
+     * @brief Sigma from which GaussianMethod::Auto switches from the FIR to the IIR filter.
+     *
+     */
+    constexpr double RECURSIVE_GAUSSIAN_SIGMA_THRESHOLD = 6.0;
+
+    /**
+     * @struct GaussianAccuracy
+     *
+     * @brief Deviation of the IIR filter from the FIR reference, in 8-bit intensity levels.
+     *
+     */
+    struct GaussianAccuracy {
+        /**
+         * @brief Largest absolute difference of any channel.
+         *
+         */
+        int maxError = 0;
+        /**
+         * @brief Mean absolute difference over all channels.
+         *
+         */
+        double meanError = 0.0;
+        /**
+         * @brief Peak signal-to-noise ratio in dB, infinite for identical images.
+         *
+         */
+        double psnr = 0.0;
+    };
+
+    /**
+     * @brief Samples a normalized Gaussian with standard deviation sigma.
+     *
+     * @param radius Number of taps on each side of the center.
+     * @param sigma Standard deviation of the Gaussian.
+     *
+     * @return A kernel of 2 * radius + 1 taps summing to 1.
+     *
+     */
+    std::vector<double> getSampledGaussianKernel(int radius, double sigma);
+
+    /**
+     * @brief Applies the Young - van Vliet recursive Gaussian filter.
+     *
+     * @param input The input pixels (Gray8 or BGR8).
+     * @param output View receiving the result, same size and channel count as the input.
+     * @param sigma Standard deviation of the Gaussian, at least 0.5.
+     *
+     * @note Filtering runs in single precision. The horizontal pass filters blocks of rows
+     * together and the vertical pass sweeps whole rows down and up, so both passes vectorize.
+     * The image border is extended by replicating the edge pixels, with the Triggs - Sdika
+     * initialization of the anti-causal filter.
+     *
+     */
+    void recursiveGaussian(ImageView input, MutableImageView output, double sigma);
+
+    /**
+     * @brief Applies the Young - van Vliet recursive Gaussian filter to an image.
+     *
+     * @param image The input image (Gray8 or BGR8).
+     * @param sigma Standard deviation of the Gaussian, at least 0.5.
+     *
+     * @return Image The blurred image.
+     *
+     */
+    Image recursiveGaussian(const Image& image, double sigma);
+
+    /**
+     * @brief Blurs an image with a true Gaussian of standard deviation sigma.
+     *
+     * @param image The input image (Gray8 or BGR8).
+     * @param sigma Standard deviation of the Gaussian.
+     * @param method FIR, IIR, or Auto to choose by sigma.
+     *
+     * @return Image The blurred image.
+     *
+     * @note Unlike gaussianSmooth, the kernel size follows from sigma, so large sigma are honored.
+     *
+     */
+    Image gaussianBlur(const Image& image, double sigma,
+                       GaussianMethod method = GaussianMethod::Auto);
+
+    /**
+     * @brief Compares the IIR filter against the FIR filter on an image.
+     *
+     * @param image The test image.
+     * @param sigma Standard deviation of the Gaussian.
+     *
+     * @return GaussianAccuracy Error of gaussianBlur(IIR) relative to gaussianBlur(FIR).
+     *
+     */
+    GaussianAccuracy measureRecursiveGaussianAccuracy(const Image& image, double sigma);
+}  // namespace CUDAVISION
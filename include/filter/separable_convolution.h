@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "util/image_view.h"
+
+class TiledImage;
+
+/**
+ * Fixed-point separable convolution engine
+ *
+ * The 1D kernels are quantized to 16-bit fixed point with FIXED_POINT_SHIFT fractional bits and
+ * applied with integer multiply-accumulate (uint8 x int16 -> int32). The inner loops are
+ * vectorized with SSE2, AVX2 or AVX-512, the instruction set is chosen at runtime (see
+ * util/cpu_features.h). Border pixels are replicated once per row (horizontal) or resolved to
+ * row pointers once per output row (vertical), so the inner loops never clamp.
+ */
+
+namespace CUDAVISION {
+    /**
+     * @brief Number of fractional bits of the fixed-point kernel weights.
+     *
+     */
+    constexpr int FIXED_POINT_SHIFT = 14;
+
+    /**
+     * @struct FixedPointKernel
+     *
+     * @brief A 1D convolution kernel quantized to 16-bit fixed point.
+     *
+     */
+    struct FixedPointKernel {
+        /**
+         * @brief Quantized weights, the real weight is weights[k] / 2^FIXED_POINT_SHIFT.
+         *
+         */
+        std::vector<int16_t> weights;
+        /**
+         * @brief Consecutive weights packed as (weights[2k], weights[2k + 1]) int16 pairs, the
+         * layout consumed by the vectorized multiply-add. Odd kernels are padded with a zero.
+         *
+         */
+        std::vector<int32_t> weightPairs;
+
+        /**
+         * @brief Quantizes a floating point kernel. The weights are rounded and the center tap is
+         * corrected so that a normalized kernel sums to exactly 2^FIXED_POINT_SHIFT.
+         *
+         * @param kernel The floating point kernel, e.g. from getGaussianKernel.
+         *
+         * @return FixedPointKernel The quantized kernel.
+         *
+         */
+        static FixedPointKernel fromKernel(const std::vector<double>& kernel);
+
+        /**
+         * @brief Number of taps on each side of the center tap.
+         *
+         */
+        int radius() const { return static_cast<int>(weights.size()) / 2; }
+    };
+
+    /**
+     * @brief Computes dst[x] = sum_k weights[k] * sources[k][x] >> FIXED_POINT_SHIFT, saturated
+     * to [0, 255], for x in [0, count).
+     *
+     * @param sources One source pointer per kernel tap.
+     * @param kernel The fixed-point kernel.
+     * @param dst Destination of count bytes.
+     * @param count Number of bytes to compute.
+     *
+     * @note This is the inner loop shared by the horizontal and the vertical pass.
+     *
+     */
+    void convolveTaps(const unsigned char* const* sources, const FixedPointKernel& kernel,
+                      unsigned char* dst, std::size_t count);
+
+    /**
+     * @brief Convolves the pixels [begin, end) of one row horizontally, replicating the pixels at
+     * the image border.
+     *
+     * @param src Source row of width * channels bytes.
+     * @param dst Destination of (end - begin) * channels bytes.
+     * @param width Number of pixels in the row.
+     * @param channels Number of interleaved channels.
+     * @param begin First pixel to compute.
+     * @param end One past the last pixel to compute.
+     * @param kernel The fixed-point kernel.
+     *
+     */
+    void convolveSegmentHorizontal(const unsigned char* src, unsigned char* dst,
+                                   unsigned int width, unsigned int channels, unsigned int begin,
+                                   unsigned int end, const FixedPointKernel& kernel);
+
+    /**
+     * @brief Convolves one row of interleaved pixels horizontally, replicating the border pixels.
+     *
+     * @param src Source row of width * channels bytes.
+     * @param dst Destination row of width * channels bytes.
+     * @param width Number of pixels in the row.
+     * @param channels Number of interleaved channels.
+     * @param kernel The fixed-point kernel.
+     *
+     */
+    void convolveRowHorizontal(const unsigned char* src, unsigned char* dst, unsigned int width,
+                               unsigned int channels, const FixedPointKernel& kernel);
+
+    /**
+     * @brief Applies a fixed-point horizontal convolution to a view.
+     *
+     * @param input The input pixels.
+     * @param output View receiving the result, same size and channel count as the input.
+     * @param kernel The fixed-point kernel.
+     *
+     */
+    void horizontalConvolution(ImageView input, MutableImageView output,
+                               const FixedPointKernel& kernel);
+
+    /**
+     * @brief Applies a fixed-point vertical convolution to a view, replicating the border rows.
+     *
+     * @param input The input pixels.
+     * @param output View receiving the result, same size and channel count as the input.
+     * @param kernel The fixed-point kernel.
+     *
+     */
+    void verticalConvolution(ImageView input, MutableImageView output,
+                             const FixedPointKernel& kernel);
+
+    /**
+     * @brief Applies a horizontal and then a vertical convolution in a single fused pass.
+     *
+     * @param input The input pixels.
+     * @param output View receiving the result, same size and channel count as the input. Must not
+     * overlap with the input.
+     * @param horizontal The fixed-point kernel of the horizontal pass.
+     * @param vertical The fixed-point kernel of the vertical pass.
+     *
+     * @note The image is processed in column strips. Within a strip, every input row is filtered
+     * horizontally once into a ring buffer of K rows, which the vertical pass combines into the
+     * output row. The input is read once and the output written once, without a full-size
+     * intermediate image.
+     *
+     */
+    void separableConvolution(ImageView input, MutableImageView output,
+                              const FixedPointKernel& horizontal, const FixedPointKernel& vertical);
+
+    /**
+     * @brief Applies a fixed-point horizontal convolution to a tiled image.
+     *
+     * @param input The input image.
+     * @param output Image of the same size, channel count and tile size receiving the result.
+     * @param kernel The fixed-point kernel.
+     *
+     * @throws std::invalid_argument If the images differ in size, channels or tiling.
+     *
+     */
+    void horizontalConvolution(const TiledImage& input, TiledImage& output,
+                               const FixedPointKernel& kernel);
+
+    /**
+     * @brief Applies a fixed-point vertical convolution to a tiled image, replicating the border
+     * rows.
+     *
+     * @param input The input image.
+     * @param output Image of the same size, channel count and tile size receiving the result.
+     * @param kernel The fixed-point kernel.
+     *
+     * @throws std::invalid_argument If the images differ in size, channels or tiling.
+     *
+     * @note The taps of an output row are rows of the same tile column, read in place from the
+     * tiles above and below. Tiles are visited column by column, so the rows shared by
+     * vertically neighboring tiles are still cached.
+     *
+     */
+    void verticalConvolution(const TiledImage& input, TiledImage& output,
+                             const FixedPointKernel& kernel);
+
+    /**
+     * @brief Applies a horizontal and a vertical convolution to a tiled image, tile by tile.
+     *
+     * @param input The input image.
+     * @param output Image of the same size, channel count and tile size receiving the result.
+     * @param horizontal The fixed-point kernel of the horizontal pass.
+     * @param vertical The fixed-point kernel of the vertical pass.
+     *
+     * @throws std::invalid_argument If the images differ in size, channels or tiling.
+     *
+     */
+    void separableConvolution(const TiledImage& input, TiledImage& output,
+                              const FixedPointKernel& horizontal, const FixedPointKernel& vertical);
+}  // namespace CUDAVISION
@@ -0,0 +1,621 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "util/histogram.h"
+#include "util/image_view.h"
+#include "util/region.h"
+#include "util/thread_pool.h"
+#include "util/tiled_image.h"
+
+/**
+ * Stencil engine
+ *
+ * Applies small integer kernels whose coefficients are known at compile time. A stencil is a
+ * type with an odd static constexpr int size and a row-major std::array<int, size * size> x;
+ * gradient stencils add a second kernel y and output the magnitude of (x, y) per pixel and
+ * channel, other stencils output the absolute response. The taps are unrolled, zero taps are
+ * removed at compile time, and kernels of rank one (Sobel, Prewitt, Scharr, binomial blurs)
+ * are split into a vertical and a horizontal 1D pass when that needs fewer taps.
+ *
+ * Every input row is copied once into a padded row whose border pixels follow the border mode,
+ * so the inner loops have no bounds checks. A new stencil only needs its coefficients:
+ *
+ *     struct MyStencil {
+ *         static constexpr int size = 3;
+ *         static constexpr std::array<int, 9> x = {...};
+ *     };
+ *     applyStencil<MyStencil>(input, output, {BorderMode::Reflect, 0, Magnitude::L1});
+ *
+ * 8-bit outputs saturate the magnitude at 255. An int32_t output view receives it unsaturated,
+ * which Magnitude::Squared requires.
+ */
+
+namespace CUDAVISION {
+    /**
+     * @enum BorderMode
+     *
+     * @brief How a stencil treats pixels outside of the image.
+     *
+     */
+    enum class BorderMode {
+        /**
+         * @brief Output pixels whose stencil reaches outside of the image are set to zero, the
+         * behaviour of the classic edge operators.
+         *
+         */
+        Zero,
+        /**
+         * @brief Pixels outside of the image have the value StencilOptions::borderValue.
+         *
+         */
+        Constant,
+        /**
+         * @brief Pixels outside of the image repeat the nearest edge pixel (aaa|abcd|ddd).
+         *
+         */
+        Replicate,
+        /**
+         * @brief Pixels outside of the image mirror the image around the edge pixel
+         * (cb|abcd|cb).
+         *
+         */
+        Reflect,
+    };
+
+    /**
+     * @enum Magnitude
+     *
+     * @brief How the responses of a stencil are combined into the output value.
+     *
+     */
+    enum class Magnitude {
+        /**
+         * @brief sqrt(gx^2 + gy^2), rounded down. For single-kernel stencils |r|.
+         *
+         */
+        L2,
+        /**
+         * @brief |gx| + |gy|, cheaper and the usual approximation of L2.
+         *
+         */
+        L1,
+        /**
+         * @brief gx^2 + gy^2 without the root, to compare against squared thresholds. Only for
+         * int32_t output views, an 8-bit output would saturate nearly every edge.
+         *
+         */
+        Squared,
+    };
+
+    /**
+     * @struct StencilOptions
+     *
+     * @brief Border handling and output of applyStencil.
+     *
+     */
+    struct StencilOptions {
+        /**
+         * @brief Treatment of the pixels outside of the image.
+         *
+         */
+        BorderMode border = BorderMode::Zero;
+        /**
+         * @brief Value of the pixels outside of the image for BorderMode::Constant.
+         *
+         */
+        unsigned char borderValue = 0;
+        /**
+         * @brief Combination of the responses, saturated to [0, 255] in 8-bit outputs.
+         *
+         */
+        Magnitude magnitude = Magnitude::L2;
+    };
+
+    /**
+     * @brief The 2x2 Roberts cross, anchored at its top left tap.
+     *
+     */
+    struct RobertsStencil {
+        static constexpr int size = 3;
+        static constexpr std::array<int, 9> x = {0, 0, 0, 0, 1, 0, 0, 0, -1};
+        static constexpr std::array<int, 9> y = {0, 0, 0, 0, 0, 1, 0, -1, 0};
+    };
+
+    /**
+     * @brief The 3x3 Prewitt operator.
+     *
+     */
+    struct PrewittStencil {
+        static constexpr int size = 3;
+        static constexpr std::array<int, 9> x = {1, 1, 1, 0, 0, 0, -1, -1, -1};
+        static constexpr std::array<int, 9> y = {1, 0, -1, 1, 0, -1, 1, 0, -1};
+    };
+
+    /**
+     * @brief The 3x3 Sobel operator.
+     *
+     */
+    struct SobelStencil {
+        static constexpr int size = 3;
+        static constexpr std::array<int, 9> x = {-1, 0, 1, -2, 0, 2, -1, 0, 1};
+        static constexpr std::array<int, 9> y = {-1, -2, -1, 0, 0, 0, 1, 2, 1};
+    };
+
+    /**
+     * @brief The 3x3 Scharr operator, a Sobel variant with better rotational symmetry.
+     *
+     */
+    struct ScharrStencil {
+        static constexpr int size = 3;
+        static constexpr std::array<int, 9> x = {-3, 0, 3, -10, 0, 10, -3, 0, 3};
+        static constexpr std::array<int, 9> y = {-3, -10, -3, 0, 0, 0, 3, 10, 3};
+    };
+
+    /**
+     * @brief The 3x3 Laplacian with 4-connected neighbours.
+     *
+     */
+    struct LaplacianStencil {
+        static constexpr int size = 3;
+        static constexpr std::array<int, 9> x = {0, 1, 0, 1, -4, 1, 0, 1, 0};
+    };
+
+    /**
+     * @brief The 5x5 Laplacian of Gaussian.
+     *
+     */
+    struct LaplacianOfGaussianStencil {
+        static constexpr int size = 5;
+        static constexpr std::array<int, 25> x = {0,  0,  -1, 0,  0,  0,  -1, -2, -1,
+                                                  0,  -1, -2, 16, -2, -1, 0,  -1, -2,
+                                                  -1, 0,  0,  0,  -1, 0,  0};
+    };
+
+    namespace detail {
+        /**
+         * Padded copies of the input rows a band of output rows needs. Row y is copied once,
+         * with radius pixels on both sides following the border mode, and kept until the
+         * stencil has moved past it.
+         */
+        class StencilRowCache {
+           public:
+            void reset(ImageView input, int radius, const StencilOptions& options);
+
+            /**
+             * Same for a window of an image of imageHeight rows, whose row 0 is row firstRow of
+             * the image, e.g. the tile buffer of a pipeline step. rows(y) takes image rows and
+             * must only reach rows inside the window.
+             */
+            void reset(ImageView input, int radius, const StencilOptions& options, int firstRow,
+                       int imageHeight);
+
+            /**
+             * Pointers to the padded rows y - radius ... y + radius, each at column 0.
+             */
+            const unsigned char* const* rows(int y);
+
+           private:
+            ImageView input;
+            int radius = 0;
+            StencilOptions options;
+            int firstRow = 0;
+            int imageHeight = 0;
+            std::size_t paddedElements = 0;
+            std::vector<unsigned char> buffer;
+            std::vector<int> tags;
+            std::vector<const unsigned char*> pointers;
+        };
+
+        /**
+         * floor(sqrt(s)) for s < 65536.
+         */
+        const unsigned char* squareRootTable();
+
+        template <std::size_t N, typename F>
+        inline void unroll(F&& f) {
+            [&]<std::size_t... I>(std::index_sequence<I...>) {
+                (f(std::integral_constant<std::size_t, I>{}), ...);
+            }(std::make_index_sequence<N>{});
+        }
+
+        template <std::size_t N>
+        constexpr int nonZeroTaps(const std::array<int, N>& taps) {
+            int count = 0;
+            for (int tap : taps) {
+                count += tap != 0;
+            }
+            return count;
+        }
+
+        template <std::size_t N>
+        struct SeparableFactors {
+            bool separable = false;
+            std::array<int, N> column{};
+            std::array<int, N> row{};
+        };
+
+        /**
+         * Splits a kernel of rank one into column x row, the row reduced by the gcd of its
+         * entries so that the column stays integral.
+         */
+        template <std::size_t N>
+        constexpr SeparableFactors<N> factorize(const std::array<int, N * N>& weights) {
+            SeparableFactors<N> factors;
+            std::size_t pivot = 0;
+            while (pivot < N * N && weights[pivot] == 0) {
+                pivot++;
+            }
+            if (pivot == N * N) {
+                return factors;
+            }
+            const std::size_t pivotRow = pivot / N;
+            const std::size_t pivotColumn = pivot % N;
+            int divisor = 0;
+            for (std::size_t j = 0; j < N; j++) {
+                divisor = std::gcd(divisor, weights[pivotRow * N + j]);
+            }
+            for (std::size_t j = 0; j < N; j++) {
+                factors.row[j] = weights[pivotRow * N + j] / divisor;
+            }
+            for (std::size_t i = 0; i < N; i++) {
+                if (weights[i * N + pivotColumn] % factors.row[pivotColumn] != 0) {
+                    return factors;
+                }
+                factors.column[i] = weights[i * N + pivotColumn] / factors.row[pivotColumn];
+            }
+            for (std::size_t i = 0; i < N * N; i++) {
+                if (factors.column[i / N] * factors.row[i % N] != weights[i]) {
+                    return factors;
+                }
+            }
+            factors.separable =
+                nonZeroTaps(factors.column) + nonZeroTaps(factors.row) < nonZeroTaps(weights);
+            return factors;
+        }
+
+        /**
+         * Rows, columns above/left (negative) and below/right of the center that the nonzero
+         * taps of a kernel reach: {top, bottom, left, right}.
+         */
+        template <std::size_t N>
+        constexpr std::array<int, 4> reach(const std::array<int, N * N>& weights) {
+            const int radius = N / 2;
+            std::array<int, 4> extent = {0, 0, 0, 0};
+            for (std::size_t i = 0; i < N * N; i++) {
+                if (weights[i] != 0) {
+                    const int dy = static_cast<int>(i / N) - radius;
+                    const int dx = static_cast<int>(i % N) - radius;
+                    extent = {std::min(extent[0], dy), std::max(extent[1], dy),
+                              std::min(extent[2], dx), std::max(extent[3], dx)};
+                }
+            }
+            return extent;
+        }
+
+        /**
+         * dst[j] = sum_i column[i] * rows[i][j] for j in [begin, end).
+         */
+        template <std::size_t N, std::array<int, N> Column>
+        inline void verticalPass(const unsigned char* const* rows, int32_t* dst,
+                                 std::ptrdiff_t begin, std::ptrdiff_t end) {
+            for (std::ptrdiff_t j = begin; j < end; j++) {
+                int32_t sum = 0;
+                unroll<N>([&](auto i) {
+                    if constexpr (Column[i] != 0) {
+                        sum += Column[i] * rows[i][j];
+                    }
+                });
+                dst[j] = sum;
+            }
+        }
+
+        /**
+         * dst[j] = sum_k row[k] * src[j + (k - radius) * channels] for j in [0, count).
+         */
+        template <std::size_t N, std::array<int, N> Row>
+        inline void horizontalPass(const int32_t* src, int32_t* dst, std::ptrdiff_t count,
+                                   std::ptrdiff_t channels) {
+            constexpr std::ptrdiff_t radius = N / 2;
+            for (std::ptrdiff_t j = 0; j < count; j++) {
+                int32_t sum = 0;
+                unroll<N>([&](auto k) {
+                    if constexpr (Row[k] != 0) {
+                        constexpr std::ptrdiff_t dx = static_cast<std::ptrdiff_t>(k) - radius;
+                        sum += Row[k] * src[j + dx * channels];
+                    }
+                });
+                dst[j] = sum;
+            }
+        }
+
+        /**
+         * dst[j] = sum_{i,k} weights[i][k] * rows[i][j + (k - radius) * channels].
+         */
+        template <std::size_t N, std::array<int, N * N> Weights>
+        inline void directPass(const unsigned char* const* rows, int32_t* dst,
+                               std::ptrdiff_t count, std::ptrdiff_t channels) {
+            constexpr std::ptrdiff_t radius = N / 2;
+            for (std::ptrdiff_t j = 0; j < count; j++) {
+                int32_t sum = 0;
+                unroll<N * N>([&](auto t) {
+                    if constexpr (Weights[t] != 0) {
+                        constexpr std::ptrdiff_t dx = static_cast<std::ptrdiff_t>(t % N) - radius;
+                        sum += Weights[t] * rows[t / N][j + dx * channels];
+                    }
+                });
+                dst[j] = sum;
+            }
+        }
+
+        /**
+         * Response of one kernel for a row of count elements. scratch holds the vertical pass
+         * of a separable kernel, including radius pixels on both sides.
+         */
+        template <std::size_t N, std::array<int, N * N> Weights>
+        inline void response(const unsigned char* const* rows, int32_t* scratch, int32_t* dst,
+                             std::ptrdiff_t count, std::ptrdiff_t channels) {
+            constexpr SeparableFactors<N> factors = factorize<N>(Weights);
+            if constexpr (factors.separable) {
+                constexpr std::ptrdiff_t halo = N / 2;
+                verticalPass<N, factors.column>(rows, scratch, -halo * channels,
+                                                count + halo * channels);
+                horizontalPass<N, factors.row>(scratch, dst, count, channels);
+            } else {
+                directPass<N, Weights>(rows, dst, count, channels);
+            }
+        }
+
+        template <typename Stencil>
+        concept GradientStencil = requires { Stencil::y; };
+
+        /**
+         * Saturated magnitude of the responses, see Magnitude. Squared is rejected by
+         * applyStencil before.
+         */
+        template <bool Gradient>
+        inline void combine(const int32_t* gx, const int32_t* gy, unsigned char* dst,
+                            std::ptrdiff_t count, Magnitude magnitude) {
+            const unsigned char* roots = squareRootTable();
+            if (magnitude == Magnitude::L1) {
+                for (std::ptrdiff_t j = 0; j < count; j++) {
+                    int32_t sum = std::abs(gx[j]);
+                    if constexpr (Gradient) {
+                        sum += std::abs(gy[j]);
+                    }
+                    dst[j] = static_cast<unsigned char>(std::min(sum, 255));
+                }
+                return;
+            }
+            for (std::ptrdiff_t j = 0; j < count; j++) {
+                if constexpr (Gradient) {
+                    const uint32_t s = static_cast<uint32_t>(gx[j] * gx[j] + gy[j] * gy[j]);
+                    dst[j] = s < 65536 ? roots[s] : 255;
+                } else {
+                    dst[j] = static_cast<unsigned char>(std::min(std::abs(gx[j]), 255));
+                }
+            }
+        }
+
+        /**
+         * Unsaturated magnitude of the responses. Even Scharr's squared gradient, at most
+         * 2 * 4080^2, fits into 32 bits.
+         */
+        template <bool Gradient>
+        inline void combine(const int32_t* gx, const int32_t* gy, int32_t* dst,
+                            std::ptrdiff_t count, Magnitude magnitude) {
+            for (std::ptrdiff_t j = 0; j < count; j++) {
+                int32_t s = 0;
+                if constexpr (Gradient) {
+                    s = magnitude == Magnitude::L1 ? std::abs(gx[j]) + std::abs(gy[j])
+                                                   : gx[j] * gx[j] + gy[j] * gy[j];
+                } else {
+                    s = magnitude == Magnitude::L1 ? std::abs(gx[j]) : gx[j] * gx[j];
+                }
+                if (magnitude == Magnitude::L2) {
+                    // Exact: the double root of an integer below 2^52 never rounds up to the
+                    // next integer.
+                    s = static_cast<int32_t>(std::sqrt(static_cast<double>(s)));
+                }
+                dst[j] = s;
+            }
+        }
+
+        /**
+         * Rows and columns {top, bottom, left, right} the taps of a stencil reach.
+         */
+        template <typename Stencil>
+        constexpr std::array<int, 4> stencilExtent() {
+            constexpr std::size_t N = Stencil::size;
+            std::array<int, 4> extent = reach<N>(Stencil::x);
+            if constexpr (GradientStencil<Stencil>) {
+                const std::array<int, 4> other = reach<N>(Stencil::y);
+                extent = {std::min(extent[0], other[0]), std::max(extent[1], other[1]),
+                          std::min(extent[2], other[2]), std::max(extent[3], other[3])};
+            }
+            return extent;
+        }
+
+        /**
+         * Per-thread state of a stencil sweep: the padded rows and the responses of one row.
+         * Several stencils of the same radius reading the same rows may share it.
+         */
+        struct StencilBuffers {
+            StencilRowCache cache;
+            std::vector<int32_t> scratch;
+            std::vector<int32_t> gx;
+            std::vector<int32_t> gy;
+        };
+
+        /**
+         * Computes output row y of an image of width x height pixels from the padded rows in
+         * buffers.cache. In Zero mode, pixels whose stencil leaves the image are set to zero.
+         */
+        template <typename Stencil, typename T>
+        inline void stencilRow(StencilBuffers& buffers, int y, int width, int height,
+                               int channels, const StencilOptions& options, T* dst) {
+            constexpr std::size_t N = Stencil::size;
+            constexpr int radius = Stencil::size / 2;
+            constexpr bool gradient = GradientStencil<Stencil>;
+            constexpr std::array<int, 4> extent = stencilExtent<Stencil>();
+            const std::ptrdiff_t count = std::ptrdiff_t{width} * channels;
+            const bool zero = options.border == BorderMode::Zero;
+            if (zero && (y < -extent[0] || y >= height - extent[1])) {
+                std::fill_n(dst, count, 0);
+                return;
+            }
+            buffers.scratch.resize(count + 2 * radius * channels);
+            buffers.gx.resize(count);
+            buffers.gy.resize(count);
+            const unsigned char* const* rows = buffers.cache.rows(y);
+            int32_t* vertical = buffers.scratch.data() + radius * channels;
+            response<N, Stencil::x>(rows, vertical, buffers.gx.data(), count, channels);
+            if constexpr (gradient) {
+                response<N, Stencil::y>(rows, vertical, buffers.gy.data(), count, channels);
+            }
+            combine<gradient>(buffers.gx.data(), buffers.gy.data(), dst, count,
+                              options.magnitude);
+            if (zero) {
+                const int firstColumn = std::min(-extent[2], width);
+                const int lastColumn = std::max(width - extent[3], firstColumn);
+                std::fill_n(dst, firstColumn * channels, 0);
+                std::fill(dst + lastColumn * channels, dst + count, 0);
+            }
+        }
+
+        /**
+         * The row-band sweep of both applyStencil overloads.
+         */
+        template <typename Stencil, typename T>
+        void sweepStencil(ImageView input, BasicImageView<T> output,
+                          const StencilOptions& options, Histogram* histogram) {
+            static_assert(Stencil::size % 2 == 1, "stencils have an odd size");
+            const int width = input.width;
+            const int height = input.height;
+            if (width == 0 || height == 0) {
+                return;
+            }
+            if (histogram) {
+                histogram->assign(256, 0);
+            }
+            std::mutex histogramMutex;
+            parallelForRows(height, [&](unsigned int begin, unsigned int end) {
+                thread_local StencilBuffers buffers;
+                buffers.cache.reset(input, Stencil::size / 2, options);
+                HistogramAccumulator accumulator(histogram ? 256 : 1);
+                for (int y = begin; y < static_cast<int>(end); y++) {
+                    stencilRow<Stencil>(buffers, y, width, height, input.channels, options,
+                                        output.row(y));
+                    if constexpr (std::is_same_v<T, unsigned char>) {
+                        if (histogram) {
+                            accumulator.add(output.row(y), output.rowElements());
+                        }
+                    }
+                }
+                if (histogram) {
+                    std::lock_guard<std::mutex> lock(histogramMutex);
+                    accumulator.addTo(*histogram);
+                }
+            });
+        }
+    }  // namespace detail
+
+    /**
+     * @brief Applies a stencil to every pixel and channel of a view.
+     *
+     * @tparam Stencil The stencil, see the predefined stencils above.
+     *
+     * @param input The input pixels (Gray8 or BGR8).
+     * @param output View receiving the result. Must have the size and channel count of the
+     * input and must not overlap with it.
+     * @param options Border mode and magnitude, L2 or L1.
+     * @param histogram If set, receives the 256-bin histogram of the output, e.g. for
+     * otsuThreshold(). It is counted from the rows while they are still in cache.
+     *
+     * @throws std::invalid_argument For Magnitude::Squared, see the int32_t overload.
+     *
+     * @note With the defaults the result is identical to the classic loops of robertsOperator,
+     * prewittOperator and sobelOperator. Rows are processed in parallel bands.
+     *
+     */
+    template <typename Stencil>
+    void applyStencil(ImageView input, MutableImageView output,
+                      const StencilOptions& options = {}, Histogram* histogram = nullptr) {
+        if (options.magnitude == Magnitude::Squared) {
+            throw std::invalid_argument("Magnitude::Squared needs an int32_t output view");
+        }
+        detail::sweepStencil<Stencil>(input, output, options, histogram);
+    }
+
+    /**
+     * @brief Same as applyStencil(ImageView, MutableImageView), writing the magnitudes
+     * unsaturated into 32-bit integers.
+     *
+     * @param input The input pixels (Gray8 or BGR8).
+     * @param output View of the size and channel count of the input receiving the magnitudes,
+     * e.g. gx^2 + gy^2 with Magnitude::Squared.
+     * @param options Border mode and magnitude.
+     *
+     */
+    template <typename Stencil>
+    void applyStencil(ImageView input, BasicImageView<int32_t> output,
+                      const StencilOptions& options = {}) {
+        detail::sweepStencil<Stencil>(input, output, options, nullptr);
+    }
+
+    /**
+     * @brief Applies a stencil inside a list of rectangles of a view.
+     *
+     * @tparam Stencil The stencil, see the predefined stencils above.
+     *
+     * @param input The full input image (Gray8 or BGR8).
+     * @param output View of the size and channel count of the input, only the pixels inside the
+     * rectangles are written.
+     * @param regions The rectangles, e.g. {box} for a single one.
+     * @param options Border mode and magnitude.
+     *
+     * @note Identical to applyStencil on the whole view inside the rectangles, see
+     * applyRegions().
+     *
+     */
+    template <typename Stencil>
+    void applyStencil(ImageView input, MutableImageView output, const std::vector<Rect>& regions,
+                      const StencilOptions& options = {}) {
+        constexpr unsigned int radius = Stencil::size / 2;
+        applyRegions(input, output, regions, radius, [&](ImageView in, MutableImageView out) {
+            applyStencil<Stencil>(in, out, options);
+        });
+    }
+
+    /**
+     * @brief Applies a stencil to a tiled image, tile by tile on the thread pool.
+     *
+     * @tparam Stencil The stencil, see the predefined stencils above.
+     *
+     * @param input The input image (1 or 3 channels).
+     * @param output Image of the same size, channel count and tile size receiving the result.
+     * @param options Border mode and magnitude.
+     *
+     * @note Identical to applyStencil on the linear image, see applyTiled().
+     *
+     */
+    template <typename Stencil>
+    void applyStencil(const TiledImage& input, TiledImage& output,
+                      const StencilOptions& options = {}) {
+        constexpr unsigned int radius = Stencil::size / 2;
+        applyTiled(input, output, radius, radius, [&](ImageView in, MutableImageView out) {
+            applyStencil<Stencil>(in, out, options);
+        });
+    }
+}  // namespace CUDAVISION
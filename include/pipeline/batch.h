@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "util/bit_image.h"
+#include "util/image.h"
+
+/**
+ * Batch execution
+ *
+ * Processes many bitmaps with three stages running concurrently: a reader thread maps and decodes
+ * the next inputs, the compute stage runs the operators (which use the thread pool), and a writer
+ * thread encodes and writes the finished results. The stages are connected by bounded queues, so
+ * disk I/O of one image overlaps the computation of the next ones while at most a fixed number of
+ * images is held in memory. An image that fails in any stage is reported and skipped, the rest of
+ * the batch continues.
+ */
+
+namespace CUDAVISION {
+    /**
+     * @struct BatchOutput
+     *
+     * @brief One named result of the per-image computation.
+     *
+     */
+    struct BatchOutput {
+        /**
+         * @brief Suffix of the output file, <input stem>_<name>.bmp.
+         *
+         */
+        std::string name;
+        /**
+         * @brief The result image. A BitImage is written as a 1 bpp bitmap, e.g. for edge maps.
+         *
+         */
+        std::variant<Image, BitImage> image;
+    };
+
+    /**
+     * @brief The per-image computation of a batch. May throw to fail a single image.
+     *
+     */
+    using BatchFunction = std::function<std::vector<BatchOutput>(const Image&)>;
+
+    /**
+     * @struct BatchOptions
+     *
+     * @brief Parameters of runBatch.
+     *
+     */
+    struct BatchOptions {
+        /**
+         * @brief Capacity of each of the two queues between the stages.
+         *
+         */
+        unsigned int queueDepth = 4;
+    };
+
+    /**
+     * @struct BatchStatistics
+     *
+     * @brief Summary of a runBatch call.
+     *
+     */
+    struct BatchStatistics {
+        /**
+         * @brief Number of images processed and written successfully.
+         *
+         */
+        std::size_t succeeded = 0;
+        /**
+         * @brief Number of images that failed in any stage.
+         *
+         */
+        std::size_t failed = 0;
+        /**
+         * @brief Wall-clock time of the whole batch in seconds.
+         *
+         */
+        double seconds = 0.0;
+        /**
+         * @brief Total input pixels of the successful images, in millions.
+         *
+         */
+        double megapixels = 0.0;
+        /**
+         * @brief Median time from the start of reading an image to the end of writing its
+         * results, in milliseconds.
+         *
+         */
+        double p50Milliseconds = 0.0;
+        /**
+         * @brief 99th percentile of the same latency, in milliseconds.
+         *
+         */
+        double p99Milliseconds = 0.0;
+        /**
+         * @brief One message per failed image, naming the input and the reason.
+         *
+         */
+        std::vector<std::string> errors;
+    };
+
+    /**
+     * @brief Collects the inputs of a batch.
+     *
+     * @param source A directory, whose .bmp files are returned in sorted order, or a manifest
+     * file with one path per line. Empty lines and lines starting with # are skipped, relative
+     * paths are resolved against the directory of the manifest.
+     *
+     * @return The input paths.
+     *
+     * @throws std::runtime_error If source cannot be read.
+     *
+     */
+    std::vector<std::filesystem::path> collectBatchInputs(const std::filesystem::path& source);
+
+    /**
+     * @brief Runs a computation over many bitmaps with overlapped reading, computing and writing.
+     *
+     * @param inputs The bitmaps to process.
+     * @param outputDirectory Directory receiving <input stem>_<output name>.bmp, created if needed.
+     * @param function The per-image computation.
+     * @param options Queue depth.
+     *
+     * @return BatchStatistics Counts, throughput, latency percentiles and the failures.
+     *
+     * @throws std::filesystem::filesystem_error If outputDirectory cannot be created.
+     *
+     * @note Inputs are processed and written in order, a failure of one image does not affect
+     * the others.
+     *
+     */
+    BatchStatistics runBatch(const std::vector<std::filesystem::path>& inputs,
+                             const std::filesystem::path& outputDirectory,
+                             const BatchFunction& function, const BatchOptions& options = {});
+}  // namespace CUDAVISION
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "filter/separable_convolution.h"
+#include "util/image.h"
+
+/**
+ * Lazy operator graph
+ *
+ * A Pipeline records operators without running them. When it runs, a planner rewrites the graph
+ * and executes all outputs in one tiled sweep over the image:
+ *
+ * - Reordering: grayscale after a blur whose color result is not needed otherwise is moved in
+ *   front of the blur, which then filters one channel instead of three.
+ * - Pointwise fusion: a grayscale conversion next to a blur is computed inside the blur's row
+ *   loop, either on the input rows of the horizontal pass or on the output rows of the vertical
+ *   pass, without a pass of its own.
+ * - Shared stencils: Roberts, Prewitt and Sobel nodes reading the same node are evaluated in a
+ *   single sweep that loads every 3x3 neighbourhood once.
+ * - Tiling: the image is processed in bands of tile rows. Every band computes the rows of the
+ *   intermediate nodes it needs, including their halo rows, into small per-thread buffers, so
+ *   only the outputs are materialized at full size. Intermediate buffers are assigned to slots
+ *   by liveness, a slot is reused as soon as the last consumer of its node has run.
+ *
+ * With a ResultCache (see pipeline/result_cache.h), run() first looks the outputs up. Missing
+ * outputs are computed by a pipeline rebased onto the nearest cached node of their chain, e.g.
+ * a blurred image kept by cacheIntermediate(), and stored for the next run.
+ */
+
+namespace CUDAVISION {
+    class ResultCache;
+
+    /**
+     * @class Pipeline
+     *
+     * @brief A lazily evaluated graph of CUDAVISION operators.
+     *
+     */
+    class Pipeline {
+       public:
+        /**
+         * @struct Node
+         *
+         * @brief Handle of a recorded operator.
+         *
+         */
+        struct Node {
+            unsigned int index = 0;
+        };
+
+        /**
+         * @brief Constructor creating a graph with only the input node.
+         *
+         */
+        Pipeline();
+
+        /**
+         * @brief Get the node standing for the image passed to run().
+         *
+         */
+        Node input() const { return {0}; }
+
+        /**
+         * @brief Records gaussianSmooth(source, kernelSize, sigma).
+         *
+         * @note The graph applies the three passes per axis as one equivalent kernel, as
+         * SmoothingMode::Fused does.
+         *
+         */
+        Node gaussianSmooth(Node source, int kernelSize, double sigma);
+
+        /**
+         * @brief Records the conversion of source to Gray8, see Image::toGrayscale().
+         *
+         */
+        Node grayscale(Node source);
+
+        /**
+         * @brief Records robertsOperator(source).
+         *
+         */
+        Node robertsOperator(Node source);
+
+        /**
+         * @brief Records prewittOperator(source).
+         *
+         */
+        Node prewittOperator(Node source);
+
+        /**
+         * @brief Records sobelOperator(source).
+         *
+         */
+        Node sobelOperator(Node source);
+
+        /**
+         * @brief Requests the result of a node from run().
+         *
+         * @param node The node to materialize.
+         *
+         * @return Index of the result in the vector returned by run().
+         *
+         */
+        unsigned int output(Node node);
+
+        /**
+         * @brief Set the number of rows per tile.
+         *
+         * @param rows Rows per tile, small enough for the intermediate rows of a tile to stay in
+         * cache. The default is 64.
+         *
+         */
+        void setTileRows(unsigned int rows);
+
+        /**
+         * @brief Allow or forbid moving grayscale in front of a blur. Enabled by default.
+         *
+         * @param enabled Whether the planner may reorder.
+         *
+         * @note Reordering changes the rounding order, the results may differ from the recorded
+         * order by a few intensity levels. All other rewrites are exact. Runs with a cache (see
+         * setCache) never reorder.
+         *
+         */
+        void setReordering(bool enabled);
+
+        /**
+         * @brief Set a cache consulted and filled by run().
+         *
+         * @param cache The cache, which must outlive the runs, or nullptr to compute every run.
+         *
+         * @note The key of a result combines the hash of the input pixels with every operator of
+         * its chain and the parameters and getGaussianKernel weights of a blur. While a cache is
+         * set, run() computes the chains in the recorded order, without the reordering of
+         * setReordering: a chain restarted from a cached intermediate cannot be reordered, and
+         * every result must be the one its key describes, however it was reached.
+         *
+         */
+        void setCache(ResultCache* cache);
+
+        /**
+         * @brief Keeps the result of an intermediate node in the memory tier of the cache, so
+         * that later runs on the same input, also of other pipelines, start from it.
+         *
+         * @param node The node, e.g. a blur shared by several chains.
+         *
+         * @note Without a cache, or when every output is found, the node is not materialized.
+         *
+         */
+        void cacheIntermediate(Node node);
+
+        /**
+         * @brief Plans and executes the graph on an image.
+         *
+         * @param image The input image (Gray8 or BGR8).
+         *
+         * @return The requested outputs, in the order of the output() calls.
+         *
+         */
+        std::vector<Image> run(const Image& image) const;
+
+        /**
+         * @brief Describes the plan run() would execute for an input.
+         *
+         * @param width Width of the input.
+         * @param height Height of the input.
+         * @param channels Channel count of the input, 1 or 3.
+         *
+         * @return One line per step with its fusions and the tile buffer slots.
+         *
+         */
+        std::string describePlan(unsigned int width, unsigned int height,
+                                 unsigned int channels) const;
+
+       private:
+        enum class Operation { Input, GaussianSmooth, Grayscale, Roberts, Prewitt, Sobel };
+
+        struct Operator {
+            Operation operation = Operation::Input;
+            unsigned int source = 0;
+            int kernelSize = 0;
+            double sigma = 0.0;
+        };
+
+        struct Plan;
+
+        Node record(Operation operation, Node source, int kernelSize = 0, double sigma = 0.0);
+        Plan plan(unsigned int width, unsigned int height, unsigned int channels) const;
+        std::vector<Image> execute(const Image& image) const;
+        std::vector<Image> runCached(const Image& image) const;
+        std::vector<uint64_t> cacheKeys(uint64_t inputHash) const;
+        Pipeline rebase(unsigned int start, const std::vector<unsigned int>& targets) const;
+
+        std::vector<Operator> operators;
+        std::vector<unsigned int> outputs;
+        std::vector<unsigned int> intermediates;
+        unsigned int tileRows = 64;
+        bool reordering = true;
+        ResultCache* cache = nullptr;
+    };
+}  // namespace CUDAVISION
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "util/image.h"
+
+/**
+ * Incremental frame processing
+ *
+ * Runs the blur -> grayscale -> Sobel pipeline over a sequence of frames of a mostly static scene,
+ * e.g. a fixed camera. The previous input and output are kept. Each new frame is compared with
+ * the previous one tile by tile, every changed tile is grown by the halo of the pipeline (the
+ * radius of the blur plus one pixel for Sobel), and only the output tiles reached by a change
+ * are recomputed and patched into the kept output. The cost of a frame follows the amount of
+ * motion rather than the resolution.
+ */
+
+namespace CUDAVISION {
+    /**
+     * @struct FrameProcessorOptions
+     *
+     * @brief Parameters of a FrameProcessor.
+     *
+     */
+    struct FrameProcessorOptions {
+        /**
+         * @brief Kernel size of the Gaussian, as for gaussianSmooth.
+         *
+         */
+        int kernelSize = 5;
+        /**
+         * @brief Standard deviation of the Gaussian, as for gaussianSmooth.
+         *
+         */
+        double sigma = 20.0;
+        /**
+         * @brief Edge length of the square tiles compared and recomputed, in pixels.
+         *
+         */
+        unsigned int tileSize = 64;
+    };
+
+    /**
+     * @struct FrameStatistics
+     *
+     * @brief Work done for the last frame.
+     *
+     */
+    struct FrameStatistics {
+        /**
+         * @brief Number of tiles of the frame.
+         *
+         */
+        std::size_t tiles = 0;
+        /**
+         * @brief Number of tiles whose input pixels changed.
+         *
+         */
+        std::size_t changedTiles = 0;
+        /**
+         * @brief Number of output tiles recomputed, the changed tiles grown by the halo.
+         *
+         */
+        std::size_t recomputedTiles = 0;
+    };
+
+    /**
+     * @class FrameProcessor
+     *
+     * @brief Stateful blur -> grayscale -> Sobel pipeline recomputing only what changed between
+     * consecutive frames.
+     *
+     */
+    class FrameProcessor {
+       public:
+        /**
+         * @brief Constructor, the first frame is processed completely.
+         *
+         * @param options Blur parameters and tile size.
+         *
+         */
+        explicit FrameProcessor(const FrameProcessorOptions& options = {});
+
+        /**
+         * @brief Processes the next frame.
+         *
+         * @param frame The frame, Gray8 or BGR8 pixels.
+         *
+         * @return View on the Gray8 edge map, valid until the next call.
+         *
+         * @note The output is identical to sobelOperator(gaussianSmooth(frame, kernelSize, sigma,
+         * SmoothingMode::Fused).toGrayscale()). A frame of another size or channel count than
+         * the previous one starts over with a complete computation.
+         *
+         */
+        ImageView process(ImageView frame);
+
+        /**
+         * @brief Forgets the previous frame, the next one is processed completely.
+         *
+         */
+        void reset();
+
+        /**
+         * @brief Get the statistics of the last processed frame.
+         *
+         */
+        const FrameStatistics& getStatistics() const { return statistics; }
+
+       private:
+        void findChangedTiles(ImageView frame);
+        void recomputeTiles(ImageView frame);
+
+        FrameProcessorOptions options;
+        unsigned int halo = 1;
+        Image previous{0, 0, PixelFormat::Gray8};
+        Image output{0, 0, PixelFormat::Gray8};
+        unsigned int columns = 0;
+        unsigned int rows = 0;
+        // One flag per tile, row-major: input changed, output to be recomputed.
+        std::vector<unsigned char> changed;
+        std::vector<unsigned char> dirty;
+        FrameStatistics statistics;
+    };
+}  // namespace CUDAVISION
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "util/image.h"
+
+/**
+ * Server mode
+ *
+ * A long-running process answering image requests on a local Unix domain socket. Everything a
+ * fresh process would rebuild for each image stays warm between requests: the thread pool, the
+ * fixed-point Gaussian kernels cached by every worker thread and the pixel buffers of the
+ * BufferPool, which the server enables with a bounded capacity (see
+ * ServerOptions::bufferPoolBytes) and which hands them to the next image of the same size.
+ *
+ * The protocol is line based. A request names an input bitmap, an output bitmap and the operator
+ * chain applied from left to right, separated by spaces:
+ *
+ *     <input.bmp> <output.bmp> <operator> [<operator> ...]
+ *
+ * where an operator is one of
+ *
+ *     blur[:<kernel size>[:<sigma>]]   fused Gaussian smoothing, default blur:5:20
+ *     median[:<radius>]                median of the (2 radius + 1)^2 window, default median:1
+ *     gray                             grayscale conversion
+ *     roberts | prewitt | sobel        edge operators
+ *     canny[:<low>:<high>]             Canny with fixed thresholds, default canny:50:100
+ *     canny:otsu | canny:p<percentile> Canny with thresholds selected from the gradients
+ *
+ * Parameters must be finite numbers, integer ones within the range of int, and a blur kernel size
+ * at most MAX_KERNEL_SIZE. A request breaking this is answered with an error line.
+ *
+ * The server answers every request with one line, either
+ *
+ *     ok <width>x<height> <milliseconds>
+ *
+ * with the time from receiving the request to writing the output, or
+ *
+ *     error <message>
+ *
+ * A request line is limited to MAX_REQUEST_BYTES, a connection sending a longer one is closed.
+ * A connection may send any number of requests. Accepted connections wait in a bounded queue for
+ * one of the worker threads, a connection arriving while the queue is full is answered with
+ * "error server busy" and closed.
+ */
+
+namespace CUDAVISION {
+    /**
+     * @brief Longest request line the server reads, in bytes.
+     *
+     */
+    constexpr std::size_t MAX_REQUEST_BYTES = 64 << 10;
+
+    /**
+     * @brief Largest blur kernel size a request may ask for, the window of the largest median.
+     *
+     */
+    constexpr int MAX_KERNEL_SIZE = 255;
+
+    /**
+     * @struct ServerOptions
+     *
+     * @brief Parameters of runServer.
+     *
+     */
+    struct ServerOptions {
+        /**
+         * @brief Path of the Unix domain socket. An existing socket file is replaced, any other
+         * file at the path makes runServer fail.
+         *
+         */
+        std::string socketPath;
+        /**
+         * @brief Number of connections served at the same time. The operators of every request
+         * use the shared thread pool.
+         *
+         */
+        unsigned int workers = 2;
+        /**
+         * @brief Number of accepted connections waiting for a worker.
+         *
+         */
+        unsigned int queueDepth = 16;
+        /**
+         * @brief A connection without a request for this long is closed, freeing its worker.
+         *
+         */
+        unsigned int idleTimeoutSeconds = 30;
+        /**
+         * @brief Capacity of the global BufferPool, which runServer enables so that the pixel
+         * buffers of one request are reused by the next. 0 leaves the pool as it is.
+         *
+         */
+        std::size_t bufferPoolBytes = std::size_t{512} << 20;
+    };
+
+    /**
+     * @struct ServerStatistics
+     *
+     * @brief Summary of a runServer call.
+     *
+     */
+    struct ServerStatistics {
+        /**
+         * @brief Number of requests answered with ok.
+         *
+         */
+        std::size_t succeeded = 0;
+        /**
+         * @brief Number of requests answered with an error.
+         *
+         */
+        std::size_t failed = 0;
+        /**
+         * @brief Number of connections rejected because the queue was full.
+         *
+         */
+        std::size_t rejected = 0;
+        /**
+         * @brief Median latency of the successful requests, in milliseconds.
+         *
+         */
+        double p50Milliseconds = 0.0;
+        /**
+         * @brief 99th percentile of the same latency, in milliseconds.
+         *
+         */
+        double p99Milliseconds = 0.0;
+    };
+
+    /**
+     * @brief Applies an operator chain of the server protocol to an image.
+     *
+     * @param image The input image.
+     * @param operators The operators, e.g. {"blur:5:2", "gray", "sobel"}.
+     *
+     * @return Image The result of the last operator, or a copy of the input for an empty chain.
+     *
+     * @throws std::invalid_argument If an operator or its parameters are not recognized, or a
+     * parameter is out of range.
+     *
+     */
+    Image applyOperatorChain(const Image& image, const std::vector<std::string>& operators);
+
+    /**
+     * @brief Serves requests on a Unix domain socket until stop is set.
+     *
+     * @param options Socket path, workers, queue depth and idle timeout.
+     * @param stop Checked several times per second, e.g. set by a signal handler. Connections
+     * being served finish their current request.
+     * @param log If true, every request is printed to stdout with its latency.
+     *
+     * @return ServerStatistics Request counts and latency percentiles.
+     *
+     * @throws std::runtime_error If the socket cannot be created, bound or listened on, or the
+     * path names a file that is not a socket.
+     *
+     * @note The socket file is removed when the server returns.
+     *
+     */
+    ServerStatistics runServer(const ServerOptions& options, const std::atomic<bool>& stop,
+                               bool log = true);
+
+    /**
+     * @brief Sends one request to a server and waits for its answer.
+     *
+     * @param socketPath Path of the server's socket.
+     * @param request The request line, without the newline.
+     *
+     * @return std::string The answer line, without the newline.
+     *
+     * @throws std::runtime_error If the server cannot be reached or closes the connection
+     * without answering.
+     *
+     */
+    std::string sendServerRequest(const std::string& socketPath, const std::string& request);
+}  // namespace CUDAVISION
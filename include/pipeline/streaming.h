@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+/**
+ * Streaming execution
+ *
+ * Runs the blur -> grayscale -> Sobel pipeline over a bitmap file strip by strip, for images too
+ * large to hold in memory. The input is read in strips of rows, every stage keeps only the rows
+ * its stencil still needs (the kernel radius of the blur, one row above and below for Sobel),
+ * and finished output strips are written immediately. Memory use is proportional to
+ * width x (strip height + total halo) and independent of the image height.
+ */
+
+namespace CUDAVISION {
+    /**
+     * @struct StreamingOptions
+     *
+     * @brief Parameters of streamEdgeDetection.
+     *
+     */
+    struct StreamingOptions {
+        /**
+         * @brief Kernel size of the Gaussian, as for gaussianSmooth.
+         *
+         */
+        int kernelSize = 5;
+        /**
+         * @brief Standard deviation of the Gaussian, as for gaussianSmooth.
+         *
+         */
+        double sigma = 20.0;
+        /**
+         * @brief Number of output rows computed and written at once.
+         *
+         */
+        unsigned int stripRows = 64;
+    };
+
+    /**
+     * @struct StreamingStatistics
+     *
+     * @brief Summary of a streamEdgeDetection run.
+     *
+     */
+    struct StreamingStatistics {
+        /**
+         * @brief Width of the image.
+         *
+         */
+        unsigned int width = 0;
+        /**
+         * @brief Height of the image.
+         *
+         */
+        unsigned int height = 0;
+        /**
+         * @brief Total size of the strip and line buffers, the peak memory of the pipeline apart
+         * from per-thread row buffers.
+         *
+         */
+        std::size_t bufferBytes = 0;
+    };
+
+    /**
+     * @brief Streams a bitmap through gaussianSmooth, toGrayscale and sobelOperator.
+     *
+     * @param input The input bitmap (8, 24 or 32 bpp).
+     * @param output Path of the 8 bpp grayscale edge map.
+     * @param options Blur parameters and strip height.
+     *
+     * @return StreamingStatistics Image size and buffer memory.
+     *
+     * @throws std::runtime_error If the input cannot be read or the output cannot be written.
+     *
+     * @note The output is identical to sobelOperator(gaussianSmooth(image, kernelSize, sigma,
+     * SmoothingMode::Fused).toGrayscale()).
+     *
+     */
+    StreamingStatistics streamEdgeDetection(const std::filesystem::path& input,
+                                            const std::filesystem::path& output,
+                                            const StreamingOptions& options = {});
+}  // namespace CUDAVISION
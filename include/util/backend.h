@@ -0,0 +1,166 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "util/image_view.h"
+
+/**
+ * Backend registry
+ *
+ * A backend is a named way of running the CUDAVISION operators, selected for the whole process
+ * at runtime. The built-in backends choose between the kernel variants that exist today:
+ *
+ *     scalar    scalar kernels on one thread, the reference all others are checked against
+ *     sse2      SSE2 kernels on one thread
+ *     avx2      AVX2 kernels on one thread
+ *     avx512    AVX-512 kernels on one thread
+ *     parallel  the widest supported kernels on all hardware threads, the default
+ *
+ * Vector backends the CPU lacks are registered but unavailable. Further backends are added with
+ * registerBackend(), and may replace operators with their own implementations, e.g. a GPU
+ * backend running canny on the device:
+ *
+ *     Backend gpu{"cuda", "canny on the GPU", [] { return deviceCount() > 0; },
+ *                 [] { setThreadCount(1); }};
+ *     gpu.operators.canny = [](ImageView input, MutableImageView output, int low, int high) {
+ *         cudaCanny(input, output, low, high);
+ *     };
+ *     registerBackend(gpu);
+ * The environment variable CUDAVISION_BACKEND selects a backend at startup,
+ * without it the process runs as "parallel" with the defaults of CUDAVISION_ISA and
+ * CUDAVISION_THREADS. The conformance test, `cuda_vision_conformance` or `ctest`, checks every
+ * available backend against the reference.
+ */
+
+namespace CUDAVISION {
+    struct StencilOptions;
+
+    /**
+     * @struct BackendOperators
+     *
+     * @brief Implementations a backend runs in place of the built-in operators.
+     *
+     * Every member replaces the view overload of the operator of the same name, and through it
+     * the overloads on whole images. Empty members keep the built-in kernels. The edge operators
+     * are replaced only for calls without a histogram.
+     *
+     * @note An implementation must not call the operator it replaces, that call would be
+     * dispatched back to it. Other operators may be called.
+     *
+     */
+    struct BackendOperators {
+        std::function<void(ImageView input, MutableImageView output, int kernelSize,
+                           double sigma)>
+            gaussianSmoothFused;
+        std::function<void(ImageView input, MutableImageView output)> toGrayscale;
+        std::function<void(ImageView input, MutableImageView output,
+                           const StencilOptions& options)>
+            robertsOperator;
+        std::function<void(ImageView input, MutableImageView output,
+                           const StencilOptions& options)>
+            prewittOperator;
+        std::function<void(ImageView input, MutableImageView output,
+                           const StencilOptions& options)>
+            sobelOperator;
+        std::function<void(ImageView input, MutableImageView output, int lowThreshold,
+                           int highThreshold)>
+            canny;
+    };
+
+    /**
+     * @struct Backend
+     *
+     * @brief A registered backend.
+     *
+     */
+    struct Backend {
+        /**
+         * @brief Name used by setBackend() and CUDAVISION_BACKEND.
+         *
+         */
+        std::string name;
+        /**
+         * @brief One line describing the backend.
+         *
+         */
+        std::string description;
+        /**
+         * @brief Whether the backend can run on this host, e.g. whether the CPU supports its
+         * instructions.
+         *
+         */
+        std::function<bool()> isAvailable;
+        /**
+         * @brief Configures the process for the backend (instruction set, threads, devices).
+         * Called by setBackend() while no operator is running.
+         *
+         */
+        std::function<void()> activate;
+        /**
+         * @brief Operators the backend implements itself, none for the built-in backends.
+         *
+         */
+        BackendOperators operators;
+    };
+
+    /**
+     * @brief Adds a backend, or replaces the backend of the same name.
+     *
+     * @param backend The backend.
+     *
+     */
+    void registerBackend(const Backend& backend);
+
+    /**
+     * @brief Get all registered backends in registration order, the reference first.
+     *
+     */
+    std::vector<Backend> getBackends();
+
+    /**
+     * @brief Get the names of the backends available on this host, the reference first.
+     *
+     */
+    std::vector<std::string> getAvailableBackendNames();
+
+    /**
+     * @brief Activates a backend.
+     *
+     * @param name Name of a registered backend.
+     *
+     * @throws std::invalid_argument If no backend of that name is registered or it is not
+     * available on this host.
+     *
+     * @note Replaces the thread pool and the operator implementations. Operators already
+     * running finish with the old ones, see setThreadCount.
+     *
+     */
+    void setBackend(const std::string& name);
+
+    /**
+     * @brief Get the name of the active backend.
+     *
+     */
+    std::string getBackendName();
+
+    /**
+     * @brief Activates the backend named by CUDAVISION_BACKEND, the first time it is called.
+     *
+     * @note Called by the thread pool and the instruction set selection before their first
+     * use, so the variable takes effect before any operator runs, and by the setters, so that
+     * explicit settings override it. Unknown or unavailable backends are reported to stderr and
+     * ignored.
+     *
+     */
+    void applyBackendFromEnvironment();
+
+    /**
+     * @brief Get the operator implementations of the active backend.
+     *
+     * @note A single atomic load, called by every operator that a backend can replace.
+     *
+     */
+    const BackendOperators& getBackendOperators();
+}  // namespace CUDAVISION
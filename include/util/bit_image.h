@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "util/image.h"
+#include "util/image_view.h"
+
+/**
+ * Bit-packed binary images
+ *
+ * A BitImage stores one bit per pixel, 64 pixels per 64-bit word: pixel x of a row is bit x % 64
+ * of word x / 64. Every row starts at a new word, the bits of the last word beyond the width are
+ * always zero. Edge maps and masks take an eighth of the memory of a Gray8 image, and the
+ * morphology and set operations below handle 64 pixels per instruction.
+ *
+ * BitImage is written as a 1 bpp bitmap, the smallest bitmap for a binary image, and read back
+ * with readBitImage() from bitmap_io.h, e.g.
+ *
+ *     BitImage edges = BitImage::fromThreshold(CUDAVISION::canny(image, 50, 100).view(), 0);
+ *     CUDAVISION::dilate(edges).writeImageToFile("edges.bmp");
+ */
+
+/**
+ * @class BitImage
+ *
+ * @brief A binary image with 64 pixels per word.
+ *
+ */
+class BitImage {
+   public:
+    /**
+     * @brief Constructor to create an image with all pixels cleared.
+     *
+     * @param width Width of the image.
+     * @param height Height of the image.
+     *
+     */
+    BitImage(unsigned int width, unsigned int height);
+
+    /**
+     * @brief Sets every pixel whose value exceeds a threshold.
+     *
+     * @param input Gray8 pixels.
+     * @param threshold Pixels greater than threshold are set, 0 for the 0 / 255 edge maps of
+     * the edge operators.
+     *
+     * @return BitImage The binary image, rows packed in parallel.
+     *
+     */
+    static BitImage fromThreshold(ImageView input, unsigned char threshold);
+
+    /**
+     * @brief Packs one row of Gray8 pixels.
+     *
+     * @param pixels The pixels of the row.
+     * @param width Number of pixels.
+     * @param threshold Pixels greater than threshold are set.
+     * @param words Destination of (width + 63) / 64 words, the bits beyond width are cleared.
+     *
+     */
+    static void packRow(const unsigned char* pixels, unsigned int width, unsigned char threshold,
+                        uint64_t* words);
+
+    unsigned int getWidth() const { return width; }
+    unsigned int getHeight() const { return height; }
+
+    /**
+     * @brief Get the number of words per row.
+     *
+     */
+    unsigned int getWordsPerRow() const { return wordsPerRow; }
+
+    /**
+     * @brief Get the words of row y.
+     *
+     */
+    const uint64_t* row(unsigned int y) const {
+        return words.data() + static_cast<std::size_t>(y) * wordsPerRow;
+    }
+
+    /**
+     * @brief Get the writable words of row y. The bits beyond the width must stay zero.
+     *
+     */
+    uint64_t* row(unsigned int y) {
+        return words.data() + static_cast<std::size_t>(y) * wordsPerRow;
+    }
+
+    /**
+     * @brief Get the mask of the valid bits of the last word of every row.
+     *
+     */
+    uint64_t getLastWordMask() const {
+        return width % 64 == 0 ? ~uint64_t{0} : (uint64_t{1} << (width % 64)) - 1;
+    }
+
+    bool get(unsigned int x, unsigned int y) const { return (row(y)[x / 64] >> (x % 64)) & 1; }
+
+    void set(unsigned int x, unsigned int y, bool value) {
+        const uint64_t bit = uint64_t{1} << (x % 64);
+        uint64_t& word = row(y)[x / 64];
+        word = value ? word | bit : word & ~bit;
+    }
+
+    /**
+     * @brief Get the number of set pixels.
+     *
+     */
+    std::size_t count() const;
+
+    /**
+     * @brief Intersects with an image of the same size.
+     *
+     * @throws std::invalid_argument If the sizes differ.
+     *
+     */
+    BitImage& operator&=(const BitImage& other);
+
+    /**
+     * @brief Unites with an image of the same size.
+     *
+     * @throws std::invalid_argument If the sizes differ.
+     *
+     */
+    BitImage& operator|=(const BitImage& other);
+
+    /**
+     * @brief Keeps the pixels set in exactly one of both images.
+     *
+     * @throws std::invalid_argument If the sizes differ.
+     *
+     */
+    BitImage& operator^=(const BitImage& other);
+
+    bool operator==(const BitImage& other) const = default;
+
+    /**
+     * @brief Expands the pixels to a Gray8 view, 255 for set pixels and 0 elsewhere.
+     *
+     * @param output View of the size of the image.
+     *
+     */
+    void unpack(MutableImageView output) const;
+
+    /**
+     * @brief Converts the image to Gray8, 255 for set pixels and 0 elsewhere.
+     *
+     */
+    Image toImage() const;
+
+    /**
+     * @brief Writes the image as a 1 bpp bitmap with a black and white palette.
+     *
+     * @param filePath The file path where the bitmap will be saved.
+     *
+     * @note Errors are reported on std::cerr, as Image::writeImageToFile does.
+     *
+     */
+    void writeImageToFile(const std::filesystem::path& filePath) const;
+
+   private:
+    unsigned int width;
+    unsigned int height;
+    unsigned int wordsPerRow;
+    std::vector<uint64_t> words;
+};
+
+inline BitImage operator&(BitImage left, const BitImage& right) { return left &= right; }
+inline BitImage operator|(BitImage left, const BitImage& right) { return left |= right; }
+inline BitImage operator^(BitImage left, const BitImage& right) { return left ^= right; }
+
+namespace CUDAVISION {
+    /**
+     * @brief Dilates with a square structuring element: a pixel is set if any pixel within
+     * radius (Chebyshev distance) is set.
+     *
+     * @param image The binary image.
+     * @param radius Half the edge length of the square, 1 for 3 x 3.
+     *
+     * @return BitImage The dilated image. Pixels outside of the image count as cleared.
+     *
+     */
+    BitImage dilate(const BitImage& image, unsigned int radius = 1);
+
+    /**
+     * @brief Erodes with a square structuring element: a pixel stays set if all pixels within
+     * radius (Chebyshev distance) are set.
+     *
+     * @param image The binary image.
+     * @param radius Half the edge length of the square, 1 for 3 x 3.
+     *
+     * @return BitImage The eroded image. Pixels outside of the image count as set, so the
+     * border of the image does not erode.
+     *
+     */
+    BitImage erode(const BitImage& image, unsigned int radius = 1);
+}  // namespace CUDAVISION
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "util/image_view.h"
+#include "util/pixel_format.h"
+
+class BitImage;
+class Image;
+
+/**
+ * Bitmap file I/O
+ *
+ * Bitmaps are read through a read-only memory mapping, the pixel array is exposed as a strided
+ * view without copying it. Row 0 of every view is the first row of a bottom-up pixel array, i.e.
+ * the bottom row of the picture, which is the row order Image keeps in memory. Top-down bitmaps
+ * (negative height) are exposed with a negative stride, so both orientations read the same.
+ * Writing assembles the headers in memory and hands them together with the pixel rows to a
+ * single vectored write.
+ *
+ * Binary images are written and read as 1 bpp bitmaps by the BitImage overloads, 64 pixels at a
+ * time.
+ *
+ * BitmapReader and BitmapWriter stream the pixel array in strips of rows instead, for images
+ * that do not fit into memory.
+ */
+
+/**
+ * @struct BitmapLayout
+ *
+ * @brief Validated geometry of a bitmap file.
+ *
+ */
+struct BitmapLayout {
+    /**
+     * @brief Width in pixels.
+     *
+     */
+    unsigned int width = 0;
+    /**
+     * @brief Height in pixels, always positive.
+     *
+     */
+    unsigned int height = 0;
+    /**
+     * @brief 1, 8, 24 or 32.
+     *
+     */
+    unsigned int bitsPerPixel = 0;
+    /**
+     * @brief Negative height in the header, the first row in the file is the top row.
+     *
+     */
+    bool topDown = false;
+    /**
+     * @brief Bytes per row in the file, including the padding to a multiple of 4.
+     *
+     */
+    std::size_t rowSize = 0;
+    /**
+     * @brief File offset of the pixel array.
+     *
+     */
+    std::size_t imageOffset = 0;
+    /**
+     * @brief File offset of the palette, 1 and 8 bpp only.
+     *
+     */
+    std::size_t paletteOffset = 0;
+    /**
+     * @brief Number of BGRX palette entries, 0 for 24 and 32 bpp.
+     *
+     */
+    unsigned int paletteSize = 0;
+};
+
+/**
+ * @class MappedBitmap
+ *
+ * @brief A validated, memory-mapped 1, 8, 24 or 32 bpp uncompressed bitmap file.
+ *
+ */
+class MappedBitmap {
+   public:
+    /**
+     * @brief Maps and validates a bitmap file.
+     *
+     * @param filePath The file path of the bitmap.
+     *
+     * @throws std::runtime_error If the file cannot be mapped or its headers are malformed:
+     * wrong signature, unsupported bit depth or compression, non-positive width, zero height,
+     * or a palette or pixel array reaching beyond the end of the file.
+     *
+     */
+    explicit MappedBitmap(const std::filesystem::path& filePath);
+
+    /**
+     * @brief Destructor, unmaps the file.
+     *
+     */
+    ~MappedBitmap();
+
+    MappedBitmap(const MappedBitmap&) = delete;
+    MappedBitmap& operator=(const MappedBitmap&) = delete;
+
+    /**
+     * @brief Get the width of the bitmap in pixels.
+     *
+     */
+    unsigned int getWidth() const { return layout.width; }
+
+    /**
+     * @brief Get the height of the bitmap in pixels.
+     *
+     */
+    unsigned int getHeight() const { return layout.height; }
+
+    /**
+     * @brief Get the number of bits per pixel, 1, 8, 24 or 32.
+     *
+     */
+    unsigned int getBitsPerPixel() const { return layout.bitsPerPixel; }
+
+    /**
+     * @brief Whether the pixel array is stored top-down (negative height in the header).
+     *
+     */
+    bool isTopDown() const { return layout.topDown; }
+
+    /**
+     * @brief Get the palette of a 1 or 8 bpp bitmap as BGRX entries.
+     *
+     * @return Pointer to getPaletteSize() * 4 bytes, nullptr for 24 and 32 bpp.
+     *
+     */
+    const unsigned char* getPalette() const { return palette; }
+
+    /**
+     * @brief Get the number of palette entries, 0 for 24 and 32 bpp.
+     *
+     */
+    unsigned int getPaletteSize() const { return layout.paletteSize; }
+
+    /**
+     * @brief Whether the palette maps every index to the gray value of the same intensity, the
+     * palette written for Gray8 images. The indices of such a bitmap are its gray values.
+     *
+     */
+    bool hasGrayPalette() const;
+
+    /**
+     * @brief Get a zero-copy view on the mapped pixel array.
+     *
+     * @return View with 1 channel (8 bpp palette indices, or the packed bytes of 1 bpp rows,
+     * (width + 7) / 8 of them, first pixel in the most significant bit), 3 channels (24 bpp BGR)
+     * or 4 channels (32 bpp BGRX). Valid as long as the MappedBitmap lives.
+     *
+     */
+    ImageView view() const;
+
+    /**
+     * @brief Get the pixel format Image loads this bitmap as: Gray8 for 8 bpp bitmaps with a
+     * grayscale palette and 1 bpp bitmaps with two gray entries, BGR8 for all others.
+     *
+     */
+    PixelFormat getPixelFormat() const;
+
+    /**
+     * @brief Converts row y of view() to getPixelFormat(), expanding palettes and 1 bpp bits and
+     * dropping the fourth byte of 32 bpp pixels.
+     *
+     * @param y Row index, 0 is the bottom row.
+     * @param dst Destination of getWidth() * channelCount(getPixelFormat()) bytes.
+     *
+     */
+    void decodeRow(unsigned int y, unsigned char* dst) const;
+
+   private:
+    const unsigned char* mapping = nullptr;
+    std::size_t mappingSize = 0;
+    const unsigned char* palette = nullptr;
+    BitmapLayout layout;
+};
+
+/**
+ * @brief Writes a binary image as a 1 bpp bitmap, set pixels white, with a single vectored write.
+ *
+ * @param filePath The file path where the bitmap will be saved.
+ * @param image The pixels, row 0 becomes the bottom row of the picture.
+ *
+ * @throws std::runtime_error If the file cannot be written.
+ *
+ */
+void writeBitmap(const std::filesystem::path& filePath, const BitImage& image);
+
+/**
+ * @brief Reads a bitmap file as a binary image.
+ *
+ * @param filePath The file path of the bitmap.
+ *
+ * @return BitImage 1 bpp bitmaps word by word, a pixel set if its palette entry is the brighter
+ * one. For all other bitmaps a pixel is set if its gray value exceeds 127.
+ *
+ * @throws std::runtime_error If the file cannot be mapped or is malformed.
+ *
+ */
+BitImage readBitImage(const std::filesystem::path& filePath);
+
+/**
+ * @brief Reads a bitmap file into an image.
+ *
+ * @param filePath The file path of the bitmap.
+ *
+ * @return Image Gray8 for 8 bpp bitmaps with a gray palette, BGR8 for all others, see
+ * MappedBitmap::getPixelFormat().
+ *
+ * @throws std::runtime_error If the file cannot be mapped or is malformed. Unlike the Image
+ * constructor, which reports the error and leaves the image empty.
+ *
+ */
+Image readBitmap(const std::filesystem::path& filePath);
+
+/**
+ * @class BitmapReader
+ *
+ * @brief Reads the pixel array of a bitmap file sequentially in strips of rows, bottom row
+ * first, without holding more than one strip in memory.
+ *
+ */
+class BitmapReader {
+   public:
+    /**
+     * @brief Opens and validates a bitmap file, with the same checks as MappedBitmap.
+     *
+     * @param filePath The file path of the bitmap.
+     *
+     * @throws std::runtime_error If the file cannot be read or its headers are malformed.
+     *
+     */
+    explicit BitmapReader(const std::filesystem::path& filePath);
+
+    /**
+     * @brief Destructor, closes the file.
+     *
+     */
+    ~BitmapReader();
+
+    BitmapReader(const BitmapReader&) = delete;
+    BitmapReader& operator=(const BitmapReader&) = delete;
+
+    /**
+     * @brief Get the width of the bitmap in pixels.
+     *
+     */
+    unsigned int getWidth() const { return layout.width; }
+
+    /**
+     * @brief Get the height of the bitmap in pixels.
+     *
+     */
+    unsigned int getHeight() const { return layout.height; }
+
+    /**
+     * @brief Get the pixel format the rows are decoded to, see MappedBitmap::getPixelFormat().
+     *
+     */
+    PixelFormat getPixelFormat() const { return format; }
+
+    /**
+     * @brief Get the number of rows read so far.
+     *
+     */
+    unsigned int getRowsRead() const { return rowsRead; }
+
+    /**
+     * @brief Reads and decodes the next rows.
+     *
+     * @param strip View receiving up to strip.height rows in getPixelFormat(), with the width of
+     * the bitmap.
+     *
+     * @return Number of rows read, less than strip.height at the top of the image.
+     *
+     * @throws std::runtime_error If the file cannot be read.
+     *
+     */
+    unsigned int readRows(MutableImageView strip);
+
+   private:
+    std::filesystem::path path;
+    int fd = -1;
+    BitmapLayout layout;
+    PixelFormat format = PixelFormat::BGR8;
+    std::vector<unsigned char> palette;
+    std::vector<unsigned char> fileRows;
+    unsigned int rowsRead = 0;
+};
+
+/**
+ * @class BitmapWriter
+ *
+ * @brief Writes a bitmap file sequentially in strips of rows, bottom row first.
+ *
+ */
+class BitmapWriter {
+   public:
+    /**
+     * @brief Creates the file and writes the headers.
+     *
+     * @param filePath The file path where the bitmap will be saved.
+     * @param width Width of the image.
+     * @param height Height of the image, the number of rows that will be written.
+     * @param channels 1 (8 bpp with a grayscale palette), 3 (24 bpp) or 4 (32 bpp).
+     *
+     * @throws std::runtime_error If the format is not supported or the file cannot be written.
+     *
+     */
+    BitmapWriter(const std::filesystem::path& filePath, unsigned int width, unsigned int height,
+                 unsigned int channels);
+
+    /**
+     * @brief Destructor, closes the file.
+     *
+     */
+    ~BitmapWriter();
+
+    BitmapWriter(const BitmapWriter&) = delete;
+    BitmapWriter& operator=(const BitmapWriter&) = delete;
+
+    /**
+     * @brief Appends rows to the pixel array with a single write.
+     *
+     * @param strip The rows, with the width and channel count given to the constructor.
+     *
+     * @throws std::runtime_error If more rows than the height are written or the write fails.
+     *
+     */
+    void writeRows(ImageView strip);
+
+   private:
+    std::filesystem::path path;
+    int fd = -1;
+    unsigned int width = 0;
+    unsigned int height = 0;
+    unsigned int channels = 0;
+    std::vector<unsigned char> packed;
+    unsigned int rowsWritten = 0;
+};
+
+/**
+ * @brief Writes a view to a bitmap file with a single vectored write.
+ *
+ * @param filePath The file path where the bitmap will be saved.
+ * @param view The pixels, row 0 becomes the bottom row of the picture. 1 channel is written as
+ * 8 bpp with a grayscale palette, 3 channels as 24 bpp and 4 channels as 32 bpp.
+ *
+ * @throws std::runtime_error If the channel count is not supported or the file cannot be
+ * written.
+ *
+ * @note Views whose rows are already stored back to back with the 4 byte row padding of the
+ * file are written straight from their memory, all others are packed into one pooled buffer
+ * first.
+ *
+ */
+void writeBitmap(const std::filesystem::path& filePath, ImageView view);
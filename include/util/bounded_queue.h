@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace CUDAVISION {
+    /**
+     * @class BoundedQueue
+     *
+     * @brief A queue of at most capacity items connecting producer and consumer threads.
+     *
+     */
+    template <typename T>
+    class BoundedQueue {
+       public:
+        /**
+         * @brief Constructor.
+         *
+         * @param capacity Maximum number of queued items, at least 1.
+         *
+         */
+        explicit BoundedQueue(unsigned int capacity) : capacity(std::max(capacity, 1u)) {}
+
+        /**
+         * @brief Appends an item, blocking while the queue is full.
+         *
+         */
+        void push(T item) {
+            std::unique_lock<std::mutex> lock(mutex);
+            notFull.wait(lock, [&] { return items.size() < capacity; });
+            items.push_back(std::move(item));
+            notEmpty.notify_one();
+        }
+
+        /**
+         * @brief Appends an item unless the queue is full or closed.
+         *
+         * @return true If the item was queued, otherwise item is left untouched.
+         *
+         */
+        bool tryPush(T& item) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (closed || items.size() >= capacity) {
+                return false;
+            }
+            items.push_back(std::move(item));
+            notEmpty.notify_one();
+            return true;
+        }
+
+        /**
+         * @brief Removes the oldest item, blocking while the queue is empty.
+         *
+         * @return The item, or nothing once the queue is closed and drained.
+         *
+         */
+        std::optional<T> pop() {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [&] { return !items.empty() || closed; });
+            if (items.empty()) {
+                return std::nullopt;
+            }
+            T item = std::move(items.front());
+            items.pop_front();
+            notFull.notify_one();
+            return item;
+        }
+
+        /**
+         * @brief Marks the end of the input, pop() returns nothing once the items are drained.
+         *
+         */
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+            notEmpty.notify_all();
+        }
+
+       private:
+        const std::size_t capacity;
+        std::deque<T> items;
+        std::mutex mutex;
+        std::condition_variable notFull;
+        std::condition_variable notEmpty;
+        bool closed = false;
+    };
+}  // namespace CUDAVISION
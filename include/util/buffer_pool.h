@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class BufferPool
+ *
+ * @brief Thread-safe pool of pixel buffers, keyed by their size in bytes.
+ *
+ * Images and the CUDAVISION operators draw their pixel buffers from the global pool and hand
+ * them back when they are destroyed. Once a fixed-size pipeline has run for one frame, every
+ * following frame is served from the pool without touching the heap. The pool is opt-in: while
+ * it is disabled, acquire() and release() fall back to plain allocation and deallocation.
+ *
+ */
+class BufferPool {
+   public:
+    /**
+     * @struct Statistics
+     *
+     * @brief Counters describing how well the pool serves its clients.
+     *
+     */
+    struct Statistics {
+        /**
+         * @brief Number of requests served by a pooled buffer.
+         *
+         */
+        std::size_t hits = 0;
+        /**
+         * @brief Number of requests that had to allocate a new buffer.
+         *
+         */
+        std::size_t misses = 0;
+        /**
+         * @brief Bytes currently handed out to clients.
+         *
+         */
+        std::size_t bytesInUse = 0;
+        /**
+         * @brief Highest value bytesInUse reached since the last reset.
+         *
+         */
+        std::size_t peakBytes = 0;
+        /**
+         * @brief Bytes currently held by the pool, waiting to be reused.
+         *
+         */
+        std::size_t pooledBytes = 0;
+    };
+
+    /**
+     * @brief Bytes the pool keeps for reuse until setCapacity() is called, enough for the
+     * intermediates of a few 4k BGR frames.
+     *
+     */
+    static constexpr std::size_t DEFAULT_CAPACITY = std::size_t{256} << 20;
+
+    /**
+     * @brief Get the process-wide pool used by Image and the CUDAVISION operators.
+     *
+     * @return Reference to the global pool.
+     *
+     */
+    static BufferPool& global();
+
+    /**
+     * @brief Enable or disable pooling. Disabling the pool releases all pooled buffers.
+     *
+     * @param enabled Whether buffers should be pooled.
+     *
+     */
+    void setEnabled(bool enabled);
+
+    /**
+     * @brief Check whether pooling is enabled.
+     *
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief Limit the number of bytes the pool keeps for reuse. Buffers released while the limit
+     * is reached are freed instead.
+     *
+     * @param bytes Maximum number of pooled bytes, DEFAULT_CAPACITY until set.
+     *
+     */
+    void setCapacity(std::size_t bytes);
+
+    /**
+     * @brief Get a buffer of exactly 'size' bytes. The content of the buffer is unspecified.
+     *
+     * @param size Size of the buffer in bytes.
+     *
+     * @return A vector with size() == size.
+     *
+     */
+    std::vector<unsigned char> acquire(std::size_t size);
+
+    /**
+     * @brief Hand a buffer back to the pool so that a later acquire() of the same size can
+     * reuse it.
+     *
+     * @param buffer The buffer to be returned. It is left empty.
+     *
+     * @note Never throws, so destructors and move operations can call it. A buffer the pool
+     * cannot take in, beyond the capacity or because its bookkeeping fails to allocate, is freed.
+     *
+     */
+    void release(std::vector<unsigned char>&& buffer) noexcept;
+
+    /**
+     * @brief Free all pooled buffers.
+     *
+     */
+    void clear();
+
+    /**
+     * @brief Get a snapshot of the pool counters.
+     *
+     */
+    Statistics getStatistics() const;
+
+    /**
+     * @brief Reset hits, misses and the peak to the current state.
+     *
+     */
+    void resetStatistics();
+
+   private:
+    mutable std::mutex mutex;
+    bool enabled = false;
+    std::size_t capacity = DEFAULT_CAPACITY;
+    std::unordered_map<std::size_t, std::vector<std::vector<unsigned char>>> buffers;
+    Statistics statistics;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+namespace CUDAVISION {
+    /**
+     * @enum InstructionSet
+     *
+     * @brief Vector instruction sets the CPU kernels are compiled for, ordered by width.
+     *
+     */
+    enum class InstructionSet {
+        Scalar,
+        SSE2,
+        AVX2,
+        AVX512,
+    };
+
+    /**
+     * @brief Queries the CPU (CPUID) for the widest instruction set supported by the kernels.
+     *
+     * @return The best supported instruction set.
+     *
+     */
+    InstructionSet detectInstructionSet();
+
+    /**
+     * @brief Get the instruction set the kernels currently dispatch to.
+     *
+     * @return The active instruction set.
+     *
+     * @note Defaults to detectInstructionSet(). The environment variable CUDAVISION_ISA
+     * (scalar, sse2, avx2, avx512) lowers the default, e.g. for benchmarking the fallbacks.
+     *
+     */
+    InstructionSet getInstructionSet();
+
+    /**
+     * @brief Select the instruction set the kernels dispatch to. Requests above the detected
+     * instruction set are clamped to it.
+     *
+     * @param instructionSet The requested instruction set.
+     *
+     */
+    void setInstructionSet(InstructionSet instructionSet);
+
+    /**
+     * @brief Get a printable name of an instruction set.
+     *
+     */
+    const char* toString(InstructionSet instructionSet);
+}  // namespace CUDAVISION
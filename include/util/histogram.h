@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "util/image_view.h"
+
+/**
+ * Histograms and automatic thresholds
+ *
+ * Histograms are accumulated per row band into private counters and merged once per band, so
+ * threads never share a counter. Within a band, consecutive values go to four sub-histograms in
+ * turn: runs of equal values (flat image regions) would otherwise make every increment wait for
+ * the store of the previous one to the same counter.
+ *
+ * The operators producing gradients (applyStencil, the edge operators, canny) can accumulate
+ * the histogram of their output while writing it, so that a threshold is selected without
+ * another pass over the image.
+ */
+
+namespace CUDAVISION {
+    /**
+     * @brief Counts per value, bin i counts the value i.
+     *
+     */
+    using Histogram = std::vector<std::uint64_t>;
+
+    /**
+     * @class HistogramAccumulator
+     *
+     * @brief Private counters of one thread or band, merged into a Histogram at the end.
+     *
+     */
+    class HistogramAccumulator {
+       public:
+        /**
+         * @brief Constructor.
+         *
+         * @param binCount Number of bins, 256 for 8-bit values.
+         *
+         */
+        explicit HistogramAccumulator(unsigned int binCount);
+
+        /**
+         * @brief Counts 8-bit values. The accumulator must have at least 256 bins.
+         *
+         */
+        void add(const unsigned char* values, std::size_t count);
+
+        /**
+         * @brief Counts 16-bit values, negative values in bin 0 and values beyond the last bin in
+         * the last bin.
+         *
+         */
+        void add(const int16_t* values, std::size_t count);
+
+        /**
+         * @brief Adds the counts to a histogram of the same number of bins.
+         *
+         */
+        void addTo(Histogram& histogram) const;
+
+       private:
+        static constexpr unsigned int SUB_HISTOGRAMS = 4;
+
+        unsigned int binCount;
+        // SUB_HISTOGRAMS x binCount counters. 32 bits suffice, a band holds less than 2^32
+        // pixels.
+        std::vector<std::uint32_t> counts;
+    };
+
+    /**
+     * @brief Computes the 256-bin histogram of 8-bit pixels, all channels counted together.
+     *
+     * @param input The pixels.
+     *
+     * @return The histogram, rows are counted in parallel bands.
+     *
+     */
+    Histogram computeHistogram(ImageView input);
+
+    /**
+     * @brief Computes the histogram of 16-bit values such as gradient magnitudes.
+     *
+     * @param input The values, e.g. a Gray16S image.
+     * @param binCount Number of bins. Negative values are counted in bin 0, values of binCount
+     * and above in the last bin.
+     *
+     * @return The histogram, rows are counted in parallel bands.
+     *
+     */
+    Histogram computeHistogram(BasicImageView<const int16_t> input, unsigned int binCount);
+
+    /**
+     * @brief Selects a threshold with Otsu's method.
+     *
+     * @param histogram The histogram of the values.
+     *
+     * @return The value t maximizing the between-class variance of the classes <= t and > t, 0
+     * for an empty histogram or a single value.
+     *
+     */
+    unsigned int otsuThreshold(const Histogram& histogram);
+
+    /**
+     * @brief Selects the value below which a given share of the counts lies.
+     *
+     * @param histogram The histogram of the values.
+     * @param percentile Share in percent, in [0, 100].
+     *
+     * @return The smallest value t such that at least percentile % of the counts are <= t.
+     *
+     */
+    unsigned int percentileThreshold(const Histogram& histogram, double percentile);
+
+    /**
+     * @brief Selects the nearest-rank percentile of a list of samples, e.g. request latencies.
+     *
+     * @param values The samples, partially reordered.
+     * @param fraction Share in [0, 1], 0.5 for the median.
+     *
+     * @return The sample at rank fraction * (size - 1), rounded, 0 for no samples.
+     *
+     */
+    double samplePercentile(std::vector<double>& values, double fraction);
+}  // namespace CUDAVISION
@@ -4,6 +4,9 @@
 #include <vector>
 
 #include "util/bitmap.h"
+#include "util/image_view.h"
+#include "util/pixel_format.h"
+#include "util/region.h"
 
 namespace fs = std::filesystem;
 
@@ -16,16 +19,28 @@ namespace fs = std::filesystem;
 class Image {
    public:
     /**
-     * @brief Constructor to create an empty image with given width and height.
+     * @brief Constructor to create a black image with given width and height.
      *
      * @param width Width of the image.
      * @param height Height of the image.
      *
+     * @note The pixel buffer is taken from the global BufferPool if pooling is enabled.
+     *
+     */
+    Image(unsigned int width, unsigned int height);
+
+    /**
+     * @brief Constructor to create a zero-initialized image of the given pixel format.
+     *
+     * @param width Width of the image.
+     * @param height Height of the image.
+     * @param format Pixel format of the image.
+     *
      */
-    Image(unsigned int width, unsigned int height) : width(width), height(height) {};
+    Image(unsigned int width, unsigned int height, PixelFormat format);
 
     /**
-     * @brief Constructor to create an image with given width, height, and pixel data.
+     * @brief Constructor to create a BGR8 image with given width, height, and pixel data.
      *
      * @param width Width of the image.
      * @param height Height of the image.
@@ -33,7 +48,20 @@ class Image {
      *
      */
     Image(unsigned int width, unsigned height, std::vector<unsigned char> pixels)
-        : width(width), height(height), pixels(pixels) {};
+        : width(width), height(height), pixels(std::move(pixels)) {};
+
+    /**
+     * @brief Constructor to create an image of the given format with given pixel data.
+     *
+     * @param width Width of the image.
+     * @param height Height of the image.
+     * @param format Pixel format of the pixel data.
+     * @param pixels Vector containing width * height * bytesPerPixel(format) bytes.
+     *
+     */
+    Image(unsigned int width, unsigned height, PixelFormat format,
+          std::vector<unsigned char> pixels)
+        : width(width), height(height), format(format), pixels(std::move(pixels)) {};
 
     /**
      * @brief Copy constructor to create a copy of an existing image.
@@ -41,13 +69,43 @@ class Image {
      * @param other The image to be copied.
      *
      */
-    Image(const Image& other) : width(other.width), height(other.height), pixels(other.pixels) {};
+    Image(const Image& other);
+
+    /**
+     * @brief Move constructor, takes over the pixel buffer of another image.
+     *
+     * @param other The image to be moved from. It is left empty.
+     *
+     */
+    Image(Image&& other) noexcept;
+
+    /**
+     * @brief Copy assignment, reuses the own pixel buffer if it has the right size.
+     *
+     * @param other The image to be copied.
+     *
+     */
+    Image& operator=(const Image& other);
+
+    /**
+     * @brief Move assignment, returns the current pixel buffer to the pool and takes over the
+     * buffer of another image.
+     *
+     * @param other The image to be moved from. It is left empty.
+     *
+     */
+    Image& operator=(Image&& other) noexcept;
 
     /**
      * @brief Constructor to create an image from a file.
      *
      * @param imagePath The file path of the image to be loaded.
      *
+     * @note The file is read through MappedBitmap. 8 bpp bitmaps with a grayscale palette and
+     * 1 bpp bitmaps with two gray entries are loaded as Gray8, all other 1, 8, 24 and 32 bpp
+     * bitmaps as BGR8. Malformed files are reported
+     * on std::cerr and leave the image empty.
+     *
      */
     Image(const fs::path imagePath);
 
@@ -65,10 +123,10 @@ class Image {
           unsigned char b);
 
     /**
-     * @brief Destructor for the Image class.
+     * @brief Destructor for the Image class, returns the pixel buffer to the pool.
      *
      */
-    ~Image() {};
+    ~Image();
 
     /**
      * @brief Get the width of the image.
@@ -86,34 +144,157 @@ class Image {
      */
     unsigned int getHeight() const;
 
+    /**
+     * @brief Get the pixel format of the image.
+     *
+     * @return Pixel format of the image.
+     *
+     */
+    PixelFormat getFormat() const;
+
+    /**
+     * @brief Get the number of interleaved channels per pixel.
+     *
+     * @return 3 for BGR8, 1 for all other formats.
+     *
+     */
+    unsigned int getChannels() const;
+
     /**
      * @brief Get the pixel data of the image.
      *
-     * @return Vector containing the pixel data.
+     * @return Reference to the vector containing the pixel data.
+     *
+     */
+    const std::vector<unsigned char>& getPixels() const;
+
+    /**
+     * @brief Get a read-only view on the pixel data without copying it.
+     *
+     * @return ImageView covering the whole image.
+     *
+     * @note Only meaningful for the 8-bit formats Gray8 and BGR8, use viewAs() otherwise.
+     *
+     */
+    ImageView view() const;
+
+    /**
+     * @brief Get a writable view on the pixel data without copying it.
+     *
+     * @return MutableImageView covering the whole image.
+     *
+     * @note Only meaningful for the 8-bit formats Gray8 and BGR8, use mutableViewAs() otherwise.
+     *
+     */
+    MutableImageView mutableView();
+
+    /**
+     * @brief Get a typed read-only view, e.g. viewAs<int16_t>() for Gray16S images.
+     *
+     * @tparam T Channel type matching the pixel format.
+     *
+     * @return View covering the whole image.
+     *
+     */
+    template <typename T>
+    BasicImageView<const T> viewAs() const {
+        return {reinterpret_cast<const T*>(pixels.data()), width, height,
+                static_cast<std::ptrdiff_t>(width * bytesPerPixel(format)), channelCount(format)};
+    }
+
+    /**
+     * @brief Get a typed writable view, e.g. mutableViewAs<float>() for Float32 images.
+     *
+     * @tparam T Channel type matching the pixel format.
+     *
+     * @return View covering the whole image.
      *
      */
-    std::vector<unsigned char> getPixels() const;
+    template <typename T>
+    BasicImageView<T> mutableViewAs() {
+        return {reinterpret_cast<T*>(pixels.data()), width, height,
+                static_cast<std::ptrdiff_t>(width * bytesPerPixel(format)), channelCount(format)};
+    }
+
+    /**
+     * @brief Convert the image to another pixel format.
+     *
+     * @param target The pixel format of the result.
+     *
+     * @return Image The converted image.
+     *
+     * @note Color is reduced with the grayscale formula of toGrayscale(), gray is replicated into
+     * all channels for BGR8. Conversions to Gray8 or BGR8 round and saturate to [0, 255],
+     * conversions to Gray16S saturate to [-32768, 32767].
+     *
+     */
+    Image convertTo(PixelFormat target) const;
 
     /**
      * @brief Write the image to a file.
      *
      * @param filePath The file path where the image will be saved.
      *
+     * @note BGR8 images are written as 24-bit bitmaps, Gray8 images as 8-bit bitmaps with a
+     * grayscale palette. Gray16S and Float32 images are converted to Gray8 first. The file is
+     * written with writeBitmap, errors are reported on std::cerr.
+     *
      */
     void writeImageToFile(const fs::path filePath);
 
     /**
-     * @brief Converts a 24-bit color image to a 8-bit grayscale image (still storing it as 24-bit).
+     * @brief Converts a 24-bit color image to a single-channel 8-bit grayscale image (Gray8).
      * Uses the following formula: 0.299 x Red + 0.587 x Green + 0.114 x Blue
      * to convert a 24-bit RGB image to a grayscale image. Pixels are stored in
-     * BGR order.
+     * BGR order. A Gray8 image is returned as a copy.
      *
      * @return Image The resulting grayscale image
      */
-    Image toGrayscale();
+    Image toGrayscale() const;
+
+    /**
+     * @brief Converts the image to grayscale and writes the result into a caller-provided view.
+     *
+     * @param output Single-channel view receiving the grayscale pixels. Must have the same size
+     * as the image.
+     *
+     */
+    void toGrayscale(MutableImageView output) const;
+
+    /**
+     * @brief Converts BGR8 pixels to grayscale with the formula of toGrayscale(), or copies
+     * single-channel pixels.
+     *
+     * @param input The input pixels with 1 or 3 channels.
+     * @param output Single-channel view of the same size receiving the grayscale pixels.
+     *
+     */
+    static void toGrayscale(ImageView input, MutableImageView output);
+
+    /**
+     * @brief Converts the image to grayscale inside a list of rectangles only.
+     *
+     * @param regions The rectangles, see CUDAVISION::applyRegions.
+     *
+     * @return Image Grayscale image of the full size, zero outside of the rectangles.
+     */
+    Image toGrayscale(const std::vector<Rect>& regions) const;
+
+    /**
+     * @brief Converts pixels to grayscale inside a list of rectangles, leaving the rest of the
+     * output untouched.
+     *
+     * @param input The input pixels with 1 or 3 channels.
+     * @param output Single-channel view of the same size.
+     * @param regions The rectangles, see CUDAVISION::applyRegions.
+     *
+     */
+    static void toGrayscale(ImageView input, MutableImageView output,
+                            const std::vector<Rect>& regions);
 
    private:
-    unsigned int width;
-    unsigned int height;
+    unsigned int width = 0;
+    unsigned int height = 0;
+    PixelFormat format = PixelFormat::BGR8;
     std::vector<unsigned char> pixels;
 };
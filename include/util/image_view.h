@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+/**
+ * @struct BasicImageView
+ *
+ * @brief Non-owning, strided view on interleaved pixel data.
+ *
+ * A view never allocates or copies. It describes a block of pixels by a pointer to the first
+ * row, the number of bytes between two consecutive rows and the number of interleaved channels
+ * per pixel. The stride may be larger than width * channels (padded rows) or negative (rows
+ * stored in reverse order).
+ *
+ * @tparam T Element type, const-qualified for read-only views.
+ *
+ */
+template <typename T>
+struct BasicImageView {
+    /**
+     * @brief Pointer to the first element of the first row.
+     *
+     */
+    T* data = nullptr;
+    /**
+     * @brief Width of the view in pixels.
+     *
+     */
+    unsigned int width = 0;
+    /**
+     * @brief Height of the view in pixels.
+     *
+     */
+    unsigned int height = 0;
+    /**
+     * @brief Distance in bytes between the start of two consecutive rows.
+     *
+     */
+    std::ptrdiff_t stride = 0;
+    /**
+     * @brief Number of interleaved channels per pixel.
+     *
+     */
+    unsigned int channels = 0;
+
+    /**
+     * @brief Get a pointer to the first element of a row.
+     *
+     * @param y Row index.
+     *
+     * @return Pointer to the first element of row y.
+     *
+     */
+    T* row(unsigned int y) const {
+        using Byte = std::conditional_t<std::is_const_v<T>, const char, char>;
+        return reinterpret_cast<T*>(reinterpret_cast<Byte*>(data) +
+                                    static_cast<std::ptrdiff_t>(y) * stride);
+    }
+
+    /**
+     * @brief Number of elements in one row (width * channels).
+     *
+     */
+    std::size_t rowElements() const { return static_cast<std::size_t>(width) * channels; }
+
+    /**
+     * @brief Check whether the view covers no pixels.
+     *
+     */
+    bool empty() const { return data == nullptr || width == 0 || height == 0; }
+
+    /**
+     * @brief Get a view on a rectangular part of this view. No pixels are copied.
+     *
+     * @param x Left column of the sub view.
+     * @param y Top row of the sub view.
+     * @param w Width of the sub view.
+     * @param h Height of the sub view.
+     *
+     * @return The sub view sharing the pixels of this view.
+     *
+     */
+    BasicImageView subView(unsigned int x, unsigned int y, unsigned int w, unsigned int h) const {
+        return {row(y) + static_cast<std::size_t>(x) * channels, w, h, stride, channels};
+    }
+
+    /**
+     * @brief Implicit conversion from a mutable view to a read-only view.
+     *
+     */
+    operator BasicImageView<const T>() const
+        requires(!std::is_const_v<T>)
+    {
+        return {data, width, height, stride, channels};
+    }
+};
+
+/**
+ * @brief Read-only view on 8-bit pixel data.
+ *
+ */
+using ImageView = BasicImageView<const unsigned char>;
+
+/**
+ * @brief Writable view on 8-bit pixel data.
+ *
+ */
+using MutableImageView = BasicImageView<unsigned char>;
@@ -0,0 +1,64 @@
+#pragma once
+
+/**
+ * @enum PixelFormat
+ *
+ * @brief Memory layout of a single pixel.
+ *
+ */
+enum class PixelFormat {
+    /**
+     * @brief One unsigned 8-bit intensity channel.
+     *
+     */
+    Gray8,
+    /**
+     * @brief Three interleaved unsigned 8-bit channels in blue, green, red order.
+     *
+     */
+    BGR8,
+    /**
+     * @brief One signed 16-bit channel, e.g. for gradients.
+     *
+     */
+    Gray16S,
+    /**
+     * @brief One 32-bit floating point channel.
+     *
+     */
+    Float32,
+};
+
+/**
+ * @brief Get the number of channels of a pixel format.
+ *
+ * @param format The pixel format.
+ *
+ * @return Number of interleaved channels per pixel.
+ *
+ */
+constexpr unsigned int channelCount(PixelFormat format) {
+    return format == PixelFormat::BGR8 ? 3 : 1;
+}
+
+/**
+ * @brief Get the size of one pixel in bytes.
+ *
+ * @param format The pixel format.
+ *
+ * @return Number of bytes per pixel.
+ *
+ */
+constexpr unsigned int bytesPerPixel(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::Gray8:
+            return 1;
+        case PixelFormat::BGR8:
+            return 3;
+        case PixelFormat::Gray16S:
+            return 2;
+        case PixelFormat::Float32:
+            return 4;
+    }
+    return 0;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "util/image_view.h"
+
+/**
+ * Regions of interest
+ *
+ * The region overloads of the operators compute their result only inside a list of rectangles
+ * on the full image, e.g. the bounding boxes of a detector:
+ *
+ *     CUDAVISION::sobelOperator(gray.view(), edges.mutableView(), boxes);
+ *
+ * Pixels outside of the rectangles are neither computed nor written. The operators read the
+ * pixels around a rectangle as far as they reach, so the result inside equals the result of
+ * the operator on the whole image, without the border artifacts of cropping. Rectangles close
+ * to each other are merged first, so that overlaps and shared surroundings are computed once.
+ */
+
+/**
+ * @struct Rect
+ *
+ * @brief An axis-aligned rectangle of pixels.
+ *
+ */
+struct Rect {
+    unsigned int x = 0;
+    unsigned int y = 0;
+    unsigned int width = 0;
+    unsigned int height = 0;
+
+    /**
+     * @brief Get the column after the last column of the rectangle.
+     *
+     */
+    unsigned int right() const { return x + width; }
+
+    /**
+     * @brief Get the row after the last row of the rectangle.
+     *
+     */
+    unsigned int bottom() const { return y + height; }
+
+    bool empty() const { return width == 0 || height == 0; }
+
+    std::size_t area() const { return std::size_t{width} * height; }
+
+    /**
+     * @brief Checks whether the rectangles share at least one pixel.
+     *
+     */
+    bool intersects(const Rect& other) const {
+        return !empty() && !other.empty() && x < other.right() && other.x < right() &&
+               y < other.bottom() && other.y < bottom();
+    }
+
+    bool operator==(const Rect& other) const = default;
+};
+
+namespace CUDAVISION {
+    /**
+     * @struct RegionGroup
+     *
+     * @brief Rectangles computed together: the operator runs once on their bounding box grown
+     * by its reach, and only the rectangles themselves are written.
+     *
+     */
+    struct RegionGroup {
+        /**
+         * @brief The bounding box of the rectangles.
+         *
+         */
+        Rect bounds;
+        /**
+         * @brief The rectangles, clipped to the image.
+         *
+         */
+        std::vector<Rect> regions;
+    };
+
+    /**
+     * @brief Groups rectangles for applyRegions.
+     *
+     * @param regions The rectangles, clipped to the image. Empty rectangles are dropped.
+     * @param width Width of the image.
+     * @param height Height of the image.
+     * @param halo Number of pixels the operator reads around an output pixel.
+     *
+     * @return The groups. Rectangles sharing pixels always end up in the same group, so no pixel
+     * is written by two groups. Two groups are merged as long as their bounding box grown by the
+     * halo has no more pixels than their grown boxes together, i.e. whenever merging does not
+     * add work, which merges neighbors sharing their halo.
+     *
+     */
+    std::vector<RegionGroup> groupRegions(const std::vector<Rect>& regions, unsigned int width,
+                                          unsigned int height, unsigned int halo);
+
+    /**
+     * @brief An operator on linear views, called on a group's bounding box grown by the halo.
+     *
+     */
+    using RegionFunction = std::function<void(ImageView, MutableImageView)>;
+
+    /**
+     * @brief Runs an operator inside a list of rectangles, the groups spread over the thread
+     * pool.
+     *
+     * @param input The full input image.
+     * @param output View of the size of the input receiving the result inside the rectangles,
+     * its channel count is the one the operator produces. Must not overlap the input.
+     * @param regions The rectangles, see groupRegions.
+     * @param halo Number of pixels the operator reads around an output pixel.
+     * @param function The operator, called with a view of the input around a group and a view
+     * of the same size.
+     *
+     * @note As applyTiled, the grown box is clamped to the image, so the operator sees the true
+     * image border where there is one and computes wrong values only within the halo, which is
+     * dropped. The result inside the rectangles equals the operator on the whole image for every
+     * operator of bounded reach. A single group parallelizes inside of the operator.
+     *
+     */
+    void applyRegions(ImageView input, MutableImageView output, const std::vector<Rect>& regions,
+                      unsigned int halo, const RegionFunction& function);
+}  // namespace CUDAVISION
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace CUDAVISION {
+    /**
+     * @class ThreadPool
+     *
+     * @brief Work-stealing thread pool executing parallel loops.
+     *
+     * Every worker owns a task queue. parallelFor splits its range into chunks, spreads them over
+     * the queues and lets the calling thread work along. Workers take tasks from the back of
+     * their own queue and steal from the front of the others once it runs dry, which balances
+     * bands of uneven cost without a central queue.
+     *
+     */
+    class ThreadPool {
+       public:
+        /**
+         * @brief Constructor starting threadCount - 1 workers, the caller of parallelFor is the
+         * remaining thread.
+         *
+         * @param threadCount Number of threads working on a loop, at least 1.
+         *
+         */
+        explicit ThreadPool(unsigned int threadCount);
+
+        /**
+         * @brief Destructor, waits for the workers to finish.
+         *
+         */
+        ~ThreadPool();
+
+        /**
+         * @brief Stops the workers once the queued chunks are done and waits for them.
+         *
+         * @note The pool stays usable: later parallel loops run all chunks on the calling
+         * thread. setThreadCount retires the pool it replaces this way instead of destroying it,
+         * so that references held by running operators stay valid.
+         *
+         */
+        void retire();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+         * @brief Number of threads working on a loop, including the caller.
+         *
+         */
+        unsigned int getThreadCount() const;
+
+        /**
+         * @brief Calls body(chunkBegin, chunkEnd) for consecutive chunks of [begin, end) in
+         * parallel and returns once all chunks are done.
+         *
+         * @param begin First index of the range.
+         * @param end One past the last index of the range.
+         * @param grain Size of a chunk, the last chunk may be smaller.
+         * @param body Function processing one chunk. Exceptions are rethrown in the caller.
+         *
+         * @note Calls from within the body of a parallel loop run the whole range on the
+         * calling thread, so nested parallel loops cannot deadlock. The calling thread only
+         * runs chunks of its own loop, never those of a loop another thread started.
+         *
+         */
+        void parallelFor(std::size_t begin, std::size_t end, std::size_t grain,
+                         const std::function<void(std::size_t, std::size_t)>& body);
+
+       private:
+        struct Job {
+            const std::function<void(std::size_t, std::size_t)>* body;
+            std::atomic<std::size_t> remaining;
+            std::mutex mutex;
+            std::condition_variable finished;
+            std::exception_ptr error;
+        };
+        struct Task {
+            Job* job;
+            std::size_t begin;
+            std::size_t end;
+        };
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        bool takeTask(std::size_t queueIndex, Task& task);
+        bool takeJobTask(const Job& job, Task& task);
+        void runTask(const Task& task);
+        void workerLoop(std::size_t queueIndex);
+
+        // Queue 0 belongs to the threads calling parallelFor, queue i > 0 to worker i - 1.
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::mutex wakeMutex;
+        std::condition_variable wake;
+        std::atomic<std::size_t> queuedTasks{0};
+        bool stopping = false;
+    };
+
+    /**
+     * @brief Set the number of threads used by the CUDAVISION operators.
+     *
+     * @param threadCount Number of threads, 0 for std::thread::hardware_concurrency().
+     *
+     * @note Replaces the global pool. The old pool is retired, not destroyed: operators still
+     * running on it finish on their calling threads, at most one thread each. The default is
+     * taken from the environment variable CUDAVISION_THREADS, or 0.
+     *
+     */
+    void setThreadCount(unsigned int threadCount);
+
+    /**
+     * @brief Get the number of threads used by the CUDAVISION operators.
+     *
+     */
+    unsigned int getThreadCount();
+
+    /**
+     * @brief Set the number of rows per task of the row-band parallel operators.
+     *
+     * @param rows Rows per band, 0 to split every image into four bands per thread.
+     *
+     */
+    void setGrainSize(unsigned int rows);
+
+    /**
+     * @brief Get the number of rows per task, 0 for automatic.
+     *
+     */
+    unsigned int getGrainSize();
+
+    /**
+     * @brief Get the pool used by the CUDAVISION operators.
+     *
+     * @note The first call applies CUDAVISION_BACKEND and creates the pool under a mutex, later
+     * calls are a single atomic load.
+     *
+     */
+    ThreadPool& getThreadPool();
+
+    /**
+     * @brief Processes the rows [0, height) in parallel bands on the global pool.
+     *
+     * @param height Number of output rows.
+     * @param body Function computing the output rows [begin, end).
+     *
+     * @note Operators read the input directly, so a band reaches its halo rows (1 for the 3x3
+     * stencils, the kernel radius for the convolutions) by reading beyond its own rows. Every
+     * output row is computed exactly as in a single-threaded run, the results are bit-identical
+     * for any thread count and grain size.
+     *
+     */
+    void parallelForRows(unsigned int height,
+                         const std::function<void(unsigned int, unsigned int)>& body);
+}  // namespace CUDAVISION
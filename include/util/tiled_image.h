@@ -0,0 +1,202 @@
+#pragma once
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "util/image.h"
+#include "util/image_view.h"
+
+/**
+ * Tiled image layout
+ *
+ * A TiledImage stores its pixels in square tiles (256 x 256 by default), each tile contiguous in
+ * memory, tiles in row-major order. Neighboring rows of a tile are tileSize * channels bytes
+ * apart instead of width * channels, so the taps of a vertical or 2D stencil fall into a few
+ * cache lines and pages even on very wide images. Tiles are also the unit of parallel work:
+ * applyTiled() runs an operator tile by tile on the thread pool.
+ *
+ * The layout is converted from and to linear views at the I/O boundary, e.g.
+ *
+ *     TiledImage tiled(image.view());
+ *     TiledImage edges(tiled.getWidth(), tiled.getHeight(), 1);
+ *     applyStencil<SobelStencil>(tiled, edges);
+ *     Image result = edges.toImage();
+ */
+
+/**
+ * @class TiledImage
+ *
+ * @brief An 8-bit image stored in contiguous square tiles.
+ *
+ */
+class TiledImage {
+   public:
+    /**
+     * @brief Default edge length of a tile in pixels. A BGR8 tile of 192 KiB stays in L2, and
+     * its rows are long enough for the vector loops of the operators.
+     *
+     */
+    static constexpr unsigned int DEFAULT_TILE_SIZE = 256;
+
+    /**
+     * @brief Constructor to create a zero-initialized tiled image.
+     *
+     * @param width Width of the image.
+     * @param height Height of the image.
+     * @param channels Number of interleaved channels, 1 (Gray8) or 3 (BGR8).
+     * @param tileSize Edge length of a tile in pixels.
+     *
+     * @note Tiles at the right and bottom border are allocated completely, their pixels outside
+     * of the image are unused.
+     *
+     */
+    TiledImage(unsigned int width, unsigned int height, unsigned int channels,
+               unsigned int tileSize = DEFAULT_TILE_SIZE);
+
+    /**
+     * @brief Constructor converting linear pixels into the tiled layout.
+     *
+     * @param linear The pixels to convert.
+     * @param tileSize Edge length of a tile in pixels.
+     *
+     */
+    explicit TiledImage(ImageView linear, unsigned int tileSize = DEFAULT_TILE_SIZE);
+
+    /**
+     * @brief Destructor, returns the pixel buffer to the pool.
+     *
+     */
+    ~TiledImage();
+
+    TiledImage(TiledImage&& other) noexcept = default;
+    TiledImage& operator=(TiledImage&& other) noexcept;
+    TiledImage(const TiledImage&) = delete;
+    TiledImage& operator=(const TiledImage&) = delete;
+
+    unsigned int getWidth() const { return width; }
+    unsigned int getHeight() const { return height; }
+    unsigned int getChannels() const { return channels; }
+    unsigned int getTileSize() const { return tileSize; }
+
+    /**
+     * @brief Get the number of tiles per tile row.
+     *
+     */
+    unsigned int getTileColumns() const { return columns; }
+
+    /**
+     * @brief Get the number of tile rows.
+     *
+     */
+    unsigned int getTileRows() const { return rows; }
+
+    /**
+     * @brief Get a view on one tile, clipped to the image.
+     *
+     * @param tx Tile column.
+     * @param ty Tile row.
+     *
+     * @return A view of at most tileSize x tileSize pixels with stride tileSize * channels.
+     *
+     */
+    ImageView tile(unsigned int tx, unsigned int ty) const;
+
+    /**
+     * @brief Get a writable view on one tile, clipped to the image.
+     *
+     */
+    MutableImageView mutableTile(unsigned int tx, unsigned int ty);
+
+    /**
+     * @brief Get a pointer to the channels of a pixel.
+     *
+     * @note Pixels are contiguous only up to the right border of their tile.
+     *
+     */
+    const unsigned char* pixel(unsigned int x, unsigned int y) const {
+        return pixels.data() + tileOffset(x / tileSize, y / tileSize) +
+               (static_cast<std::size_t>(y % tileSize) * tileSize + x % tileSize) * channels;
+    }
+
+    /**
+     * @brief Get a writable pointer to the channels of a pixel.
+     *
+     */
+    unsigned char* pixel(unsigned int x, unsigned int y) {
+        return const_cast<unsigned char*>(std::as_const(*this).pixel(x, y));
+    }
+
+    /**
+     * @brief Copies a rectangle into linear memory.
+     *
+     * @param x Left column of the rectangle.
+     * @param y Top row of the rectangle.
+     * @param target View receiving the rectangle, its size is the size of the rectangle. Must
+     * have the channel count of the image and lie within it.
+     *
+     */
+    void copyTo(unsigned int x, unsigned int y, MutableImageView target) const;
+
+    /**
+     * @brief Copies linear pixels into a rectangle.
+     *
+     * @param x Left column of the rectangle.
+     * @param y Top row of the rectangle.
+     * @param source The pixels, its size is the size of the rectangle.
+     *
+     */
+    void copyFrom(unsigned int x, unsigned int y, ImageView source);
+
+    /**
+     * @brief Converts the image back to the linear layout.
+     *
+     * @return A Gray8 or BGR8 image.
+     *
+     */
+    Image toImage() const;
+
+   private:
+    std::size_t tileOffset(unsigned int tx, unsigned int ty) const {
+        return (static_cast<std::size_t>(ty) * columns + tx) * tileSize * tileSize * channels;
+    }
+
+    unsigned int width;
+    unsigned int height;
+    unsigned int channels;
+    unsigned int tileSize;
+    unsigned int columns;
+    unsigned int rows;
+    std::vector<unsigned char> pixels;
+};
+
+namespace CUDAVISION {
+    /**
+     * @brief An operator on linear views, see applyTiled().
+     *
+     */
+    using TileFunction = std::function<void(ImageView, MutableImageView)>;
+
+    /**
+     * @brief Runs an operator tile by tile, the tiles spread over the thread pool.
+     *
+     * @param input The input image.
+     * @param output Image of the same size and tile size receiving the result, its channel count
+     * is the one the operator produces. Must not be the input.
+     * @param haloX Number of pixels the operator reads left and right of an output pixel.
+     * @param haloY Number of pixels the operator reads above and below an output pixel.
+     * @param function The operator, called with a linear copy of a tile grown by the halo and a
+     * view of the same size.
+     *
+     * @throws std::invalid_argument If the sizes or tile sizes differ.
+     *
+     * @note The grown tile is clamped to the image, so the operator sees the true image border
+     * where there is one and computes wrong values only within the halo, which is dropped. The
+     * result equals the operator on the whole image for every operator of bounded reach. The
+     * halo is computed once per neighboring tile, i.e. (1 + 2 * halo / tileSize)^2 times the
+     * work for a 2D halo.
+     *
+     */
+    void applyTiled(const TiledImage& input, TiledImage& output, unsigned int haloX,
+                    unsigned int haloY, const TileFunction& function);
+}  // namespace CUDAVISION
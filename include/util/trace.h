@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+/**
+ * Tracing
+ *
+ * Scoped timers on the operators and I/O calls, recorded into a ring buffer per thread, and
+ * counters for bytes read and written and for allocations. Recording is switched on at runtime
+ * with setTracing() or the environment variable CUDAVISION_TRACE. CUDAVISION_TRACE=<file.json>
+ * writes a Chrome trace (chrome://tracing, ui.perfetto.dev) and prints the summary to stderr
+ * when the process exits. While tracing is off, a timer costs one relaxed atomic load.
+ *
+ * The CMake option CUDAVISION_TRACING=OFF compiles the timers and counters out completely. The
+ * functions below stay available and then report an empty trace.
+ */
+
+#ifndef CUDAVISION_TRACING
+#define CUDAVISION_TRACING 1
+#endif
+
+namespace CUDAVISION {
+    /**
+     * @enum Counter
+     *
+     * @brief Counters accumulated while tracing.
+     *
+     */
+    enum class Counter { BytesRead, BytesWritten, Allocations, AllocatedBytes };
+
+    /**
+     * @brief Whether events are being recorded. Read by every scoped timer.
+     *
+     */
+    inline std::atomic<bool> tracingActive{false};
+
+    /**
+     * @brief Get whether events are being recorded.
+     *
+     */
+    inline bool isTracing() { return tracingActive.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Start or stop recording. Recorded events are kept until clearTrace().
+     *
+     * @param enabled Whether to record.
+     *
+     */
+    void setTracing(bool enabled);
+
+    /**
+     * @brief Discard all recorded events and reset the counters.
+     *
+     */
+    void clearTrace();
+
+    /**
+     * @brief Records a finished span on the calling thread, used by ScopedTimer.
+     *
+     * @param name Name of the span, must outlive the trace (a string literal).
+     * @param begin Start in nanoseconds of std::chrono::steady_clock.
+     * @param end End in nanoseconds of std::chrono::steady_clock.
+     *
+     */
+    void recordSpan(const char* name, std::int64_t begin, std::int64_t end);
+
+    /**
+     * @brief Adds to a counter and records its new value.
+     *
+     * @param counter The counter.
+     * @param amount The increment.
+     *
+     */
+    void addToCounter(Counter counter, std::uint64_t amount);
+
+    /**
+     * @brief Writes the recorded events as Chrome trace event JSON.
+     *
+     * @param filePath Path of the JSON file.
+     *
+     * @throws std::runtime_error If the file cannot be written.
+     *
+     * @note Every thread keeps only its most recent events, older ones are overwritten. The
+     * number of overwritten events is part of the summary.
+     *
+     */
+    void writeChromeTrace(const std::filesystem::path& filePath);
+
+    /**
+     * @brief Get a text summary: calls, total, mean and maximum time per span name, the
+     * counters and the number of overwritten events.
+     *
+     * @note The span statistics include the overwritten events.
+     *
+     */
+    std::string getTraceSummary();
+
+    /**
+     * @class ScopedTimer
+     *
+     * @brief Records the lifetime of a scope as a span, if tracing is on when it starts.
+     *
+     */
+    class ScopedTimer {
+       public:
+        explicit ScopedTimer(const char* name) : name(isTracing() ? name : nullptr) {
+            if (this->name) {
+                begin = now();
+            }
+        }
+
+        ~ScopedTimer() {
+            if (name) {
+                recordSpan(name, begin, now());
+            }
+        }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+       private:
+        static std::int64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                .count();
+        }
+
+        const char* name;
+        std::int64_t begin = 0;
+    };
+}  // namespace CUDAVISION
+
+#define CUDAVISION_TRACE_CONCAT_(a, b) a##b
+#define CUDAVISION_TRACE_CONCAT(a, b) CUDAVISION_TRACE_CONCAT_(a, b)
+
+#if CUDAVISION_TRACING
+/**
+ * Times the rest of the enclosing scope under the given name (a string literal).
+ */
+#define CUDAVISION_TRACE_SCOPE(name) \
+    ::CUDAVISION::ScopedTimer CUDAVISION_TRACE_CONCAT(traceScope, __LINE__)(name)
+/**
+ * Adds amount to a CUDAVISION::Counter while tracing.
+ */
+#define CUDAVISION_TRACE_COUNT(counter, amount)                                            \
+    do {                                                                                   \
+        if (::CUDAVISION::isTracing()) {                                                   \
+            ::CUDAVISION::addToCounter(::CUDAVISION::Counter::counter,                     \
+                                       static_cast<std::uint64_t>(amount));                \
+        }                                                                                  \
+    } while (false)
+#else
+#define CUDAVISION_TRACE_SCOPE(name) static_cast<void>(0)
+#define CUDAVISION_TRACE_COUNT(counter, amount) static_cast<void>(0)
+#endif
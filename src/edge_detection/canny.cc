@@ -1,8 +1,15 @@
 #include "edge_detection/canny.h"
 
+#include <algorithm>
 #include <cmath>
+#include <memory>
+#include <mutex>
 #include <vector>
 
+#include "util/backend.h"
+#include "util/thread_pool.h"
+#include "util/trace.h"
+
 namespace CUDAVISION {
     /**
      * Canny Edge Detection
@@ -35,159 +42,563 @@ namespace CUDAVISION {
     }
 
     Image horizontalConvolution(const Image& image, const std::vector<double>& kernel) {
-        int height = image.getHeight();
-        int width = image.getWidth();
-        const std::vector<unsigned char>& pixels = image.getPixels();
-        std::vector<unsigned char> outputPixels(3 * height * width);
-        int kernelMid = kernel.size() / 2;
-
-        for (int i = 0; i < height; i++) {
-            for (int j = 0; j < width; j++) {
-                double sumR = 0.0, sumG = 0.0, sumB = 0.0;
-                for (int k = -kernelMid; k <= kernelMid; k++) {
-                    int px = std::min(std::max(j + k, 0), width - 1);
-                    sumB += pixels[3 * (i * width + px)] * kernel[k + kernelMid];
-                    sumG += pixels[3 * (i * width + px) + 1] * kernel[k + kernelMid];
-                    sumR += pixels[3 * (i * width + px) + 2] * kernel[k + kernelMid];
+        Image output(image.getWidth(), image.getHeight(), image.getFormat());
+        horizontalConvolution(image.view(), output.mutableView(), kernel);
+        return output;
+    }
+
+    void horizontalConvolution(ImageView input, MutableImageView output,
+                               const std::vector<double>& kernel) {
+        horizontalConvolution(input, output, FixedPointKernel::fromKernel(kernel));
+    }
+
+    Image verticalConvolution(const Image& image, const std::vector<double>& kernel) {
+        Image output(image.getWidth(), image.getHeight(), image.getFormat());
+        verticalConvolution(image.view(), output.mutableView(), kernel);
+        return output;
+    }
+
+    void verticalConvolution(ImageView input, MutableImageView output,
+                             const std::vector<double>& kernel) {
+        verticalConvolution(input, output, FixedPointKernel::fromKernel(kernel));
+    }
+
+    std::vector<double> getEquivalentKernel(const std::vector<double>& kernel, int passes) {
+        std::vector<double> equivalent = {1.0};
+        for (int pass = 0; pass < passes; pass++) {
+            std::vector<double> next(equivalent.size() + kernel.size() - 1, 0.0);
+            for (size_t i = 0; i < equivalent.size(); i++) {
+                for (size_t k = 0; k < kernel.size(); k++) {
+                    next[i + k] += equivalent[i] * kernel[k];
                 }
+            }
+            equivalent = std::move(next);
+        }
+        return equivalent;
+    }
+
+    /**
+     * Returns the fixed-point Gaussian kernel applied 'passes' times, caching the kernel of the
+     * last call per thread so that a pipeline running with fixed parameters does not rebuild it
+     * for every frame. The kernel is shared, not borrowed: a later call on the same thread with
+     * other parameters, e.g. from a region group or a re-entrant operator, replaces the cache
+     * entry but leaves the kernel a running pass holds intact.
+     */
+    static std::shared_ptr<const FixedPointKernel> cachedGaussianKernel(int kernelSize,
+                                                                        double sigma, int passes) {
+        thread_local int cachedSize = -1;
+        thread_local double cachedSigma = 0.0;
+        thread_local int cachedPasses = -1;
+        thread_local std::shared_ptr<const FixedPointKernel> kernel;
+        if (!kernel || kernelSize != cachedSize || sigma != cachedSigma ||
+            passes != cachedPasses) {
+            kernel = std::make_shared<const FixedPointKernel>(FixedPointKernel::fromKernel(
+                getEquivalentKernel(getGaussianKernel(kernelSize, sigma), passes)));
+            cachedSize = kernelSize;
+            cachedSigma = sigma;
+            cachedPasses = passes;
+        }
+        return kernel;
+    }
+
+    Image gaussianSmooth(const Image& image, int kernelSize, double sigma) {
+        return gaussianSmooth(image, kernelSize, sigma, SmoothingMode::Multipass);
+    }
+
+    Image gaussianSmooth(const Image& image, int kernelSize, double sigma, SmoothingMode mode) {
+        Image output(image.getWidth(), image.getHeight(), image.getFormat());
+        if (mode == SmoothingMode::Fused) {
+            gaussianSmoothFused(image.view(), output.mutableView(), kernelSize, sigma);
+            return output;
+        }
+        Image scratch(image.getWidth(), image.getHeight(), image.getFormat());
+        gaussianSmooth(image.view(), output.mutableView(), scratch.mutableView(), kernelSize,
+                       sigma);
+        return output;
+    }
+
+    void gaussianSmooth(ImageView input, MutableImageView output, MutableImageView scratch,
+                        int kernelSize, double sigma) {
+        CUDAVISION_TRACE_SCOPE("gaussianSmooth");
+        const std::shared_ptr<const FixedPointKernel> kernel =
+            cachedGaussianKernel(kernelSize, sigma, 1);
+        // Ping-pong between scratch and output so that the last of the six passes lands in
+        // output: V(in -> scratch), V(scratch -> out), V(out -> scratch), H(scratch -> out), ...
+        verticalConvolution(input, scratch, *kernel);
+        verticalConvolution(scratch, output, *kernel);
+        verticalConvolution(output, scratch, *kernel);
+        horizontalConvolution(scratch, output, *kernel);
+        horizontalConvolution(output, scratch, *kernel);
+        horizontalConvolution(scratch, output, *kernel);
+    }
+
+    void gaussianSmoothFused(ImageView input, MutableImageView output, int kernelSize,
+                             double sigma) {
+        CUDAVISION_TRACE_SCOPE("gaussianSmoothFused");
+        if (const auto& replaced = getBackendOperators().gaussianSmoothFused) {
+            replaced(input, output, kernelSize, sigma);
+            return;
+        }
+        const std::shared_ptr<const FixedPointKernel> kernel =
+            cachedGaussianKernel(kernelSize, sigma, 3);
+        separableConvolution(input, output, *kernel, *kernel);
+    }
+
+    Image gaussianSmooth(const Image& image, const std::vector<Rect>& regions, int kernelSize,
+                         double sigma, SmoothingMode mode) {
+        Image output(image.getWidth(), image.getHeight(), image.getFormat());
+        gaussianSmooth(image.view(), output.mutableView(), regions, kernelSize, sigma, mode);
+        return output;
+    }
 
-                int pixelIdx = i * width + j;
-                outputPixels[3 * pixelIdx] =
-                    static_cast<unsigned char>(std::min(std::max(sumB, 0.0), 255.0));
-                outputPixels[3 * pixelIdx + 1] =
-                    static_cast<unsigned char>(std::min(std::max(sumG, 0.0), 255.0));
-                outputPixels[3 * pixelIdx + 2] =
-                    static_cast<unsigned char>(std::min(std::max(sumR, 0.0), 255.0));
+    void gaussianSmooth(ImageView input, MutableImageView output,
+                        const std::vector<Rect>& regions, int kernelSize, double sigma,
+                        SmoothingMode mode) {
+        CUDAVISION_TRACE_SCOPE("gaussianSmooth regions");
+        // Both modes reach as far as the kernel applied three times.
+        const unsigned int halo = cachedGaussianKernel(kernelSize, sigma, 3)->radius();
+        applyRegions(input, output, regions, halo, [&](ImageView in, MutableImageView out) {
+            if (mode == SmoothingMode::Fused) {
+                gaussianSmoothFused(in, out, kernelSize, sigma);
+                return;
             }
+            Image scratch(in.width, in.height,
+                          in.channels == 1 ? PixelFormat::Gray8 : PixelFormat::BGR8);
+            gaussianSmooth(in, out, scratch.mutableView(), kernelSize, sigma);
+        });
+    }
+
+    /**
+     * Sets every pixel of the view to zero, used for the border of the edge operators.
+     */
+    static void clearView(MutableImageView view) {
+        for (unsigned int i = 0; i < view.height; i++) {
+            std::fill_n(view.row(i), view.rowElements(), 0);
         }
+    }
 
-        return Image(width, height, outputPixels);
+    Image robertsOperator(const Image& image) {
+        Image output(image.getWidth(), image.getHeight(), image.getFormat());
+        robertsOperator(image.view(), output.mutableView());
+        return output;
     }
 
-    Image verticalConvolution(const Image& image, const std::vector<double>& kernel) {
-        int height = image.getHeight();
-        int width = image.getWidth();
-        const std::vector<unsigned char>& pixels = image.getPixels();
-        std::vector<unsigned char> outputPixels(3 * height * width);
-        int kernelMid = kernel.size() / 2;
-
-        for (int i = 0; i < height; i++) {
-            for (int j = 0; j < width; j++) {
-                double sumR = 0.0, sumG = 0.0, sumB = 0.0;
-                for (int k = -kernelMid; k <= kernelMid; k++) {
-                    int py = std::min(std::max(i + k, 0), height - 1);
-                    sumB += pixels[3 * (py * width + j)] * kernel[k + kernelMid];
-                    sumG += pixels[3 * (py * width + j) + 1] * kernel[k + kernelMid];
-                    sumR += pixels[3 * (py * width + j) + 2] * kernel[k + kernelMid];
-                }
+    void robertsOperator(ImageView input, MutableImageView output,
+                         const StencilOptions& options, Histogram* histogram) {
+        CUDAVISION_TRACE_SCOPE("robertsOperator");
+        if (const auto& replaced = getBackendOperators().robertsOperator; replaced && !histogram) {
+            replaced(input, output, options);
+            return;
+        }
+        applyStencil<RobertsStencil>(input, output, options, histogram);
+    }
+
+    Image robertsOperator(const Image& image, const std::vector<Rect>& regions) {
+        Image output(image.getWidth(), image.getHeight(), image.getFormat());
+        robertsOperator(image.view(), output.mutableView(), regions);
+        return output;
+    }
+
+    void robertsOperator(ImageView input, MutableImageView output,
+                         const std::vector<Rect>& regions, const StencilOptions& options) {
+        CUDAVISION_TRACE_SCOPE("robertsOperator regions");
+        applyStencil<RobertsStencil>(input, output, regions, options);
+    }
+
+    Image prewittOperator(const Image& image) {
+        Image output(image.getWidth(), image.getHeight(), image.getFormat());
+        prewittOperator(image.view(), output.mutableView());
+        return output;
+    }
+
+    void prewittOperator(ImageView input, MutableImageView output,
+                         const StencilOptions& options, Histogram* histogram) {
+        CUDAVISION_TRACE_SCOPE("prewittOperator");
+        if (const auto& replaced = getBackendOperators().prewittOperator; replaced && !histogram) {
+            replaced(input, output, options);
+            return;
+        }
+        applyStencil<PrewittStencil>(input, output, options, histogram);
+    }
+
+    Image prewittOperator(const Image& image, const std::vector<Rect>& regions) {
+        Image output(image.getWidth(), image.getHeight(), image.getFormat());
+        prewittOperator(image.view(), output.mutableView(), regions);
+        return output;
+    }
+
+    void prewittOperator(ImageView input, MutableImageView output,
+                         const std::vector<Rect>& regions, const StencilOptions& options) {
+        CUDAVISION_TRACE_SCOPE("prewittOperator regions");
+        applyStencil<PrewittStencil>(input, output, regions, options);
+    }
+
+    Image sobelOperator(const Image& image) {
+        Image output(image.getWidth(), image.getHeight(), image.getFormat());
+        sobelOperator(image.view(), output.mutableView());
+        return output;
+    }
+
+    void sobelOperator(ImageView input, MutableImageView output,
+                       const StencilOptions& options, Histogram* histogram) {
+        CUDAVISION_TRACE_SCOPE("sobelOperator");
+        if (const auto& replaced = getBackendOperators().sobelOperator; replaced && !histogram) {
+            replaced(input, output, options);
+            return;
+        }
+        applyStencil<SobelStencil>(input, output, options, histogram);
+    }
+
+    Image sobelOperator(const Image& image, const std::vector<Rect>& regions) {
+        Image output(image.getWidth(), image.getHeight(), image.getFormat());
+        sobelOperator(image.view(), output.mutableView(), regions);
+        return output;
+    }
 
-                int pixelIdx = i * width + j;
-                outputPixels[3 * pixelIdx] =
-                    static_cast<unsigned char>(std::min(std::max(sumB, 0.0), 255.0));
-                outputPixels[3 * pixelIdx + 1] =
-                    static_cast<unsigned char>(std::min(std::max(sumG, 0.0), 255.0));
-                outputPixels[3 * pixelIdx + 2] =
-                    static_cast<unsigned char>(std::min(std::max(sumR, 0.0), 255.0));
+    void sobelOperator(ImageView input, MutableImageView output,
+                       const std::vector<Rect>& regions, const StencilOptions& options) {
+        CUDAVISION_TRACE_SCOPE("sobelOperator regions");
+        applyStencil<SobelStencil>(input, output, regions, options);
+    }
+
+    /**
+     * Direction sectors of the gradient, naming the axis along which non-maximum suppression
+     * compares a pixel with its two neighbours.
+     */
+    enum GradientSector : unsigned char { SECTOR_0, SECTOR_45, SECTOR_90, SECTOR_135 };
+
+    /**
+     * States of the edge map during Canny, replaced by 0 / 255 at the end.
+     */
+    enum EdgeState : unsigned char { EDGE_NONE = 0, EDGE_WEAK = 1, EDGE_STRONG = 2 };
+
+    /**
+     * Computes Sobel magnitude and direction sector of the interior pixels of row y.
+     */
+    static void cannyGradientRow(ImageView input, int y, int16_t* magnitude,
+                                 unsigned char* sector) {
+        // tan(22.5) and tan(67.5) in Q15, to quantize the direction without atan2.
+        constexpr int32_t TAN_22_5 = 13573;
+        constexpr int32_t TAN_67_5 = 79109;
+        const unsigned char* r0 = input.row(y - 1);
+        const unsigned char* r1 = input.row(y);
+        const unsigned char* r2 = input.row(y + 1);
+        const int width = input.width;
+        for (int x = 1; x < width - 1; x++) {
+            int gx =
+                (r0[x + 1] - r0[x - 1]) + 2 * (r1[x + 1] - r1[x - 1]) + (r2[x + 1] - r2[x - 1]);
+            int gy = (r2[x - 1] + 2 * r2[x] + r2[x + 1]) - (r0[x - 1] + 2 * r0[x] + r0[x + 1]);
+            int ax = std::abs(gx), ay = std::abs(gy);
+            magnitude[x] = static_cast<int16_t>(ax + ay);
+            int32_t scaled = ay << 15;
+            if (scaled < ax * TAN_22_5) {
+                sector[x] = SECTOR_0;
+            } else if (scaled > ax * TAN_67_5) {
+                sector[x] = SECTOR_90;
+            } else {
+                sector[x] = (gx ^ gy) < 0 ? SECTOR_135 : SECTOR_45;
             }
         }
+    }
 
-        return Image(width, height, outputPixels);
+    /**
+     * Whether the center of row y is a local maximum along its gradient direction, given the
+     * magnitudes of rows y - 1, y and y + 1.
+     */
+    static inline bool isGradientMaximum(const int16_t* above, const int16_t* center,
+                                         const int16_t* below, unsigned char sector, int x) {
+        const int m = center[x];
+        int a, b;
+        switch (sector) {
+            case SECTOR_0:
+                a = center[x - 1], b = center[x + 1];
+                break;
+            case SECTOR_90:
+                a = above[x], b = below[x];
+                break;
+            case SECTOR_45:
+                a = above[x - 1], b = below[x + 1];
+                break;
+            default:
+                a = above[x + 1], b = below[x - 1];
+                break;
+        }
+        // Strict on one side only, so that plateaus of equal magnitude keep one pixel.
+        return m > a && m >= b;
     }
 
-    Image gaussianSmooth(const Image& image, int kernelSize, double sigma) {
-        std::vector<double> kernel = getGaussianKernel(kernelSize, sigma);
-        Image tempImage = image;
-        for (int i = 0; i < 3; i++) {
-            tempImage = verticalConvolution(tempImage, kernel);
+    /**
+     * Classifies a local maximum of magnitude m above the low threshold into the edge map and
+     * pushes it onto the stack if it is strong.
+     */
+    static inline void cannyClassify(int m, unsigned char* edge, int highThreshold,
+                                     std::vector<unsigned char*>& stack) {
+        if (m > highThreshold) {
+            *edge = EDGE_STRONG;
+            stack.push_back(edge);
+        } else {
+            *edge = EDGE_WEAK;
         }
-        for (int i = 0; i < 3; i++) {
-            tempImage = horizontalConvolution(tempImage, kernel);
+    }
+
+    /**
+     * Non-maximum suppression of row y, given the magnitudes of rows y - 1, y and y + 1.
+     * Classifies the maxima into the edge map and pushes the strong ones onto the stack.
+     */
+    static void cannySuppressRow(const int16_t* above, const int16_t* center, const int16_t* below,
+                                 const unsigned char* sector, unsigned char* edges, int width,
+                                 int lowThreshold, int highThreshold,
+                                 std::vector<unsigned char*>& stack) {
+        for (int x = 1; x < width - 1; x++) {
+            const int m = center[x];
+            if (m > lowThreshold && isGradientMaximum(above, center, below, sector[x], x)) {
+                cannyClassify(m, edges + x, highThreshold, stack);
+            }
         }
-        return tempImage;
     }
 
-    Image robertsOperator(const Image& image) {
-        std::vector<int> kx = {1, 0, 0, -1};
-        std::vector<int> ky = {0, 1, -1, 0};
-        unsigned int height = image.getHeight();
-        unsigned int width = image.getWidth();
-        const auto& pixels = image.getPixels();
-        std::vector<unsigned char> outputPixels(3 * height * width, 0);
-
-        for (int i = 0; i < height - 1; i++) {
-            for (int j = 0; j < width - 1; j++) {
-                int idx = 3 * (i * width + j);
-                for (int c = 0; c < 3; c++) {
-                    int gx = kx[0] * pixels[idx + c] + kx[3] * pixels[idx + 3 * (width + 1) + c];
-                    int gy = ky[1] * pixels[idx + 3 + c] + ky[2] * pixels[idx + 3 * width + c];
-                    int gradient = static_cast<int>(std::sqrt(gx * gx + gy * gy));
-                    outputPixels[idx + c] =
-                        static_cast<unsigned char>(std::min(255, std::max(0, gradient)));
+    /**
+     * Computes the gradient of the rows first - 1 to last of a band into rolling buffers of
+     * three rows, indexed by y % 3, and calls suppressRow(y, above, center, below, sector) for
+     * every row y in [first, last). Row 0 and row height - 1 have no gradient, their slot stays
+     * zero.
+     */
+    template <typename SuppressRow>
+    static void cannyGradientBand(ImageView input, int first, int last, SuppressRow suppressRow) {
+        const int width = input.width;
+        const int height = input.height;
+        thread_local std::vector<int16_t> magnitudes;
+        thread_local std::vector<unsigned char> sectors;
+        magnitudes.assign(3 * width, 0);
+        sectors.assign(3 * width, SECTOR_0);
+        auto magnitude = [&](int y) { return magnitudes.data() + (y % 3) * width; };
+        auto sector = [&](int y) { return sectors.data() + (y % 3) * width; };
+
+        for (int y = first - 1; y <= last; y++) {
+            if (y >= 1 && y < height - 1) {
+                cannyGradientRow(input, y, magnitude(y), sector(y));
+            } else {
+                std::fill_n(magnitude(y), width, 0);
+            }
+            if (y >= first + 1) {
+                suppressRow(y - 1, magnitude(y - 2), magnitude(y - 1), magnitude(y),
+                            sector(y - 1));
+            }
+        }
+    }
+
+    /**
+     * Hysteresis: every weak pixel 8-connected to a strong one becomes strong. Strong pixels are
+     * interior pixels, so all their neighbours lie inside the image.
+     */
+    static void cannyHysteresis(MutableImageView output, std::vector<unsigned char*>& stack) {
+        const std::ptrdiff_t stride = output.stride;
+        const std::ptrdiff_t neighbours[8] = {-stride - 1, -stride, -stride + 1, -1,
+                                              1,           stride - 1, stride,     stride + 1};
+        while (!stack.empty()) {
+            unsigned char* pixel = stack.back();
+            stack.pop_back();
+            for (std::ptrdiff_t offset : neighbours) {
+                unsigned char* neighbour = pixel + offset;
+                if (*neighbour == EDGE_WEAK) {
+                    *neighbour = EDGE_STRONG;
+                    stack.push_back(neighbour);
                 }
             }
         }
-        return Image(width, height, outputPixels);
     }
 
-    Image prewittOperator(const Image& image) {
-        std::vector<int> kx = {1, 1, 1, 0, 0, 0, -1, -1, -1};
-        std::vector<int> ky = {1, 0, -1, 1, 0, -1, 1, 0, -1};
-        unsigned int height = image.getHeight();
-        unsigned int width = image.getWidth();
-        const auto& pixels = image.getPixels();
-        std::vector<unsigned char> outputPixels(3 * height * width, 0);
-
-        for (int i = 1; i < height - 1; i++) {
-            for (int j = 1; j < width - 1; j++) {
-                int idx = 3 * (i * width + j);
-                for (int c = 0; c < 3; c++) {
-                    int gx = 0, gy = 0;
-                    for (int ki = 0; ki < 3; ki++) {
-                        for (int kj = 0; kj < 3; kj++) {
-                            int weightX = kx[ki * 3 + kj];
-                            int weightY = ky[ki * 3 + kj];
-                            int nidx = 3 * ((i + ki - 1) * width + (j + kj - 1)) + c;
-                            gx += weightX * pixels[nidx];
-                            gy += weightY * pixels[nidx];
-                        }
-                    }
-                    int gradient = static_cast<int>(std::sqrt(gx * gx + gy * gy));
-                    outputPixels[idx + c] =
-                        static_cast<unsigned char>(std::min(255, std::max(0, gradient)));
+    /**
+     * Replaces the edge states by 255 for strong and 0 for all other pixels.
+     */
+    static void cannyStatesToGray(MutableImageView output) {
+        const int width = output.width;
+        parallelForRows(output.height, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int y = begin; y < end; y++) {
+                unsigned char* row = output.row(y);
+                for (int x = 0; x < width; x++) {
+                    row[x] = row[x] == EDGE_STRONG ? 255 : 0;
                 }
             }
+        });
+    }
+
+    Image canny(const Image& image, int lowThreshold, int highThreshold) {
+        Image output(image.getWidth(), image.getHeight(), PixelFormat::Gray8);
+        if (image.getFormat() == PixelFormat::Gray8) {
+            canny(image.view(), output.mutableView(), lowThreshold, highThreshold);
+        } else {
+            Image gray = image.toGrayscale();
+            canny(gray.view(), output.mutableView(), lowThreshold, highThreshold);
         }
-        return Image(width, height, outputPixels);
+        return output;
     }
 
-    Image sobelOperator(const Image& image) {
-        std::vector<int> kx = {-1, 0, 1, -2, 0, 2, -1, 0, 1};
-        std::vector<int> ky = {-1, -2, -1, 0, 0, 0, 1, 2, 1};
-        unsigned int height = image.getHeight();
-        unsigned int width = image.getWidth();
-        const auto& pixels = image.getPixels();
-        std::vector<unsigned char> outputPixels(3 * height * width, 0);
-
-        for (int i = 1; i < height - 1; i++) {
-            for (int j = 1; j < width - 1; j++) {
-                int idx = 3 * (i * width + j);
-                for (int c = 0; c < 3; c++) {
-                    int gx = 0, gy = 0;
-                    for (int ki = 0; ki < 3; ki++) {
-                        for (int kj = 0; kj < 3; kj++) {
-                            int weightX = kx[ki * 3 + kj];
-                            int weightY = ky[ki * 3 + kj];
-                            int nidx = 3 * ((i + ki - 1) * width + (j + kj - 1)) + c;
-                            gx += weightX * pixels[nidx];
-                            gy += weightY * pixels[nidx];
+    /**
+     * Gradient, non-maximum suppression and hysteresis of canny, leaving EDGE_STRONG at the
+     * edge pixels of output.
+     */
+    static void cannyEdgeStates(ImageView input, MutableImageView output, int lowThreshold,
+                                int highThreshold) {
+        const int width = input.width;
+        const int height = input.height;
+        clearView(output);
+        if (width < 3 || height < 3) {
+            return;
+        }
+
+        // Gradient and non-maximum suppression run in row bands. Every band recomputes the
+        // gradient of the row above and below it and hands its strong pixels to the stack of
+        // this call. The stack is a plain local: a thread_local named inside the bands would
+        // resolve to each worker's own copy, and the seeds found there would be lost.
+        std::vector<unsigned char*> stack;
+        std::mutex stackMutex;
+        parallelForRows(height, [&](unsigned int begin, unsigned int end) {
+            const int first = std::max<int>(begin, 1);
+            const int last = std::min<int>(end, height - 1);
+            if (first >= last) {
+                return;
+            }
+            thread_local std::vector<unsigned char*> strong;
+            strong.clear();
+            cannyGradientBand(input, first, last,
+                              [&](int y, const int16_t* above, const int16_t* center,
+                                  const int16_t* below, const unsigned char* sector) {
+                                  cannySuppressRow(above, center, below, sector, output.row(y),
+                                                   width, lowThreshold, highThreshold, strong);
+                              });
+            std::lock_guard<std::mutex> lock(stackMutex);
+            stack.insert(stack.end(), strong.begin(), strong.end());
+        });
+        cannyHysteresis(output, stack);
+    }
+
+    void canny(ImageView input, MutableImageView output, int lowThreshold, int highThreshold) {
+        CUDAVISION_TRACE_SCOPE("canny");
+        if (const auto& replaced = getBackendOperators().canny) {
+            replaced(input, output, lowThreshold, highThreshold);
+            return;
+        }
+        cannyEdgeStates(input, output, lowThreshold, highThreshold);
+        cannyStatesToGray(output);
+    }
+
+    void canny(ImageView input, BitImage& output, int lowThreshold, int highThreshold) {
+        CUDAVISION_TRACE_SCOPE("canny");
+        if (output.getWidth() != input.width || output.getHeight() != input.height) {
+            output = BitImage(input.width, input.height);
+        }
+        // The states are packed directly, EDGE_STRONG is the only state above EDGE_WEAK.
+        Image states(input.width, input.height, PixelFormat::Gray8);
+        cannyEdgeStates(input, states.mutableView(), lowThreshold, highThreshold);
+        const ImageView packed = states.view();
+        parallelForRows(input.height, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int y = begin; y < end; y++) {
+                BitImage::packRow(packed.row(y), packed.width, EDGE_WEAK, output.row(y));
+            }
+        });
+    }
+
+    Image canny(const Image& image, const AutoThreshold& selection) {
+        Image output(image.getWidth(), image.getHeight(), PixelFormat::Gray8);
+        if (image.getFormat() == PixelFormat::Gray8) {
+            canny(image.view(), output.mutableView(), selection);
+        } else {
+            Image gray = image.toGrayscale();
+            canny(gray.view(), output.mutableView(), selection);
+        }
+        return output;
+    }
+
+    CannyThresholds canny(ImageView input, MutableImageView output,
+                          const AutoThreshold& selection) {
+        CUDAVISION_TRACE_SCOPE("canny");
+        const int width = input.width;
+        const int height = input.height;
+        clearView(output);
+        if (width < 3 || height < 3) {
+            return {};
+        }
+
+        // One sweep computes the gradient, counts the magnitudes of the interior pixels and
+        // keeps the local maxima of every band, row by row. The L1 Sobel magnitude of 8-bit
+        // pixels lies in [0, 2040].
+        constexpr unsigned int MAGNITUDE_BINS = 2041;
+        struct Maximum {
+            uint32_t x;
+            int16_t magnitude;
+        };
+        struct Band {
+            int first = 0;
+            // End of the maxima of row first + i in maxima.
+            std::vector<std::size_t> rowEnds;
+            std::vector<Maximum> maxima;
+        };
+        std::vector<Band> bands;
+        Histogram histogram(MAGNITUDE_BINS, 0);
+        std::mutex bandMutex;
+        parallelForRows(height, [&](unsigned int begin, unsigned int end) {
+            const int first = std::max<int>(begin, 1);
+            const int last = std::min<int>(end, height - 1);
+            if (first >= last) {
+                return;
+            }
+            HistogramAccumulator accumulator(MAGNITUDE_BINS);
+            Band band;
+            band.first = first;
+            band.rowEnds.reserve(last - first);
+            cannyGradientBand(input, first, last,
+                              [&](int, const int16_t* above, const int16_t* center,
+                                  const int16_t* below, const unsigned char* sector) {
+                                  accumulator.add(center + 1, width - 2);
+                                  // Room for a whole row, compacted without branches.
+                                  std::size_t count = band.maxima.size();
+                                  band.maxima.resize(count + width);
+                                  Maximum* maxima = band.maxima.data();
+                                  for (int x = 1; x < width - 1; x++) {
+                                      maxima[count] = {static_cast<uint32_t>(x), center[x]};
+                                      count += center[x] > 0 && isGradientMaximum(above, center,
+                                                                                  below, sector[x],
+                                                                                  x);
+                                  }
+                                  band.maxima.resize(count);
+                                  band.rowEnds.push_back(count);
+                              });
+            std::lock_guard<std::mutex> lock(bandMutex);
+            accumulator.addTo(histogram);
+            bands.push_back(std::move(band));
+        });
+
+        const int high = selection.method == ThresholdMethod::Otsu
+                             ? otsuThreshold(histogram)
+                             : percentileThreshold(histogram, selection.percentile);
+        const CannyThresholds thresholds{
+            static_cast<int>(std::lround(std::clamp(selection.lowRatio, 0.0, 1.0) * high)), high};
+
+        // The bands are classified by the thread pool again, each writing only its own rows.
+        std::vector<unsigned char*> stack;
+        std::mutex stackMutex;
+        getThreadPool().parallelFor(0, bands.size(), 1, [&](std::size_t begin, std::size_t end) {
+            std::vector<unsigned char*> strong;
+            for (std::size_t i = begin; i < end; i++) {
+                const Band& band = bands[i];
+                std::size_t k = 0;
+                for (std::size_t row = 0; row < band.rowEnds.size(); row++) {
+                    unsigned char* edges = output.row(band.first + row);
+                    for (; k < band.rowEnds[row]; k++) {
+                        const Maximum& maximum = band.maxima[k];
+                        if (maximum.magnitude > thresholds.low) {
+                            cannyClassify(maximum.magnitude, edges + maximum.x, thresholds.high,
+                                          strong);
                         }
                     }
-                    int gradient = static_cast<int>(std::sqrt(gx * gx + gy * gy));
-                    outputPixels[idx + c] =
-                        static_cast<unsigned char>(std::min(255, std::max(0, gradient)));
                 }
             }
-        }
-        return Image(width, height, outputPixels);
+            std::lock_guard<std::mutex> lock(stackMutex);
+            stack.insert(stack.end(), strong.begin(), strong.end());
+        });
+        cannyHysteresis(output, stack);
+        cannyStatesToGray(output);
+        return thresholds;
     }
-}  // namespace CUDAVISION
\ No newline at end of file
+}  // namespace CUDAVISION
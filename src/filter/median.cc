@@ -0,0 +1,366 @@
+#include "filter/median.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "util/cpu_features.h"
+#include "util/thread_pool.h"
+#include "util/trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CUDAVISION_X86 1
+#endif
+
+namespace CUDAVISION {
+    /**
+     * A compare-exchange of a sorting network: afterwards the first element holds the minimum
+     * and the second the maximum of both.
+     */
+    using CompareExchange = std::pair<uint8_t, uint8_t>;
+
+    /**
+     * Median of 9 in 19 compare-exchanges, element 4 after the network. A. W. Paeth, "Median
+     * finding on a 3x3 grid", Graphics Gems, 1990.
+     */
+    static constexpr std::array<CompareExchange, 19> MEDIAN_OF_9 = {{
+        {1, 2}, {4, 5}, {7, 8}, {0, 1}, {3, 4}, {6, 7}, {1, 2}, {4, 5}, {7, 8}, {0, 3},
+        {5, 8}, {4, 7}, {3, 6}, {1, 4}, {2, 5}, {4, 7}, {4, 2}, {6, 4}, {4, 2},
+    }};
+
+    /**
+     * Median of 25 in 99 compare-exchanges, element 12 after the network. N. Devillard, "Fast
+     * median search: an ANSI C implementation", 1998.
+     */
+    static constexpr std::array<CompareExchange, 99> MEDIAN_OF_25 = {{
+        {0, 1},   {3, 4},   {2, 4},   {2, 3},   {6, 7},   {5, 7},   {5, 6},   {9, 10},
+        {8, 10},  {8, 9},   {12, 13}, {11, 13}, {11, 12}, {15, 16}, {14, 16}, {14, 15},
+        {18, 19}, {17, 19}, {17, 18}, {21, 22}, {20, 22}, {20, 21}, {23, 24}, {2, 5},
+        {3, 6},   {0, 6},   {0, 3},   {4, 7},   {1, 7},   {1, 4},   {11, 14}, {8, 14},
+        {8, 11},  {12, 15}, {9, 15},  {9, 12},  {13, 16}, {10, 16}, {10, 13}, {20, 23},
+        {17, 23}, {17, 20}, {21, 24}, {18, 24}, {18, 21}, {19, 22}, {8, 17},  {9, 18},
+        {0, 18},  {0, 9},   {10, 19}, {1, 19},  {1, 10},  {11, 20}, {2, 20},  {2, 11},
+        {12, 21}, {3, 21},  {3, 12},  {13, 22}, {4, 22},  {4, 13},  {14, 23}, {5, 23},
+        {5, 14},  {15, 24}, {6, 24},  {6, 15},  {7, 16},  {7, 19},  {13, 21}, {15, 23},
+        {7, 13},  {7, 15},  {1, 9},   {3, 11},  {5, 17},  {11, 17}, {9, 17},  {4, 10},
+        {6, 12},  {7, 14},  {4, 6},   {4, 7},   {12, 14}, {10, 14}, {6, 7},   {10, 12},
+        {6, 10},  {6, 17},  {12, 17}, {7, 17},  {7, 10},  {12, 18}, {7, 12},  {10, 18},
+        {12, 20}, {10, 20}, {10, 12},
+    }};
+
+    /**
+     * Scalar reference of the sorting networks, also used for the tails of the vector loops.
+     * sources holds one pointer per window position, row by row, all advancing with x.
+     */
+    template <std::size_t N, std::size_t P>
+    static void medianNetworkScalar(const unsigned char* const* sources,
+                                    const std::array<CompareExchange, P>& network,
+                                    unsigned char* dst, std::size_t begin, std::size_t end) {
+        for (std::size_t x = begin; x < end; x++) {
+            unsigned char p[N];
+            for (std::size_t k = 0; k < N; k++) {
+                p[k] = sources[k][x];
+            }
+            for (const auto& [a, b] : network) {
+                const unsigned char low = std::min(p[a], p[b]);
+                p[b] = std::max(p[a], p[b]);
+                p[a] = low;
+            }
+            dst[x] = p[N / 2];
+        }
+    }
+
+#ifdef CUDAVISION_X86
+    /**
+     * The vector paths run the network on 16 or 32 neighboring bytes at once, one compare-exchange
+     * being an unsigned byte min and max. The channels of BGR8 pixels are independent bytes, so
+     * interleaved pixels need no special treatment.
+     */
+    template <std::size_t N, std::size_t P>
+    static std::size_t medianNetworkSSE2(const unsigned char* const* sources,
+                                         const std::array<CompareExchange, P>& network,
+                                         unsigned char* dst, std::size_t count) {
+        std::size_t x = 0;
+        for (; x + 16 <= count; x += 16) {
+            __m128i p[N];
+            for (std::size_t k = 0; k < N; k++) {
+                p[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sources[k] + x));
+            }
+            for (const auto& [a, b] : network) {
+                const __m128i low = _mm_min_epu8(p[a], p[b]);
+                p[b] = _mm_max_epu8(p[a], p[b]);
+                p[a] = low;
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), p[N / 2]);
+        }
+        return x;
+    }
+
+    template <std::size_t N, std::size_t P>
+    __attribute__((target("avx2"))) static std::size_t medianNetworkAVX2(
+        const unsigned char* const* sources, const std::array<CompareExchange, P>& network,
+        unsigned char* dst, std::size_t count) {
+        std::size_t x = 0;
+        for (; x + 32 <= count; x += 32) {
+            __m256i p[N];
+            for (std::size_t k = 0; k < N; k++) {
+                p[k] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sources[k] + x));
+            }
+            for (const auto& [a, b] : network) {
+                const __m256i low = _mm256_min_epu8(p[a], p[b]);
+                p[b] = _mm256_max_epu8(p[a], p[b]);
+                p[a] = low;
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x), p[N / 2]);
+        }
+        return x;
+    }
+#endif
+
+    template <std::size_t N, std::size_t P>
+    static void medianNetwork(const unsigned char* const* sources,
+                              const std::array<CompareExchange, P>& network, unsigned char* dst,
+                              std::size_t count) {
+        std::size_t done = 0;
+#ifdef CUDAVISION_X86
+        switch (getInstructionSet()) {
+            case InstructionSet::AVX512:
+            case InstructionSet::AVX2:
+                done = medianNetworkAVX2<N>(sources, network, dst, count);
+                break;
+            case InstructionSet::SSE2:
+                done = medianNetworkSSE2<N>(sources, network, dst, count);
+                break;
+            case InstructionSet::Scalar:
+                break;
+        }
+#endif
+        medianNetworkScalar<N>(sources, network, dst, done, count);
+    }
+
+    /**
+     * Filters rows [begin, end) with a sorting network. The 2r + 1 rows of the window are copied
+     * with r replicated pixels on both sides, so that every window position is a plain shifted
+     * read of a padded row.
+     */
+    template <std::size_t N, std::size_t P>
+    static void medianNetworkRows(ImageView input, MutableImageView output, int radius,
+                                  const std::array<CompareExchange, P>& network,
+                                  unsigned int begin, unsigned int end) {
+        thread_local std::vector<unsigned char> padded;
+        const int taps = 2 * radius + 1;
+        const std::size_t channels = input.channels;
+        const std::size_t rowElements = input.rowElements();
+        const std::size_t paddedElements = rowElements + 2 * radius * channels;
+        padded.resize(paddedElements * taps);
+        const unsigned char* sources[N];
+        for (int dy = 0; dy < taps; dy++) {
+            for (int dx = 0; dx < taps; dx++) {
+                sources[dy * taps + dx] = padded.data() + dy * paddedElements + dx * channels;
+            }
+        }
+
+        const int lastRow = static_cast<int>(input.height) - 1;
+        for (unsigned int y = begin; y < end; y++) {
+            for (int dy = 0; dy < taps; dy++) {
+                const unsigned char* src =
+                    input.row(std::clamp(static_cast<int>(y) + dy - radius, 0, lastRow));
+                unsigned char* out = padded.data() + dy * paddedElements;
+                for (int i = 0; i < radius; i++, out += channels) {
+                    std::memcpy(out, src, channels);
+                }
+                std::memcpy(out, src, rowElements);
+                out += rowElements;
+                for (int i = 0; i < radius; i++, out += channels) {
+                    std::memcpy(out, src + rowElements - channels, channels);
+                }
+            }
+            medianNetwork<N>(sources, network, output.row(y), rowElements);
+        }
+    }
+
+    /**
+     * 16 histogram bins. GCC vector extensions rather than intrinsics, so that the same code
+     * compiles to two SSE2 or one AVX2 instruction per operation, depending on the function it
+     * is inlined into. Without AVX the type would only be 16-byte aligned, while the AVX2 code
+     * expects 32 bytes.
+     */
+    typedef uint16_t Bins __attribute__((vector_size(32), aligned(32)));
+    typedef int16_t Lanes __attribute__((vector_size(32), aligned(32)));
+
+    static constexpr Lanes LANE_INDEX = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+    /**
+     * Histogram of one column of one channel. The bins are cumulative within each block of 16:
+     * fine[b][i] counts the values 16 b to 16 b + i, coarse[b] the values 0 to 16 b + 15.
+     * Cumulative counts are still linear, so window histograms are sums and differences of
+     * column histograms as usual, but a bin is found by a binary search instead of a scan.
+     */
+    struct ColumnHistogram {
+        Bins fine[16];
+        Bins coarse;
+    };
+
+    /**
+     * Counts a value in the bins of its own and all higher values: the comparison masks are -1,
+     * so subtracting them adds one.
+     */
+    static void addToColumn(ColumnHistogram& column, unsigned char value) {
+        column.fine[value >> 4] -= reinterpret_cast<Bins>(LANE_INDEX >= (value & 15));
+        column.coarse -= reinterpret_cast<Bins>(LANE_INDEX >= (value >> 4));
+    }
+
+    static void removeFromColumn(ColumnHistogram& column, unsigned char value) {
+        column.fine[value >> 4] += reinterpret_cast<Bins>(LANE_INDEX >= (value & 15));
+        column.coarse += reinterpret_cast<Bins>(LANE_INDEX >= (value >> 4));
+    }
+
+    /**
+     * Finds the first of 16 cumulative bins exceeding rank and lowers rank by the count before
+     * it. A branch-free binary search, the last bin always exceeds rank.
+     */
+    [[gnu::always_inline]] static inline int findBin(const Bins& cumulative, int& rank) {
+        int index = 0;
+        for (int step = 8; step > 0; step /= 2) {
+            index += cumulative[index + step - 1] <= rank ? step : 0;
+        }
+        rank -= index > 0 ? cumulative[index - 1] : 0;
+        return index;
+    }
+
+    /**
+     * Filters rows [begin, end) of one channel with sliding histograms. columns holds one
+     * histogram per column, rebuilt for the first row of the band and then moved down.
+     *
+     * The window histogram moves right one column per pixel. The coarse part always follows,
+     * a block of fine bins is brought up to date only when the median falls into it: by the
+     * columns that entered and left since its last update, or from scratch if that was more
+     * than radius pixels ago.
+     */
+    [[gnu::always_inline]] static inline void medianHistogramRows(
+        ImageView input, MutableImageView output, int radius, unsigned int channel,
+        unsigned int begin, unsigned int end, std::vector<ColumnHistogram>& columns) {
+        const int width = static_cast<int>(input.width);
+        const int lastRow = static_cast<int>(input.height) - 1;
+        const unsigned int channels = input.channels;
+        const int rank = (2 * radius + 1) * (2 * radius + 1) / 2;
+        auto column = [&](int x) -> const ColumnHistogram& {
+            return columns[std::clamp(x, 0, width - 1)];
+        };
+
+        columns.assign(width, ColumnHistogram{});
+        for (int dy = -radius; dy <= radius; dy++) {
+            const unsigned char* src =
+                input.row(std::clamp(static_cast<int>(begin) + dy, 0, lastRow)) + channel;
+            for (int x = 0; x < width; x++) {
+                addToColumn(columns[x], src[x * channels]);
+            }
+        }
+
+        for (unsigned int y = begin; y < end; y++) {
+            const int leaving = std::clamp(static_cast<int>(y) - radius - 1, 0, lastRow);
+            const int entering = std::clamp(static_cast<int>(y) + radius, 0, lastRow);
+            if (y > begin && leaving != entering) {
+                const unsigned char* out = input.row(leaving) + channel;
+                const unsigned char* in = input.row(entering) + channel;
+                for (int x = 0; x < width; x++) {
+                    removeFromColumn(columns[x], out[x * channels]);
+                    addToColumn(columns[x], in[x * channels]);
+                }
+            }
+
+            Bins coarse{};
+            for (int dx = -radius; dx <= radius; dx++) {
+                coarse += column(dx).coarse;
+            }
+            Bins fine[16];
+            int updated[16];
+            std::fill(std::begin(updated), std::end(updated), -1 - 2 * radius);
+
+            unsigned char* dst = output.row(y) + channel;
+            for (int x = 0; x < width; x++) {
+                if (x > 0) {
+                    coarse += column(x + radius).coarse - column(x - radius - 1).coarse;
+                }
+                int remaining = rank;
+                const int block = findBin(coarse, remaining);
+
+                Bins& bins = fine[block];
+                if (x - updated[block] > radius) {
+                    bins = Bins{};
+                    for (int dx = -radius; dx <= radius; dx++) {
+                        bins += column(x + dx).fine[block];
+                    }
+                } else {
+                    for (int i = updated[block] + 1; i <= x; i++) {
+                        bins += column(i + radius).fine[block] - column(i - radius - 1).fine[block];
+                    }
+                }
+                updated[block] = x;
+                const int value = 16 * block + findBin(bins, remaining);
+                dst[x * channels] = static_cast<unsigned char>(value);
+            }
+        }
+    }
+
+#ifdef CUDAVISION_X86
+    __attribute__((target("avx2"))) static void medianHistogramRowsAVX2(
+        ImageView input, MutableImageView output, int radius, unsigned int channel,
+        unsigned int begin, unsigned int end, std::vector<ColumnHistogram>& columns) {
+        medianHistogramRows(input, output, radius, channel, begin, end, columns);
+    }
+#endif
+
+    static void medianHistogramRowsDefault(ImageView input, MutableImageView output, int radius,
+                                           unsigned int channel, unsigned int begin,
+                                           unsigned int end,
+                                           std::vector<ColumnHistogram>& columns) {
+        medianHistogramRows(input, output, radius, channel, begin, end, columns);
+    }
+
+    void medianFilter(ImageView input, MutableImageView output, int radius) {
+        CUDAVISION_TRACE_SCOPE("medianFilter");
+        if (radius < 0 || radius > MEDIAN_MAX_RADIUS) {
+            throw std::invalid_argument("medianFilter: radius must be in [0, " +
+                                        std::to_string(MEDIAN_MAX_RADIUS) + "]");
+        }
+        if (input.width == 0 || input.height == 0) {
+            return;
+        }
+        parallelForRows(input.height, [&](unsigned int begin, unsigned int end) {
+            if (radius == 0) {
+                for (unsigned int y = begin; y < end; y++) {
+                    std::memcpy(output.row(y), input.row(y), input.rowElements());
+                }
+            } else if (radius == 1) {
+                medianNetworkRows<9>(input, output, radius, MEDIAN_OF_9, begin, end);
+            } else if (radius == 2) {
+                medianNetworkRows<25>(input, output, radius, MEDIAN_OF_25, begin, end);
+            } else {
+                thread_local std::vector<ColumnHistogram> columns;
+                auto rows = medianHistogramRowsDefault;
+#ifdef CUDAVISION_X86
+                if (getInstructionSet() == InstructionSet::AVX2 ||
+                    getInstructionSet() == InstructionSet::AVX512) {
+                    rows = medianHistogramRowsAVX2;
+                }
+#endif
+                for (unsigned int channel = 0; channel < input.channels; channel++) {
+                    rows(input, output, radius, channel, begin, end, columns);
+                }
+            }
+        });
+    }
+
+    Image medianFilter(const Image& image, int radius) {
+        Image output(image.getWidth(), image.getHeight(), image.getFormat());
+        medianFilter(image.view(), output.mutableView(), radius);
+        return output;
+    }
+}  // namespace CUDAVISION
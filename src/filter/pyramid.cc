@@ -0,0 +1,109 @@
+#include "filter/pyramid.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "util/buffer_pool.h"
+#include "util/thread_pool.h"
+#include "util/trace.h"
+
+namespace CUDAVISION {
+    std::vector<double> getBinomialKernel() {
+        return {1.0 / 16, 4.0 / 16, 6.0 / 16, 4.0 / 16, 1.0 / 16};
+    }
+
+    GaussianPyramid::GaussianPyramid(Image image, unsigned int levelCount,
+                                     const std::vector<double>& kernel)
+        : base(std::move(image)), kernel(FixedPointKernel::fromKernel(kernel)) {
+        unsigned int width = base.getWidth();
+        unsigned int height = base.getHeight();
+        const unsigned int channels = base.getChannels();
+        views.push_back(base.mutableView());
+        if (width == 0 || height == 0) {
+            return;
+        }
+        // Lay out all levels back to back in one buffer.
+        std::vector<std::size_t> offsets;
+        std::size_t total = 0;
+        while ((width > 1 || height > 1) && (levelCount == 0 || views.size() < levelCount)) {
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+            offsets.push_back(total);
+            total += std::size_t{width} * height * channels;
+            views.push_back({nullptr, width, height,
+                             static_cast<std::ptrdiff_t>(width * channels), channels});
+        }
+        storage = BufferPool::global().acquire(total);
+        for (std::size_t i = 0; i < offsets.size(); i++) {
+            views[i + 1].data = storage.data() + offsets[i];
+        }
+    }
+
+    GaussianPyramid::~GaussianPyramid() { BufferPool::global().release(std::move(storage)); }
+
+    ImageView GaussianPyramid::level(unsigned int index) {
+        if (index >= views.size()) {
+            throw std::out_of_range("pyramid level " + std::to_string(index) + " of " +
+                                    std::to_string(views.size()));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        while (builtLevels <= index) {
+            buildLevel(builtLevels++);
+        }
+        const MutableImageView& view = views[index];
+        return {view.data, view.width, view.height, view.stride, view.channels};
+    }
+
+    Image GaussianPyramid::levelImage(unsigned int index) {
+        ImageView view = level(index);
+        Image image(view.width, view.height,
+                    view.channels == 1 ? PixelFormat::Gray8 : PixelFormat::BGR8);
+        MutableImageView target = image.mutableView();
+        for (unsigned int y = 0; y < view.height; y++) {
+            std::copy_n(view.row(y), view.rowElements(), target.row(y));
+        }
+        return image;
+    }
+
+    void GaussianPyramid::buildLevel(unsigned int index) {
+        CUDAVISION_TRACE_SCOPE("GaussianPyramid level");
+        const MutableImageView& source = views[index - 1];
+        const MutableImageView& target = views[index];
+        const int radius = kernel.radius();
+        const unsigned int channels = source.channels;
+        // Output row y is the vertical pass centered on source row 2y, filtered horizontally,
+        // of which the even pixels are kept.
+        parallelForRows(target.height, [&](unsigned int begin, unsigned int end) {
+            thread_local std::vector<const unsigned char*> sources;
+            thread_local std::vector<unsigned char> vertical, horizontal;
+            sources.resize(kernel.weights.size());
+            vertical.resize(source.rowElements());
+            horizontal.resize(source.rowElements());
+            for (unsigned int y = begin; y < end; y++) {
+                for (std::size_t k = 0; k < sources.size(); k++) {
+                    const int row = std::clamp<int>(2 * y + k - radius, 0, source.height - 1);
+                    sources[k] = source.row(row);
+                }
+                convolveTaps(sources.data(), kernel, vertical.data(), vertical.size());
+                convolveRowHorizontal(vertical.data(), horizontal.data(), source.width, channels,
+                                      kernel);
+                unsigned char* dst = target.row(y);
+                for (unsigned int x = 0; x < target.width; x++) {
+                    std::copy_n(&horizontal[2 * x * channels], channels, dst + x * channels);
+                }
+            }
+        });
+    }
+
+    std::vector<Image> GaussianPyramid::apply(
+        const std::function<void(ImageView, MutableImageView)>& function, PixelFormat format) {
+        std::vector<Image> results;
+        for (unsigned int i = 0; i < getLevelCount(); i++) {
+            ImageView input = level(i);
+            results.emplace_back(input.width, input.height, format);
+            function(input, results.back().mutableView());
+        }
+        return results;
+    }
+}  // namespace CUDAVISION
@@ -0,0 +1,359 @@
+#include "filter/recursive_gaussian.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "filter/separable_convolution.h"
+#include "util/buffer_pool.h"
+#include "util/thread_pool.h"
+#include "util/trace.h"
+
+namespace CUDAVISION {
+    /**
+     * Coefficients of the Young - van Vliet filter, normalized by b0:
+     * w[n] = B * x[n] + a1 * w[n - 1] + a2 * w[n - 2] + a3 * w[n - 3].
+     */
+    struct RecursiveCoefficients {
+        float B, a1, a2, a3;
+    };
+
+    /**
+     * I. T. Young, L. J. van Vliet, "Recursive implementation of the Gaussian filter", 1995.
+     */
+    static RecursiveCoefficients getRecursiveCoefficients(double sigma) {
+        sigma = std::max(sigma, 0.5);
+        double q = sigma >= 2.5 ? 0.98711 * sigma - 0.96330
+                                : 3.97156 - 4.14554 * std::sqrt(1.0 - 0.26891 * sigma);
+        double q2 = q * q, q3 = q2 * q;
+        double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+        double b1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+        double b2 = -(1.4281 * q2 + 1.26661 * q3);
+        double b3 = 0.422205 * q3;
+        RecursiveCoefficients c;
+        c.a1 = b1 / b0;
+        c.a2 = b2 / b0;
+        c.a3 = b3 / b0;
+        c.B = 1.0 - (c.a1 + c.a2 + c.a3);
+        return c;
+    }
+
+    /**
+     * Matrix M mapping the last three causal outputs to the first three anti-causal states for a
+     * signal replicated beyond its end (B. Triggs, M. Sdika, "Boundary conditions for
+     * Young - van Vliet recursive filtering", 2006):
+     * y[N + k] = u + sum_j M[k][j] * (w[N - 1 - j] - u), with u the replicated edge value.
+     * Instead of the closed form, M is obtained by running the filters on unit deviations until
+     * they have decayed, which is exact up to float precision.
+     */
+    struct BoundaryMatrix {
+        float m[3][3];
+    };
+
+    static BoundaryMatrix getBoundaryMatrix(const RecursiveCoefficients& c, double sigma) {
+        BoundaryMatrix matrix;
+        const int length = static_cast<int>(20 * sigma) + 64;
+        std::vector<double> w(length);
+        for (int j = 0; j < 3; j++) {
+            double w1 = j == 0, w2 = j == 1, w3 = j == 2;
+            for (int n = 0; n < length; n++) {
+                w[n] = c.a1 * w1 + c.a2 * w2 + c.a3 * w3;
+                w3 = w2;
+                w2 = w1;
+                w1 = w[n];
+            }
+            double y1 = 0.0, y2 = 0.0, y3 = 0.0;
+            for (int n = length; n-- > 0;) {
+                double y = c.B * w[n] + c.a1 * y1 + c.a2 * y2 + c.a3 * y3;
+                if (n < 3) {
+                    matrix.m[n][j] = static_cast<float>(y);
+                }
+                y3 = y2;
+                y2 = y1;
+                y1 = y;
+            }
+        }
+        return matrix;
+    }
+
+    /**
+     * Filters one row of interleaved float pixels forward and backward, in place. All channels
+     * run in the same loop, so their independent recursions overlap in the pipeline.
+     */
+    template <unsigned int C>
+    static void filterRow(float* x, unsigned int width, const RecursiveCoefficients& c,
+                          const BoundaryMatrix& boundary) {
+        float w1[C], w2[C], w3[C], edge[C];
+        // Left border: the causal filter is in steady state for the replicated first pixel.
+        for (unsigned int ch = 0; ch < C; ch++) {
+            w1[ch] = w2[ch] = w3[ch] = x[ch];
+            edge[ch] = x[(width - 1) * C + ch];
+        }
+        for (unsigned int n = 0; n < width; n++) {
+            for (unsigned int ch = 0; ch < C; ch++) {
+                float w = c.B * x[n * C + ch] + c.a1 * w1[ch] + c.a2 * w2[ch] + c.a3 * w3[ch];
+                x[n * C + ch] = w;
+                w3[ch] = w2[ch];
+                w2[ch] = w1[ch];
+                w1[ch] = w;
+            }
+        }
+        // Right border: anti-causal states from the last causal outputs (Triggs - Sdika).
+        for (unsigned int ch = 0; ch < C; ch++) {
+            float d[3];
+            for (unsigned int j = 0; j < 3; j++) {
+                d[j] = x[(width - 1 - std::min(j, width - 1)) * C + ch] - edge[ch];
+            }
+            const auto& m = boundary.m;
+            w1[ch] = edge[ch] + m[0][0] * d[0] + m[0][1] * d[1] + m[0][2] * d[2];
+            w2[ch] = edge[ch] + m[1][0] * d[0] + m[1][1] * d[1] + m[1][2] * d[2];
+            w3[ch] = edge[ch] + m[2][0] * d[0] + m[2][1] * d[1] + m[2][2] * d[2];
+        }
+        for (unsigned int n = width; n-- > 0;) {
+            for (unsigned int ch = 0; ch < C; ch++) {
+                float w = c.B * x[n * C + ch] + c.a1 * w1[ch] + c.a2 * w2[ch] + c.a3 * w3[ch];
+                x[n * C + ch] = w;
+                w3[ch] = w2[ch];
+                w2[ch] = w1[ch];
+                w1[ch] = w;
+            }
+        }
+    }
+
+    static void filterRow(float* x, unsigned int width, unsigned int channels,
+                          const RecursiveCoefficients& c, const BoundaryMatrix& boundary) {
+        if (channels == 3) {
+            filterRow<3>(x, width, c, boundary);
+        } else {
+            filterRow<1>(x, width, c, boundary);
+        }
+    }
+
+    /**
+     * One step of the vertical recursion on whole rows: dst = B * dst + a1 * p1 + a2 * p2 +
+     * a3 * p3. Runs along the row, so the compiler vectorizes it.
+     */
+    static void filterRows(float* dst, const float* p1, const float* p2, const float* p3,
+                           std::size_t count, const RecursiveCoefficients& c) {
+        for (std::size_t i = 0; i < count; i++) {
+            dst[i] = c.B * dst[i] + c.a1 * p1[i] + c.a2 * p2[i] + c.a3 * p3[i];
+        }
+    }
+
+    /**
+     * Number of rows filtered together by the horizontal pass.
+     */
+    constexpr unsigned int ROW_BLOCK = 8;
+
+    /**
+     * Column chunks of the vertical passes are multiples of one 64 byte cache line of floats.
+     */
+    constexpr std::size_t COLUMN_CHUNK = 16;
+
+    /**
+     * Horizontal pass over ROW_BLOCK rows at once. The rows are transposed into columns of
+     * ROW_BLOCK * C lanes, three border columns on each side, so that the recursion runs as
+     * filterRows steps over whole columns: all rows advance in the same vectorized step instead
+     * of forming one long serial dependency chain per row.
+     */
+    template <unsigned int C>
+    static void filterRowBlock(ImageView input, unsigned int firstRow, float* const* rows,
+                               float* columns, const RecursiveCoefficients& c,
+                               const BoundaryMatrix& boundary) {
+        constexpr unsigned int LANES = ROW_BLOCK * C;
+        const unsigned int width = input.width;
+        auto column = [&](int n) { return columns + (n + 3) * LANES; };
+        for (unsigned int r = 0; r < ROW_BLOCK; r++) {
+            const unsigned char* src = input.row(firstRow + r);
+            for (unsigned int n = 0; n < width; n++) {
+                for (unsigned int ch = 0; ch < C; ch++) {
+                    column(n)[r * C + ch] = src[n * C + ch];
+                }
+            }
+        }
+        float edge[LANES];
+        std::copy_n(column(width - 1), LANES, edge);
+
+        // Left border: the causal filter is in steady state for the replicated first column.
+        for (int n = -3; n < 0; n++) {
+            std::copy_n(column(0), LANES, column(n));
+        }
+        for (int n = 0; n < static_cast<int>(width); n++) {
+            filterRows(column(n), column(n - 1), column(n - 2), column(n - 3), LANES, c);
+        }
+        // Right border: anti-causal states from the last causal outputs (Triggs - Sdika).
+        const auto& m = boundary.m;
+        const float* last[3] = {column(width - 1), column(width >= 2 ? width - 2 : 0),
+                                column(width >= 3 ? width - 3 : 0)};
+        for (unsigned int l = 0; l < LANES; l++) {
+            const float d0 = last[0][l] - edge[l], d1 = last[1][l] - edge[l],
+                        d2 = last[2][l] - edge[l];
+            for (int k = 0; k < 3; k++) {
+                column(width + k)[l] = edge[l] + m[k][0] * d0 + m[k][1] * d1 + m[k][2] * d2;
+            }
+        }
+        for (int n = width; n-- > 0;) {
+            filterRows(column(n), column(n + 1), column(n + 2), column(n + 3), LANES, c);
+        }
+
+        for (unsigned int r = 0; r < ROW_BLOCK; r++) {
+            float* dst = rows[r];
+            for (unsigned int n = 0; n < width; n++) {
+                for (unsigned int ch = 0; ch < C; ch++) {
+                    dst[n * C + ch] = column(n)[r * C + ch];
+                }
+            }
+        }
+    }
+
+    std::vector<double> getSampledGaussianKernel(int radius, double sigma) {
+        std::vector<double> kernel(2 * radius + 1);
+        double sum = 0.0;
+        for (int i = -radius; i <= radius; i++) {
+            kernel[i + radius] = std::exp(-(i * i) / (2 * sigma * sigma));
+            sum += kernel[i + radius];
+        }
+        for (double& weight : kernel) {
+            weight /= sum;
+        }
+        return kernel;
+    }
+
+    void recursiveGaussian(ImageView input, MutableImageView output, double sigma) {
+        CUDAVISION_TRACE_SCOPE("recursiveGaussian");
+        const unsigned int width = input.width;
+        const unsigned int height = input.height;
+        const std::size_t rowElements = input.rowElements();
+        if (input.empty()) {
+            return;
+        }
+        const RecursiveCoefficients c = getRecursiveCoefficients(sigma);
+        const BoundaryMatrix boundary = getBoundaryMatrix(c, sigma);
+
+        // Rows of the float image plus three rows for the anti-causal states below the image.
+        std::vector<unsigned char> buffer =
+            BufferPool::global().acquire(rowElements * (height + 3) * sizeof(float));
+        float* image = reinterpret_cast<float*>(buffer.data());
+        auto row = [&](unsigned int y) { return image + y * rowElements; };
+
+        // Horizontal pass, blocks of ROW_BLOCK rows are independent.
+        const unsigned int blocks = height / ROW_BLOCK;
+        parallelForRows(blocks, [&](unsigned int begin, unsigned int end) {
+            thread_local std::vector<float> columns;
+            columns.resize((width + 6) * ROW_BLOCK * input.channels);
+            for (unsigned int block = begin; block < end; block++) {
+                const unsigned int y = block * ROW_BLOCK;
+                float* rows[ROW_BLOCK];
+                for (unsigned int r = 0; r < ROW_BLOCK; r++) {
+                    rows[r] = row(y + r);
+                }
+                if (input.channels == 3) {
+                    filterRowBlock<3>(input, y, rows, columns.data(), c, boundary);
+                } else {
+                    filterRowBlock<1>(input, y, rows, columns.data(), c, boundary);
+                }
+            }
+        });
+        for (unsigned int y = blocks * ROW_BLOCK; y < height; y++) {
+            std::copy_n(input.row(y), rowElements, row(y));
+            filterRow(row(y), width, input.channels, c, boundary);
+        }
+
+        // The vertical passes are sequential along y but independent per column, so they run on
+        // column chunks of whole cache lines.
+        ThreadPool& pool = getThreadPool();
+        const std::size_t chunk = std::max(
+            COLUMN_CHUNK,
+            (rowElements / pool.getThreadCount() + COLUMN_CHUNK - 1) / COLUMN_CHUNK * COLUMN_CHUNK);
+        pool.parallelFor(0, rowElements, chunk, [&](std::size_t begin, std::size_t end) {
+            const std::size_t count = end - begin;
+            auto column = [&](unsigned int y) { return row(y) + begin; };
+
+            // Causal pass from top to bottom. Above the image the filter is in steady state for
+            // the replicated first row, which is what row 0 holds after its own step.
+            for (unsigned int y = 0; y < height; y++) {
+                const float* p1 = column(y >= 1 ? y - 1 : 0);
+                const float* p2 = column(y >= 2 ? y - 2 : 0);
+                const float* p3 = column(y >= 3 ? y - 3 : 0);
+                filterRows(column(y), p1, p2, p3, count, c);
+            }
+            // Anti-causal states below the image (Triggs - Sdika), from the last three causal
+            // rows and the replicated last row, which is the horizontally filtered last input
+            // row. That row is recomputed here since the causal pass has overwritten it; every
+            // chunk filters the whole row and keeps its own columns.
+            thread_local std::vector<float> lastRow;
+            lastRow.resize(rowElements);
+            std::copy_n(input.row(height - 1), rowElements, lastRow.data());
+            filterRow(lastRow.data(), width, input.channels, c, boundary);
+            const float* edge = lastRow.data() + begin;
+            float* states[3] = {column(height), column(height + 1), column(height + 2)};
+            const float* last[3] = {column(height - 1), column(height >= 2 ? height - 2 : 0),
+                                    column(height >= 3 ? height - 3 : 0)};
+            const auto& m = boundary.m;
+            for (std::size_t i = 0; i < count; i++) {
+                const float u = edge[i];
+                const float d0 = last[0][i] - u, d1 = last[1][i] - u, d2 = last[2][i] - u;
+                states[0][i] = u + m[0][0] * d0 + m[0][1] * d1 + m[0][2] * d2;
+                states[1][i] = u + m[1][0] * d0 + m[1][1] * d1 + m[1][2] * d2;
+                states[2][i] = u + m[2][0] * d0 + m[2][1] * d1 + m[2][2] * d2;
+            }
+            for (unsigned int y = height; y-- > 0;) {
+                filterRows(column(y), column(y + 1), column(y + 2), column(y + 3), count, c);
+            }
+        });
+
+        parallelForRows(height, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int y = begin; y < end; y++) {
+                const float* src = row(y);
+                unsigned char* dst = output.row(y);
+                for (std::size_t i = 0; i < rowElements; i++) {
+                    dst[i] = static_cast<int>(std::clamp(src[i] + 0.5f, 0.0f, 255.0f));
+                }
+            }
+        });
+        BufferPool::global().release(std::move(buffer));
+    }
+
+    Image recursiveGaussian(const Image& image, double sigma) {
+        Image output(image.getWidth(), image.getHeight(), image.getFormat());
+        recursiveGaussian(image.view(), output.mutableView(), sigma);
+        return output;
+    }
+
+    Image gaussianBlur(const Image& image, double sigma, GaussianMethod method) {
+        if (method == GaussianMethod::Auto) {
+            method = sigma < RECURSIVE_GAUSSIAN_SIGMA_THRESHOLD ? GaussianMethod::FIR
+                                                                : GaussianMethod::IIR;
+        }
+        if (method == GaussianMethod::IIR) {
+            return recursiveGaussian(image, sigma);
+        }
+        const int radius = static_cast<int>(std::ceil(3.0 * sigma));
+        const FixedPointKernel kernel =
+            FixedPointKernel::fromKernel(getSampledGaussianKernel(radius, sigma));
+        Image output(image.getWidth(), image.getHeight(), image.getFormat());
+        separableConvolution(image.view(), output.mutableView(), kernel, kernel);
+        return output;
+    }
+
+    GaussianAccuracy measureRecursiveGaussianAccuracy(const Image& image, double sigma) {
+        Image reference = gaussianBlur(image, sigma, GaussianMethod::FIR);
+        Image recursive = gaussianBlur(image, sigma, GaussianMethod::IIR);
+        const std::vector<unsigned char>& a = reference.getPixels();
+        const std::vector<unsigned char>& b = recursive.getPixels();
+
+        GaussianAccuracy accuracy;
+        double sumAbs = 0.0, sumSquared = 0.0;
+        for (std::size_t i = 0; i < a.size(); i++) {
+            int difference = std::abs(a[i] - b[i]);
+            accuracy.maxError = std::max(accuracy.maxError, difference);
+            sumAbs += difference;
+            sumSquared += difference * difference;
+        }
+        const double n = std::max<std::size_t>(a.size(), 1);
+        accuracy.meanError = sumAbs / n;
+        accuracy.psnr = sumSquared == 0.0 ? std::numeric_limits<double>::infinity()
+                                          : 10.0 * std::log10(255.0 * 255.0 / (sumSquared / n));
+        return accuracy;
+    }
+}  // namespace CUDAVISION
@@ -0,0 +1,379 @@
+#include "filter/separable_convolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "util/cpu_features.h"
+#include "util/thread_pool.h"
+#include "util/tiled_image.h"
+#include "util/trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CUDAVISION_X86 1
+#endif
+
+namespace CUDAVISION {
+    FixedPointKernel FixedPointKernel::fromKernel(const std::vector<double>& kernel) {
+        FixedPointKernel fixed;
+        const double scale = 1 << FIXED_POINT_SHIFT;
+        double sum = 0.0;
+        int quantizedSum = 0;
+        for (double weight : kernel) {
+            int16_t quantized = static_cast<int16_t>(std::lround(weight * scale));
+            fixed.weights.push_back(quantized);
+            sum += weight;
+            quantizedSum += quantized;
+        }
+        // Push the rounding error into the center tap, so that flat regions stay flat.
+        if (!fixed.weights.empty()) {
+            int target = static_cast<int>(std::lround(sum * scale));
+            fixed.weights[fixed.weights.size() / 2] += target - quantizedSum;
+        }
+        for (size_t k = 0; k < fixed.weights.size(); k += 2) {
+            uint16_t low = static_cast<uint16_t>(fixed.weights[k]);
+            uint16_t high =
+                k + 1 < fixed.weights.size() ? static_cast<uint16_t>(fixed.weights[k + 1]) : 0;
+            fixed.weightPairs.push_back(static_cast<int32_t>(low | (high << 16)));
+        }
+        return fixed;
+    }
+
+    /**
+     * Scalar reference of the multiply-accumulate, also used for the tails of the vector loops.
+     * Every vector path must produce exactly the same bytes.
+     */
+    static void convolveTapsScalar(const unsigned char* const* sources,
+                                   const FixedPointKernel& kernel, unsigned char* dst,
+                                   std::size_t begin, std::size_t end) {
+        const int taps = kernel.weights.size();
+        for (std::size_t x = begin; x < end; x++) {
+            int32_t sum = 0;
+            for (int k = 0; k < taps; k++) {
+                sum += kernel.weights[k] * sources[k][x];
+            }
+            dst[x] = static_cast<unsigned char>(std::clamp(sum >> FIXED_POINT_SHIFT, 0, 255));
+        }
+    }
+
+#ifdef CUDAVISION_X86
+    /**
+     * The vector paths process two taps per step: the source bytes of both taps are widened to
+     * 16 bit and interleaved, so that one madd multiplies them with a (w[k], w[k + 1]) pair and
+     * adds the products into 32-bit lanes. Unpacking and packing both work within 128-bit lanes,
+     * so the output ends up in the original byte order for all three widths.
+     */
+    static std::size_t convolveTapsSSE2(const unsigned char* const* sources,
+                                        const FixedPointKernel& kernel, unsigned char* dst,
+                                        std::size_t count) {
+        const int taps = kernel.weights.size();
+        const __m128i zero = _mm_setzero_si128();
+        std::size_t x = 0;
+        for (; x + 16 <= count; x += 16) {
+            __m128i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero;
+            for (int k = 0; k < taps; k += 2) {
+                const __m128i weights = _mm_set1_epi32(kernel.weightPairs[k / 2]);
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sources[k] + x));
+                __m128i b = k + 1 < taps ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+                                               sources[k + 1] + x))
+                                         : zero;
+                __m128i aLow = _mm_unpacklo_epi8(a, zero), aHigh = _mm_unpackhi_epi8(a, zero);
+                __m128i bLow = _mm_unpacklo_epi8(b, zero), bHigh = _mm_unpackhi_epi8(b, zero);
+                acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(aLow, bLow), weights));
+                acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(aLow, bLow), weights));
+                acc2 =
+                    _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(aHigh, bHigh), weights));
+                acc3 =
+                    _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(aHigh, bHigh), weights));
+            }
+            __m128i low = _mm_packs_epi32(_mm_srai_epi32(acc0, FIXED_POINT_SHIFT),
+                                          _mm_srai_epi32(acc1, FIXED_POINT_SHIFT));
+            __m128i high = _mm_packs_epi32(_mm_srai_epi32(acc2, FIXED_POINT_SHIFT),
+                                           _mm_srai_epi32(acc3, FIXED_POINT_SHIFT));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(low, high));
+        }
+        return x;
+    }
+
+    __attribute__((target("avx2"))) static std::size_t convolveTapsAVX2(
+        const unsigned char* const* sources, const FixedPointKernel& kernel, unsigned char* dst,
+        std::size_t count) {
+        const int taps = kernel.weights.size();
+        const __m256i zero = _mm256_setzero_si256();
+        std::size_t x = 0;
+        for (; x + 32 <= count; x += 32) {
+            __m256i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero;
+            for (int k = 0; k < taps; k += 2) {
+                const __m256i weights = _mm256_set1_epi32(kernel.weightPairs[k / 2]);
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(sources[k] + x));
+                __m256i b = k + 1 < taps ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+                                               sources[k + 1] + x))
+                                         : zero;
+                __m256i aLow = _mm256_unpacklo_epi8(a, zero), aHigh = _mm256_unpackhi_epi8(a, zero);
+                __m256i bLow = _mm256_unpacklo_epi8(b, zero), bHigh = _mm256_unpackhi_epi8(b, zero);
+                acc0 = _mm256_add_epi32(
+                    acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(aLow, bLow), weights));
+                acc1 = _mm256_add_epi32(
+                    acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(aLow, bLow), weights));
+                acc2 = _mm256_add_epi32(
+                    acc2, _mm256_madd_epi16(_mm256_unpacklo_epi16(aHigh, bHigh), weights));
+                acc3 = _mm256_add_epi32(
+                    acc3, _mm256_madd_epi16(_mm256_unpackhi_epi16(aHigh, bHigh), weights));
+            }
+            __m256i low = _mm256_packs_epi32(_mm256_srai_epi32(acc0, FIXED_POINT_SHIFT),
+                                             _mm256_srai_epi32(acc1, FIXED_POINT_SHIFT));
+            __m256i high = _mm256_packs_epi32(_mm256_srai_epi32(acc2, FIXED_POINT_SHIFT),
+                                              _mm256_srai_epi32(acc3, FIXED_POINT_SHIFT));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + x),
+                                _mm256_packus_epi16(low, high));
+        }
+        return x;
+    }
+
+    // GCC 12 reports the undefined source operand of _mm512_srai_epi32 in its own header as maybe
+    // uninitialized.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+    __attribute__((target("avx512f,avx512bw"))) static std::size_t convolveTapsAVX512(
+        const unsigned char* const* sources, const FixedPointKernel& kernel, unsigned char* dst,
+        std::size_t count) {
+        const int taps = kernel.weights.size();
+        const __m512i zero = _mm512_setzero_si512();
+        std::size_t x = 0;
+        for (; x + 64 <= count; x += 64) {
+            __m512i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero;
+            for (int k = 0; k < taps; k += 2) {
+                const __m512i weights = _mm512_set1_epi32(kernel.weightPairs[k / 2]);
+                __m512i a = _mm512_loadu_si512(sources[k] + x);
+                __m512i b = k + 1 < taps ? _mm512_loadu_si512(sources[k + 1] + x) : zero;
+                __m512i aLow = _mm512_unpacklo_epi8(a, zero), aHigh = _mm512_unpackhi_epi8(a, zero);
+                __m512i bLow = _mm512_unpacklo_epi8(b, zero), bHigh = _mm512_unpackhi_epi8(b, zero);
+                acc0 = _mm512_add_epi32(
+                    acc0, _mm512_madd_epi16(_mm512_unpacklo_epi16(aLow, bLow), weights));
+                acc1 = _mm512_add_epi32(
+                    acc1, _mm512_madd_epi16(_mm512_unpackhi_epi16(aLow, bLow), weights));
+                acc2 = _mm512_add_epi32(
+                    acc2, _mm512_madd_epi16(_mm512_unpacklo_epi16(aHigh, bHigh), weights));
+                acc3 = _mm512_add_epi32(
+                    acc3, _mm512_madd_epi16(_mm512_unpackhi_epi16(aHigh, bHigh), weights));
+            }
+            __m512i low = _mm512_packs_epi32(_mm512_srai_epi32(acc0, FIXED_POINT_SHIFT),
+                                             _mm512_srai_epi32(acc1, FIXED_POINT_SHIFT));
+            __m512i high = _mm512_packs_epi32(_mm512_srai_epi32(acc2, FIXED_POINT_SHIFT),
+                                              _mm512_srai_epi32(acc3, FIXED_POINT_SHIFT));
+            _mm512_storeu_si512(dst + x, _mm512_packus_epi16(low, high));
+        }
+        return x;
+    }
+#pragma GCC diagnostic pop
+#endif
+
+    void convolveTaps(const unsigned char* const* sources, const FixedPointKernel& kernel,
+                      unsigned char* dst, std::size_t count) {
+        std::size_t done = 0;
+#ifdef CUDAVISION_X86
+        switch (getInstructionSet()) {
+            case InstructionSet::AVX512:
+                done = convolveTapsAVX512(sources, kernel, dst, count);
+                break;
+            case InstructionSet::AVX2:
+                done = convolveTapsAVX2(sources, kernel, dst, count);
+                break;
+            case InstructionSet::SSE2:
+                done = convolveTapsSSE2(sources, kernel, dst, count);
+                break;
+            case InstructionSet::Scalar:
+                break;
+        }
+#endif
+        convolveTapsScalar(sources, kernel, dst, done, count);
+    }
+
+    void convolveSegmentHorizontal(const unsigned char* src, unsigned char* dst,
+                                   unsigned int width, unsigned int channels, unsigned int begin,
+                                   unsigned int end, const FixedPointKernel& kernel) {
+        // Replicate the border pixels into a padded copy of the segment, so that every tap of the
+        // inner loop is a plain shifted read.
+        thread_local std::vector<unsigned char> padded;
+        thread_local std::vector<const unsigned char*> sources;
+        if (begin >= end) {
+            return;
+        }
+        const int radius = kernel.radius();
+        const int first = static_cast<int>(begin) - radius;
+        const int last = static_cast<int>(end) + radius;
+        const int inFirst = std::max(first, 0);
+        const int inLast = std::min(last, static_cast<int>(width));
+        padded.resize(static_cast<std::size_t>(last - first) * channels);
+        unsigned char* out = padded.data();
+        for (int px = first; px < inFirst; px++, out += channels) {
+            std::memcpy(out, src, channels);
+        }
+        std::memcpy(out, src + inFirst * channels, (inLast - inFirst) * channels);
+        out += (inLast - inFirst) * channels;
+        for (int px = inLast; px < last; px++, out += channels) {
+            std::memcpy(out, src + (width - 1) * channels, channels);
+        }
+
+        sources.resize(kernel.weights.size());
+        for (std::size_t k = 0; k < sources.size(); k++) {
+            sources[k] = padded.data() + k * channels;
+        }
+        convolveTaps(sources.data(), kernel, dst, static_cast<std::size_t>(end - begin) * channels);
+    }
+
+    void convolveRowHorizontal(const unsigned char* src, unsigned char* dst, unsigned int width,
+                               unsigned int channels, const FixedPointKernel& kernel) {
+        convolveSegmentHorizontal(src, dst, width, channels, 0, width, kernel);
+    }
+
+    void horizontalConvolution(ImageView input, MutableImageView output,
+                               const FixedPointKernel& kernel) {
+        CUDAVISION_TRACE_SCOPE("horizontalConvolution");
+        parallelForRows(input.height, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                convolveRowHorizontal(input.row(i), output.row(i), input.width, input.channels,
+                                      kernel);
+            }
+        });
+    }
+
+    void verticalConvolution(ImageView input, MutableImageView output,
+                             const FixedPointKernel& kernel) {
+        CUDAVISION_TRACE_SCOPE("verticalConvolution");
+        const int radius = kernel.radius();
+        const int height = input.height;
+        parallelForRows(height, [&](unsigned int begin, unsigned int end) {
+            thread_local std::vector<const unsigned char*> sources;
+            sources.resize(kernel.weights.size());
+            for (int i = begin; i < static_cast<int>(end); i++) {
+                for (int k = -radius; k <= radius; k++) {
+                    sources[k + radius] = input.row(std::clamp(i + k, 0, height - 1));
+                }
+                convolveTaps(sources.data(), kernel, output.row(i), input.rowElements());
+            }
+        });
+    }
+
+    /**
+     * Cache-blocked fused pass over the output rectangle [x0, x1) x [y0, y1). Each input row of
+     * the column strip is convolved horizontally exactly once into a ring buffer holding the
+     * last K rows, and every output row is one vertical combination of the ring. The strip width
+     * is chosen so that the ring stays in L2.
+     */
+    static void separableConvolutionRegion(ImageView input, MutableImageView output,
+                                           const FixedPointKernel& horizontal,
+                                           const FixedPointKernel& vertical, unsigned int x0,
+                                           unsigned int y0, unsigned int x1, unsigned int y1) {
+        constexpr std::size_t RING_BYTES = 128 * 1024;
+        const int radius = vertical.radius();
+        const int taps = vertical.weights.size();
+        const int height = input.height;
+        const unsigned int channels = input.channels;
+        const unsigned int stripWidth =
+            std::max<std::size_t>(64, RING_BYTES / (static_cast<std::size_t>(taps) * channels));
+
+        thread_local std::vector<unsigned char> ring;
+        thread_local std::vector<const unsigned char*> sources;
+        sources.resize(taps);
+
+        for (unsigned int stripBegin = x0; stripBegin < x1; stripBegin += stripWidth) {
+            const unsigned int stripEnd = std::min(stripBegin + stripWidth, x1);
+            const std::size_t stripBytes =
+                static_cast<std::size_t>(stripEnd - stripBegin) * channels;
+            ring.resize(stripBytes * taps);
+            // Ring slot of an input row. The rows needed by one output row form a contiguous
+            // range of at most K distinct rows, so they never share a slot.
+            auto slot = [&](int row) { return ring.data() + (row % taps) * stripBytes; };
+
+            int nextRow = std::clamp(static_cast<int>(y0) - radius, 0, height - 1);
+            for (int y = y0; y < static_cast<int>(y1); y++) {
+                const int lastRow = std::min(y + radius, height - 1);
+                for (; nextRow <= lastRow; nextRow++) {
+                    convolveSegmentHorizontal(input.row(nextRow), slot(nextRow), input.width,
+                                              channels, stripBegin, stripEnd, horizontal);
+                }
+                for (int k = -radius; k <= radius; k++) {
+                    sources[k + radius] = slot(std::clamp(y + k, 0, height - 1));
+                }
+                convolveTaps(sources.data(), vertical, output.row(y) + stripBegin * channels,
+                             stripBytes);
+            }
+        }
+    }
+
+    void separableConvolution(ImageView input, MutableImageView output,
+                              const FixedPointKernel& horizontal,
+                              const FixedPointKernel& vertical) {
+        CUDAVISION_TRACE_SCOPE("separableConvolution");
+        // Every band primes its ring buffer with the radius rows above it, its halo.
+        parallelForRows(input.height, [&](unsigned int begin, unsigned int end) {
+            separableConvolutionRegion(input, output, horizontal, vertical, 0, begin, input.width,
+                                       end);
+        });
+    }
+
+    /**
+     * Rejects tiled images that cannot be combined by the convolutions.
+     */
+    static void checkTiledPair(const TiledImage& input, const TiledImage& output) {
+        if (input.getWidth() != output.getWidth() || input.getHeight() != output.getHeight() ||
+            input.getChannels() != output.getChannels() ||
+            input.getTileSize() != output.getTileSize()) {
+            throw std::invalid_argument("convolution: tiled images differ in size or tiling");
+        }
+    }
+
+    void horizontalConvolution(const TiledImage& input, TiledImage& output,
+                               const FixedPointKernel& kernel) {
+        CUDAVISION_TRACE_SCOPE("horizontalConvolution tiled");
+        checkTiledPair(input, output);
+        applyTiled(input, output, kernel.radius(), 0, [&](ImageView in, MutableImageView out) {
+            for (unsigned int i = 0; i < in.height; i++) {
+                convolveRowHorizontal(in.row(i), out.row(i), in.width, in.channels, kernel);
+            }
+        });
+    }
+
+    void verticalConvolution(const TiledImage& input, TiledImage& output,
+                             const FixedPointKernel& kernel) {
+        CUDAVISION_TRACE_SCOPE("verticalConvolution tiled");
+        checkTiledPair(input, output);
+        const int radius = kernel.radius();
+        const int height = input.getHeight();
+        const unsigned int tileSize = input.getTileSize();
+        const unsigned int rows = input.getTileRows();
+        const std::size_t tiles = std::size_t{input.getTileColumns()} * rows;
+        getThreadPool().parallelFor(0, tiles, 1, [&](std::size_t begin, std::size_t end) {
+            thread_local std::vector<const unsigned char*> sources;
+            sources.resize(kernel.weights.size());
+            for (std::size_t index = begin; index < end; index++) {
+                const unsigned int tx = index / rows;
+                const unsigned int ty = index % rows;
+                MutableImageView target = output.mutableTile(tx, ty);
+                for (unsigned int i = 0; i < target.height; i++) {
+                    const int y = ty * tileSize + i;
+                    for (int k = -radius; k <= radius; k++) {
+                        sources[k + radius] =
+                            input.pixel(tx * tileSize, std::clamp(y + k, 0, height - 1));
+                    }
+                    convolveTaps(sources.data(), kernel, target.row(i), target.rowElements());
+                }
+            }
+        });
+    }
+
+    void separableConvolution(const TiledImage& input, TiledImage& output,
+                              const FixedPointKernel& horizontal,
+                              const FixedPointKernel& vertical) {
+        CUDAVISION_TRACE_SCOPE("separableConvolution tiled");
+        checkTiledPair(input, output);
+        applyTiled(input, output, horizontal.radius(), vertical.radius(),
+                   [&](ImageView in, MutableImageView out) {
+                       separableConvolutionRegion(in, out, horizontal, vertical, 0, 0, in.width,
+                                                  in.height);
+                   });
+    }
+}  // namespace CUDAVISION
@@ -0,0 +1,95 @@
+#include "filter/stencil.h"
+
+#include <cmath>
+#include <cstring>
+
+namespace CUDAVISION::detail {
+    /**
+     * Maps a coordinate outside of [0, size) into the image, or returns -1 for a constant
+     * border. Zero mode never uses the pixels outside, any valid row will do.
+     */
+    static int resolveBorder(int i, int size, BorderMode border) {
+        if (i >= 0 && i < size) {
+            return i;
+        }
+        switch (border) {
+            case BorderMode::Constant:
+                return -1;
+            case BorderMode::Reflect: {
+                if (size == 1) {
+                    return 0;
+                }
+                const int period = 2 * (size - 1);
+                i = std::abs(i) % period;
+                return i < size ? i : period - i;
+            }
+            default:
+                return std::clamp(i, 0, size - 1);
+        }
+    }
+
+    void StencilRowCache::reset(ImageView input, int radius, const StencilOptions& options) {
+        reset(input, radius, options, 0, input.height);
+    }
+
+    void StencilRowCache::reset(ImageView input, int radius, const StencilOptions& options,
+                                int firstRow, int imageHeight) {
+        this->input = input;
+        this->radius = radius;
+        this->options = options;
+        this->firstRow = firstRow;
+        this->imageHeight = imageHeight;
+        const std::size_t rows = 2 * radius + 1;
+        paddedElements = (input.width + 2 * radius) * input.channels;
+        buffer.resize(rows * paddedElements);
+        tags.assign(rows, INT32_MIN);
+        pointers.resize(rows);
+    }
+
+    const unsigned char* const* StencilRowCache::rows(int y) {
+        const int size = 2 * radius + 1;
+        const int width = input.width;
+        const int channels = input.channels;
+        const std::size_t margin = std::size_t{static_cast<unsigned int>(radius)} * channels;
+        for (int i = 0; i < size; i++) {
+            const int row = y + i - radius;
+            const int slot = ((row % size) + size) % size;
+            unsigned char* padded = buffer.data() + slot * paddedElements;
+            pointers[i] = padded + margin;
+            if (tags[slot] == row) {
+                continue;
+            }
+            tags[slot] = row;
+            const int source = resolveBorder(row, imageHeight, options.border);
+            if (source < 0) {
+                std::memset(padded, options.borderValue, paddedElements);
+                continue;
+            }
+            std::memcpy(padded + margin, input.row(source - firstRow),
+                        std::size_t{input.rowElements()});
+            for (int x = -radius; x < 0; x++) {
+                for (int side = 0; side < 2; side++) {
+                    const int column = side == 0 ? x : width - 1 - x;
+                    unsigned char* dst = padded + margin + column * channels;
+                    const int mapped = resolveBorder(column, width, options.border);
+                    for (int c = 0; c < channels; c++) {
+                        dst[c] = mapped < 0 ? options.borderValue
+                                            : padded[margin + mapped * channels + c];
+                    }
+                }
+            }
+        }
+        return pointers.data();
+    }
+
+    const unsigned char* squareRootTable() {
+        static const std::vector<unsigned char> table = [] {
+            std::vector<unsigned char> roots(65536);
+            for (std::size_t s = 0; s < roots.size(); s++) {
+                roots[s] = static_cast<unsigned char>(std::sqrt(static_cast<double>(s)));
+            }
+            return roots;
+        }();
+        return table.data();
+    }
+}  // namespace CUDAVISION::detail
@@ -0,0 +1,160 @@
+#include "pipeline/batch.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+
+#include "util/bitmap_io.h"
+#include "util/bounded_queue.h"
+#include "util/histogram.h"
+#include "util/trace.h"
+
+namespace fs = std::filesystem;
+
+namespace CUDAVISION {
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * An image on its way through the stages. A non-empty error marks it as failed, later
+     * stages only pass it on.
+     */
+    struct BatchJob {
+        std::size_t index = 0;
+        Clock::time_point start;
+        std::size_t pixels = 0;
+        std::optional<Image> image;
+        std::vector<BatchOutput> outputs;
+        std::string error;
+    };
+
+    std::vector<fs::path> collectBatchInputs(const fs::path& source) {
+        std::error_code error;
+        std::vector<fs::path> inputs;
+        if (fs::is_directory(source, error)) {
+            for (const fs::directory_entry& entry : fs::directory_iterator(source, error)) {
+                std::string extension = entry.path().extension().string();
+                std::transform(extension.begin(), extension.end(), extension.begin(),
+                               [](unsigned char c) { return std::tolower(c); });
+                if (extension == ".bmp" && entry.is_regular_file(error)) {
+                    inputs.push_back(entry.path());
+                }
+            }
+            if (error) {
+                throw std::runtime_error(source.string() + ": " + error.message());
+            }
+            std::sort(inputs.begin(), inputs.end());
+            return inputs;
+        }
+
+        std::ifstream manifest(source);
+        if (!manifest) {
+            throw std::runtime_error(source.string() + ": cannot open directory or manifest");
+        }
+        std::string line;
+        while (std::getline(manifest, line)) {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            line.erase(0, line.find_first_not_of(" \t"));
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            fs::path path(line);
+            inputs.push_back(path.is_relative() ? source.parent_path() / path : path);
+        }
+        return inputs;
+    }
+
+    BatchStatistics runBatch(const std::vector<fs::path>& inputs, const fs::path& outputDirectory,
+                             const BatchFunction& function, const BatchOptions& options) {
+        const Clock::time_point batchStart = Clock::now();
+        fs::create_directories(outputDirectory);
+
+        BoundedQueue<BatchJob> decoded(options.queueDepth);
+        BoundedQueue<BatchJob> computed(options.queueDepth);
+        BatchStatistics statistics;
+        std::vector<double> latencies;
+        latencies.reserve(inputs.size());
+
+        // Prefetch and decode. Mapping and decoding the next inputs while the current one is
+        // computed hides the read latency.
+        std::thread reader([&] {
+            for (std::size_t i = 0; i < inputs.size(); i++) {
+                BatchJob job;
+                job.index = i;
+                job.start = Clock::now();
+                try {
+                    CUDAVISION_TRACE_SCOPE("batch decode");
+                    job.image = readBitmap(inputs[i]);
+                    job.pixels = std::size_t{job.image->getWidth()} * job.image->getHeight();
+                } catch (const std::exception& error) {
+                    job.error = error.what();
+                }
+                decoded.push(std::move(job));
+            }
+            decoded.close();
+        });
+
+        // Encode and write, and account for every job once it leaves the pipeline.
+        std::thread writer([&] {
+            while (std::optional<BatchJob> job = computed.pop()) {
+                const fs::path& input = inputs[job->index];
+                if (job->error.empty()) {
+                    try {
+                        CUDAVISION_TRACE_SCOPE("batch write");
+                        for (const BatchOutput& output : job->outputs) {
+                            const fs::path path = outputDirectory / (input.stem().string() + "_" +
+                                                                     output.name + ".bmp");
+                            if (const BitImage* bits = std::get_if<BitImage>(&output.image)) {
+                                writeBitmap(path, *bits);
+                            } else {
+                                writeBitmap(path, std::get<Image>(output.image).view());
+                            }
+                        }
+                    } catch (const std::exception& error) {
+                        job->error = error.what();
+                    }
+                }
+                if (!job->error.empty()) {
+                    statistics.failed++;
+                    // Reader errors already name the file.
+                    statistics.errors.push_back(
+                        job->error.find(input.string()) == std::string::npos
+                            ? input.string() + ": " + job->error
+                            : job->error);
+                    continue;
+                }
+                statistics.succeeded++;
+                statistics.megapixels += job->pixels / 1e6;
+                latencies.push_back(
+                    std::chrono::duration<double, std::milli>(Clock::now() - job->start).count());
+            }
+        });
+
+        // Compute on the calling thread, the operators spread each image over the thread pool.
+        while (std::optional<BatchJob> job = decoded.pop()) {
+            if (job->error.empty()) {
+                try {
+                    CUDAVISION_TRACE_SCOPE("batch compute");
+                    job->outputs = function(*job->image);
+                } catch (const std::exception& error) {
+                    job->error = error.what();
+                }
+            }
+            // The input is not needed any more, return its buffer before the job is queued.
+            job->image.reset();
+            computed.push(std::move(*job));
+        }
+        computed.close();
+        reader.join();
+        writer.join();
+
+        statistics.seconds = std::chrono::duration<double>(Clock::now() - batchStart).count();
+        statistics.p50Milliseconds = samplePercentile(latencies, 0.50);
+        statistics.p99Milliseconds = samplePercentile(latencies, 0.99);
+        return statistics;
+    }
+}  // namespace CUDAVISION
@@ -0,0 +1,692 @@
+#include "pipeline/graph.h"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <map>
+#include <optional>
+#include <sstream>
+
+#include "edge_detection/canny.h"
+#include "pipeline/result_cache.h"
+#include "util/buffer_pool.h"
+#include "util/thread_pool.h"
+#include "util/trace.h"
+
+namespace CUDAVISION {
+    /**
+     * A recorded operator after planning.
+     */
+    struct PlanStep {
+        Pipeline::Node node;
+        int operation = 0;
+        int source = -1;
+        unsigned int channels = 0;
+        int kernelSize = 0;
+        double sigma = 0.0;
+        FixedPointKernel kernel;
+        bool live = false;
+        std::vector<unsigned int> consumers;
+        int output = -1;
+        // Rows needed above and below a tile, the halo of all consumers together.
+        unsigned int above = 0;
+        unsigned int below = 0;
+        // Grayscale converted on the fly by the horizontal pass of its only consumer, a blur.
+        bool fusedIntoConsumer = false;
+        // Grayscale computed in the vertical pass of the blur it reads.
+        bool fusedIntoProducer = false;
+        // For a blur: the grayscale step computed in its vertical pass, and whether the blur
+        // reads its source through a grayscale step fused into it.
+        int fusedGray = -1;
+        bool grayInput = false;
+        // Edge operators reading the same step run as one group, at the first member.
+        int groupLeader = -1;
+        std::vector<unsigned int> group;
+        bool stored = false;
+        bool direct = false;
+        int slot = -1;
+        int scratchSlot = -1;
+    };
+
+    struct Pipeline::Plan {
+        unsigned int width = 0;
+        unsigned int height = 0;
+        unsigned int tileRows = 0;
+        std::vector<PlanStep> steps;
+        std::vector<int> outputSteps;
+        std::vector<std::size_t> slotBytes;
+    };
+
+    Pipeline::Pipeline() { operators.push_back({}); }
+
+    Pipeline::Node Pipeline::record(Operation operation, Node source, int kernelSize,
+                                    double sigma) {
+        operators.push_back({operation, source.index, kernelSize, sigma});
+        return {static_cast<unsigned int>(operators.size() - 1)};
+    }
+
+    Pipeline::Node Pipeline::gaussianSmooth(Node source, int kernelSize, double sigma) {
+        return record(Operation::GaussianSmooth, source, kernelSize, sigma);
+    }
+
+    Pipeline::Node Pipeline::grayscale(Node source) {
+        return record(Operation::Grayscale, source);
+    }
+
+    Pipeline::Node Pipeline::robertsOperator(Node source) {
+        return record(Operation::Roberts, source);
+    }
+
+    Pipeline::Node Pipeline::prewittOperator(Node source) {
+        return record(Operation::Prewitt, source);
+    }
+
+    Pipeline::Node Pipeline::sobelOperator(Node source) {
+        return record(Operation::Sobel, source);
+    }
+
+    unsigned int Pipeline::output(Node node) {
+        auto existing = std::find(outputs.begin(), outputs.end(), node.index);
+        if (existing != outputs.end()) {
+            return existing - outputs.begin();
+        }
+        outputs.push_back(node.index);
+        return outputs.size() - 1;
+    }
+
+    void Pipeline::setTileRows(unsigned int rows) { tileRows = std::max(rows, 1u); }
+
+    void Pipeline::setReordering(bool enabled) { reordering = enabled; }
+
+    void Pipeline::setCache(ResultCache* cache) { this->cache = cache; }
+
+    void Pipeline::cacheIntermediate(Node node) {
+        if (node.index != 0 && std::find(intermediates.begin(), intermediates.end(),
+                                         node.index) == intermediates.end()) {
+            intermediates.push_back(node.index);
+        }
+    }
+
+    Pipeline::Plan Pipeline::plan(unsigned int width, unsigned int height,
+                                  unsigned int channels) const {
+        Plan plan;
+        plan.width = width;
+        plan.height = height;
+        plan.tileRows = std::min(tileRows, std::max(height, 1u));
+        std::vector<PlanStep>& steps = plan.steps;
+        steps.resize(operators.size());
+
+        // Grayscale of a single-channel node is the node itself, consumers read through it.
+        std::vector<unsigned int> alias(operators.size());
+        for (unsigned int i = 0; i < operators.size(); i++) {
+            const Operator& op = operators[i];
+            PlanStep& step = steps[i];
+            step.node = {i};
+            step.operation = static_cast<int>(op.operation);
+            step.kernelSize = op.kernelSize;
+            step.sigma = op.sigma;
+            alias[i] = i;
+            if (op.operation == Operation::Input) {
+                step.channels = channels;
+                continue;
+            }
+            step.source = alias[op.source];
+            step.channels = steps[step.source].channels;
+            if (op.operation == Operation::Grayscale) {
+                if (step.channels == 1) {
+                    alias[i] = step.source;
+                }
+                step.channels = 1;
+            }
+        }
+        for (unsigned int index : outputs) {
+            plan.outputSteps.push_back(alias[index]);
+        }
+
+        auto isOperation = [&](const PlanStep& step, Operation operation) {
+            return step.operation == static_cast<int>(operation);
+        };
+        auto updateConsumers = [&]() {
+            for (PlanStep& step : steps) {
+                step.live = false;
+                step.consumers.clear();
+                step.output = -1;
+            }
+            for (unsigned int i = 0; i < plan.outputSteps.size(); i++) {
+                if (steps[plan.outputSteps[i]].output < 0) {
+                    steps[plan.outputSteps[i]].output = i;
+                }
+                steps[plan.outputSteps[i]].live = true;
+            }
+            for (unsigned int i = steps.size(); i-- > 0;) {
+                if (steps[i].live && steps[i].source >= 0) {
+                    steps[steps[i].source].live = true;
+                    steps[steps[i].source].consumers.push_back(i);
+                }
+            }
+            for (PlanStep& step : steps) {
+                std::sort(step.consumers.begin(), step.consumers.end());
+            }
+        };
+        updateConsumers();
+
+        // Reordering: grayscale(blur(x)) becomes blur(grayscale(x)) when the color blur is only
+        // read by the conversion. The two steps swap their operations, consumers of the
+        // grayscale step then read the blur.
+        if (reordering) {
+            for (PlanStep& gray : steps) {
+                if (!gray.live || !isOperation(gray, Operation::Grayscale)) {
+                    continue;
+                }
+                PlanStep& blur = steps[gray.source];
+                if (!isOperation(blur, Operation::GaussianSmooth) || blur.output >= 0 ||
+                    blur.consumers.size() != 1) {
+                    continue;
+                }
+                std::swap(gray.operation, blur.operation);
+                std::swap(gray.kernelSize, blur.kernelSize);
+                std::swap(gray.sigma, blur.sigma);
+                blur.channels = 1;
+            }
+            updateConsumers();
+        }
+
+        for (unsigned int i = 0; i < steps.size(); i++) {
+            PlanStep& step = steps[i];
+            if (!step.live) {
+                continue;
+            }
+            if (isOperation(step, Operation::GaussianSmooth)) {
+                step.kernel = FixedPointKernel::fromKernel(
+                    getEquivalentKernel(getGaussianKernel(step.kernelSize, step.sigma), 3));
+            }
+            if (isOperation(step, Operation::Grayscale) && step.source >= 0) {
+                PlanStep& source = steps[step.source];
+                if (isOperation(source, Operation::GaussianSmooth) && source.fusedGray < 0) {
+                    step.fusedIntoProducer = true;
+                    source.fusedGray = i;
+                } else if (step.output < 0 && step.consumers.size() == 1 &&
+                           isOperation(steps[step.consumers[0]], Operation::GaussianSmooth)) {
+                    step.fusedIntoConsumer = true;
+                    steps[step.consumers[0]].grayInput = true;
+                }
+            }
+            if (isOperation(step, Operation::Roberts) || isOperation(step, Operation::Prewitt) ||
+                isOperation(step, Operation::Sobel)) {
+                PlanStep& source = steps[step.source];
+                for (unsigned int consumer : source.consumers) {
+                    if (steps[consumer].groupLeader >= 0 &&
+                        steps[steps[consumer].groupLeader].source == step.source) {
+                        step.groupLeader = steps[consumer].groupLeader;
+                        break;
+                    }
+                }
+                if (step.groupLeader < 0) {
+                    step.groupLeader = i;
+                }
+                steps[step.groupLeader].group.push_back(i);
+            }
+        }
+
+        // Halo rows, from the outputs back to the input.
+        for (unsigned int i = steps.size(); i-- > 0;) {
+            const PlanStep& step = steps[i];
+            if (!step.live || step.source < 0) {
+                continue;
+            }
+            unsigned int haloAbove = 0, haloBelow = 0;
+            if (isOperation(step, Operation::GaussianSmooth)) {
+                haloAbove = haloBelow = step.kernel.radius();
+            } else if (isOperation(step, Operation::Roberts) ||
+                       isOperation(step, Operation::Prewitt) ||
+                       isOperation(step, Operation::Sobel)) {
+                // The stencil engine pads the full 3 x 3 window, also for the 2 x 2 Roberts
+                // cross that only reaches down.
+                haloAbove = haloBelow = 1;
+            }
+            PlanStep& source = steps[step.source];
+            source.above = std::max(source.above, step.above + haloAbove);
+            source.below = std::max(source.below, step.below + haloBelow);
+        }
+
+        // Buffers: outputs without halo are computed in place, intermediates get a tile buffer
+        // unless they are fused into a neighbour.
+        for (PlanStep& step : steps) {
+            if (!step.live || isOperation(step, Operation::Input) || step.fusedIntoConsumer) {
+                continue;
+            }
+            if (isOperation(step, Operation::GaussianSmooth) && step.output < 0 &&
+                step.consumers.size() == 1 && step.fusedGray >= 0) {
+                continue;
+            }
+            step.stored = true;
+            step.direct = step.output >= 0 && step.above == 0 && step.below == 0;
+        }
+
+        // Slots by liveness. A step is defined when it (or the blur or group computing it)
+        // runs and dies after its last consumer, outputs copied at the end of a tile live on.
+        auto definedAt = [&](unsigned int i) -> unsigned int {
+            const PlanStep& step = steps[i];
+            if (step.fusedIntoProducer) {
+                return step.source;
+            }
+            return step.groupLeader >= 0 ? step.groupLeader : i;
+        };
+        std::vector<unsigned int> lastUse(steps.size(), 0);
+        for (unsigned int i = 0; i < steps.size(); i++) {
+            const PlanStep& step = steps[i];
+            for (unsigned int consumer : step.consumers) {
+                const PlanStep& reader = steps[consumer];
+                if (reader.fusedIntoConsumer) {
+                    for (unsigned int next : reader.consumers) {
+                        lastUse[i] = std::max(lastUse[i], definedAt(next));
+                    }
+                } else {
+                    lastUse[i] = std::max(lastUse[i], definedAt(consumer));
+                }
+            }
+            if (step.output >= 0 && !step.direct) {
+                lastUse[i] = std::numeric_limits<unsigned int>::max();
+            }
+        }
+        std::vector<unsigned int> order;
+        for (unsigned int i = 0; i < steps.size(); i++) {
+            if (steps[i].stored && !steps[i].direct) {
+                order.push_back(i);
+            }
+            if (steps[i].live && isOperation(steps[i], Operation::GaussianSmooth)) {
+                order.push_back(i);
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+            return definedAt(a) < definedAt(b);
+        });
+        std::vector<int> slotOwner;
+        std::vector<unsigned int> slotFreeAfter;
+        auto allocate = [&](std::size_t bytes, unsigned int time, unsigned int freeAfter) {
+            int chosen = -1;
+            for (unsigned int s = 0; s < plan.slotBytes.size(); s++) {
+                if (slotFreeAfter[s] < time &&
+                    (chosen < 0 || plan.slotBytes[s] > plan.slotBytes[chosen])) {
+                    chosen = s;
+                }
+            }
+            if (chosen < 0) {
+                chosen = plan.slotBytes.size();
+                plan.slotBytes.push_back(0);
+                slotFreeAfter.push_back(0);
+            }
+            plan.slotBytes[chosen] = std::max(plan.slotBytes[chosen], bytes);
+            slotFreeAfter[chosen] = freeAfter;
+            return chosen;
+        };
+        std::vector<bool> scratchDone(steps.size(), false);
+        for (unsigned int i : order) {
+            PlanStep& step = steps[i];
+            const unsigned int time = definedAt(i);
+            const std::size_t rowBytes = std::size_t{width} * step.channels;
+            const unsigned int rows = plan.tileRows + step.above + step.below;
+            // A blur appears twice in the order, once for the scratch rows of its horizontal
+            // pass, which die when the blur is done, and once for its result if stored.
+            if (isOperation(step, Operation::GaussianSmooth) && !scratchDone[i]) {
+                scratchDone[i] = true;
+                const unsigned int scratchRows = rows + 2 * step.kernel.radius();
+                step.scratchSlot = allocate(scratchRows * rowBytes, time, time);
+                continue;
+            }
+            step.slot = allocate(rows * rowBytes, time, lastUse[i]);
+        }
+        return plan;
+    }
+
+    /**
+     * Rows [first, ...) of a step within a tile, or of a full image for first = 0.
+     */
+    struct TileRows {
+        unsigned char* data = nullptr;
+        std::ptrdiff_t stride = 0;
+        unsigned int first = 0;
+
+        unsigned char* row(unsigned int y) const { return data + (y - first) * stride; }
+    };
+
+    std::vector<Image> Pipeline::run(const Image& image) const {
+        return cache ? runCached(image) : execute(image);
+    }
+
+    /**
+     * Mixed into every cache key, changed whenever an operator of the graph computes different
+     * results, so that results of older versions are no longer found.
+     */
+    static constexpr uint64_t RESULT_VERSION = 2;
+
+    std::vector<uint64_t> Pipeline::cacheKeys(uint64_t inputHash) const {
+        std::vector<uint64_t> keys(operators.size());
+        keys[0] = combineHash(inputHash, RESULT_VERSION);
+        for (std::size_t i = 1; i < operators.size(); i++) {
+            const Operator& op = operators[i];
+            uint64_t key = combineHash(keys[op.source], static_cast<uint64_t>(op.operation));
+            if (op.operation == Operation::GaussianSmooth) {
+                key = combineHash(key, op.kernelSize);
+                key = combineHash(key, std::bit_cast<uint64_t>(op.sigma));
+                for (double weight : getGaussianKernel(op.kernelSize, op.sigma)) {
+                    key = combineHash(key, std::bit_cast<uint64_t>(weight));
+                }
+            }
+            keys[i] = key;
+        }
+        return keys;
+    }
+
+    Pipeline Pipeline::rebase(unsigned int start, const std::vector<unsigned int>& targets) const {
+        Pipeline rebased;
+        rebased.tileRows = tileRows;
+        // The keys describe the recorded order, see setCache.
+        rebased.reordering = false;
+        std::vector<int> mapped(operators.size(), -1);
+        mapped[start] = 0;
+        for (unsigned int target : targets) {
+            std::vector<unsigned int> chain;
+            for (unsigned int node = target; mapped[node] < 0; node = operators[node].source) {
+                chain.push_back(node);
+            }
+            for (auto node = chain.rbegin(); node != chain.rend(); ++node) {
+                const Operator& op = operators[*node];
+                const Node source{static_cast<unsigned int>(mapped[op.source])};
+                mapped[*node] = rebased.record(op.operation, source, op.kernelSize, op.sigma).index;
+            }
+            rebased.output({static_cast<unsigned int>(mapped[target])});
+        }
+        return rebased;
+    }
+
+    std::vector<Image> Pipeline::runCached(const Image& image) const {
+        CUDAVISION_TRACE_SCOPE("Pipeline::run cached");
+        const std::vector<uint64_t> keys = cacheKeys(cache->hashInput(image.view()));
+        auto isOutput = [&](unsigned int node) {
+            return std::find(outputs.begin(), outputs.end(), node) != outputs.end();
+        };
+        auto isAncestor = [&](unsigned int ancestor, unsigned int node) {
+            while (node > ancestor) {
+                node = operators[node].source;
+            }
+            return node == ancestor;
+        };
+
+        // Outputs not found, grouped by the nearest cached node of their chain.
+        std::vector<std::optional<Image>> found(outputs.size());
+        std::map<unsigned int, std::vector<unsigned int>> groups;
+        for (std::size_t i = 0; i < outputs.size(); i++) {
+            const unsigned int node = outputs[i];
+            found[i] = node == 0 ? std::optional<Image>(image) : cache->find(keys[node]);
+            if (found[i]) {
+                continue;
+            }
+            unsigned int start = operators[node].source;
+            while (start != 0 && !cache->contains(keys[start])) {
+                start = operators[start].source;
+            }
+            groups[start].push_back(node);
+        }
+
+        for (auto& [start, targets] : groups) {
+            for (unsigned int node : intermediates) {
+                if (node != start && !isOutput(node) && isAncestor(start, node) &&
+                    std::any_of(targets.begin(), targets.end(), [&](unsigned int target) {
+                        return isAncestor(node, target);
+                    })) {
+                    targets.push_back(node);
+                }
+            }
+            // The start node may have been evicted since, then the chain starts at the input.
+            std::optional<Image> source;
+            if (start != 0) {
+                source = cache->find(keys[start]);
+            }
+            std::vector<Image> results =
+                rebase(source ? start : 0, targets).execute(source ? *source : image);
+            for (std::size_t t = 0; t < targets.size(); t++) {
+                const bool output = isOutput(targets[t]);
+                cache->store(keys[targets[t]], results[t], output);
+                for (std::size_t i = 0; output && i < outputs.size(); i++) {
+                    if (outputs[i] == targets[t]) {
+                        found[i] = std::move(results[t]);
+                    }
+                }
+            }
+        }
+
+        std::vector<Image> results;
+        for (std::optional<Image>& result : found) {
+            results.push_back(std::move(*result));
+        }
+        return results;
+    }
+
+    std::vector<Image> Pipeline::execute(const Image& image) const {
+        CUDAVISION_TRACE_SCOPE("Pipeline::run");
+        const unsigned int width = image.getWidth();
+        const unsigned int height = image.getHeight();
+        const Plan plan = this->plan(width, height, image.getChannels());
+        const std::vector<PlanStep>& steps = plan.steps;
+
+        std::vector<Image> results;
+        for (int index : plan.outputSteps) {
+            if (index == 0) {
+                results.push_back(image);
+                continue;
+            }
+            const PixelFormat format =
+                steps[index].channels == 1 ? PixelFormat::Gray8 : PixelFormat::BGR8;
+            results.emplace_back(width, height, format,
+                                 BufferPool::global().acquire(std::size_t{width} * height *
+                                                              bytesPerPixel(format)));
+        }
+        if (width == 0 || height == 0) {
+            return results;
+        }
+
+        auto is = [](const PlanStep& step, Operation operation) {
+            return step.operation == static_cast<int>(operation);
+        };
+        ImageView input = image.view();
+        auto processTile = [&](unsigned int begin, unsigned int end) {
+            CUDAVISION_TRACE_SCOPE("Pipeline tile");
+            thread_local std::vector<std::vector<unsigned char>> slots;
+            thread_local std::vector<unsigned char> grayRow, blurRow;
+            thread_local std::vector<const unsigned char*> sources;
+            thread_local detail::StencilBuffers edgeBuffers;
+            slots.resize(std::max(slots.size(), plan.slotBytes.size()));
+            for (std::size_t s = 0; s < plan.slotBytes.size(); s++) {
+                if (slots[s].size() < plan.slotBytes[s]) {
+                    slots[s].resize(plan.slotBytes[s]);
+                }
+            }
+
+            std::vector<TileRows> rows(steps.size());
+            auto firstRow = [&](const PlanStep& step) {
+                return begin > step.above ? begin - step.above : 0;
+            };
+            auto lastRow = [&](const PlanStep& step) { return std::min(end + step.below, height); };
+            for (unsigned int i = 0; i < steps.size(); i++) {
+                const PlanStep& step = steps[i];
+                const std::ptrdiff_t rowBytes = std::ptrdiff_t{width} * step.channels;
+                if (i == 0) {
+                    rows[i] = {const_cast<unsigned char*>(input.data), input.stride, 0};
+                } else if (step.direct) {
+                    rows[i] = {results[step.output].mutableView().data, rowBytes, 0};
+                } else if (step.slot >= 0) {
+                    rows[i] = {slots[step.slot].data(), rowBytes, firstRow(step)};
+                }
+            }
+
+            for (unsigned int i = 1; i < steps.size(); i++) {
+                const PlanStep& step = steps[i];
+                if (!step.live || step.fusedIntoConsumer || step.fusedIntoProducer) {
+                    continue;
+                }
+                const unsigned int first = firstRow(step), last = lastRow(step);
+                if (is(step, Operation::Grayscale)) {
+                    const PlanStep& source = steps[step.source];
+                    for (unsigned int y = first; y < last; y++) {
+                        Image::toGrayscale({rows[step.source].row(y), width, 1, 0, source.channels},
+                                           {rows[i].row(y), width, 1, 0, 1});
+                    }
+                } else if (is(step, Operation::GaussianSmooth)) {
+                    // Horizontal pass over the rows within the radius, reading the source
+                    // through the fused grayscale conversion if there is one.
+                    const int radius = step.kernel.radius();
+                    const unsigned int channels = step.channels;
+                    int sourceIndex = step.source;
+                    if (step.grayInput) {
+                        sourceIndex = steps[sourceIndex].source;
+                    }
+                    const unsigned int hFirst = first > unsigned(radius) ? first - radius : 0;
+                    const unsigned int hLast = std::min(last + radius, height);
+                    TileRows horizontal{slots[step.scratchSlot].data(),
+                                        std::ptrdiff_t{width} * channels, hFirst};
+                    grayRow.resize(width);
+                    for (unsigned int y = hFirst; y < hLast; y++) {
+                        const unsigned char* src = rows[sourceIndex].row(y);
+                        if (step.grayInput) {
+                            Image::toGrayscale({src, width, 1, 0, steps[sourceIndex].channels},
+                                               {grayRow.data(), width, 1, 0, 1});
+                            src = grayRow.data();
+                        }
+                        convolveRowHorizontal(src, horizontal.row(y), width, channels,
+                                              step.kernel);
+                    }
+                    // Vertical pass, followed by the fused grayscale conversion.
+                    sources.resize(2 * radius + 1);
+                    blurRow.resize(std::size_t{width} * channels);
+                    const PlanStep* gray = step.fusedGray >= 0 ? &steps[step.fusedGray] : nullptr;
+                    for (unsigned int y = first; y < last; y++) {
+                        for (int k = 0; k <= 2 * radius; k++) {
+                            sources[k] = horizontal.row(
+                                std::clamp<int>(int(y) - radius + k, 0, int(height) - 1));
+                        }
+                        unsigned char* dst = step.stored ? rows[i].row(y) : blurRow.data();
+                        convolveTaps(sources.data(), step.kernel, dst, blurRow.size());
+                        if (gray && y >= firstRow(*gray) && y < lastRow(*gray)) {
+                            Image::toGrayscale({dst, width, 1, 0, channels},
+                                               {rows[step.fusedGray].row(y), width, 1, 0, 1});
+                        }
+                    }
+                } else if (step.groupLeader == int(i)) {
+                    // All edge operators on the same source in one sweep over its rows, sharing
+                    // the padded rows of the stencil engine. The defaults of StencilOptions give
+                    // exactly what the individual operators compute.
+                    const PlanStep& sourceStep = steps[step.source];
+                    const TileRows& source = rows[step.source];
+                    const unsigned int sourceRows =
+                        step.source == 0 ? height : lastRow(sourceStep) - source.first;
+                    const StencilOptions options;
+                    edgeBuffers.cache.reset({source.data, width, sourceRows, source.stride,
+                                             sourceStep.channels},
+                                            1, options, source.first, height);
+                    unsigned int groupFirst = height, groupLast = 0;
+                    for (unsigned int member : step.group) {
+                        groupFirst = std::min(groupFirst, firstRow(steps[member]));
+                        groupLast = std::max(groupLast, lastRow(steps[member]));
+                    }
+                    for (unsigned int y = groupFirst; y < groupLast; y++) {
+                        for (unsigned int member : step.group) {
+                            const PlanStep& edge = steps[member];
+                            if (y < firstRow(edge) || y >= lastRow(edge)) {
+                                continue;
+                            }
+                            unsigned char* dst = rows[member].row(y);
+                            if (is(edge, Operation::Roberts)) {
+                                detail::stencilRow<RobertsStencil>(edgeBuffers, y, width, height,
+                                                                   step.channels, options, dst);
+                            } else if (is(edge, Operation::Prewitt)) {
+                                detail::stencilRow<PrewittStencil>(edgeBuffers, y, width, height,
+                                                                   step.channels, options, dst);
+                            } else {
+                                detail::stencilRow<SobelStencil>(edgeBuffers, y, width, height,
+                                                                 step.channels, options, dst);
+                            }
+                        }
+                    }
+                }
+            }
+
+            // Outputs computed with a halo were kept in tile buffers, copy the tile rows.
+            for (unsigned int i = 1; i < steps.size(); i++) {
+                const PlanStep& step = steps[i];
+                if (step.output < 0 || step.direct) {
+                    continue;
+                }
+                MutableImageView target = results[step.output].mutableView();
+                for (unsigned int y = begin; y < end; y++) {
+                    std::copy_n(rows[i].row(y), target.rowElements(), target.row(y));
+                }
+            }
+        };
+        // A thread may be handed several tiles at once, the tile buffers are sized for one.
+        const unsigned int tiles = (height + plan.tileRows - 1) / plan.tileRows;
+        getThreadPool().parallelFor(0, tiles, 1, [&](std::size_t first, std::size_t last) {
+            for (std::size_t tile = first; tile < last; tile++) {
+                processTile(tile * plan.tileRows,
+                            std::min<std::size_t>((tile + 1) * plan.tileRows, height));
+            }
+        });
+
+        // Outputs requested more than once share the first result.
+        for (unsigned int i = 0; i < plan.outputSteps.size(); i++) {
+            const int output = steps[plan.outputSteps[i]].output;
+            if (plan.outputSteps[i] != 0 && output != int(i)) {
+                results[i] = results[output];
+            }
+        }
+        return results;
+    }
+
+    std::string Pipeline::describePlan(unsigned int width, unsigned int height,
+                                       unsigned int channels) const {
+        static const char* const names[] = {"input",   "gaussianSmooth", "grayscale",
+                                            "roberts", "prewitt",        "sobel"};
+        const Plan plan = this->plan(width, height, channels);
+        std::ostringstream description;
+        description << "tiles of " << plan.tileRows << " rows\n";
+        for (unsigned int i = 0; i < plan.steps.size(); i++) {
+            const PlanStep& step = plan.steps[i];
+            if (!step.live) {
+                continue;
+            }
+            description << i << ": " << names[step.operation];
+            if (step.source >= 0) {
+                description << "(" << step.source << ")";
+            }
+            description << " x" << step.channels;
+            if (step.above || step.below) {
+                description << ", halo -" << step.above << "/+" << step.below;
+            }
+            if (step.fusedIntoConsumer) {
+                description << ", fused into the horizontal pass of " << step.consumers[0];
+            }
+            if (step.fusedIntoProducer) {
+                description << ", fused into the vertical pass of " << step.source;
+            }
+            if (step.groupLeader >= 0 && step.groupLeader != int(i)) {
+                description << ", computed with " << step.groupLeader;
+            }
+            if (step.direct) {
+                description << ", written to output " << step.output;
+            } else if (step.slot >= 0) {
+                description << ", slot " << step.slot;
+                if (step.output >= 0) {
+                    description << ", copied to output " << step.output;
+                }
+            }
+            description << "\n";
+        }
+        std::size_t total = 0;
+        for (std::size_t bytes : plan.slotBytes) {
+            total += bytes;
+        }
+        description << plan.slotBytes.size() << " tile slots, " << total
+                    << " bytes per thread\n";
+        return description.str();
+    }
+}  // namespace CUDAVISION
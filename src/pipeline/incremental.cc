@@ -0,0 +1,247 @@
+#include "pipeline/incremental.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "edge_detection/canny.h"
+#include "util/buffer_pool.h"
+#include "util/cpu_features.h"
+#include "util/thread_pool.h"
+#include "util/trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CUDAVISION_X86 1
+#endif
+
+namespace CUDAVISION {
+    /**
+     * Tile spans are short (tileSize * channels bytes), so the vector loops compare whole
+     * registers and test them at once instead of locating the first difference like memcmp.
+     */
+    static bool bytesDifferScalar(const unsigned char* a, const unsigned char* b,
+                                  std::size_t count) {
+        return std::memcmp(a, b, count) != 0;
+    }
+
+#ifdef CUDAVISION_X86
+    static bool bytesDifferSSE2(const unsigned char* a, const unsigned char* b,
+                                std::size_t count) {
+        std::size_t x = 0;
+        for (; x + 32 <= count; x += 32) {
+            __m128i equal0 =
+                _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x)),
+                               _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x)));
+            __m128i equal1 =
+                _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x + 16)),
+                               _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x + 16)));
+            if (_mm_movemask_epi8(_mm_and_si128(equal0, equal1)) != 0xFFFF) {
+                return true;
+            }
+        }
+        return bytesDifferScalar(a + x, b + x, count - x);
+    }
+
+    __attribute__((target("avx2"))) static bool bytesDifferAVX2(const unsigned char* a,
+                                                                const unsigned char* b,
+                                                                std::size_t count) {
+        std::size_t x = 0;
+        for (; x + 64 <= count; x += 64) {
+            __m256i difference0 =
+                _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + x)),
+                                 _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + x)));
+            __m256i difference1 = _mm256_xor_si256(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + x + 32)),
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + x + 32)));
+            __m256i difference = _mm256_or_si256(difference0, difference1);
+            if (!_mm256_testz_si256(difference, difference)) {
+                return true;
+            }
+        }
+        return bytesDifferScalar(a + x, b + x, count - x);
+    }
+#endif
+
+    static bool bytesDiffer(const unsigned char* a, const unsigned char* b, std::size_t count) {
+#ifdef CUDAVISION_X86
+        switch (getInstructionSet()) {
+            case InstructionSet::AVX512:
+            case InstructionSet::AVX2:
+                return bytesDifferAVX2(a, b, count);
+            case InstructionSet::SSE2:
+                return bytesDifferSSE2(a, b, count);
+            case InstructionSet::Scalar:
+                break;
+        }
+#endif
+        return bytesDifferScalar(a, b, count);
+    }
+
+    FrameProcessor::FrameProcessor(const FrameProcessorOptions& options) : options(options) {
+        this->options.tileSize = std::max(options.tileSize, 1u);
+        // The fused blur applies the kernel three times, Sobel reaches one pixel further.
+        const std::vector<double> kernel =
+            getEquivalentKernel(getGaussianKernel(options.kernelSize, options.sigma), 3);
+        halo = static_cast<unsigned int>(kernel.size() / 2) + 1;
+    }
+
+    void FrameProcessor::reset() {
+        previous = Image(0, 0, PixelFormat::Gray8);
+        output = Image(0, 0, PixelFormat::Gray8);
+    }
+
+    ImageView FrameProcessor::process(ImageView frame) {
+        CUDAVISION_TRACE_SCOPE("FrameProcessor::process");
+        if (frame.channels != 1 && frame.channels != 3) {
+            throw std::invalid_argument("FrameProcessor: frames must have 1 or 3 channels");
+        }
+        const unsigned int tileSize = options.tileSize;
+        const bool restart = frame.width != previous.getWidth() ||
+                             frame.height != previous.getHeight() ||
+                             frame.channels != previous.getChannels();
+        if (restart) {
+            previous = Image(frame.width, frame.height,
+                             frame.channels == 1 ? PixelFormat::Gray8 : PixelFormat::BGR8);
+            output = Image(frame.width, frame.height, PixelFormat::Gray8);
+            columns = (frame.width + tileSize - 1) / tileSize;
+            rows = (frame.height + tileSize - 1) / tileSize;
+            changed.assign(std::size_t{columns} * rows, 1);
+            MutableImageView kept = previous.mutableView();
+            for (unsigned int y = 0; y < frame.height; y++) {
+                std::copy_n(frame.row(y), frame.rowElements(), kept.row(y));
+            }
+        } else {
+            findChangedTiles(frame);
+        }
+
+        // Every output tile within the halo of a changed tile is recomputed.
+        dirty.assign(changed.size(), 0);
+        statistics = {};
+        statistics.tiles = changed.size();
+        // Tiles reached by the halo of the pixels starting at begin, or ending before end.
+        auto firstTileWithin = [&](unsigned int begin) {
+            return begin > halo ? (begin - halo) / tileSize : 0;
+        };
+        auto lastTileWithin = [&](unsigned int end) { return (end + halo - 1) / tileSize + 1; };
+        for (unsigned int ty = 0; ty < rows; ty++) {
+            for (unsigned int tx = 0; tx < columns; tx++) {
+                if (!changed[std::size_t{ty} * columns + tx]) {
+                    continue;
+                }
+                statistics.changedTiles++;
+                const unsigned int x0 = firstTileWithin(tx * tileSize);
+                const unsigned int y0 = firstTileWithin(ty * tileSize);
+                const unsigned int x1 = std::min(lastTileWithin((tx + 1) * tileSize), columns);
+                const unsigned int y1 = std::min(lastTileWithin((ty + 1) * tileSize), rows);
+                for (unsigned int y = y0; y < y1; y++) {
+                    std::fill(dirty.begin() + std::size_t{y} * columns + x0,
+                              dirty.begin() + std::size_t{y} * columns + x1, 1);
+                }
+            }
+        }
+        statistics.recomputedTiles = std::count(dirty.begin(), dirty.end(), 1);
+        recomputeTiles(frame);
+        return output.view();
+    }
+
+    void FrameProcessor::findChangedTiles(ImageView frame) {
+        CUDAVISION_TRACE_SCOPE("FrameProcessor diff");
+        const unsigned int tileSize = options.tileSize;
+        MutableImageView kept = previous.mutableView();
+        changed.assign(std::size_t{columns} * rows, 0);
+        getThreadPool().parallelFor(0, rows, 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t ty = begin; ty < end; ty++) {
+                const unsigned int y0 = ty * tileSize;
+                const unsigned int y1 = std::min(y0 + tileSize, frame.height);
+                for (unsigned int tx = 0; tx < columns; tx++) {
+                    const std::size_t x0 = std::size_t{tx} * tileSize * frame.channels;
+                    const std::size_t span =
+                        std::min<std::size_t>(tileSize * frame.channels, frame.rowElements() - x0);
+                    unsigned int y = y0;
+                    while (y < y1 && !bytesDiffer(frame.row(y) + x0, kept.row(y) + x0, span)) {
+                        y++;
+                    }
+                    if (y == y1) {
+                        continue;
+                    }
+                    // Keep the new pixels of the tile for the comparison with the next frame.
+                    changed[ty * columns + tx] = 1;
+                    for (; y < y1; y++) {
+                        std::copy_n(frame.row(y) + x0, span, kept.row(y) + x0);
+                    }
+                }
+            }
+        });
+    }
+
+    void FrameProcessor::recomputeTiles(ImageView frame) {
+        CUDAVISION_TRACE_SCOPE("FrameProcessor tiles");
+        struct Run {
+            unsigned int x0, y0, x1, y1;
+        };
+        // Consecutive dirty tiles of a tile row are recomputed together, sharing their halo.
+        const unsigned int tileSize = options.tileSize;
+        std::vector<Run> runs;
+        for (unsigned int ty = 0; ty < rows; ty++) {
+            for (unsigned int tx = 0; tx < columns; tx++) {
+                if (!dirty[std::size_t{ty} * columns + tx]) {
+                    continue;
+                }
+                unsigned int end = tx + 1;
+                while (end < columns && dirty[std::size_t{ty} * columns + end]) {
+                    end++;
+                }
+                runs.push_back({tx * tileSize, ty * tileSize, std::min(end * tileSize, frame.width),
+                                std::min((ty + 1) * tileSize, frame.height)});
+                tx = end;
+            }
+        }
+
+        // A run is computed on its rectangle grown by the halo, clamped to the frame. Blur and
+        // Sobel see wrong borders only within the halo, which is dropped, and at the frame
+        // border, where they behave like on the full frame.
+        MutableImageView result = output.mutableView();
+        auto compute = [&](const Run& run) {
+            const unsigned int x0 = run.x0 > halo ? run.x0 - halo : 0;
+            const unsigned int y0 = run.y0 > halo ? run.y0 - halo : 0;
+            const unsigned int width = std::min(run.x1 + halo, frame.width) - x0;
+            const unsigned int height = std::min(run.y1 + halo, frame.height) - y0;
+            const std::ptrdiff_t stride = width;
+            // Pooled locals, not per-thread buffers: the operators run parallel loops, and
+            // whatever else this thread runs meanwhile must not be able to resize them.
+            BufferPool& pool = BufferPool::global();
+            std::vector<unsigned char> blurred =
+                pool.acquire(std::size_t{width} * height * frame.channels);
+            std::vector<unsigned char> gray = pool.acquire(std::size_t{width} * height);
+            std::vector<unsigned char> edges = pool.acquire(std::size_t{width} * height);
+            MutableImageView blurredView{blurred.data(), width, height, stride * frame.channels,
+                                         frame.channels};
+            MutableImageView grayView{gray.data(), width, height, stride, 1};
+            MutableImageView edgeView{edges.data(), width, height, stride, 1};
+            gaussianSmoothFused(frame.subView(x0, y0, width, height), blurredView,
+                                options.kernelSize, options.sigma);
+            Image::toGrayscale(blurredView, grayView);
+            sobelOperator(grayView, edgeView);
+            for (unsigned int y = run.y0; y < run.y1; y++) {
+                std::copy_n(edgeView.row(y - y0) + (run.x0 - x0), run.x1 - run.x0,
+                            result.row(y) + run.x0);
+            }
+            pool.release(std::move(blurred));
+            pool.release(std::move(gray));
+            pool.release(std::move(edges));
+        };
+        // A single run (e.g. the first frame) parallelizes inside of the operators, several runs
+        // are spread over the pool and run their operators inline.
+        if (runs.size() == 1) {
+            compute(runs.front());
+            return;
+        }
+        getThreadPool().parallelFor(0, runs.size(), 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                compute(runs[i]);
+            }
+        });
+    }
+}  // namespace CUDAVISION
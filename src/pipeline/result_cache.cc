@@ -0,0 +1,403 @@
+#include "pipeline/result_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "util/buffer_pool.h"
+#include "util/thread_pool.h"
+#include "util/trace.h"
+
+namespace CUDAVISION {
+    static constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87;
+    static constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4F;
+    static constexpr uint64_t PRIME3 = 0x165667B19E3779F9;
+    static constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63;
+
+    /**
+     * Rows hashed together by one task of the thread pool.
+     */
+    static constexpr unsigned int HASH_BLOCK_ROWS = 32;
+
+    /**
+     * Header of a file of the disk tier, followed by height rows of width * channels bytes.
+     */
+    struct RawHeader {
+        char magic[4] = {'C', 'V', 'R', 'C'};
+        uint32_t version = 1;
+        uint64_t key = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t channels = 0;
+        uint32_t reserved = 0;
+    };
+    static_assert(sizeof(RawHeader) == 32);
+
+    static constexpr const char* RAW_EXTENSION = ".cvraw";
+
+    // The rounds of xxHash64, with four independent lanes so that the multiplications overlap.
+    static uint64_t mixRound(uint64_t lane, uint64_t input) {
+        return std::rotl(lane + input * PRIME2, 31) * PRIME1;
+    }
+
+    static uint64_t avalanche(uint64_t hash) {
+        hash ^= hash >> 33;
+        hash *= PRIME2;
+        hash ^= hash >> 29;
+        hash *= PRIME3;
+        return hash ^ hash >> 32;
+    }
+
+    uint64_t combineHash(uint64_t hash, uint64_t value) {
+        return std::rotl(hash ^ mixRound(0, value), 27) * PRIME1 + PRIME4;
+    }
+
+    static uint64_t load64(const unsigned char* bytes) {
+        uint64_t word;
+        std::memcpy(&word, bytes, sizeof(word));
+        return word;
+    }
+
+    static uint64_t hashRow(const unsigned char* bytes, std::size_t length) {
+        uint64_t lanes[4] = {PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1};
+        std::size_t i = 0;
+        for (; i + 32 <= length; i += 32) {
+            for (unsigned int lane = 0; lane < 4; lane++) {
+                lanes[lane] = mixRound(lanes[lane], load64(bytes + i + 8 * lane));
+            }
+        }
+        uint64_t hash = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) +
+                        std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+        for (; i + 8 <= length; i += 8) {
+            hash = combineHash(hash, load64(bytes + i));
+        }
+        uint64_t tail = 0;
+        for (unsigned int shift = 0; i < length; i++, shift += 8) {
+            tail |= uint64_t{bytes[i]} << shift;
+        }
+        return combineHash(hash, tail);
+    }
+
+    uint64_t hashPixels(ImageView view) {
+        CUDAVISION_TRACE_SCOPE("hashPixels");
+        const std::size_t blocks = (view.height + HASH_BLOCK_ROWS - 1) / HASH_BLOCK_ROWS;
+        std::vector<uint64_t> blockHashes(blocks);
+        getThreadPool().parallelFor(0, blocks, 1, [&](std::size_t first, std::size_t last) {
+            for (std::size_t block = first; block < last; block++) {
+                const unsigned int begin = block * HASH_BLOCK_ROWS;
+                const unsigned int end = std::min(begin + HASH_BLOCK_ROWS, view.height);
+                uint64_t hash = PRIME3;
+                for (unsigned int y = begin; y < end; y++) {
+                    hash = combineHash(hash, hashRow(view.row(y), view.rowElements()));
+                }
+                blockHashes[block] = hash;
+            }
+        });
+        uint64_t hash = combineHash(combineHash(combineHash(PRIME4, view.width), view.height),
+                                    view.channels);
+        for (uint64_t blockHash : blockHashes) {
+            hash = combineHash(hash, blockHash);
+        }
+        return avalanche(hash);
+    }
+
+    /**
+     * Reads a file of the disk tier. Returns nothing if it is missing, truncated or holds
+     * another key.
+     */
+    static std::optional<Image> readRaw(const std::filesystem::path& path, uint64_t key) {
+        CUDAVISION_TRACE_SCOPE("ResultCache read");
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return std::nullopt;
+        }
+        struct stat status;
+        if (::fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(RawHeader))) {
+            ::close(fd);
+            return std::nullopt;
+        }
+        const auto size = static_cast<std::size_t>(status.st_size);
+        void* address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (address == MAP_FAILED) {
+            return std::nullopt;
+        }
+        const auto* mapping = static_cast<const unsigned char*>(address);
+        RawHeader header;
+        std::memcpy(&header, mapping, sizeof(header));
+        const std::size_t pixels =
+            std::size_t{header.width} * header.height * header.channels;
+        std::optional<Image> image;
+        if (std::memcmp(header.magic, RawHeader{}.magic, sizeof(header.magic)) == 0 &&
+            header.version == RawHeader{}.version && header.key == key &&
+            (header.channels == 1 || header.channels == 3) &&
+            size == sizeof(RawHeader) + pixels) {
+            std::vector<unsigned char> buffer = BufferPool::global().acquire(pixels);
+            std::copy_n(mapping + sizeof(RawHeader), pixels, buffer.data());
+            image.emplace(header.width, header.height,
+                          header.channels == 1 ? PixelFormat::Gray8 : PixelFormat::BGR8,
+                          std::move(buffer));
+        }
+        ::munmap(address, size);
+        return image;
+    }
+
+    /**
+     * Writes a file of the disk tier under a temporary name and renames it, so that readers in
+     * other processes never see a partial file.
+     */
+    static void writeRaw(const std::filesystem::path& path, uint64_t key, const Image& image) {
+        CUDAVISION_TRACE_SCOPE("ResultCache write");
+        static std::atomic<unsigned int> counter{0};
+        std::filesystem::path temporary = path;
+        temporary += ".tmp" + std::to_string(::getpid()) + "." + std::to_string(counter++);
+
+        RawHeader header;
+        header.key = key;
+        header.width = image.getWidth();
+        header.height = image.getHeight();
+        header.channels = image.getChannels();
+        const ImageView view = image.view();
+        const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), temporary.string());
+        }
+        auto writeFully = [&](const unsigned char* data, std::size_t length) {
+            while (length > 0) {
+                const ssize_t written = ::write(fd, data, length);
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (written <= 0) {
+                    return false;
+                }
+                data += written;
+                length -= written;
+            }
+            return true;
+        };
+        bool complete = writeFully(reinterpret_cast<const unsigned char*>(&header), sizeof(header));
+        for (unsigned int y = 0; complete && y < view.height; y++) {
+            complete = writeFully(view.row(y), view.rowElements());
+        }
+        int error = complete ? 0 : errno;
+        if (::close(fd) != 0 && error == 0) {
+            error = errno;
+        }
+        if (error != 0) {
+            std::filesystem::remove(temporary);
+            throw std::system_error(error, std::generic_category(), temporary.string());
+        }
+        std::filesystem::rename(temporary, path);
+    }
+
+    /**
+     * The key of a file of the disk tier, parsed from its name.
+     */
+    static std::optional<uint64_t> keyOf(const std::filesystem::path& path) {
+        const std::string stem = path.stem().string();
+        if (path.extension() != RAW_EXTENSION || stem.size() != 16 ||
+            stem.find_first_not_of("0123456789abcdef") != std::string::npos) {
+            return std::nullopt;
+        }
+        return std::stoull(stem, nullptr, 16);
+    }
+
+    ResultCache::ResultCache(const ResultCacheOptions& options) : options(options) {
+        if (options.directory.empty()) {
+            return;
+        }
+        std::filesystem::create_directories(options.directory);
+        // Files used least recently come first, by their modification time.
+        std::vector<std::pair<std::filesystem::file_time_type, uint64_t>> files;
+        for (const auto& file : std::filesystem::directory_iterator(options.directory)) {
+            const std::optional<uint64_t> key = keyOf(file.path());
+            if (!key || !file.is_regular_file()) {
+                continue;
+            }
+            disk[*key].bytes = file.file_size();
+            statistics.diskBytes += file.file_size();
+            files.emplace_back(file.last_write_time(), *key);
+        }
+        std::sort(files.begin(), files.end());
+        for (const auto& file : files) {
+            DiskEntry& entry = disk[file.second];
+            entry.lastUse = ++useCounter;
+            diskOrder[entry.lastUse] = file.second;
+        }
+        evictFromDisk();
+    }
+
+    std::filesystem::path ResultCache::pathOf(uint64_t key) const {
+        char name[17];
+        std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+        return options.directory / (std::string(name) + RAW_EXTENSION);
+    }
+
+    uint64_t ResultCache::hashInput(ImageView view) {
+        const auto start = std::chrono::steady_clock::now();
+        const uint64_t hash = hashPixels(view);
+        const double seconds =
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::lock_guard<std::mutex> lock(mutex);
+        statistics.hashSeconds += seconds;
+        return hash;
+    }
+
+    void ResultCache::insertIntoMemory(uint64_t key, const Image& image) {
+        const std::size_t bytes = image.view().rowElements() * std::size_t{image.getHeight()};
+        auto existing = memoryIndex.find(key);
+        if (existing != memoryIndex.end()) {
+            memory.splice(memory.begin(), memory, existing->second);
+            return;
+        }
+        if (bytes > options.memoryBytes) {
+            return;
+        }
+        memory.push_front({key, image});
+        memoryIndex[key] = memory.begin();
+        statistics.memoryBytes += bytes;
+        while (statistics.memoryBytes > options.memoryBytes) {
+            const MemoryEntry& oldest = memory.back();
+            statistics.memoryBytes -=
+                oldest.image.view().rowElements() * std::size_t{oldest.image.getHeight()};
+            memoryIndex.erase(oldest.key);
+            memory.pop_back();
+            statistics.evictions++;
+        }
+    }
+
+    void ResultCache::touchOnDisk(uint64_t key, DiskEntry& entry) {
+        diskOrder.erase(entry.lastUse);
+        entry.lastUse = ++useCounter;
+        diskOrder[entry.lastUse] = key;
+        // Other processes order the files by their modification time.
+        std::error_code ignored;
+        std::filesystem::last_write_time(pathOf(key), std::filesystem::file_time_type::clock::now(),
+                                         ignored);
+    }
+
+    void ResultCache::evictFromDisk() {
+        while (statistics.diskBytes > options.diskBytes && !diskOrder.empty()) {
+            const uint64_t key = diskOrder.begin()->second;
+            diskOrder.erase(diskOrder.begin());
+            statistics.diskBytes -= disk[key].bytes;
+            disk.erase(key);
+            std::error_code ignored;
+            std::filesystem::remove(pathOf(key), ignored);
+            statistics.evictions++;
+        }
+    }
+
+    std::optional<Image> ResultCache::find(uint64_t key) {
+        CUDAVISION_TRACE_SCOPE("ResultCache::find");
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto entry = memoryIndex.find(key);
+            if (entry != memoryIndex.end()) {
+                memory.splice(memory.begin(), memory, entry->second);
+                statistics.memoryHits++;
+                return entry->second->image;
+            }
+            if (options.directory.empty()) {
+                statistics.misses++;
+                return std::nullopt;
+            }
+        }
+        // Files of other processes are not in the index yet, so the file is tried either way.
+        // Reading happens outside of the lock.
+        std::optional<Image> image = readRaw(pathOf(key), key);
+        std::lock_guard<std::mutex> lock(mutex);
+        auto entry = disk.find(key);
+        if (!image) {
+            if (entry != disk.end()) {
+                // Removed by another process.
+                statistics.diskBytes -= entry->second.bytes;
+                diskOrder.erase(entry->second.lastUse);
+                disk.erase(entry);
+            }
+            statistics.misses++;
+            return std::nullopt;
+        }
+        if (entry == disk.end()) {
+            entry = disk.emplace(key, DiskEntry{}).first;
+            entry->second.bytes = sizeof(RawHeader) + image->view().rowElements() *
+                                                          std::size_t{image->getHeight()};
+            statistics.diskBytes += entry->second.bytes;
+        }
+        touchOnDisk(key, entry->second);
+        evictFromDisk();
+        insertIntoMemory(key, *image);
+        statistics.diskHits++;
+        return image;
+    }
+
+    bool ResultCache::contains(uint64_t key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (memoryIndex.count(key) || disk.count(key)) {
+            return true;
+        }
+        return !options.directory.empty() && std::filesystem::exists(pathOf(key));
+    }
+
+    void ResultCache::store(uint64_t key, const Image& image, bool persist) {
+        CUDAVISION_TRACE_SCOPE("ResultCache::store");
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            insertIntoMemory(key, image);
+            statistics.stores++;
+            if (!persist || options.directory.empty() || disk.count(key)) {
+                return;
+            }
+        }
+        try {
+            writeRaw(pathOf(key), key, image);
+        } catch (const std::exception& error) {
+            std::cerr << "Result could not be cached: " << error.what() << std::endl;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (disk.count(key)) {
+            return;
+        }
+        DiskEntry& entry = disk[key];
+        entry.bytes =
+            sizeof(RawHeader) + image.view().rowElements() * std::size_t{image.getHeight()};
+        statistics.diskBytes += entry.bytes;
+        entry.lastUse = ++useCounter;
+        diskOrder[entry.lastUse] = key;
+        evictFromDisk();
+    }
+
+    void ResultCache::clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        memory.clear();
+        memoryIndex.clear();
+        statistics.memoryBytes = 0;
+        for (const auto& entry : disk) {
+            std::error_code ignored;
+            std::filesystem::remove(pathOf(entry.first), ignored);
+        }
+        disk.clear();
+        diskOrder.clear();
+        statistics.diskBytes = 0;
+    }
+
+    ResultCacheStatistics ResultCache::getStatistics() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return statistics;
+    }
+}  // namespace CUDAVISION
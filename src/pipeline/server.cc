@@ -0,0 +1,393 @@
+#include "pipeline/server.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "edge_detection/canny.h"
+#include "filter/median.h"
+#include "util/bitmap_io.h"
+#include "util/bounded_queue.h"
+#include "util/buffer_pool.h"
+#include "util/histogram.h"
+#include "util/trace.h"
+
+namespace CUDAVISION {
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * How often blocking socket calls wake up to check the stop flag, in milliseconds.
+     */
+    static constexpr int POLL_MILLISECONDS = 200;
+
+    /**
+     * Owns a socket descriptor, closed on destruction.
+     */
+    class Socket {
+       public:
+        explicit Socket(int descriptor = -1) : descriptor(descriptor) {}
+        Socket(Socket&& other) noexcept : descriptor(other.descriptor) { other.descriptor = -1; }
+        Socket& operator=(Socket&& other) noexcept {
+            std::swap(descriptor, other.descriptor);
+            return *this;
+        }
+        Socket(const Socket&) = delete;
+        Socket& operator=(const Socket&) = delete;
+        ~Socket() {
+            if (descriptor >= 0) {
+                close(descriptor);
+            }
+        }
+
+        int get() const { return descriptor; }
+
+       private:
+        int descriptor;
+    };
+
+    static sockaddr_un socketAddress(const std::string& path) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("invalid socket path '" + path + "'");
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        return address;
+    }
+
+    static std::runtime_error socketError(const std::string& what, const std::string& path) {
+        return std::runtime_error(path + ": " + what + ": " + std::strerror(errno));
+    }
+
+    /**
+     * Removes the socket file at path, left by this or an earlier server. Any other file there
+     * is kept, the bind then fails instead of deleting it.
+     */
+    static void removeSocketFile(const std::string& path) {
+        struct stat status {};
+        if (lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) {
+            unlink(path.c_str());
+        }
+    }
+
+    /**
+     * Writes all bytes, without raising SIGPIPE if the peer is gone. Returns false on failure.
+     */
+    static bool sendAll(int descriptor, const std::string& data) {
+        std::size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t written =
+                send(descriptor, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+            sent += written;
+        }
+        return true;
+    }
+
+    /**
+     * Reads lines from a socket, keeping the bytes after the last complete line.
+     */
+    class LineReader {
+       public:
+        explicit LineReader(int descriptor) : descriptor(descriptor) {}
+
+        /**
+         * Reads the next line without its newline. Returns false at the end of the stream, on
+         * an error, once more than MAX_REQUEST_BYTES arrived without a newline, after
+         * timeoutMilliseconds without data (negative waits forever) or once stop is set.
+         */
+        bool next(std::string& line, int timeoutMilliseconds, const std::atomic<bool>* stop) {
+            const Clock::time_point deadline =
+                Clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+            while (true) {
+                std::size_t newline = buffer.find('\n');
+                if (newline != std::string::npos) {
+                    line.assign(buffer, 0, newline);
+                    if (!line.empty() && line.back() == '\r') {
+                        line.pop_back();
+                    }
+                    buffer.erase(0, newline + 1);
+                    return true;
+                }
+                if ((stop && stop->load()) || buffer.size() > MAX_REQUEST_BYTES ||
+                    (timeoutMilliseconds >= 0 && Clock::now() >= deadline)) {
+                    return false;
+                }
+                pollfd readable{descriptor, POLLIN, 0};
+                int ready = poll(&readable, 1, POLL_MILLISECONDS);
+                if (ready < 0 && errno != EINTR) {
+                    return false;
+                }
+                if (ready <= 0) {
+                    continue;
+                }
+                char chunk[4096];
+                ssize_t received = recv(descriptor, chunk, sizeof(chunk), 0);
+                if (received < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (received <= 0) {
+                    return false;
+                }
+                buffer.append(chunk, received);
+            }
+        }
+
+       private:
+        int descriptor;
+        std::string buffer;
+    };
+
+    /**
+     * Splits "name:a:b" into name and parameters.
+     */
+    static std::vector<std::string> splitOperator(const std::string& op) {
+        std::vector<std::string> parts;
+        std::size_t begin = 0;
+        while (true) {
+            std::size_t colon = op.find(':', begin);
+            parts.push_back(op.substr(begin, colon - begin));
+            if (colon == std::string::npos) {
+                return parts;
+            }
+            begin = colon + 1;
+        }
+    }
+
+    static double parseNumber(const std::string& text, const std::string& op) {
+        std::size_t parsed = 0;
+        double value = 0.0;
+        try {
+            value = std::stod(text, &parsed);
+        } catch (const std::exception&) {
+            parsed = 0;
+        }
+        if (parsed == 0 || parsed != text.size() || !std::isfinite(value)) {
+            throw std::invalid_argument("invalid parameter '" + text + "' of " + op);
+        }
+        return value;
+    }
+
+    /**
+     * Parses an integer parameter, checked as a double before the conversion.
+     */
+    static int parseInteger(const std::string& text, const std::string& op) {
+        const double value = parseNumber(text, op);
+        if (value < std::numeric_limits<int>::min() || value > std::numeric_limits<int>::max()) {
+            throw std::invalid_argument("parameter '" + text + "' of " + op + " out of range");
+        }
+        return static_cast<int>(value);
+    }
+
+    Image applyOperatorChain(const Image& image, const std::vector<std::string>& operators) {
+        Image result = image;
+        for (const std::string& op : operators) {
+            const std::vector<std::string> parts = splitOperator(op);
+            const std::string& name = parts[0];
+            const std::size_t parameters = parts.size() - 1;
+            auto parameter = [&](std::size_t i, double fallback) {
+                return i <= parameters ? parseNumber(parts[i], op) : fallback;
+            };
+            auto integer = [&](std::size_t i, int fallback) {
+                return i <= parameters ? parseInteger(parts[i], op) : fallback;
+            };
+            if (name == "blur" && parameters <= 2) {
+                const int kernelSize = integer(1, 5);
+                const double sigma = parameter(2, 20.0);
+                if (kernelSize < 1 || kernelSize % 2 == 0 || kernelSize > MAX_KERNEL_SIZE ||
+                    sigma <= 0.0) {
+                    throw std::invalid_argument(op + ": kernel size must be odd and at most " +
+                                                std::to_string(MAX_KERNEL_SIZE) +
+                                                ", sigma positive");
+                }
+                result = gaussianSmooth(result, kernelSize, sigma, SmoothingMode::Fused);
+            } else if (name == "median" && parameters <= 1) {
+                // medianFilter rejects radii out of range with std::invalid_argument.
+                result = medianFilter(result, integer(1, 1));
+            } else if (name == "gray" && parameters == 0) {
+                result = result.toGrayscale();
+            } else if ((name == "roberts" || name == "prewitt" || name == "sobel") &&
+                       parameters == 0) {
+                // The edge operators expect one channel.
+                if (result.getFormat() != PixelFormat::Gray8) {
+                    result = result.toGrayscale();
+                }
+                result = name == "roberts"   ? robertsOperator(result)
+                         : name == "prewitt" ? prewittOperator(result)
+                                             : sobelOperator(result);
+            } else if (name == "canny" && parameters == 1 && parts[1] == "otsu") {
+                result = canny(result, AutoThreshold{});
+            } else if (name == "canny" && parameters == 1 && parts[1].size() > 1 &&
+                       parts[1][0] == 'p') {
+                AutoThreshold selection;
+                selection.method = ThresholdMethod::Percentile;
+                selection.percentile = parseNumber(parts[1].substr(1), op);
+                result = canny(result, selection);
+            } else if (name == "canny" && (parameters == 0 || parameters == 2)) {
+                result = canny(result, integer(1, 50), integer(2, 100));
+            } else {
+                throw std::invalid_argument("unknown operator '" + op + "'");
+            }
+        }
+        return result;
+    }
+
+    /**
+     * Runs one request line and returns the answer line.
+     */
+    static std::string serveRequest(const std::string& request, double& milliseconds) {
+        const Clock::time_point start = Clock::now();
+        std::istringstream fields(request);
+        std::string input, output, op;
+        std::vector<std::string> operators;
+        fields >> input >> output;
+        while (fields >> op) {
+            operators.push_back(op);
+        }
+        if (output.empty()) {
+            return "error expected <input.bmp> <output.bmp> <operator> ...";
+        }
+        try {
+            CUDAVISION_TRACE_SCOPE("server request");
+            Image result = applyOperatorChain(readBitmap(input), operators);
+            writeBitmap(output, result.view());
+            milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            std::ostringstream answer;
+            answer << "ok " << result.getWidth() << "x" << result.getHeight() << " "
+                   << milliseconds;
+            return answer.str();
+        } catch (const std::exception& error) {
+            std::string message = error.what();
+            std::replace(message.begin(), message.end(), '\n', ' ');
+            return "error " + message;
+        }
+    }
+
+    ServerStatistics runServer(const ServerOptions& options, const std::atomic<bool>& stop,
+                               bool log) {
+        const sockaddr_un address = socketAddress(options.socketPath);
+        Socket listener(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        if (listener.get() < 0) {
+            throw socketError("socket", options.socketPath);
+        }
+        removeSocketFile(options.socketPath);
+        if (bind(listener.get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) <
+            0) {
+            throw socketError("bind", options.socketPath);
+        }
+        if (listen(listener.get(), SOMAXCONN) < 0) {
+            removeSocketFile(options.socketPath);
+            throw socketError("listen", options.socketPath);
+        }
+
+        if (options.bufferPoolBytes > 0) {
+            BufferPool::global().setCapacity(options.bufferPoolBytes);
+            BufferPool::global().setEnabled(true);
+        }
+
+        BoundedQueue<Socket> connections(options.queueDepth);
+        ServerStatistics statistics;
+        std::vector<double> latencies;
+        std::mutex statisticsMutex;
+
+        // Every worker serves one connection at a time, request after request, until the client
+        // closes it, stays idle too long or the server stops.
+        const int idleMilliseconds = static_cast<int>(options.idleTimeoutSeconds) * 1000;
+        std::vector<std::thread> workers;
+        for (unsigned int i = 0; i < std::max(options.workers, 1u); i++) {
+            workers.emplace_back([&] {
+                while (std::optional<Socket> connection = connections.pop()) {
+                    LineReader reader(connection->get());
+                    std::string request;
+                    while (reader.next(request, idleMilliseconds, &stop)) {
+                        double milliseconds = 0.0;
+                        const std::string answer = serveRequest(request, milliseconds);
+                        const bool ok = answer.compare(0, 3, "ok ") == 0;
+                        {
+                            std::lock_guard<std::mutex> lock(statisticsMutex);
+                            if (ok) {
+                                statistics.succeeded++;
+                                latencies.push_back(milliseconds);
+                            } else {
+                                statistics.failed++;
+                            }
+                            if (log) {
+                                std::cout << request << " -> " << answer << std::endl;
+                            }
+                        }
+                        if (!sendAll(connection->get(), answer + "\n")) {
+                            break;
+                        }
+                    }
+                }
+            });
+        }
+
+        while (!stop.load()) {
+            pollfd readable{listener.get(), POLLIN, 0};
+            if (poll(&readable, 1, POLL_MILLISECONDS) <= 0) {
+                continue;
+            }
+            Socket connection(accept4(listener.get(), nullptr, nullptr, SOCK_CLOEXEC));
+            if (connection.get() < 0) {
+                continue;
+            }
+            if (!connections.tryPush(connection)) {
+                sendAll(connection.get(), "error server busy\n");
+                std::lock_guard<std::mutex> lock(statisticsMutex);
+                statistics.rejected++;
+            }
+        }
+
+        connections.close();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        removeSocketFile(options.socketPath);
+        statistics.p50Milliseconds = samplePercentile(latencies, 0.50);
+        statistics.p99Milliseconds = samplePercentile(latencies, 0.99);
+        return statistics;
+    }
+
+    std::string sendServerRequest(const std::string& socketPath, const std::string& request) {
+        const sockaddr_un address = socketAddress(socketPath);
+        Socket connection(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        if (connection.get() < 0) {
+            throw socketError("socket", socketPath);
+        }
+        if (connect(connection.get(), reinterpret_cast<const sockaddr*>(&address),
+                    sizeof(address)) < 0) {
+            throw socketError("connect", socketPath);
+        }
+        // A busy server answers and closes before reading, so read even if sending failed.
+        const bool sent = sendAll(connection.get(), request + "\n");
+        const int sendError = errno;
+        LineReader reader(connection.get());
+        std::string answer;
+        if (!reader.next(answer, -1, nullptr)) {
+            errno = sendError;
+            throw sent ? std::runtime_error(socketPath + ": connection closed without an answer")
+                       : socketError("send", socketPath);
+        }
+        return answer;
+    }
+}  // namespace CUDAVISION
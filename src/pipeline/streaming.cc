@@ -0,0 +1,163 @@
+#include "pipeline/streaming.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "edge_detection/canny.h"
+#include "filter/separable_convolution.h"
+#include "util/bitmap_io.h"
+#include "util/buffer_pool.h"
+#include "util/thread_pool.h"
+#include "util/trace.h"
+
+namespace CUDAVISION {
+    /**
+     * Rows [first, end()) of an image, kept in a buffer of fixed capacity. Rows that are no
+     * longer needed are dropped from the front, the remaining ones move to the start.
+     */
+    class RowWindow {
+       public:
+        RowWindow(unsigned int width, unsigned int channels, unsigned int capacity)
+            : width(width),
+              channels(channels),
+              capacity(capacity),
+              data(BufferPool::global().acquire(std::size_t{width} * channels * capacity)) {}
+
+        ~RowWindow() { BufferPool::global().release(std::move(data)); }
+
+        unsigned int end() const { return first + count; }
+
+        std::size_t bytes() const { return data.size(); }
+
+        unsigned char* row(unsigned int y) {
+            return data.data() + std::size_t{y - first} * width * channels;
+        }
+
+        /**
+         * Drops the rows before y.
+         */
+        void dropBefore(unsigned int y) {
+            if (y <= first) {
+                return;
+            }
+            const unsigned int dropped = std::min(y - first, count);
+            const std::size_t rowBytes = std::size_t{width} * channels;
+            std::memmove(data.data(), data.data() + dropped * rowBytes,
+                         (count - dropped) * rowBytes);
+            first = y;
+            count -= dropped;
+        }
+
+        /**
+         * Appends rows rows and returns a view on them.
+         */
+        MutableImageView append(unsigned int rows) {
+            MutableImageView appended{row(end()), width, rows,
+                                      static_cast<std::ptrdiff_t>(width * channels), channels};
+            count += rows;
+            return appended;
+        }
+
+        /**
+         * View on the rows [begin, end).
+         */
+        ImageView view(unsigned int begin, unsigned int end) {
+            return {row(begin), width, end - begin, static_cast<std::ptrdiff_t>(width * channels),
+                    channels};
+        }
+
+        const unsigned int width;
+        const unsigned int channels;
+        const unsigned int capacity;
+
+       private:
+        std::vector<unsigned char> data;
+        unsigned int first = 0;
+        unsigned int count = 0;
+    };
+
+    StreamingStatistics streamEdgeDetection(const std::filesystem::path& input,
+                                            const std::filesystem::path& output,
+                                            const StreamingOptions& options) {
+        CUDAVISION_TRACE_SCOPE("streamEdgeDetection");
+        BitmapReader reader(input);
+        const unsigned int width = reader.getWidth();
+        const unsigned int height = reader.getHeight();
+        const unsigned int channels = channelCount(reader.getPixelFormat());
+        const unsigned int stripRows = std::clamp(options.stripRows, 1u, height);
+        BitmapWriter writer(output, width, height, 1);
+
+        // gaussianSmooth applies the kernel three times per axis, the equivalent kernel does it
+        // in one pass, as SmoothingMode::Fused.
+        const FixedPointKernel kernel = FixedPointKernel::fromKernel(
+            getEquivalentKernel(getGaussianKernel(options.kernelSize, options.sigma), 3));
+        const unsigned int radius = kernel.radius();
+        const unsigned int taps = 2 * radius + 1;
+
+        // Line buffers: input rows just read, horizontally blurred rows with a halo of radius
+        // rows, grayscale rows with a halo of one row, and the Sobel result of one strip.
+        RowWindow read(width, channels, stripRows);
+        RowWindow blurred(width, channels, stripRows + 2 + 2 * radius);
+        RowWindow gray(width, 1, stripRows + 2);
+        RowWindow edges(width, 1, stripRows + 2);
+
+        for (unsigned int y0 = 0; y0 < height; y0 += stripRows) {
+            const unsigned int y1 = std::min(y0 + stripRows, height);
+            // Sobel needs the grayscale rows one above and below the strip.
+            const unsigned int grayBegin = y0 > 0 ? y0 - 1 : 0;
+            const unsigned int grayEnd = std::min(y1 + 1, height);
+            gray.dropBefore(grayBegin);
+            const unsigned int newGray = gray.end();
+
+            // The vertical blur of the new rows needs the horizontally blurred rows within
+            // radius, clamped to the image.
+            const unsigned int blurredEnd = std::min(grayEnd + radius, height);
+            blurred.dropBefore(newGray > radius ? newGray - radius : 0);
+            while (blurred.end() < blurredEnd) {
+                read.dropBefore(read.end());
+                MutableImageView strip = read.append(std::min(blurredEnd - blurred.end(),
+                                                              read.capacity));
+                strip.height = reader.readRows(strip);
+                MutableImageView target = blurred.append(strip.height);
+                parallelForRows(strip.height, [&](unsigned int begin, unsigned int end) {
+                    for (unsigned int i = begin; i < end; i++) {
+                        convolveRowHorizontal(strip.row(i), target.row(i), width, channels,
+                                              kernel);
+                    }
+                });
+            }
+
+            MutableImageView grayRows = gray.append(grayEnd - newGray);
+            parallelForRows(grayRows.height, [&](unsigned int begin, unsigned int end) {
+                thread_local std::vector<const unsigned char*> sources;
+                thread_local std::vector<unsigned char> row;
+                sources.resize(taps);
+                row.resize(std::size_t{width} * channels);
+                for (unsigned int i = begin; i < end; i++) {
+                    const int y = newGray + i;
+                    for (unsigned int k = 0; k < taps; k++) {
+                        int source = std::clamp<int>(y - radius + k, 0, height - 1);
+                        sources[k] = blurred.row(source);
+                    }
+                    convolveTaps(sources.data(), kernel, row.data(), row.size());
+                    Image::toGrayscale({row.data(), width, 1, 0, channels},
+                                       grayRows.subView(0, i, width, 1));
+                }
+            });
+
+            // The Sobel rows at the view border are zero, which is right exactly where the
+            // window border is the image border. Only the strip rows are written.
+            edges.dropBefore(edges.end());
+            MutableImageView edgeRows = edges.append(grayEnd - grayBegin);
+            sobelOperator(gray.view(grayBegin, grayEnd), edgeRows);
+            writer.writeRows(edgeRows.subView(0, y0 - grayBegin, width, y1 - y0));
+        }
+
+        StreamingStatistics statistics;
+        statistics.width = width;
+        statistics.height = height;
+        statistics.bufferBytes = read.bytes() + blurred.bytes() + gray.bytes() + edges.bytes();
+        return statistics;
+    }
+}  // namespace CUDAVISION
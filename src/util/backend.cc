@@ -0,0 +1,149 @@
+#include "util/backend.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#include "util/cpu_features.h"
+#include "util/thread_pool.h"
+
+namespace CUDAVISION {
+    struct BackendRegistry {
+        std::mutex mutex;
+        std::vector<Backend> backends;
+        std::string active = "parallel";
+        // Operator sets of backends activated before, kept for the operators still using them.
+        std::vector<std::unique_ptr<BackendOperators>> operators;
+    };
+
+    static const BackendOperators builtinOperators;
+    static std::atomic<const BackendOperators*> activeOperators{&builtinOperators};
+
+    static bool hasOperators(const BackendOperators& operators) {
+        return operators.gaussianSmoothFused || operators.toGrayscale ||
+               operators.robertsOperator || operators.prewittOperator ||
+               operators.sobelOperator || operators.canny;
+    }
+
+    /**
+     * A backend running the kernels of one instruction set on one thread.
+     */
+    static Backend instructionSetBackend(InstructionSet instructionSet, const char* description) {
+        return {toString(instructionSet), description,
+                [instructionSet] { return instructionSet <= detectInstructionSet(); },
+                [instructionSet] {
+                    setInstructionSet(instructionSet);
+                    setThreadCount(1);
+                },
+                {}};
+    }
+
+    static BackendRegistry& backendRegistry() {
+        static BackendRegistry registry{
+            {},
+            {
+                instructionSetBackend(InstructionSet::Scalar,
+                                      "scalar kernels on one thread, the reference"),
+                instructionSetBackend(InstructionSet::SSE2, "SSE2 kernels on one thread"),
+                instructionSetBackend(InstructionSet::AVX2, "AVX2 kernels on one thread"),
+                instructionSetBackend(InstructionSet::AVX512, "AVX-512 kernels on one thread"),
+                {"parallel", "widest supported kernels on all hardware threads",
+                 [] { return true; },
+                 [] {
+                     setInstructionSet(detectInstructionSet());
+                     setThreadCount(0);
+                 },
+                 {}},
+            },
+            "parallel",
+            {},
+        };
+        return registry;
+    }
+
+    void registerBackend(const Backend& backend) {
+        BackendRegistry& registry = backendRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        auto existing =
+            std::find_if(registry.backends.begin(), registry.backends.end(),
+                         [&](const Backend& other) { return other.name == backend.name; });
+        if (existing != registry.backends.end()) {
+            *existing = backend;
+        } else {
+            registry.backends.push_back(backend);
+        }
+    }
+
+    std::vector<Backend> getBackends() {
+        BackendRegistry& registry = backendRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        return registry.backends;
+    }
+
+    std::vector<std::string> getAvailableBackendNames() {
+        std::vector<std::string> names;
+        for (const Backend& backend : getBackends()) {
+            if (backend.isAvailable()) {
+                names.push_back(backend.name);
+            }
+        }
+        return names;
+    }
+
+    void setBackend(const std::string& name) {
+        applyBackendFromEnvironment();
+        const std::vector<Backend> backends = getBackends();
+        auto backend =
+            std::find_if(backends.begin(), backends.end(),
+                         [&](const Backend& candidate) { return candidate.name == name; });
+        if (backend == backends.end()) {
+            throw std::invalid_argument("unknown backend " + name);
+        }
+        if (!backend->isAvailable()) {
+            throw std::invalid_argument("backend " + name + " is not available on this host");
+        }
+        backend->activate();
+        BackendRegistry& registry = backendRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.active = name;
+        if (!hasOperators(backend->operators)) {
+            activeOperators.store(&builtinOperators, std::memory_order_release);
+            return;
+        }
+        registry.operators.push_back(std::make_unique<BackendOperators>(backend->operators));
+        activeOperators.store(registry.operators.back().get(), std::memory_order_release);
+    }
+
+    std::string getBackendName() {
+        applyBackendFromEnvironment();
+        BackendRegistry& registry = backendRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        return registry.active;
+    }
+
+    void applyBackendFromEnvironment() {
+        // Set before activating, the backend's own setters call back into this function.
+        static std::atomic<bool> applied{false};
+        if (applied.load(std::memory_order_relaxed) || applied.exchange(true)) {
+            return;
+        }
+        const char* requested = std::getenv("CUDAVISION_BACKEND");
+        if (requested == nullptr || *requested == '\0') {
+            return;
+        }
+        try {
+            setBackend(requested);
+        } catch (const std::invalid_argument& error) {
+            std::cerr << "CUDAVISION_BACKEND: " << error.what() << std::endl;
+        }
+    }
+
+    const BackendOperators& getBackendOperators() {
+        applyBackendFromEnvironment();
+        return *activeOperators.load(std::memory_order_acquire);
+    }
+}  // namespace CUDAVISION
@@ -0,0 +1,258 @@
+#include "util/bit_image.h"
+
+#include <algorithm>
+#include <bit>
+#include <iostream>
+#include <stdexcept>
+
+#include "util/bitmap_io.h"
+#include "util/cpu_features.h"
+#include "util/thread_pool.h"
+#include "util/trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CUDAVISION_X86 1
+#endif
+
+BitImage::BitImage(unsigned int width, unsigned int height)
+    : width(width),
+      height(height),
+      wordsPerRow((width + 63) / 64),
+      words(static_cast<std::size_t>(wordsPerRow) * height, 0) {}
+
+/**
+ * Packs the pixels [begin, width) bit by bit into words, word index begin / 64 onwards.
+ * begin is a multiple of 64.
+ */
+static void packRowScalar(const unsigned char* pixels, unsigned int begin, unsigned int width,
+                          unsigned char threshold, uint64_t* words) {
+    for (unsigned int x = begin; x < width; x += 64) {
+        const unsigned int count = std::min(64u, width - x);
+        uint64_t word = 0;
+        for (unsigned int i = 0; i < count; i++) {
+            word |= uint64_t{pixels[x + i] > threshold} << i;
+        }
+        words[x / 64] = word;
+    }
+}
+
+#ifdef CUDAVISION_X86
+/**
+ * The vector loops compare unsigned bytes as signed ones with the sign bit flipped, and collect
+ * the comparison results with movemask, 16 or 32 pixels at once.
+ */
+static void packRowSSE2(const unsigned char* pixels, unsigned int width, unsigned char threshold,
+                        uint64_t* words) {
+    const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+    const __m128i limit = _mm_set1_epi8(static_cast<char>(threshold ^ 0x80));
+    unsigned int x = 0;
+    for (; x + 64 <= width; x += 64) {
+        uint64_t word = 0;
+        for (unsigned int i = 0; i < 4; i++) {
+            const __m128i values = _mm_xor_si128(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + x + 16 * i)), bias);
+            word |= static_cast<uint64_t>(static_cast<uint16_t>(
+                        _mm_movemask_epi8(_mm_cmpgt_epi8(values, limit))))
+                    << (16 * i);
+        }
+        words[x / 64] = word;
+    }
+    packRowScalar(pixels, x, width, threshold, words);
+}
+
+__attribute__((target("avx2"))) static void packRowAVX2(const unsigned char* pixels,
+                                                        unsigned int width,
+                                                        unsigned char threshold, uint64_t* words) {
+    const __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80));
+    const __m256i limit = _mm256_set1_epi8(static_cast<char>(threshold ^ 0x80));
+    unsigned int x = 0;
+    for (; x + 64 <= width; x += 64) {
+        const __m256i low = _mm256_xor_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + x)), bias);
+        const __m256i high = _mm256_xor_si256(
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + x + 32)), bias);
+        const auto lowBits =
+            static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(low, limit)));
+        const auto highBits =
+            static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(high, limit)));
+        words[x / 64] = lowBits | static_cast<uint64_t>(highBits) << 32;
+    }
+    packRowScalar(pixels, x, width, threshold, words);
+}
+#endif
+
+void BitImage::packRow(const unsigned char* pixels, unsigned int width, unsigned char threshold,
+                       uint64_t* words) {
+#ifdef CUDAVISION_X86
+    switch (CUDAVISION::getInstructionSet()) {
+        case CUDAVISION::InstructionSet::AVX512:
+        case CUDAVISION::InstructionSet::AVX2:
+            packRowAVX2(pixels, width, threshold, words);
+            return;
+        case CUDAVISION::InstructionSet::SSE2:
+            packRowSSE2(pixels, width, threshold, words);
+            return;
+        case CUDAVISION::InstructionSet::Scalar:
+            break;
+    }
+#endif
+    packRowScalar(pixels, 0, width, threshold, words);
+}
+
+BitImage BitImage::fromThreshold(ImageView input, unsigned char threshold) {
+    CUDAVISION_TRACE_SCOPE("BitImage::fromThreshold");
+    if (input.channels != 1) {
+        throw std::invalid_argument("BitImage::fromThreshold expects one channel");
+    }
+    BitImage image(input.width, input.height);
+    CUDAVISION::parallelForRows(input.height, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int y = begin; y < end; y++) {
+            packRow(input.row(y), input.width, threshold, image.row(y));
+        }
+    });
+    return image;
+}
+
+std::size_t BitImage::count() const {
+    std::size_t total = 0;
+    for (uint64_t word : words) {
+        total += std::popcount(word);
+    }
+    return total;
+}
+
+/**
+ * Combines the words of two images of the same size. The padding bits stay zero for and, or and
+ * xor.
+ */
+template <typename Operation>
+static BitImage& combine(BitImage& image, const BitImage& other, Operation operation) {
+    if (image.getWidth() != other.getWidth() || image.getHeight() != other.getHeight()) {
+        throw std::invalid_argument("BitImage operands differ in size");
+    }
+    const std::size_t wordsPerRow = image.getWordsPerRow();
+    for (unsigned int y = 0; y < image.getHeight(); y++) {
+        uint64_t* target = image.row(y);
+        const uint64_t* source = other.row(y);
+        for (std::size_t i = 0; i < wordsPerRow; i++) {
+            target[i] = operation(target[i], source[i]);
+        }
+    }
+    return image;
+}
+
+BitImage& BitImage::operator&=(const BitImage& other) {
+    return combine(*this, other, [](uint64_t a, uint64_t b) { return a & b; });
+}
+
+BitImage& BitImage::operator|=(const BitImage& other) {
+    return combine(*this, other, [](uint64_t a, uint64_t b) { return a | b; });
+}
+
+BitImage& BitImage::operator^=(const BitImage& other) {
+    return combine(*this, other, [](uint64_t a, uint64_t b) { return a ^ b; });
+}
+
+void BitImage::unpack(MutableImageView output) const {
+    CUDAVISION_TRACE_SCOPE("BitImage::unpack");
+    CUDAVISION::parallelForRows(height, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int y = begin; y < end; y++) {
+            const uint64_t* source = row(y);
+            unsigned char* target = output.row(y);
+            for (unsigned int x = 0; x < width; x++) {
+                target[x] = (source[x / 64] >> (x % 64)) & 1 ? 255 : 0;
+            }
+        }
+    });
+}
+
+Image BitImage::toImage() const {
+    Image image(width, height, PixelFormat::Gray8);
+    unpack(image.mutableView());
+    return image;
+}
+
+void BitImage::writeImageToFile(const std::filesystem::path& filePath) const {
+    CUDAVISION_TRACE_SCOPE("BitImage::writeImageToFile");
+    try {
+        writeBitmap(filePath, *this);
+    } catch (const std::runtime_error& error) {
+        std::cerr << "File could not be written: " << error.what() << std::endl;
+    }
+}
+
+namespace CUDAVISION {
+    /**
+     * Dilation in the complement when complement is set, which is the erosion of the image with
+     * pixels outside of it counting as set: erode(A) = ~dilate(~A).
+     *
+     * The horizontal pass ORs every word with copies of itself shifted by up to 63 pixels, the
+     * bits crossing a word boundary carried over from the neighboring words. Steps grow to
+     * 2 * extent + 1, so a radius r takes O(log r) passes. The vertical pass ORs the rows
+     * within the radius.
+     */
+    static BitImage morphology(const BitImage& image, unsigned int radius, bool complement) {
+        const unsigned int width = image.getWidth();
+        const unsigned int height = image.getHeight();
+        const unsigned int wordsPerRow = image.getWordsPerRow();
+        const uint64_t flip = complement ? ~uint64_t{0} : 0;
+        const uint64_t lastMask = image.getLastWordMask();
+        auto mask = [&](unsigned int i) { return i + 1 == wordsPerRow ? lastMask : ~uint64_t{0}; };
+
+        BitImage horizontal(width, height);
+        parallelForRows(height, [&](unsigned int begin, unsigned int end) {
+            thread_local std::vector<uint64_t> previous;
+            for (unsigned int y = begin; y < end; y++) {
+                const uint64_t* source = image.row(y);
+                uint64_t* target = horizontal.row(y);
+                for (unsigned int i = 0; i < wordsPerRow; i++) {
+                    target[i] = (source[i] ^ flip) & mask(i);
+                }
+                for (unsigned int extent = 0; extent < radius;) {
+                    const unsigned int step = std::min({radius - extent, 2 * extent + 1, 63u});
+                    previous.assign(target, target + wordsPerRow);
+                    for (unsigned int i = 0; i < wordsPerRow; i++) {
+                        const uint64_t before = i > 0 ? previous[i - 1] : 0;
+                        const uint64_t after = i + 1 < wordsPerRow ? previous[i + 1] : 0;
+                        const uint64_t word = previous[i];
+                        target[i] = (word | word << step | before >> (64 - step) | word >> step |
+                                     after << (64 - step)) &
+                                    mask(i);
+                    }
+                    extent += step;
+                }
+            }
+        });
+
+        BitImage output(width, height);
+        parallelForRows(height, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int y = begin; y < end; y++) {
+                uint64_t* target = output.row(y);
+                const unsigned int first = y > radius ? y - radius : 0;
+                const unsigned int last =
+                    std::min<std::size_t>(std::size_t{y} + radius, height - 1);
+                for (unsigned int k = first; k <= last; k++) {
+                    const uint64_t* source = horizontal.row(k);
+                    for (unsigned int i = 0; i < wordsPerRow; i++) {
+                        target[i] |= source[i];
+                    }
+                }
+                for (unsigned int i = 0; i < wordsPerRow; i++) {
+                    target[i] = (target[i] ^ flip) & mask(i);
+                }
+            }
+        });
+        return output;
+    }
+
+    BitImage dilate(const BitImage& image, unsigned int radius) {
+        CUDAVISION_TRACE_SCOPE("dilate");
+        return morphology(image, radius, false);
+    }
+
+    BitImage erode(const BitImage& image, unsigned int radius) {
+        CUDAVISION_TRACE_SCOPE("erode");
+        return morphology(image, radius, true);
+    }
+}  // namespace CUDAVISION
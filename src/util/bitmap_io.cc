@@ -0,0 +1,632 @@
+#include "util/bitmap_io.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "util/bit_image.h"
+#include "util/bitmap.h"
+#include "util/buffer_pool.h"
+#include "util/image.h"
+#include "util/trace.h"
+
+static constexpr std::size_t FILE_HEADER_SIZE = sizeof(BitmapFileHeader);
+static constexpr std::size_t INFO_HEADER_SIZE = sizeof(BitmapInfoHeader);
+static constexpr uint32_t COMPRESSION_RGB = 0;
+static constexpr uint32_t COMPRESSION_BITFIELDS = 3;
+static constexpr std::size_t MAX_HEADER_BYTES = 1 << 20;
+
+/**
+ * Size of a pixel array row in the file, padded to a multiple of 4 bytes.
+ */
+static std::size_t paddedRowSize(std::size_t width, unsigned int bitsPerPixel) {
+    return (width * bitsPerPixel + 31) / 32 * 4;
+}
+
+[[noreturn]] static void fail(const std::filesystem::path& filePath, const std::string& reason) {
+    throw std::runtime_error(filePath.string() + ": " + reason);
+}
+
+/**
+ * Validates the headers at the start of a bitmap file.
+ *
+ * @param data The first available bytes of the file, at least up to the end of the palette.
+ * @param fileSize Size of the whole file.
+ */
+static BitmapLayout parseLayout(const std::filesystem::path& filePath, const unsigned char* data,
+                                std::size_t available, std::size_t fileSize) {
+    if (available < FILE_HEADER_SIZE + INFO_HEADER_SIZE) {
+        fail(filePath, "file too small for the bitmap headers");
+    }
+    BitmapFileHeader fileHeader;
+    BitmapInfoHeader infoHeader;
+    std::memcpy(&fileHeader, data, FILE_HEADER_SIZE);
+    std::memcpy(&infoHeader, data + FILE_HEADER_SIZE, INFO_HEADER_SIZE);
+    if (fileHeader.headerFieldA != 'B' || fileHeader.headerFieldB != 'M') {
+        fail(filePath, "missing BM signature");
+    }
+    if (infoHeader.headerSize < INFO_HEADER_SIZE ||
+        FILE_HEADER_SIZE + infoHeader.headerSize > available) {
+        fail(filePath, "invalid info header size " + std::to_string(infoHeader.headerSize));
+    }
+    if (infoHeader.numberOfColorPlanes != 1) {
+        fail(filePath, "number of color planes must be 1");
+    }
+    BitmapLayout layout;
+    layout.bitsPerPixel = infoHeader.bitsPerPixel;
+    if (layout.bitsPerPixel != 1 && layout.bitsPerPixel != 8 && layout.bitsPerPixel != 24 &&
+        layout.bitsPerPixel != 32) {
+        fail(filePath, "unsupported bit depth " + std::to_string(layout.bitsPerPixel));
+    }
+    if (infoHeader.compressionMethod == COMPRESSION_BITFIELDS && layout.bitsPerPixel == 32) {
+        // The channel masks follow the 40 byte header, inside or after a larger info header.
+        const std::size_t masksOffset = FILE_HEADER_SIZE + INFO_HEADER_SIZE;
+        if (masksOffset + 3 * sizeof(uint32_t) > available) {
+            fail(filePath, "missing channel masks");
+        }
+        uint32_t masks[3];
+        std::memcpy(masks, data + masksOffset, sizeof(masks));
+        if (masks[0] != 0x00FF0000 || masks[1] != 0x0000FF00 || masks[2] != 0x000000FF) {
+            fail(filePath, "unsupported channel masks");
+        }
+    } else if (infoHeader.compressionMethod != COMPRESSION_RGB) {
+        fail(filePath, "unsupported compression " + std::to_string(infoHeader.compressionMethod));
+    }
+    if (infoHeader.bitmapWidth <= 0 || infoHeader.bitmapHeight == 0 ||
+        infoHeader.bitmapHeight == std::numeric_limits<int32_t>::min()) {
+        fail(filePath, "invalid dimensions");
+    }
+    layout.width = static_cast<unsigned int>(infoHeader.bitmapWidth);
+    layout.topDown = infoHeader.bitmapHeight < 0;
+    layout.height = static_cast<unsigned int>(layout.topDown ? -infoHeader.bitmapHeight
+                                                             : infoHeader.bitmapHeight);
+
+    if (layout.bitsPerPixel <= 8) {
+        layout.paletteSize =
+            infoHeader.colorPalette == 0 ? 1u << layout.bitsPerPixel : infoHeader.colorPalette;
+        layout.paletteOffset = FILE_HEADER_SIZE + infoHeader.headerSize;
+        const std::size_t paletteEnd = layout.paletteOffset + 4 * std::size_t{layout.paletteSize};
+        if (layout.paletteSize > 256 || paletteEnd > available ||
+            paletteEnd > fileHeader.imageOffset) {
+            fail(filePath, "invalid palette");
+        }
+    }
+
+    layout.rowSize = paddedRowSize(layout.width, layout.bitsPerPixel);
+    layout.imageOffset = fileHeader.imageOffset;
+    if (layout.imageOffset < FILE_HEADER_SIZE + infoHeader.headerSize ||
+        layout.imageOffset > fileSize ||
+        (fileSize - layout.imageOffset) / layout.rowSize < layout.height) {
+        fail(filePath, "pixel array exceeds the file");
+    }
+    // The file size bounds the packed pixels, not the decoded ones: a 1 bpp pixel decodes to 3
+    // bytes. Reject sizes whose decoded pixels, at most 4 bytes each, do not fit a std::size_t.
+    if (layout.height > std::numeric_limits<std::size_t>::max() / 4 / layout.width) {
+        fail(filePath, "image too large");
+    }
+    return layout;
+}
+
+/**
+ * Whether every palette entry is the gray value of its own index.
+ */
+static bool isGrayPalette(const unsigned char* palette, unsigned int paletteSize) {
+    if (!palette) {
+        return false;
+    }
+    for (unsigned int i = 0; i < paletteSize; i++) {
+        const unsigned char* entry = palette + 4 * i;
+        if (entry[0] != i || entry[1] != i || entry[2] != i) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Whether both entries of a 1 bpp palette are shades of gray.
+ */
+static bool isGrayMonoPalette(const unsigned char* palette, unsigned int paletteSize) {
+    if (!palette) {
+        return false;
+    }
+    for (unsigned int i = 0; i < std::min(paletteSize, 2u); i++) {
+        const unsigned char* entry = palette + 4 * i;
+        if (entry[0] != entry[1] || entry[1] != entry[2]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * The pixel format a bitmap is decoded to: Gray8 for 8 bpp with the identity gray palette and
+ * for 1 bpp with two gray entries, BGR8 for all others.
+ */
+static PixelFormat decodedFormat(const BitmapLayout& layout, const unsigned char* palette) {
+    const bool gray = layout.bitsPerPixel == 1 ? isGrayMonoPalette(palette, layout.paletteSize)
+                                               : isGrayPalette(palette, layout.paletteSize);
+    return gray ? PixelFormat::Gray8 : PixelFormat::BGR8;
+}
+
+/**
+ * Converts one row of the pixel array to Gray8 (gray palettes) or BGR8.
+ */
+static void decodeBitmapRow(const unsigned char* src, unsigned char* dst,
+                            const BitmapLayout& layout, const unsigned char* palette,
+                            PixelFormat format) {
+    const unsigned int width = layout.width;
+    if (layout.bitsPerPixel == 1) {
+        // The first pixel is the most significant bit, indices beyond the palette are black.
+        static constexpr unsigned char BLACK[4] = {0, 0, 0, 0};
+        const unsigned int channels = channelCount(format);
+        for (unsigned int j = 0; j < width; j++) {
+            const unsigned int index = (src[j / 8] >> (7 - j % 8)) & 1;
+            const unsigned char* entry = index < layout.paletteSize ? palette + 4 * index : BLACK;
+            std::copy_n(entry, channels, dst + channels * j);
+        }
+    } else if (format == PixelFormat::Gray8 || layout.bitsPerPixel == 24) {
+        std::copy_n(src, width * channelCount(format), dst);
+    } else if (layout.bitsPerPixel == 32) {
+        for (unsigned int j = 0; j < width; j++) {
+            std::copy_n(src + 4 * j, 3, dst + 3 * j);
+        }
+    } else {
+        // Color palettes are expanded, indices beyond the palette are black.
+        for (unsigned int j = 0; j < width; j++) {
+            if (src[j] < layout.paletteSize) {
+                std::copy_n(palette + 4 * src[j], 3, dst + 3 * j);
+            } else {
+                std::fill_n(dst + 3 * j, 3, 0);
+            }
+        }
+    }
+}
+
+MappedBitmap::MappedBitmap(const std::filesystem::path& filePath) {
+    CUDAVISION_TRACE_SCOPE("MappedBitmap");
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fail(filePath, std::strerror(errno));
+    }
+    struct stat status;
+    if (::fstat(fd, &status) != 0 || status.st_size <= 0) {
+        ::close(fd);
+        fail(filePath, "empty or unreadable file");
+    }
+    mappingSize = static_cast<std::size_t>(status.st_size);
+    void* address = ::mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED) {
+        fail(filePath, std::strerror(errno));
+    }
+    mapping = static_cast<const unsigned char*>(address);
+    CUDAVISION_TRACE_COUNT(BytesRead, mappingSize);
+    ::madvise(address, mappingSize, MADV_SEQUENTIAL);
+    try {
+        layout = parseLayout(filePath, mapping, mappingSize, mappingSize);
+    } catch (...) {
+        // The destructor does not run for a throwing constructor.
+        ::munmap(address, mappingSize);
+        throw;
+    }
+    if (layout.bitsPerPixel <= 8) {
+        palette = mapping + layout.paletteOffset;
+    }
+}
+
+MappedBitmap::~MappedBitmap() {
+    if (mapping) {
+        ::munmap(const_cast<unsigned char*>(mapping), mappingSize);
+    }
+}
+
+bool MappedBitmap::hasGrayPalette() const { return isGrayPalette(palette, layout.paletteSize); }
+
+ImageView MappedBitmap::view() const {
+    const unsigned char* pixelArray = mapping + layout.imageOffset;
+    const auto stride = static_cast<std::ptrdiff_t>(layout.rowSize);
+    // 1 bpp rows are exposed as their packed bytes.
+    const unsigned int channels = std::max(layout.bitsPerPixel / 8, 1u);
+    const unsigned int width = layout.bitsPerPixel == 1 ? (layout.width + 7) / 8 : layout.width;
+    if (layout.topDown) {
+        return {pixelArray + (layout.height - 1) * layout.rowSize, width, layout.height, -stride,
+                channels};
+    }
+    return {pixelArray, width, layout.height, stride, channels};
+}
+
+PixelFormat MappedBitmap::getPixelFormat() const { return decodedFormat(layout, palette); }
+
+void MappedBitmap::decodeRow(unsigned int y, unsigned char* dst) const {
+    decodeBitmapRow(view().row(y), dst, layout, palette, getPixelFormat());
+}
+
+/**
+ * Reads count bytes at offset, resuming after short reads.
+ */
+static bool readFully(int fd, unsigned char* dst, std::size_t count, std::size_t offset) {
+    while (count > 0) {
+        ssize_t received = ::pread(fd, dst, count, static_cast<off_t>(offset));
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            if (received == 0) {
+                errno = 0;
+            }
+            return false;
+        }
+        CUDAVISION_TRACE_COUNT(BytesRead, received);
+        dst += received;
+        count -= received;
+        offset += received;
+    }
+    return true;
+}
+
+BitmapReader::BitmapReader(const std::filesystem::path& filePath) : path(filePath) {
+    fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fail(filePath, std::strerror(errno));
+    }
+    try {
+        struct stat status;
+        if (::fstat(fd, &status) != 0 || status.st_size <= 0) {
+            fail(filePath, "empty or unreadable file");
+        }
+        const auto fileSize = static_cast<std::size_t>(status.st_size);
+        // Headers and palette lie before the pixel array, whose offset is in the file header.
+        unsigned char fileHeader[FILE_HEADER_SIZE];
+        if (!readFully(fd, fileHeader, std::min(fileSize, FILE_HEADER_SIZE), 0)) {
+            fail(filePath, std::strerror(errno));
+        }
+        uint32_t imageOffset = 0;
+        if (fileSize >= FILE_HEADER_SIZE) {
+            std::memcpy(&imageOffset, fileHeader + offsetof(BitmapFileHeader, imageOffset),
+                        sizeof(imageOffset));
+        }
+        const std::size_t prefixSize = std::min<std::size_t>(
+            fileSize, std::max<std::size_t>(imageOffset, FILE_HEADER_SIZE + INFO_HEADER_SIZE + 12));
+        if (prefixSize > MAX_HEADER_BYTES) {
+            fail(filePath, "pixel array offset too large");
+        }
+        std::vector<unsigned char> prefix(prefixSize);
+        if (!readFully(fd, prefix.data(), prefixSize, 0)) {
+            fail(filePath, std::strerror(errno));
+        }
+        layout = parseLayout(filePath, prefix.data(), prefixSize, fileSize);
+        if (layout.bitsPerPixel <= 8) {
+            palette.assign(prefix.begin() + layout.paletteOffset,
+                           prefix.begin() + layout.paletteOffset + 4 * layout.paletteSize);
+        }
+        format = decodedFormat(layout, palette.empty() ? nullptr : palette.data());
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+BitmapReader::~BitmapReader() {
+    BufferPool::global().release(std::move(fileRows));
+    ::close(fd);
+}
+
+unsigned int BitmapReader::readRows(MutableImageView strip) {
+    CUDAVISION_TRACE_SCOPE("BitmapReader::readRows");
+    const unsigned int count = std::min(strip.height, layout.height - rowsRead);
+    if (count == 0) {
+        return 0;
+    }
+    // Rows [rowsRead, rowsRead + count) are consecutive in the file, in reverse order for
+    // top-down bitmaps.
+    const std::size_t firstFileRow =
+        layout.topDown ? layout.height - rowsRead - count : rowsRead;
+    if (fileRows.size() < count * layout.rowSize) {
+        BufferPool::global().release(std::move(fileRows));
+        fileRows = BufferPool::global().acquire(count * layout.rowSize);
+    }
+    if (!readFully(fd, fileRows.data(), count * layout.rowSize,
+                   layout.imageOffset + firstFileRow * layout.rowSize)) {
+        fail(path, errno ? std::strerror(errno) : "unexpected end of file");
+    }
+    const unsigned char* paletteData = palette.empty() ? nullptr : palette.data();
+    for (unsigned int i = 0; i < count; i++) {
+        const unsigned int fileRow = layout.topDown ? count - 1 - i : i;
+        decodeBitmapRow(fileRows.data() + fileRow * layout.rowSize, strip.row(i), layout,
+                        paletteData, format);
+    }
+    rowsRead += count;
+    return count;
+}
+
+/**
+ * Bits per pixel of the bitmap written for a channel count.
+ */
+static unsigned int bitsPerPixelOf(const std::filesystem::path& filePath, unsigned int channels) {
+    if (channels != 1 && channels != 3 && channels != 4) {
+        fail(filePath, "cannot write " + std::to_string(channels) + " channels as a bitmap");
+    }
+    return 8 * channels;
+}
+
+/**
+ * File header, info header and palette of a bitmap: the grayscale ramp for 8 bpp, black and
+ * white for 1 bpp.
+ */
+static std::vector<unsigned char> makeHeaders(const std::filesystem::path& filePath,
+                                              unsigned int width, unsigned int height,
+                                              unsigned int bitsPerPixel) {
+    const std::size_t pixelArraySize = paddedRowSize(width, bitsPerPixel) * height;
+
+    // 1 and 8 bpp bitmaps index a palette, which is the identity ramp for grayscale images.
+    const unsigned int paletteSize = bitsPerPixel <= 8 ? 1u << bitsPerPixel : 0;
+    const std::size_t paletteBytes = 4 * std::size_t{paletteSize};
+    std::vector<unsigned char> header(FILE_HEADER_SIZE + INFO_HEADER_SIZE + paletteBytes);
+    const std::size_t fileSize = header.size() + pixelArraySize;
+    if (fileSize > std::numeric_limits<uint32_t>::max() ||
+        width > static_cast<unsigned int>(std::numeric_limits<int32_t>::max()) ||
+        height > static_cast<unsigned int>(std::numeric_limits<int32_t>::max())) {
+        fail(filePath, "image too large for a bitmap");
+    }
+
+    BitmapFileHeader fileHeader;
+    fileHeader.headerFieldA = 'B';
+    fileHeader.headerFieldB = 'M';
+    fileHeader.fileSize = static_cast<uint32_t>(fileSize);
+    fileHeader.reservedA = 0;
+    fileHeader.reservedB = 0;
+    fileHeader.imageOffset = static_cast<uint32_t>(header.size());
+    std::memcpy(header.data(), &fileHeader, FILE_HEADER_SIZE);
+
+    BitmapInfoHeader infoHeader;
+    infoHeader.headerSize = INFO_HEADER_SIZE;
+    infoHeader.bitmapWidth = width;
+    infoHeader.bitmapHeight = height;
+    infoHeader.numberOfColorPlanes = 1;
+    infoHeader.bitsPerPixel = bitsPerPixel;
+    infoHeader.compressionMethod = COMPRESSION_RGB;
+    infoHeader.imageSize = 0;
+    infoHeader.horizontalResolution = 0;
+    infoHeader.verticalResolution = 0;
+    infoHeader.colorPalette = paletteSize;
+    infoHeader.importantColors = 0;
+    std::memcpy(header.data() + FILE_HEADER_SIZE, &infoHeader, INFO_HEADER_SIZE);
+
+    unsigned char* palette = header.data() + FILE_HEADER_SIZE + INFO_HEADER_SIZE;
+    for (unsigned int i = 0; i < paletteSize; i++) {
+        const unsigned char gray = i * 255 / (paletteSize - 1);
+        palette[4 * i + 0] = palette[4 * i + 1] = palette[4 * i + 2] = gray;
+        palette[4 * i + 3] = 0;
+    }
+    return header;
+}
+
+/**
+ * Copies rows into the padded layout of a pixel array.
+ */
+static void packRows(ImageView rows, std::size_t rowSize, unsigned char* dst) {
+    for (unsigned int y = 0; y < rows.height; y++) {
+        unsigned char* row = dst + y * rowSize;
+        std::copy_n(rows.row(y), rows.rowElements(), row);
+        std::fill(row + rows.rowElements(), row + rowSize, 0);
+    }
+}
+
+/**
+ * Writes all parts with writev, resuming after short writes.
+ *
+ * @return 0 on success, errno otherwise.
+ */
+static int writeFully(int fd, iovec* parts, int count) {
+    while (count > 0) {
+        ssize_t written = ::writev(fd, parts, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno;
+        }
+        CUDAVISION_TRACE_COUNT(BytesWritten, written);
+        auto done = static_cast<std::size_t>(written);
+        while (count > 0 && done >= parts->iov_len) {
+            done -= parts->iov_len;
+            parts++;
+            count--;
+        }
+        if (count > 0) {
+            parts->iov_base = static_cast<unsigned char*>(parts->iov_base) + done;
+            parts->iov_len -= done;
+        }
+    }
+    return 0;
+}
+
+void writeBitmap(const std::filesystem::path& filePath, ImageView view) {
+    CUDAVISION_TRACE_SCOPE("writeBitmap");
+    std::vector<unsigned char> header =
+        makeHeaders(filePath, view.width, view.height, bitsPerPixelOf(filePath, view.channels));
+    const std::size_t rowSize = paddedRowSize(view.width, 8 * view.channels);
+    const std::size_t pixelArraySize = rowSize * view.height;
+
+    // Rows stored back to back without padding are already the pixel array of the file.
+    std::vector<unsigned char> packed;
+    const unsigned char* pixelArray = view.data;
+    if (view.stride != static_cast<std::ptrdiff_t>(rowSize) || rowSize != view.rowElements()) {
+        packed = BufferPool::global().acquire(pixelArraySize);
+        packRows(view, rowSize, packed.data());
+        pixelArray = packed.data();
+    }
+
+    int fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        BufferPool::global().release(std::move(packed));
+        fail(filePath, std::strerror(errno));
+    }
+    iovec parts[2] = {{header.data(), header.size()},
+                      {const_cast<unsigned char*>(pixelArray), pixelArraySize}};
+    int error = writeFully(fd, parts, 2);
+    if (::close(fd) != 0 && error == 0) {
+        error = errno;
+    }
+    BufferPool::global().release(std::move(packed));
+    if (error != 0) {
+        fail(filePath, std::strerror(error));
+    }
+}
+
+/**
+ * Swaps the bit order within every byte of a word. BitImage keeps the first pixel of a byte in
+ * its least significant bit, 1 bpp bitmaps in its most significant bit.
+ */
+static uint64_t reverseBitsInBytes(uint64_t word) {
+    word = (word >> 1 & 0x5555555555555555) | (word & 0x5555555555555555) << 1;
+    word = (word >> 2 & 0x3333333333333333) | (word & 0x3333333333333333) << 2;
+    return (word >> 4 & 0x0F0F0F0F0F0F0F0F) | (word & 0x0F0F0F0F0F0F0F0F) << 4;
+}
+
+void writeBitmap(const std::filesystem::path& filePath, const BitImage& image) {
+    CUDAVISION_TRACE_SCOPE("writeBitmap");
+    std::vector<unsigned char> header =
+        makeHeaders(filePath, image.getWidth(), image.getHeight(), 1);
+    const std::size_t rowSize = paddedRowSize(image.getWidth(), 1);
+    const std::size_t pixelArraySize = rowSize * image.getHeight();
+    std::vector<unsigned char> packed = BufferPool::global().acquire(pixelArraySize);
+    for (unsigned int y = 0; y < image.getHeight(); y++) {
+        unsigned char* row = packed.data() + y * rowSize;
+        std::fill_n(row, rowSize, 0);
+        const uint64_t* words = image.row(y);
+        const std::size_t bytes = (image.getWidth() + 7) / 8;
+        for (std::size_t i = 0; i < bytes; i += 8) {
+            const uint64_t word = reverseBitsInBytes(words[i / 8]);
+            for (std::size_t k = 0; k < std::min<std::size_t>(8, bytes - i); k++) {
+                row[i + k] = static_cast<unsigned char>(word >> (8 * k));
+            }
+        }
+    }
+
+    int fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        BufferPool::global().release(std::move(packed));
+        fail(filePath, std::strerror(errno));
+    }
+    iovec parts[2] = {{header.data(), header.size()}, {packed.data(), pixelArraySize}};
+    int error = writeFully(fd, parts, 2);
+    if (::close(fd) != 0 && error == 0) {
+        error = errno;
+    }
+    BufferPool::global().release(std::move(packed));
+    if (error != 0) {
+        fail(filePath, std::strerror(error));
+    }
+}
+
+Image readBitmap(const std::filesystem::path& filePath) {
+    CUDAVISION_TRACE_SCOPE("readBitmap");
+    MappedBitmap bitmap(filePath);
+    Image image(bitmap.getWidth(), bitmap.getHeight(), bitmap.getPixelFormat());
+    MutableImageView pixels = image.mutableView();
+    for (unsigned int y = 0; y < pixels.height; y++) {
+        bitmap.decodeRow(y, pixels.row(y));
+    }
+    return image;
+}
+
+BitImage readBitImage(const std::filesystem::path& filePath) {
+    CUDAVISION_TRACE_SCOPE("readBitImage");
+    MappedBitmap bitmap(filePath);
+    BitImage image(bitmap.getWidth(), bitmap.getHeight());
+    const ImageView pixels = bitmap.view();
+    if (bitmap.getBitsPerPixel() == 1) {
+        // Set pixels are the ones whose palette entry is brighter, indices beyond the palette are
+        // black.
+        auto brightness = [&](unsigned int index) {
+            const unsigned char* entry = bitmap.getPalette() + 4 * index;
+            return index < bitmap.getPaletteSize() ? entry[0] + 2 * entry[1] + entry[2] : 0;
+        };
+        const uint64_t invert = brightness(1) > brightness(0) ? 0 : ~uint64_t{0};
+        const unsigned int wordsPerRow = image.getWordsPerRow();
+        const uint64_t lastMask = image.getLastWordMask();
+        for (unsigned int y = 0; y < image.getHeight(); y++) {
+            const unsigned char* bytes = pixels.row(y);
+            uint64_t* words = image.row(y);
+            for (unsigned int i = 0; i < wordsPerRow; i++) {
+                uint64_t word = 0;
+                for (unsigned int k = 0; k < 8 && 8 * i + k < pixels.width; k++) {
+                    word |= uint64_t{bytes[8 * i + k]} << (8 * k);
+                }
+                word = reverseBitsInBytes(word) ^ invert;
+                words[i] = i + 1 == wordsPerRow ? word & lastMask : word;
+            }
+        }
+        return image;
+    }
+
+    const PixelFormat format = bitmap.getPixelFormat();
+    std::vector<unsigned char> decoded(std::size_t{bitmap.getWidth()} * channelCount(format));
+    std::vector<unsigned char> gray(bitmap.getWidth());
+    for (unsigned int y = 0; y < image.getHeight(); y++) {
+        bitmap.decodeRow(y, decoded.data());
+        const unsigned char* row = decoded.data();
+        if (format != PixelFormat::Gray8) {
+            Image::toGrayscale({decoded.data(), bitmap.getWidth(), 1, 0, 3},
+                               {gray.data(), bitmap.getWidth(), 1, 0, 1});
+            row = gray.data();
+        }
+        BitImage::packRow(row, bitmap.getWidth(), 127, image.row(y));
+    }
+    return image;
+}
+
+BitmapWriter::BitmapWriter(const std::filesystem::path& filePath, unsigned int width,
+                           unsigned int height, unsigned int channels)
+    : path(filePath), width(width), height(height), channels(channels) {
+    std::vector<unsigned char> header =
+        makeHeaders(filePath, width, height, bitsPerPixelOf(filePath, channels));
+    fd = ::open(filePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fail(filePath, std::strerror(errno));
+    }
+    iovec part = {header.data(), header.size()};
+    if (int error = writeFully(fd, &part, 1)) {
+        ::close(fd);
+        fail(filePath, std::strerror(error));
+    }
+}
+
+BitmapWriter::~BitmapWriter() {
+    BufferPool::global().release(std::move(packed));
+    ::close(fd);
+}
+
+void BitmapWriter::writeRows(ImageView strip) {
+    CUDAVISION_TRACE_SCOPE("BitmapWriter::writeRows");
+    if (strip.width != width || strip.channels != channels) {
+        fail(path, "strip does not match the bitmap format");
+    }
+    if (strip.height > height - rowsWritten) {
+        fail(path, "more rows written than the bitmap height");
+    }
+    const std::size_t rowSize = paddedRowSize(width, 8 * channels);
+    if (packed.size() < strip.height * rowSize) {
+        BufferPool::global().release(std::move(packed));
+        packed = BufferPool::global().acquire(strip.height * rowSize);
+    }
+    packRows(strip, rowSize, packed.data());
+    iovec part = {packed.data(), strip.height * rowSize};
+    if (int error = writeFully(fd, &part, 1)) {
+        fail(path, std::strerror(error));
+    }
+    rowsWritten += strip.height;
+}
@@ -0,0 +1,98 @@
+#include "util/buffer_pool.h"
+
+#include <algorithm>
+#include <new>
+
+#include "util/trace.h"
+
+BufferPool& BufferPool::global() {
+    static BufferPool pool;
+    return pool;
+}
+
+void BufferPool::setEnabled(bool enabled) {
+    std::lock_guard<std::mutex> lock(mutex);
+    this->enabled = enabled;
+    if (!enabled) {
+        buffers.clear();
+        statistics.pooledBytes = 0;
+    }
+}
+
+bool BufferPool::isEnabled() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return enabled;
+}
+
+void BufferPool::setCapacity(std::size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    capacity = bytes;
+}
+
+std::vector<unsigned char> BufferPool::acquire(std::size_t size) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (enabled) {
+            statistics.bytesInUse += size;
+            statistics.peakBytes = std::max(statistics.peakBytes, statistics.bytesInUse);
+            auto it = buffers.find(size);
+            if (it != buffers.end() && !it->second.empty()) {
+                std::vector<unsigned char> buffer = std::move(it->second.back());
+                it->second.pop_back();
+                statistics.pooledBytes -= size;
+                statistics.hits++;
+                return buffer;
+            }
+            statistics.misses++;
+        }
+    }
+    // Allocate outside of the lock, a miss must not stall the other threads.
+    CUDAVISION_TRACE_COUNT(Allocations, 1);
+    CUDAVISION_TRACE_COUNT(AllocatedBytes, size);
+    return std::vector<unsigned char>(size);
+}
+
+void BufferPool::release(std::vector<unsigned char>&& buffer) noexcept {
+    std::size_t size = buffer.size();
+    if (size == 0) {
+        return;
+    }
+    std::vector<unsigned char> freed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!enabled) {
+            return;
+        }
+        statistics.bytesInUse -= std::min(statistics.bytesInUse, size);
+        if (statistics.pooledBytes + size > capacity) {
+            freed = std::move(buffer);
+        } else {
+            try {
+                buffers[size].push_back(std::move(buffer));
+                statistics.pooledBytes += size;
+            } catch (const std::bad_alloc&) {
+                // push_back leaves the buffer untouched when it throws, drop it.
+                freed = std::move(buffer);
+            }
+        }
+    }
+    buffer.clear();
+}
+
+void BufferPool::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    buffers.clear();
+    statistics.pooledBytes = 0;
+}
+
+BufferPool::Statistics BufferPool::getStatistics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return statistics;
+}
+
+void BufferPool::resetStatistics() {
+    std::lock_guard<std::mutex> lock(mutex);
+    statistics.hits = 0;
+    statistics.misses = 0;
+    statistics.peakBytes = statistics.bytesInUse;
+}
@@ -0,0 +1,73 @@
+#include "util/cpu_features.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <strings.h>
+
+#include "util/backend.h"
+
+namespace CUDAVISION {
+    InstructionSet detectInstructionSet() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512bw")) {
+            return InstructionSet::AVX512;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return InstructionSet::AVX2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return InstructionSet::SSE2;
+        }
+#endif
+        return InstructionSet::Scalar;
+    }
+
+    /**
+     * Reads the CUDAVISION_ISA environment variable, falling back to the detected instruction set.
+     */
+    static InstructionSet defaultInstructionSet() {
+        InstructionSet detected = detectInstructionSet();
+        const char* requested = std::getenv("CUDAVISION_ISA");
+        if (requested == nullptr) {
+            return detected;
+        }
+        for (InstructionSet candidate : {InstructionSet::Scalar, InstructionSet::SSE2,
+                                         InstructionSet::AVX2, InstructionSet::AVX512}) {
+            if (strcasecmp(requested, toString(candidate)) == 0) {
+                return std::min(candidate, detected);
+            }
+        }
+        return detected;
+    }
+
+    static std::atomic<InstructionSet>& activeInstructionSet() {
+        static std::atomic<InstructionSet> active(defaultInstructionSet());
+        return active;
+    }
+
+    InstructionSet getInstructionSet() {
+        applyBackendFromEnvironment();
+        return activeInstructionSet().load();
+    }
+
+    void setInstructionSet(InstructionSet instructionSet) {
+        applyBackendFromEnvironment();
+        activeInstructionSet().store(std::min(instructionSet, detectInstructionSet()));
+    }
+
+    const char* toString(InstructionSet instructionSet) {
+        switch (instructionSet) {
+            case InstructionSet::Scalar:
+                return "scalar";
+            case InstructionSet::SSE2:
+                return "sse2";
+            case InstructionSet::AVX2:
+                return "avx2";
+            case InstructionSet::AVX512:
+                return "avx512";
+        }
+        return "unknown";
+    }
+}  // namespace CUDAVISION
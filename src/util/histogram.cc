@@ -0,0 +1,141 @@
+#include "util/histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+#include "util/thread_pool.h"
+#include "util/trace.h"
+
+namespace CUDAVISION {
+    HistogramAccumulator::HistogramAccumulator(unsigned int binCount)
+        : binCount(std::max(binCount, 1u)), counts(SUB_HISTOGRAMS * this->binCount, 0) {}
+
+    void HistogramAccumulator::add(const unsigned char* values, std::size_t count) {
+        std::uint32_t* h0 = counts.data();
+        std::uint32_t* h1 = h0 + binCount;
+        std::uint32_t* h2 = h1 + binCount;
+        std::uint32_t* h3 = h2 + binCount;
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            h0[values[i]]++;
+            h1[values[i + 1]]++;
+            h2[values[i + 2]]++;
+            h3[values[i + 3]]++;
+        }
+        for (; i < count; i++) {
+            h0[values[i]]++;
+        }
+    }
+
+    void HistogramAccumulator::add(const int16_t* values, std::size_t count) {
+        const int last = binCount - 1;
+        auto bin = [last](int16_t value) { return std::clamp<int>(value, 0, last); };
+        std::uint32_t* h0 = counts.data();
+        std::uint32_t* h1 = h0 + binCount;
+        std::uint32_t* h2 = h1 + binCount;
+        std::uint32_t* h3 = h2 + binCount;
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            h0[bin(values[i])]++;
+            h1[bin(values[i + 1])]++;
+            h2[bin(values[i + 2])]++;
+            h3[bin(values[i + 3])]++;
+        }
+        for (; i < count; i++) {
+            h0[bin(values[i])]++;
+        }
+    }
+
+    void HistogramAccumulator::addTo(Histogram& histogram) const {
+        histogram.resize(std::max<std::size_t>(histogram.size(), binCount), 0);
+        for (unsigned int sub = 0; sub < SUB_HISTOGRAMS; sub++) {
+            const std::uint32_t* bins = counts.data() + sub * binCount;
+            for (unsigned int i = 0; i < binCount; i++) {
+                histogram[i] += bins[i];
+            }
+        }
+    }
+
+    /**
+     * Counts the rows of a view in parallel bands, each with its own accumulator.
+     */
+    template <typename T>
+    static Histogram countRows(BasicImageView<const T> input, unsigned int binCount) {
+        Histogram histogram(binCount, 0);
+        std::mutex mutex;
+        parallelForRows(input.height, [&](unsigned int begin, unsigned int end) {
+            HistogramAccumulator accumulator(binCount);
+            for (unsigned int y = begin; y < end; y++) {
+                accumulator.add(input.row(y), input.rowElements());
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            accumulator.addTo(histogram);
+        });
+        return histogram;
+    }
+
+    Histogram computeHistogram(ImageView input) {
+        CUDAVISION_TRACE_SCOPE("computeHistogram");
+        return countRows(input, 256);
+    }
+
+    Histogram computeHistogram(BasicImageView<const int16_t> input, unsigned int binCount) {
+        CUDAVISION_TRACE_SCOPE("computeHistogram");
+        return countRows(input, std::max(binCount, 1u));
+    }
+
+    unsigned int otsuThreshold(const Histogram& histogram) {
+        double total = 0.0;
+        double sum = 0.0;
+        for (std::size_t i = 0; i < histogram.size(); i++) {
+            total += histogram[i];
+            sum += static_cast<double>(i) * histogram[i];
+        }
+        // Between-class variance of {<= t} and {> t}: w0 * w1 * (mean0 - mean1)^2.
+        double weight = 0.0;
+        double weightedSum = 0.0;
+        double best = -1.0;
+        unsigned int threshold = 0;
+        for (std::size_t t = 0; t + 1 < histogram.size(); t++) {
+            weight += histogram[t];
+            weightedSum += static_cast<double>(t) * histogram[t];
+            const double rest = total - weight;
+            if (weight == 0.0 || rest == 0.0) {
+                continue;
+            }
+            const double difference = weightedSum / weight - (sum - weightedSum) / rest;
+            const double variance = weight * rest * difference * difference;
+            if (variance > best) {
+                best = variance;
+                threshold = t;
+            }
+        }
+        return threshold;
+    }
+
+    unsigned int percentileThreshold(const Histogram& histogram, double percentile) {
+        std::uint64_t total = 0;
+        for (std::uint64_t count : histogram) {
+            total += count;
+        }
+        const double target = std::clamp(percentile, 0.0, 100.0) / 100.0 * total;
+        std::uint64_t cumulative = 0;
+        for (std::size_t t = 0; t < histogram.size(); t++) {
+            cumulative += histogram[t];
+            if (cumulative >= target && cumulative > 0) {
+                return t;
+            }
+        }
+        return histogram.empty() ? 0 : histogram.size() - 1;
+    }
+
+    double samplePercentile(std::vector<double>& values, double fraction) {
+        if (values.empty()) {
+            return 0.0;
+        }
+        const std::size_t rank = static_cast<std::size_t>(fraction * (values.size() - 1) + 0.5);
+        std::nth_element(values.begin(), values.begin() + rank, values.end());
+        return values[rank];
+    }
+}  // namespace CUDAVISION
@@ -1,33 +1,102 @@
 #include "util/image.h"
 
-#include <fstream>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <stdexcept>
+
+#include "util/backend.h"
+#include "util/bitmap_io.h"
+#include "util/buffer_pool.h"
+#include "util/thread_pool.h"
+#include "util/trace.h"
 
 Image::Image(const std::filesystem::path filePath) {
-    std::ifstream file(filePath, std::ifstream::binary);
-    if (!file) {
-        std::cerr << "File could not be read" << std::endl;
-        return;
+    CUDAVISION_TRACE_SCOPE("Image::Image(path)");
+    try {
+        MappedBitmap bitmap(filePath);
+        width = bitmap.getWidth();
+        height = bitmap.getHeight();
+        format = bitmap.getPixelFormat();
+        const std::size_t rowElements = std::size_t{width} * channelCount(format);
+        pixels = BufferPool::global().acquire(rowElements * height);
+        for (unsigned int i = 0; i < height; i++) {
+            bitmap.decodeRow(i, &pixels[i * rowElements]);
+        }
+    } catch (const std::runtime_error& error) {
+        std::cerr << "File could not be read: " << error.what() << std::endl;
+        width = 0;
+        height = 0;
+    }
+}
+
+Image::Image(unsigned int width, unsigned int height)
+    : width(width),
+      height(height),
+      pixels(BufferPool::global().acquire(std::size_t{3} * width * height)) {
+    std::fill(pixels.begin(), pixels.end(), 0);
+}
+
+Image::Image(unsigned int width, unsigned int height, PixelFormat format)
+    : width(width),
+      height(height),
+      format(format),
+      pixels(BufferPool::global().acquire(std::size_t{width} * height * bytesPerPixel(format))) {
+    std::fill(pixels.begin(), pixels.end(), 0);
+}
+
+Image::Image(const Image& other)
+    : width(other.width),
+      height(other.height),
+      format(other.format),
+      pixels(BufferPool::global().acquire(other.pixels.size())) {
+    std::copy(other.pixels.begin(), other.pixels.end(), pixels.begin());
+}
+
+Image::Image(Image&& other) noexcept
+    : width(other.width),
+      height(other.height),
+      format(other.format),
+      pixels(std::move(other.pixels)) {
+    other.width = 0;
+    other.height = 0;
+}
+
+Image& Image::operator=(const Image& other) {
+    if (this != &other) {
+        if (pixels.size() != other.pixels.size()) {
+            BufferPool::global().release(std::move(pixels));
+            pixels = BufferPool::global().acquire(other.pixels.size());
+        }
+        std::copy(other.pixels.begin(), other.pixels.end(), pixels.begin());
+        width = other.width;
+        height = other.height;
+        format = other.format;
+    }
+    return *this;
+}
+
+Image& Image::operator=(Image&& other) noexcept {
+    if (this != &other) {
+        BufferPool::global().release(std::move(pixels));
+        pixels = std::move(other.pixels);
+        width = other.width;
+        height = other.height;
+        format = other.format;
+        other.width = 0;
+        other.height = 0;
     }
-    BitmapFileHeader fileHeader;
-    BitmapInfoHeader infoHeader;
-    file.read(reinterpret_cast<char*>(&fileHeader), sizeof(BitmapFileHeader));
-    file.read(reinterpret_cast<char*>(&infoHeader), sizeof(BitmapInfoHeader));
-    unsigned long long N = infoHeader.bitmapHeight * infoHeader.bitmapWidth;
-    height = infoHeader.bitmapHeight;
-    width = infoHeader.bitmapWidth;
-    unsigned int rowSize = ((width * 3 + 3) / 4) * 4;
-    pixels.resize(height * rowSize, 0);
-    file.seekg(fileHeader.imageOffset);
-    file.read(reinterpret_cast<char*>(pixels.data()), pixels.size());
+    return *this;
 }
 
+Image::~Image() { BufferPool::global().release(std::move(pixels)); }
+
 Image::Image(unsigned int width, unsigned int height, unsigned char r, unsigned char g,
              unsigned char b)
     : width(width), height(height) {
-    unsigned int N = height * width;
-    pixels.resize(N * 3, 0);
-    for (unsigned int i = 0; i < N; i++) {
+    const std::size_t N = std::size_t{height} * width;
+    pixels = BufferPool::global().acquire(N * 3);
+    for (std::size_t i = 0; i < N; i++) {
         pixels[3 * i] = b;
         pixels[3 * i + 1] = g;
         pixels[3 * i + 2] = r;
@@ -38,52 +107,136 @@ unsigned int Image::getHeight() const { return height; }
 
 unsigned int Image::getWidth() const { return width; }
 
-std::vector<unsigned char> Image::getPixels() const { return pixels; }
+PixelFormat Image::getFormat() const { return format; }
 
-void Image::writeImageToFile(const fs::path filePath) {
-    std::ofstream output(filePath, std::ofstream::binary);
-
-    BitmapFileHeader fileHeader;
-    fileHeader.headerFieldA = 'B';
-    fileHeader.headerFieldB = 'M';
-    fileHeader.fileSize = sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader) + pixels.size();
-    fileHeader.reservedA = 0;
-    fileHeader.reservedB = 0;
-    fileHeader.imageOffset = sizeof(BitmapFileHeader) + sizeof(BitmapInfoHeader);
-    output.write(reinterpret_cast<char*>(&fileHeader), sizeof(BitmapFileHeader));
-
-    BitmapInfoHeader infoHeader;
-    infoHeader.headerSize = sizeof(BitmapInfoHeader);
-    infoHeader.bitmapWidth = width;
-    infoHeader.bitmapHeight = height;
-    infoHeader.numberOfColorPlanes = 1;
-    infoHeader.bitsPerPixel = 8 * (pixels.size() / (width * height));
-    infoHeader.compressionMethod = 0;
-    infoHeader.imageSize = 0;
-    infoHeader.horizontalResolution = 0;
-    infoHeader.verticalResolution = 0;
-    infoHeader.colorPalette = 0;
-    infoHeader.importantColors = 0;
-    output.write(reinterpret_cast<char*>(&infoHeader), sizeof(BitmapInfoHeader));
-    unsigned int rowSize = ((width * 3 + 3) / 4) * 4;
-    for (unsigned int i = 0; i < height; i++) {
-        output.write(reinterpret_cast<char*>(&pixels[i * rowSize]), rowSize);
-    }
+unsigned int Image::getChannels() const { return channelCount(format); }
+
+const std::vector<unsigned char>& Image::getPixels() const { return pixels; }
+
+ImageView Image::view() const {
+    return {pixels.data(), width, height,
+            static_cast<std::ptrdiff_t>(width) * bytesPerPixel(format), channelCount(format)};
 }
 
-Image Image::toGrayscale() {
-    const size_t size = width * height;
-    std::vector<uint8_t> grayscalePixels(size * 3);
+MutableImageView Image::mutableView() {
+    return {pixels.data(), width, height,
+            static_cast<std::ptrdiff_t>(width) * bytesPerPixel(format), channelCount(format)};
+}
+
+/**
+ * Reads pixel i of an image as a gray value in double precision.
+ */
+static double grayValue(const unsigned char* pixels, PixelFormat format, size_t i) {
+    switch (format) {
+        case PixelFormat::Gray8:
+            return pixels[i];
+        case PixelFormat::BGR8:
+            return 0.114f * pixels[3 * i] + 0.587f * pixels[3 * i + 1] +
+                   0.299f * pixels[3 * i + 2];
+        case PixelFormat::Gray16S:
+            return reinterpret_cast<const int16_t*>(pixels)[i];
+        case PixelFormat::Float32:
+            return reinterpret_cast<const float*>(pixels)[i];
+    }
+    return 0.0;
+}
 
+Image Image::convertTo(PixelFormat target) const {
+    if (target == format) {
+        return *this;
+    }
+    if (format == PixelFormat::BGR8 && target == PixelFormat::Gray8) {
+        return toGrayscale();
+    }
+    Image output(width, height, target);
+    const size_t size = static_cast<size_t>(width) * height;
+    unsigned char* dst = output.pixels.data();
     for (size_t i = 0; i < size; i++) {
-        unsigned char b = pixels[3 * i + 0];
-        unsigned char g = pixels[3 * i + 1];
-        unsigned char r = pixels[3 * i + 2];
-        unsigned char gray = static_cast<unsigned char>(0.114f * b + 0.587f * g + 0.299f * r);
-        grayscalePixels[3 * i + 0] = gray;
-        grayscalePixels[3 * i + 1] = gray;
-        grayscalePixels[3 * i + 2] = gray;
+        double value = grayValue(pixels.data(), format, i);
+        switch (target) {
+            case PixelFormat::Gray8:
+                dst[i] = static_cast<unsigned char>(std::clamp(std::round(value), 0.0, 255.0));
+                break;
+            case PixelFormat::BGR8: {
+                auto gray = static_cast<unsigned char>(std::clamp(std::round(value), 0.0, 255.0));
+                dst[3 * i] = dst[3 * i + 1] = dst[3 * i + 2] = gray;
+                break;
+            }
+            case PixelFormat::Gray16S:
+                reinterpret_cast<int16_t*>(dst)[i] =
+                    static_cast<int16_t>(std::clamp(std::round(value), -32768.0, 32767.0));
+                break;
+            case PixelFormat::Float32:
+                reinterpret_cast<float*>(dst)[i] = static_cast<float>(value);
+                break;
+        }
+    }
+    return output;
+}
+
+void Image::writeImageToFile(const fs::path filePath) {
+    CUDAVISION_TRACE_SCOPE("Image::writeImageToFile");
+    if (format == PixelFormat::Gray16S || format == PixelFormat::Float32) {
+        convertTo(PixelFormat::Gray8).writeImageToFile(filePath);
+        return;
+    }
+    try {
+        writeBitmap(filePath, view());
+    } catch (const std::runtime_error& error) {
+        std::cerr << "File could not be written: " << error.what() << std::endl;
+    }
+}
+
+Image Image::toGrayscale() const {
+    if (format != PixelFormat::BGR8) {
+        return convertTo(PixelFormat::Gray8);
     }
+    Image output(width, height, PixelFormat::Gray8);
+    toGrayscale(output.mutableView());
+    return output;
+}
+
+void Image::toGrayscale(MutableImageView output) const {
+    // Traced here, the fused pipelines call the static overload for single rows.
+    CUDAVISION_TRACE_SCOPE("toGrayscale");
+    toGrayscale(view(), output);
+}
+
+Image Image::toGrayscale(const std::vector<Rect>& regions) const {
+    Image output(width, height, PixelFormat::Gray8);
+    toGrayscale(view(), output.mutableView(), regions);
+    return output;
+}
+
+void Image::toGrayscale(ImageView input, MutableImageView output,
+                        const std::vector<Rect>& regions) {
+    CUDAVISION_TRACE_SCOPE("toGrayscale regions");
+    CUDAVISION::applyRegions(input, output, regions, 0,
+                             [](ImageView in, MutableImageView out) { toGrayscale(in, out); });
+}
 
-    return Image(width, height, grayscalePixels);
-}
\ No newline at end of file
+void Image::toGrayscale(ImageView input, MutableImageView output) {
+    if (const auto& replaced = CUDAVISION::getBackendOperators().toGrayscale) {
+        replaced(input, output);
+        return;
+    }
+    const unsigned int width = input.width;
+    if (input.channels == 1) {
+        for (unsigned int i = 0; i < input.height; i++) {
+            std::copy_n(input.row(i), width, output.row(i));
+        }
+        return;
+    }
+    CUDAVISION::parallelForRows(input.height, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; i++) {
+            const unsigned char* src = input.row(i);
+            unsigned char* dst = output.row(i);
+            for (unsigned int j = 0; j < width; j++) {
+                unsigned char b = src[3 * j + 0];
+                unsigned char g = src[3 * j + 1];
+                unsigned char r = src[3 * j + 2];
+                dst[j] = static_cast<unsigned char>(0.114f * b + 0.587f * g + 0.299f * r);
+            }
+        }
+    });
+}
@@ -0,0 +1,129 @@
+#include "util/region.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "util/buffer_pool.h"
+#include "util/thread_pool.h"
+#include "util/trace.h"
+
+namespace CUDAVISION {
+    static Rect boundingBox(const Rect& a, const Rect& b) {
+        const unsigned int x = std::min(a.x, b.x);
+        const unsigned int y = std::min(a.y, b.y);
+        return {x, y, std::max(a.right(), b.right()) - x, std::max(a.bottom(), b.bottom()) - y};
+    }
+
+    /**
+     * The rectangle grown by halo on every side, clamped to the image.
+     */
+    static Rect grow(const Rect& rect, unsigned int halo, unsigned int width,
+                     unsigned int height) {
+        const unsigned int x = rect.x > halo ? rect.x - halo : 0;
+        const unsigned int y = rect.y > halo ? rect.y - halo : 0;
+        return {x, y, std::min(rect.right() + halo, width) - x,
+                std::min(rect.bottom() + halo, height) - y};
+    }
+
+    static bool shareAnyPixel(const RegionGroup& a, const RegionGroup& b) {
+        if (!a.bounds.intersects(b.bounds)) {
+            return false;
+        }
+        for (const Rect& first : a.regions) {
+            for (const Rect& second : b.regions) {
+                if (first.intersects(second)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    std::vector<RegionGroup> groupRegions(const std::vector<Rect>& regions, unsigned int width,
+                                          unsigned int height, unsigned int halo) {
+        std::vector<RegionGroup> groups;
+        for (const Rect& region : regions) {
+            const unsigned int x = std::min(region.x, width);
+            const unsigned int y = std::min(region.y, height);
+            const Rect clipped{x, y, std::min(region.width, width - x),
+                               std::min(region.height, height - y)};
+            if (!clipped.empty()) {
+                groups.push_back({clipped, {clipped}});
+            }
+        }
+
+        // Merge pairs until none is left to merge. The lists are short (boxes of a detector),
+        // so the quadratic search does not matter next to the pixel work.
+        for (bool merged = true; merged;) {
+            merged = false;
+            for (std::size_t i = 0; i < groups.size() && !merged; i++) {
+                for (std::size_t j = i + 1; j < groups.size() && !merged; j++) {
+                    RegionGroup& a = groups[i];
+                    RegionGroup& b = groups[j];
+                    const Rect bounds = boundingBox(a.bounds, b.bounds);
+                    const std::size_t separate = grow(a.bounds, halo, width, height).area() +
+                                                 grow(b.bounds, halo, width, height).area();
+                    if (!shareAnyPixel(a, b) &&
+                        grow(bounds, halo, width, height).area() > separate) {
+                        continue;
+                    }
+                    a.bounds = bounds;
+                    a.regions.insert(a.regions.end(), b.regions.begin(), b.regions.end());
+                    groups.erase(groups.begin() + j);
+                    merged = true;
+                }
+            }
+        }
+        return groups;
+    }
+
+    void applyRegions(ImageView input, MutableImageView output, const std::vector<Rect>& regions,
+                      unsigned int halo, const RegionFunction& function) {
+        CUDAVISION_TRACE_SCOPE("applyRegions");
+        if (input.width != output.width || input.height != output.height) {
+            throw std::invalid_argument("applyRegions: input and output differ in size");
+        }
+        const std::vector<RegionGroup> groups =
+            groupRegions(regions, input.width, input.height, halo);
+        auto compute = [&](const RegionGroup& group) {
+            // A single rectangle without halo is computed in place.
+            if (halo == 0 && group.regions.size() == 1) {
+                const Rect& r = group.bounds;
+                function(input.subView(r.x, r.y, r.width, r.height),
+                         output.subView(r.x, r.y, r.width, r.height));
+                return;
+            }
+            // A pooled local, not a per-thread buffer: the operator runs parallel loops, and
+            // whatever else this thread runs meanwhile must not be able to resize the result.
+            const Rect grown = grow(group.bounds, halo, input.width, input.height);
+            std::vector<unsigned char> result =
+                BufferPool::global().acquire(grown.area() * output.channels);
+            MutableImageView resultView{
+                result.data(), grown.width, grown.height,
+                static_cast<std::ptrdiff_t>(grown.width * output.channels), output.channels};
+            function(input.subView(grown.x, grown.y, grown.width, grown.height), resultView);
+            for (const Rect& r : group.regions) {
+                const ImageView inner =
+                    resultView.subView(r.x - grown.x, r.y - grown.y, r.width, r.height);
+                MutableImageView target = output.subView(r.x, r.y, r.width, r.height);
+                for (unsigned int i = 0; i < r.height; i++) {
+                    std::copy_n(inner.row(i), inner.rowElements(), target.row(i));
+                }
+            }
+            BufferPool::global().release(std::move(result));
+        };
+        // As in FrameProcessor, a single group parallelizes inside of the operator, several
+        // groups are spread over the pool and run their operators inline.
+        if (groups.size() == 1) {
+            compute(groups.front());
+            return;
+        }
+        getThreadPool().parallelFor(0, groups.size(), 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; i++) {
+                compute(groups[i]);
+            }
+        });
+    }
+}  // namespace CUDAVISION
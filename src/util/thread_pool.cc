@@ -0,0 +1,220 @@
+#include "util/thread_pool.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "util/backend.h"
+
+namespace CUDAVISION {
+    /**
+     * Set while a thread runs a chunk of a parallel loop, nested loops run inline there.
+     */
+    static thread_local bool insideLoop = false;
+
+    ThreadPool::ThreadPool(unsigned int threadCount) {
+        threadCount = std::max(threadCount, 1u);
+        for (unsigned int i = 0; i < threadCount; i++) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (unsigned int i = 1; i < threadCount; i++) {
+            workers.emplace_back(&ThreadPool::workerLoop, this, i);
+        }
+    }
+
+    ThreadPool::~ThreadPool() { retire(); }
+
+    void ThreadPool::retire() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        // The workers stay in the vector, parallelFor only checks whether there were any.
+        for (std::thread& worker : workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+    unsigned int ThreadPool::getThreadCount() const { return queues.size(); }
+
+    void ThreadPool::parallelFor(std::size_t begin, std::size_t end, std::size_t grain,
+                                 const std::function<void(std::size_t, std::size_t)>& body) {
+        if (end <= begin) {
+            return;
+        }
+        grain = std::max<std::size_t>(grain, 1);
+        const std::size_t chunks = (end - begin + grain - 1) / grain;
+        if (chunks == 1 || workers.empty() || insideLoop) {
+            body(begin, end);
+            return;
+        }
+
+        Job job;
+        job.body = &body;
+        job.remaining = chunks;
+        for (std::size_t chunk = 0; chunk < chunks; chunk++) {
+            std::size_t chunkBegin = begin + chunk * grain;
+            Queue& queue = *queues[chunk % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back({&job, chunkBegin, std::min(chunkBegin + grain, end)});
+        }
+        queuedTasks += chunks;
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+        }
+        wake.notify_all();
+
+        // Work along on the own chunks until none is queued, then wait for the chunks still
+        // running. Chunks of other callers' loops are left to the workers: the caller may keep
+        // thread-local state alive across this call, which a foreign chunk could overwrite.
+        Task task;
+        while (job.remaining > 0 && takeJobTask(job, task)) {
+            runTask(task);
+        }
+        {
+            std::unique_lock<std::mutex> lock(job.mutex);
+            job.finished.wait(lock, [&] { return job.remaining == 0; });
+        }
+        if (job.error) {
+            std::rethrow_exception(job.error);
+        }
+    }
+
+    bool ThreadPool::takeTask(std::size_t queueIndex, Task& task) {
+        {
+            Queue& own = *queues[queueIndex];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty()) {
+                task = own.tasks.back();
+                own.tasks.pop_back();
+                queuedTasks--;
+                return true;
+            }
+        }
+        for (std::size_t i = 1; i < queues.size(); i++) {
+            Queue& victim = *queues[(queueIndex + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = victim.tasks.front();
+                victim.tasks.pop_front();
+                queuedTasks--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ThreadPool::takeJobTask(const Job& job, Task& task) {
+        for (std::unique_ptr<Queue>& queue : queues) {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            auto it = std::find_if(queue->tasks.begin(), queue->tasks.end(),
+                                   [&](const Task& queued) { return queued.job == &job; });
+            if (it != queue->tasks.end()) {
+                task = *it;
+                queue->tasks.erase(it);
+                queuedTasks--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ThreadPool::runTask(const Task& task) {
+        Job& job = *task.job;
+        const bool nested = insideLoop;
+        insideLoop = true;
+        try {
+            (*job.body)(task.begin, task.end);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            if (!job.error) {
+                job.error = std::current_exception();
+            }
+        }
+        insideLoop = nested;
+        // Decrement under the lock, the job lives on the stack of the waiting caller and may be
+        // gone as soon as the lock is released.
+        std::lock_guard<std::mutex> lock(job.mutex);
+        if (--job.remaining == 0) {
+            job.finished.notify_all();
+        }
+    }
+
+    void ThreadPool::workerLoop(std::size_t queueIndex) {
+        Task task;
+        while (true) {
+            if (takeTask(queueIndex, task)) {
+                runTask(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait(lock, [&] { return stopping || queuedTasks > 0; });
+            if (stopping && queuedTasks == 0) {
+                return;
+            }
+        }
+    }
+
+    static std::mutex globalPoolMutex;
+    static std::unique_ptr<ThreadPool> globalPool;
+    // Pools replaced by setThreadCount, kept because operators may still hold a reference.
+    static std::vector<std::unique_ptr<ThreadPool>> retiredPools;
+    // The pool of globalPool, read without the mutex by every operator once it is set.
+    static std::atomic<ThreadPool*> currentPool{nullptr};
+    static std::atomic<unsigned int> grainSize{0};
+
+    static unsigned int resolveThreadCount(unsigned int threadCount) {
+        if (threadCount == 0) {
+            threadCount = std::thread::hardware_concurrency();
+        }
+        return std::max(threadCount, 1u);
+    }
+
+    void setThreadCount(unsigned int threadCount) {
+        applyBackendFromEnvironment();
+        std::lock_guard<std::mutex> lock(globalPoolMutex);
+        std::unique_ptr<ThreadPool> replaced = std::move(globalPool);
+        globalPool = std::make_unique<ThreadPool>(resolveThreadCount(threadCount));
+        currentPool.store(globalPool.get(), std::memory_order_release);
+        if (replaced) {
+            replaced->retire();
+            retiredPools.push_back(std::move(replaced));
+        }
+    }
+
+    ThreadPool& getThreadPool() {
+        // Every operator asks for the pool, only the first call sets it up.
+        if (ThreadPool* pool = currentPool.load(std::memory_order_acquire)) {
+            return *pool;
+        }
+        applyBackendFromEnvironment();
+        std::lock_guard<std::mutex> lock(globalPoolMutex);
+        if (!globalPool) {
+            const char* requested = std::getenv("CUDAVISION_THREADS");
+            unsigned int threadCount = requested ? std::strtoul(requested, nullptr, 10) : 0;
+            globalPool = std::make_unique<ThreadPool>(resolveThreadCount(threadCount));
+            currentPool.store(globalPool.get(), std::memory_order_release);
+        }
+        return *globalPool;
+    }
+
+    unsigned int getThreadCount() { return getThreadPool().getThreadCount(); }
+
+    void setGrainSize(unsigned int rows) { grainSize = rows; }
+
+    unsigned int getGrainSize() { return grainSize; }
+
+    void parallelForRows(unsigned int height,
+                         const std::function<void(unsigned int, unsigned int)>& body) {
+        ThreadPool& pool = getThreadPool();
+        std::size_t grain = grainSize;
+        if (grain == 0) {
+            grain = (height + 4 * pool.getThreadCount() - 1) / (4 * pool.getThreadCount());
+        }
+        pool.parallelFor(0, height, grain, [&](std::size_t begin, std::size_t end) {
+            body(static_cast<unsigned int>(begin), static_cast<unsigned int>(end));
+        });
+    }
+}  // namespace CUDAVISION
@@ -0,0 +1,163 @@
+#include "util/tiled_image.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "util/buffer_pool.h"
+#include "util/thread_pool.h"
+#include "util/trace.h"
+
+TiledImage::TiledImage(unsigned int width, unsigned int height, unsigned int channels,
+                       unsigned int tileSize)
+    : width(width),
+      height(height),
+      channels(channels),
+      tileSize(std::max(tileSize, 1u)),
+      columns((width + this->tileSize - 1) / this->tileSize),
+      rows((height + this->tileSize - 1) / this->tileSize),
+      pixels(BufferPool::global().acquire(tileOffset(0, rows))) {
+    std::fill(pixels.begin(), pixels.end(), 0);
+}
+
+TiledImage::TiledImage(ImageView linear, unsigned int tileSize)
+    : width(linear.width),
+      height(linear.height),
+      channels(linear.channels),
+      tileSize(std::max(tileSize, 1u)),
+      columns((width + this->tileSize - 1) / this->tileSize),
+      rows((height + this->tileSize - 1) / this->tileSize),
+      pixels(BufferPool::global().acquire(tileOffset(0, rows))) {
+    CUDAVISION_TRACE_SCOPE("TiledImage from linear");
+    copyFrom(0, 0, linear);
+}
+
+TiledImage::~TiledImage() { BufferPool::global().release(std::move(pixels)); }
+
+TiledImage& TiledImage::operator=(TiledImage&& other) noexcept {
+    if (this != &other) {
+        BufferPool::global().release(std::move(pixels));
+        width = other.width;
+        height = other.height;
+        channels = other.channels;
+        tileSize = other.tileSize;
+        columns = other.columns;
+        rows = other.rows;
+        pixels = std::move(other.pixels);
+        other.width = 0;
+        other.height = 0;
+        other.columns = 0;
+        other.rows = 0;
+    }
+    return *this;
+}
+
+ImageView TiledImage::tile(unsigned int tx, unsigned int ty) const {
+    return {pixels.data() + tileOffset(tx, ty), std::min(tileSize, width - tx * tileSize),
+            std::min(tileSize, height - ty * tileSize),
+            static_cast<std::ptrdiff_t>(tileSize * channels), channels};
+}
+
+MutableImageView TiledImage::mutableTile(unsigned int tx, unsigned int ty) {
+    ImageView view = tile(tx, ty);
+    return {const_cast<unsigned char*>(view.data), view.width, view.height, view.stride,
+            view.channels};
+}
+
+/**
+ * Copies the rectangle of a tiled buffer at (x, y) from or to a linear view, one run of
+ * contiguous bytes per tile and row.
+ */
+template <typename TiledPointer, typename LinearView, typename Copy>
+static void copyRectangle(const TiledImage& image, TiledPointer pixel, unsigned int x,
+                          unsigned int y, LinearView linear, Copy copy) {
+    if (x + linear.width > image.getWidth() || y + linear.height > image.getHeight() ||
+        linear.channels != image.getChannels()) {
+        throw std::invalid_argument("TiledImage: rectangle outside of the image");
+    }
+    const unsigned int tileSize = image.getTileSize();
+    const unsigned int channels = image.getChannels();
+    CUDAVISION::parallelForRows(linear.height, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; i++) {
+            unsigned int column = x;
+            while (column < x + linear.width) {
+                const unsigned int run =
+                    std::min(tileSize - column % tileSize, x + linear.width - column);
+                copy(pixel(column, y + i), linear.row(i) + (column - x) * channels,
+                     std::size_t{run} * channels);
+                column += run;
+            }
+        }
+    });
+}
+
+void TiledImage::copyTo(unsigned int x, unsigned int y, MutableImageView target) const {
+    copyRectangle(
+        *this, [this](unsigned int px, unsigned int py) { return pixel(px, py); }, x, y, target,
+        [](const unsigned char* tiled, unsigned char* linear, std::size_t bytes) {
+            std::memcpy(linear, tiled, bytes);
+        });
+}
+
+void TiledImage::copyFrom(unsigned int x, unsigned int y, ImageView source) {
+    copyRectangle(
+        *this, [this](unsigned int px, unsigned int py) { return pixel(px, py); }, x, y, source,
+        [](unsigned char* tiled, const unsigned char* linear, std::size_t bytes) {
+            std::memcpy(tiled, linear, bytes);
+        });
+}
+
+Image TiledImage::toImage() const {
+    CUDAVISION_TRACE_SCOPE("TiledImage to linear");
+    Image image(width, height, channels == 1 ? PixelFormat::Gray8 : PixelFormat::BGR8);
+    copyTo(0, 0, image.mutableView());
+    return image;
+}
+
+namespace CUDAVISION {
+    void applyTiled(const TiledImage& input, TiledImage& output, unsigned int haloX,
+                    unsigned int haloY, const TileFunction& function) {
+        if (input.getWidth() != output.getWidth() || input.getHeight() != output.getHeight() ||
+            input.getTileSize() != output.getTileSize()) {
+            throw std::invalid_argument("applyTiled: input and output differ in size or tiling");
+        }
+        const unsigned int width = input.getWidth();
+        const unsigned int height = input.getHeight();
+        const unsigned int columns = input.getTileColumns();
+        const std::size_t tiles = std::size_t{columns} * input.getTileRows();
+        getThreadPool().parallelFor(0, tiles, 1, [&](std::size_t begin, std::size_t end) {
+            thread_local std::vector<unsigned char> grown, result;
+            for (std::size_t index = begin; index < end; index++) {
+                const unsigned int tx = index % columns;
+                const unsigned int ty = index / columns;
+                MutableImageView target = output.mutableTile(tx, ty);
+                // Without a halo the operator works on the tiles in place.
+                if (haloX == 0 && haloY == 0) {
+                    function(input.tile(tx, ty), target);
+                    continue;
+                }
+                const unsigned int x = tx * input.getTileSize();
+                const unsigned int y = ty * input.getTileSize();
+                const unsigned int x0 = x > haloX ? x - haloX : 0;
+                const unsigned int y0 = y > haloY ? y - haloY : 0;
+                const unsigned int w = std::min(x + target.width + haloX, width) - x0;
+                const unsigned int h = std::min(y + target.height + haloY, height) - y0;
+                grown.resize(std::size_t{w} * h * input.getChannels());
+                result.resize(std::size_t{w} * h * output.getChannels());
+                MutableImageView grownView{grown.data(), w, h,
+                                           static_cast<std::ptrdiff_t>(w * input.getChannels()),
+                                           input.getChannels()};
+                MutableImageView resultView{
+                    result.data(), w, h, static_cast<std::ptrdiff_t>(w * output.getChannels()),
+                    output.getChannels()};
+                input.copyTo(x0, y0, grownView);
+                function(grownView, resultView);
+                const ImageView inner = resultView.subView(x - x0, y - y0, target.width,
+                                                           target.height);
+                for (unsigned int i = 0; i < target.height; i++) {
+                    std::copy_n(inner.row(i), inner.rowElements(), target.row(i));
+                }
+            }
+        });
+    }
+}  // namespace CUDAVISION
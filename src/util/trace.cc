@@ -0,0 +1,247 @@
+#include "util/trace.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace CUDAVISION {
+    /**
+     * Events kept per thread. Older events are overwritten, the span statistics keep counting.
+     */
+    static constexpr std::size_t THREAD_EVENTS = 1 << 13;
+
+    static constexpr const char* COUNTER_NAMES[] = {"bytes read", "bytes written", "allocations",
+                                                    "allocated bytes"};
+
+    struct TraceEvent {
+        const char* name = nullptr;
+        std::int64_t begin = 0;
+        // End of a span, or the value of a counter when counter is set.
+        std::int64_t end = 0;
+        bool counter = false;
+    };
+
+    struct SpanStatistics {
+        std::uint64_t calls = 0;
+        std::int64_t total = 0;
+        std::int64_t max = 0;
+    };
+
+    /**
+     * The ring buffer of one thread. Only its thread writes, the lock is uncontended except
+     * while a trace is exported.
+     */
+    struct ThreadTrace {
+        unsigned int id = 0;
+        std::mutex mutex;
+        std::vector<TraceEvent> events;
+        std::uint64_t recorded = 0;
+        std::unordered_map<const char*, SpanStatistics> spans;
+
+        void push(const TraceEvent& event) {
+            if (events.empty()) {
+                events.resize(THREAD_EVENTS);
+            }
+            events[recorded % THREAD_EVENTS] = event;
+            recorded++;
+        }
+    };
+
+    struct TraceState {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<ThreadTrace>> threads;
+        std::atomic<std::uint64_t> counters[std::size(COUNTER_NAMES)] = {};
+        std::atomic<std::int64_t> origin{0};
+    };
+
+    static TraceState& traceState() {
+        static TraceState state;
+        return state;
+    }
+
+    static ThreadTrace& threadTrace() {
+        thread_local std::shared_ptr<ThreadTrace> trace = [] {
+            TraceState& state = traceState();
+            auto created = std::make_shared<ThreadTrace>();
+            std::lock_guard<std::mutex> lock(state.mutex);
+            created->id = state.threads.size();
+            state.threads.push_back(created);
+            return created;
+        }();
+        return *trace;
+    }
+
+    static std::int64_t steadyNanoseconds() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    void setTracing(bool enabled) {
+        if (enabled) {
+            std::int64_t unset = 0;
+            traceState().origin.compare_exchange_strong(unset, steadyNanoseconds());
+        }
+        tracingActive.store(enabled, std::memory_order_relaxed);
+    }
+
+    void clearTrace() {
+        TraceState& state = traceState();
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (const std::shared_ptr<ThreadTrace>& thread : state.threads) {
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+            thread->recorded = 0;
+            thread->spans.clear();
+        }
+        for (std::atomic<std::uint64_t>& counter : state.counters) {
+            counter.store(0, std::memory_order_relaxed);
+        }
+        state.origin.store(isTracing() ? steadyNanoseconds() : 0);
+    }
+
+    void recordSpan(const char* name, std::int64_t begin, std::int64_t end) {
+        ThreadTrace& trace = threadTrace();
+        std::lock_guard<std::mutex> lock(trace.mutex);
+        trace.push({name, begin, end, false});
+        SpanStatistics& statistics = trace.spans[name];
+        statistics.calls++;
+        statistics.total += end - begin;
+        statistics.max = std::max(statistics.max, end - begin);
+    }
+
+    void addToCounter(Counter counter, std::uint64_t amount) {
+        const std::size_t index = static_cast<std::size_t>(counter);
+        const std::uint64_t value =
+            traceState().counters[index].fetch_add(amount, std::memory_order_relaxed) + amount;
+        ThreadTrace& trace = threadTrace();
+        std::lock_guard<std::mutex> lock(trace.mutex);
+        trace.push({COUNTER_NAMES[index], steadyNanoseconds(), static_cast<std::int64_t>(value),
+                    true});
+    }
+
+    void writeChromeTrace(const std::filesystem::path& filePath) {
+        TraceState& state = traceState();
+        const std::int64_t origin = state.origin.load();
+        std::ofstream file(filePath);
+        file << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\": \"ms\", "
+             << "\"traceEvents\": [\n";
+        bool first = true;
+        auto separator = [&]() -> std::ofstream& {
+            file << (first ? "" : ",\n");
+            first = false;
+            return file;
+        };
+
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for (const std::shared_ptr<ThreadTrace>& thread : state.threads) {
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+            separator() << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+                        << thread->id << ", \"args\": {\"name\": \"thread " << thread->id
+                        << "\"}}";
+            const std::uint64_t kept = std::min<std::uint64_t>(thread->recorded, THREAD_EVENTS);
+            for (std::uint64_t i = thread->recorded - kept; i < thread->recorded; i++) {
+                const TraceEvent& event = thread->events[i % THREAD_EVENTS];
+                const double timestamp = (event.begin - origin) / 1e3;
+                if (event.counter) {
+                    separator() << "{\"name\": \"" << event.name
+                                << "\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << timestamp
+                                << ", \"args\": {\"value\": " << event.end << "}}";
+                } else {
+                    separator() << "{\"name\": \"" << event.name
+                                << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << thread->id
+                                << ", \"ts\": " << timestamp
+                                << ", \"dur\": " << (event.end - event.begin) / 1e3 << "}";
+                }
+            }
+        }
+        file << "\n]}\n";
+        file.close();
+        if (!file) {
+            throw std::runtime_error(filePath.string() + ": could not write the trace");
+        }
+    }
+
+    std::string getTraceSummary() {
+        TraceState& state = traceState();
+        // Spans of equal names from different threads (or translation units) are merged.
+        std::map<std::string, SpanStatistics> spans;
+        std::uint64_t overwritten = 0;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            for (const std::shared_ptr<ThreadTrace>& thread : state.threads) {
+                std::lock_guard<std::mutex> threadLock(thread->mutex);
+                overwritten += thread->recorded - std::min<std::uint64_t>(thread->recorded,
+                                                                          THREAD_EVENTS);
+                for (const auto& [name, statistics] : thread->spans) {
+                    SpanStatistics& merged = spans[name];
+                    merged.calls += statistics.calls;
+                    merged.total += statistics.total;
+                    merged.max = std::max(merged.max, statistics.max);
+                }
+            }
+        }
+        std::vector<std::pair<std::string, SpanStatistics>> sorted(spans.begin(), spans.end());
+        std::sort(sorted.begin(), sorted.end(),
+                  [](const auto& a, const auto& b) { return a.second.total > b.second.total; });
+
+        std::ostringstream summary;
+        summary << std::fixed << std::setprecision(3) << std::left << std::setw(32) << "span"
+                << std::right << std::setw(10) << "calls" << std::setw(14) << "total ms"
+                << std::setw(12) << "mean ms" << std::setw(12) << "max ms" << "\n";
+        for (const auto& [name, statistics] : sorted) {
+            summary << std::left << std::setw(32) << name << std::right << std::setw(10)
+                    << statistics.calls << std::setw(14) << statistics.total / 1e6
+                    << std::setw(12) << statistics.total / 1e6 / statistics.calls
+                    << std::setw(12) << statistics.max / 1e6 << "\n";
+        }
+        for (std::size_t i = 0; i < std::size(COUNTER_NAMES); i++) {
+            summary << std::left << std::setw(32) << COUNTER_NAMES[i] << std::right
+                    << std::setw(10) << state.counters[i].load(std::memory_order_relaxed) << "\n";
+        }
+        summary << std::left << std::setw(32) << "overwritten events" << std::right
+                << std::setw(10) << overwritten << "\n";
+        return summary.str();
+    }
+
+    /**
+     * Starts tracing at startup if CUDAVISION_TRACE names an output file, and writes the trace
+     * and the summary at exit.
+     */
+    struct TraceFromEnvironment {
+        TraceFromEnvironment() {
+            const char* requested = std::getenv("CUDAVISION_TRACE");
+            if (requested != nullptr && *requested != '\0') {
+                filePath = requested;
+                // Construct the state first, so that it outlives this object.
+                traceState();
+                setTracing(true);
+            }
+        }
+
+        ~TraceFromEnvironment() {
+            if (filePath.empty()) {
+                return;
+            }
+            setTracing(false);
+            try {
+                writeChromeTrace(filePath);
+            } catch (const std::runtime_error& error) {
+                std::cerr << error.what() << std::endl;
+            }
+            std::cerr << getTraceSummary();
+        }
+
+        std::filesystem::path filePath;
+    };
+
+    static TraceFromEnvironment traceFromEnvironment;
+}  // namespace CUDAVISION